@@ -169,4 +169,31 @@ static void pn_allocator_reset(PNAllocator* allocator) {
   pn_allocator_reset_to_mark(allocator, allocator->reset_mark);
 }
 
+/* Moves all of src's chunks to dst, leaving src empty. The chunks are linked
+ * behind dst's current chunk, so dst's last allocation can still be
+ * realloc'd, but they are only freed when dst is reset completely. */
+static void pn_allocator_merge(PNAllocator* dst, PNAllocator* src) {
+  PNAllocatorChunk* head = src->chunk_head;
+  if (!head) {
+    return;
+  }
+
+  PNAllocatorChunk* tail = head;
+  while (tail->next) {
+    tail = tail->next;
+  }
+
+  if (dst->chunk_head) {
+    tail->next = dst->chunk_head->next;
+    dst->chunk_head->next = head;
+    src->internal_fragmentation += head->end - head->current;
+  } else {
+    dst->chunk_head = head;
+  }
+
+  dst->total_used += src->total_used;
+  dst->internal_fragmentation += src->internal_fragmentation;
+  pn_allocator_init(src, src->min_chunk_size, src->name);
+}
+
 #endif /* PN_ALLOCATOR_H_ */
@@ -13,7 +13,7 @@
 static PNRuntimeValue pn_builtin_NACL_IRT_QUERY(PNThread* thread,
                                                 PNFunction* function,
                                                 uint32_t num_args,
-                                                PNValueId* arg_ids) {
+                                                PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 3);
   PN_BUILTIN_ARG(name_p, 0, u32);
@@ -133,7 +133,7 @@ static PNRuntimeValue pn_builtin_NACL_IRT_QUERY(PNThread* thread,
 static PNRuntimeValue pn_builtin_NACL_IRT_BASIC_EXIT(PNThread* thread,
                                                      PNFunction* function,
                                                      uint32_t num_args,
-                                                     PNValueId* arg_ids) {
+                                                     PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 1);
   PN_BUILTIN_ARG(exit_code, 0, i32);
@@ -147,7 +147,7 @@ static PNRuntimeValue pn_builtin_NACL_IRT_BASIC_EXIT(PNThread* thread,
 static PNRuntimeValue pn_builtin_NACL_IRT_BASIC_GETTOD(PNThread* thread,
                                                        PNFunction* function,
                                                        uint32_t num_args,
-                                                       PNValueId* arg_ids) {
+                                                       PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 1);
   PN_BUILTIN_ARG(tv_p, 0, i32);
@@ -171,7 +171,7 @@ static PNRuntimeValue pn_builtin_NACL_IRT_BASIC_GETTOD(PNThread* thread,
 static PNRuntimeValue pn_builtin_NACL_IRT_BASIC_SYSCONF(PNThread* thread,
                                                         PNFunction* function,
                                                         uint32_t num_args,
-                                                        PNValueId* arg_ids) {
+                                                        PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 2);
   PN_BUILTIN_ARG(name, 0, u32);
@@ -191,7 +191,7 @@ static PNRuntimeValue pn_builtin_NACL_IRT_BASIC_SYSCONF(PNThread* thread,
 static PNRuntimeValue pn_builtin_NACL_IRT_FDIO_CLOSE(PNThread* thread,
                                                      PNFunction* function,
                                                      uint32_t num_args,
-                                                     PNValueId* arg_ids) {
+                                                     PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 1);
   PN_BUILTIN_ARG(fd, 0, u32);
@@ -201,7 +201,7 @@ static PNRuntimeValue pn_builtin_NACL_IRT_FDIO_CLOSE(PNThread* thread,
 static PNRuntimeValue pn_builtin_NACL_IRT_FDIO_READ(PNThread* thread,
                                                     PNFunction* function,
                                                     uint32_t num_args,
-                                                    PNValueId* arg_ids) {
+                                                    PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 4);
   PN_BUILTIN_ARG(fd, 0, u32);
@@ -215,7 +215,7 @@ static PNRuntimeValue pn_builtin_NACL_IRT_FDIO_READ(PNThread* thread,
 static PNRuntimeValue pn_builtin_NACL_IRT_FDIO_SEEK(PNThread* thread,
                                                     PNFunction* function,
                                                     uint32_t num_args,
-                                                    PNValueId* arg_ids) {
+                                                    PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 4);
   PN_BUILTIN_ARG(fd, 0, u32);
@@ -229,7 +229,7 @@ static PNRuntimeValue pn_builtin_NACL_IRT_FDIO_SEEK(PNThread* thread,
 static PNRuntimeValue pn_builtin_NACL_IRT_FDIO_WRITE(PNThread* thread,
                                                      PNFunction* function,
                                                      uint32_t num_args,
-                                                     PNValueId* arg_ids) {
+                                                     PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 4);
   PN_BUILTIN_ARG(fd, 0, u32);
@@ -243,7 +243,7 @@ static PNRuntimeValue pn_builtin_NACL_IRT_FDIO_WRITE(PNThread* thread,
 static PNRuntimeValue pn_builtin_NACL_IRT_FDIO_FSTAT(PNThread* thread,
                                                      PNFunction* function,
                                                      uint32_t num_args,
-                                                     PNValueId* arg_ids) {
+                                                     PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 2);
   PN_BUILTIN_ARG(fd, 0, u32);
@@ -254,7 +254,7 @@ static PNRuntimeValue pn_builtin_NACL_IRT_FDIO_FSTAT(PNThread* thread,
 static PNRuntimeValue pn_builtin_NACL_IRT_FDIO_ISATTY(PNThread* thread,
                                                       PNFunction* function,
                                                       uint32_t num_args,
-                                                      PNValueId* arg_ids) {
+                                                      PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 2);
   PN_BUILTIN_ARG(fd, 0, u32);
@@ -266,7 +266,7 @@ static PNRuntimeValue pn_builtin_NACL_IRT_FDIO_ISATTY(PNThread* thread,
 static PNRuntimeValue pn_builtin_NACL_IRT_FILENAME_GETCWD(PNThread* thread,
                                                           PNFunction* function,
                                                           uint32_t num_args,
-                                                          PNValueId* arg_ids) {
+                                                          PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 2);
   PN_BUILTIN_ARG(pathname_p, 0, u32);
@@ -278,7 +278,7 @@ static PNRuntimeValue pn_builtin_NACL_IRT_FILENAME_GETCWD(PNThread* thread,
 static PNRuntimeValue pn_builtin_NACL_IRT_FILENAME_OPEN(PNThread* thread,
                                                         PNFunction* function,
                                                         uint32_t num_args,
-                                                        PNValueId* arg_ids) {
+                                                        PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 4);
   PN_BUILTIN_ARG(pathname_p, 0, u32);
@@ -292,7 +292,7 @@ static PNRuntimeValue pn_builtin_NACL_IRT_FILENAME_OPEN(PNThread* thread,
 static PNRuntimeValue pn_builtin_NACL_IRT_FILENAME_ACCESS(PNThread* thread,
                                                           PNFunction* function,
                                                           uint32_t num_args,
-                                                          PNValueId* arg_ids) {
+                                                          PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 2);
   PN_BUILTIN_ARG(pathname_p, 0, u32);
@@ -305,7 +305,7 @@ static PNRuntimeValue pn_builtin_NACL_IRT_FILENAME_READLINK(
     PNThread* thread,
     PNFunction* function,
     uint32_t num_args,
-    PNValueId* arg_ids) {
+    PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 4);
   PN_BUILTIN_ARG(path_p, 0, u32);
@@ -319,7 +319,7 @@ static PNRuntimeValue pn_builtin_NACL_IRT_FILENAME_READLINK(
 static PNRuntimeValue pn_builtin_NACL_IRT_FILENAME_STAT(PNThread* thread,
                                                         PNFunction* function,
                                                         uint32_t num_args,
-                                                        PNValueId* arg_ids) {
+                                                        PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 2);
   PN_BUILTIN_ARG(pathname_p, 0, u32);
@@ -331,7 +331,7 @@ static PNRuntimeValue pn_builtin_NACL_IRT_FILENAME_STAT(PNThread* thread,
 static PNRuntimeValue pn_builtin_NACL_IRT_MEMORY_MMAP(PNThread* thread,
                                                       PNFunction* function,
                                                       uint32_t num_args,
-                                                      PNValueId* arg_ids) {
+                                                      PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 6);
   PN_BUILTIN_ARG(addr_pp, 0, u32);
@@ -405,7 +405,7 @@ found:
 static PNRuntimeValue pn_builtin_NACL_IRT_MEMORY_MUNMAP(PNThread* thread,
                                                         PNFunction* function,
                                                         uint32_t num_args,
-                                                        PNValueId* arg_ids) {
+                                                        PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 2);
   PN_BUILTIN_ARG(addr_p, 0, u32);
@@ -438,7 +438,7 @@ static PNRuntimeValue pn_builtin_NACL_IRT_MEMORY_MUNMAP(PNThread* thread,
 static PNRuntimeValue pn_builtin_NACL_IRT_TLS_INIT(PNThread* thread,
                                                    PNFunction* function,
                                                    uint32_t num_args,
-                                                   PNValueId* arg_ids) {
+                                                   PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 1);
   PN_BUILTIN_ARG(thread_ptr_p, 0, u32);
@@ -452,7 +452,7 @@ static PNRuntimeValue pn_builtin_NACL_IRT_TLS_INIT(PNThread* thread,
 static PNRuntimeValue pn_builtin_NACL_IRT_FUTEX_WAIT_ABS(PNThread* thread,
                                                          PNFunction* function,
                                                          uint32_t num_args,
-                                                         PNValueId* arg_ids) {
+                                                         PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   /* (Doc From irt.h)
   If |*addr| still contains |value|, futex_wait_abs() waits to be woken up by a
@@ -520,7 +520,7 @@ static PNRuntimeValue pn_builtin_NACL_IRT_FUTEX_WAIT_ABS(PNThread* thread,
 static PNRuntimeValue pn_builtin_NACL_IRT_FUTEX_WAKE(PNThread* thread,
                                                      PNFunction* function,
                                                      uint32_t num_args,
-                                                     PNValueId* arg_ids) {
+                                                     PNSlotId* arg_ids) {
   /*
   (Doc From irt.h)
   futex_wake() wakes up threads that are waiting on |addr| using futex_wait().
@@ -552,7 +552,7 @@ static PNRuntimeValue pn_builtin_NACL_IRT_FUTEX_WAKE(PNThread* thread,
 static PNRuntimeValue pn_builtin_NACL_IRT_THREAD_CREATE(PNThread* thread,
                                                         PNFunction* function,
                                                         uint32_t num_args,
-                                                        PNValueId* arg_ids) {
+                                                        PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 3);
   PN_BUILTIN_ARG(start_func_p, 0, u32);
@@ -565,12 +565,14 @@ static PNRuntimeValue pn_builtin_NACL_IRT_THREAD_CREATE(PNThread* thread,
     /* Dead thread list is singly-linked */
     new_thread = executor->dead_threads;
     executor->dead_threads = new_thread->next;
+    /* Reuse the dead thread's frame stack chunks and jmpbuf table */
+    pn_frame_stack_reset(&new_thread->frame_stack);
+    new_thread->num_jmpbufs = 0;
   } else {
-    new_thread = pn_allocator_alloc(&executor->allocator, sizeof(PNThread),
-                                    PN_DEFAULT_ALIGN);
+    new_thread = pn_allocator_allocz(&executor->allocator, sizeof(PNThread),
+                                     PN_DEFAULT_ALIGN);
   }
 
-  pn_allocator_init(&new_thread->allocator, PN_MIN_CHUNKSIZE, "thread");
   new_thread->executor = executor;
   new_thread->current_frame = &executor->sentinel_frame;
   new_thread->tls = thread_p;
@@ -588,7 +590,7 @@ static PNRuntimeValue pn_builtin_NACL_IRT_THREAD_CREATE(PNThread* thread,
   new_function_id -= PN_MAX_BUILTINS;
   pn_function_id_check(executor->module, new_function_id);
   PNFunction* new_function = &executor->module->functions[new_function_id];
-  pn_thread_push_function(new_thread, new_function_id, new_function);
+  pn_thread_push_function(new_thread, new_function);
   new_thread->current_frame->memory_stack_top = stack_p;
 
   PN_TRACE(IRT, "      created thread %d\n", new_thread->id);
@@ -599,7 +601,7 @@ static PNRuntimeValue pn_builtin_NACL_IRT_THREAD_CREATE(PNThread* thread,
 static PNRuntimeValue pn_builtin_NACL_IRT_THREAD_EXIT(PNThread* thread,
                                                       PNFunction* function,
                                                       uint32_t num_args,
-                                                      PNValueId* arg_ids) {
+                                                      PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 1);
   PN_BUILTIN_ARG(stack_flag_p, 0, u32);
@@ -622,7 +624,7 @@ static PNRuntimeValue pn_builtin_NACL_IRT_PPAPIHOOK_PPAPI_START(
     PNThread* thread,
     PNFunction* function,
     uint32_t num_args,
-    PNValueId* arg_ids) {
+    PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 1);
   PN_BUILTIN_ARG(start_functions_p, 0, u32);
@@ -688,7 +690,7 @@ pn_builtin_NACL_IRT_PPAPIHOOK_PPAPI_REGISTER_THREAD_CREATOR(
     PNThread* thread,
     PNFunction* function,
     uint32_t num_args,
-    PNValueId* arg_ids) {
+    PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 1);
   PN_BUILTIN_ARG(thread_functions_p, 0, u32);
@@ -705,7 +707,7 @@ pn_builtin_NACL_IRT_PPAPIHOOK_PPAPI_REGISTER_THREAD_CREATOR(
 #define PN_BUILTIN_STUB(name)                                    \
   static PNRuntimeValue pn_builtin_##name(                       \
       PNThread* thread, PNFunction* function, uint32_t num_args, \
-      PNValueId* arg_ids) {                                      \
+      PNSlotId* arg_ids) {                                      \
     PN_TRACE(IRT, "    " #name "(...)\n");                       \
     return pn_executor_value_u32(PN_ENOSYS);                     \
   }
@@ -0,0 +1,496 @@
+/* Copyright 2015 The Native Client Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. */
+
+#ifndef PN_CACHE_H_
+#define PN_CACHE_H_
+
+#if PN_CACHE
+
+/* --cache-dir keeps lowered modules on disk. A cache file holds what the
+ * executor needs: the functions with their instruction streams and constant
+ * pools, the types, module values and global vars, and the initialized global
+ * var memory. It is named for a hash of the pexe and of the interpreter build,
+ * so a later run of the same pexe with the same build maps it and starts
+ * running without reading the bitstream.
+ *
+ * Pointers are written as offsets from the start of the file and fixed up
+ * when the file is loaded; the pointers in instruction streams are found
+ * through PNFunction.relocs. The per-function IR (values, basic blocks,
+ * constants) is not written, so the cache isn't used when tracing. */
+
+typedef struct PNCacheWriter {
+  void* data;
+  uint32_t size;
+  uint32_t capacity;
+} PNCacheWriter;
+
+static uint64_t pn_cache_hash(uint64_t hash, const void* data, size_t size) {
+  const uint8_t* p = data;
+  size_t n;
+  for (n = 0; n < size; ++n) {
+    hash = (hash ^ p[n]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+#define PN_CACHE_HASH_INIT 14695981039346656037ULL
+
+/* Identifies the interpreter build, since instruction streams depend on the
+ * opcodes, handler offsets and struct layouts of the build that lowered them.
+ * Options that change lowering are included too. */
+static uint64_t pn_cache_build_id(void) {
+  static const char s_build_time[] = __DATE__ " " __TIME__;
+  uint32_t config[] = {PN_TRACING,
+                       PN_TIMERS,
+                       PN_PPAPI,
+                       PN_DIRECT_THREADED,
+                       PN_JIT,
+                       PN_NATIVE,
+                       PN_CALCULATE_PRED_BBS,
+                       PN_CALCULATE_LOOPS,
+                       PN_CALCULATE_LIVENESS,
+                       PN_MAX_OPCODE,
+                       sizeof(void*),
+                       sizeof(PNFunction),
+                       sizeof(PNType),
+                       sizeof(PNValue),
+                       sizeof(PNGlobalVar),
+                       PN_CACHE_VERSION,
+                       g_pn_dedupe_phi_nodes};
+  uint64_t hash = PN_CACHE_HASH_INIT;
+  hash = pn_cache_hash(hash, s_build_time, sizeof(s_build_time));
+  hash = pn_cache_hash(hash, config, sizeof(config));
+#if PN_DIRECT_THREADED
+  if (!g_pn_opcode_handlers) {
+    pn_executor_init_opcode_handlers();
+  }
+  hash = pn_cache_hash(hash, g_pn_opcode_handlers,
+                       PN_MAX_OPCODE * sizeof(g_pn_opcode_handlers[0]));
+#endif /* PN_DIRECT_THREADED */
+  return hash;
+}
+
+static void pn_cache_get_path(char* path,
+                              size_t path_size,
+                              const char* dirname,
+                              uint64_t pexe_hash,
+                              uint64_t build_id) {
+  snprintf(path, path_size, "%s/%016" PRIx64 "-%016" PRIx64 ".pncache",
+           dirname, pexe_hash, build_id);
+}
+
+/**** WRITING *****************************************************************/
+
+/* Returns the offset of the copy in the file */
+static uint32_t pn_cache_write_data(PNCacheWriter* w,
+                                    const void* data,
+                                    size_t size,
+                                    uint32_t align) {
+  uint32_t offset = pn_align_up(w->size, align);
+  PN_CHECK(offset + size >= offset && offset + size < 0x80000000);
+  if (offset + size > w->capacity) {
+    while (offset + size > w->capacity) {
+      w->capacity = w->capacity ? w->capacity * 2 : PN_MIN_CHUNKSIZE;
+    }
+    w->data = pn_realloc(w->data, w->capacity);
+  }
+
+  memset(w->data + w->size, 0, offset - w->size);
+  if (data) {
+    memcpy(w->data + offset, data, size);
+  } else {
+    memset(w->data + offset, 0, size);
+  }
+  w->size = offset + size;
+  return offset;
+}
+
+#define PN_CACHE_OFFSET_POINTER(offset) ((void*)(uintptr_t)(offset))
+
+static void* pn_cache_write_pointer(PNCacheWriter* w,
+                                    const void* data,
+                                    size_t size,
+                                    uint32_t align) {
+  if (!data) {
+    return NULL;
+  }
+  return PN_CACHE_OFFSET_POINTER(pn_cache_write_data(w, data, size, align));
+}
+
+static void pn_cache_write_function(PNCacheWriter* w,
+                                    PNModule* module,
+                                    PNFunction* function,
+                                    uint32_t function_offset) {
+  PN_CHECK(function->is_proto || function->relocs);
+  PNFunction copy = *function;
+  copy.name = pn_cache_write_pointer(
+      w, function->name, function->name ? strlen(function->name) + 1 : 0, 1);
+  copy.constant_pool = pn_cache_write_pointer(
+      w, function->constant_pool,
+      sizeof(PNRuntimeValue) *
+          (function->num_constants + function->num_module_value_slots),
+      sizeof(PNRuntimeValue));
+  copy.relocs = pn_cache_write_pointer(
+      w, function->relocs, sizeof(uint32_t) * function->num_relocs,
+      sizeof(uint32_t));
+  copy.instructions =
+      pn_cache_write_pointer(w, function->instructions,
+                             function->instructions_size, PN_DEFAULT_ALIGN);
+
+  if (function->instructions) {
+    void* instructions = w->data + (uintptr_t)copy.instructions;
+    uint32_t n;
+    for (n = 0; n < function->num_relocs; ++n) {
+      void* p = instructions + (function->relocs[n] >> 1);
+      void* target;
+      uintptr_t value;
+      memcpy(&target, p, sizeof(target));
+      if ((function->relocs[n] & 1) == PN_RELOC_CALLEE) {
+        PNCallee* callee = target;
+        value = callee->function - module->functions;
+      } else {
+        value = target - function->instructions;
+      }
+      memcpy(p, &value, sizeof(value));
+    }
+  }
+
+  /* The IR isn't written, only its size. Everything else is recalculated
+   * when the function is loaded. */
+  copy.constants = NULL;
+  copy.bbs = NULL;
+  copy.values = NULL;
+  copy.module_value_ids = NULL;
+  memset(&copy.callee, 0, sizeof(copy.callee));
+#if PN_CALCULATE_LIVENESS
+  copy.value_liveness_range = NULL;
+#endif /* PN_CALCULATE_LIVENESS */
+#if PN_JIT
+  copy.jit_entries = NULL;
+#endif /* PN_JIT */
+  memcpy(w->data + function_offset, &copy, sizeof(copy));
+}
+
+/* Writes the file under a temporary name and renames it, so concurrent runs
+ * only ever see whole files. On failure, errno says why. */
+static PNBool pn_cache_write_file(PNCacheWriter* w, const char* path) {
+  char temp_path[PATH_MAX + 16];
+  snprintf(temp_path, sizeof(temp_path), "%s.%d", path, (int)getpid());
+
+  FILE* f = fopen(temp_path, "wb");
+  if (!f) {
+    return PN_FALSE;
+  }
+
+  size_t written = fwrite(w->data, 1, w->size, f);
+  if (fclose(f) != 0 || written != w->size || rename(temp_path, path) != 0) {
+    int error = errno;
+    unlink(temp_path);
+    errno = error;
+    return PN_FALSE;
+  }
+  return PN_TRUE;
+}
+
+/* Writes the module, which must have been read with record_relocs set and
+ * not run yet. */
+static void pn_cache_write(PNModule* module,
+                           const char* dirname,
+                           uint64_t pexe_hash,
+                           uint64_t build_id) {
+  PN_BEGIN_TIME(CACHE_WRITE);
+  PNCacheWriter w = {};
+  PNCacheHeader header = {};
+  uint32_t n;
+  pn_cache_write_data(&w, NULL, sizeof(header), PN_DEFAULT_ALIGN);
+
+  header.magic = PN_CACHE_MAGIC;
+  header.version = PN_CACHE_VERSION;
+  header.pexe_hash = pexe_hash;
+  header.build_id = build_id;
+  header.module_version = module->version;
+  memcpy(header.known_functions, module->known_functions,
+         sizeof(header.known_functions));
+
+  header.num_types = module->num_types;
+  header.types_offset =
+      pn_cache_write_data(&w, module->types, sizeof(PNType) * module->num_types,
+                          PN_DEFAULT_ALIGN);
+  for (n = 0; n < module->num_types; ++n) {
+    PNType* type = &module->types[n];
+    if (type->code == PN_TYPE_CODE_FUNCTION) {
+      void* arg_types = pn_cache_write_pointer(
+          &w, type->arg_types, sizeof(PNTypeId) * type->num_args,
+          sizeof(PNTypeId));
+      PNType* copy = w.data + header.types_offset + n * sizeof(PNType);
+      copy->arg_types = arg_types;
+    }
+  }
+
+  header.num_values = module->num_values;
+  header.values_offset = pn_cache_write_data(
+      &w, module->values, sizeof(PNValue) * module->num_values,
+      PN_DEFAULT_ALIGN);
+  header.num_global_vars = module->num_global_vars;
+  header.global_vars_offset = pn_cache_write_data(
+      &w, module->global_vars, sizeof(PNGlobalVar) * module->num_global_vars,
+      PN_DEFAULT_ALIGN);
+
+  PNMemory* memory = module->memory;
+  header.globalvar_start = memory->globalvar_start;
+  header.globalvar_end = memory->globalvar_end;
+  header.globalvar_data_offset = pn_cache_write_data(
+      &w, memory->data + memory->globalvar_start,
+      memory->globalvar_end - memory->globalvar_start, PN_DEFAULT_ALIGN);
+
+  header.num_functions = module->num_functions;
+  header.functions_offset =
+      pn_cache_write_data(&w, NULL, sizeof(PNFunction) * module->num_functions,
+                          PN_DEFAULT_ALIGN);
+  for (n = 0; n < module->num_functions; ++n) {
+    pn_cache_write_function(
+        &w, module, &module->functions[n],
+        header.functions_offset + n * sizeof(PNFunction));
+  }
+
+  header.file_size = w.size;
+  memcpy(w.data, &header, sizeof(header));
+
+  char path[PATH_MAX];
+  pn_cache_get_path(path, sizeof(path), dirname, pexe_hash, build_id);
+  if (pn_cache_write_file(&w, path)) {
+    if (g_pn_verbose) {
+      PN_PRINT("Wrote cache %s.\n", path);
+    }
+  } else {
+    PN_ERROR("unable to write cache %s: %s\n", path, strerror(errno));
+  }
+
+  pn_free(w.data);
+  PN_END_TIME(CACHE_WRITE);
+}
+
+/**** LOADING *****************************************************************/
+
+typedef struct PNCacheFile {
+  void* data;
+  uint32_t size;
+} PNCacheFile;
+
+/* Returns the |size| bytes at |offset| in the file, or NULL if they aren't
+ * all in the file. */
+static void* pn_cache_get_data(PNCacheFile* file,
+                               uint64_t offset,
+                               uint64_t size) {
+  if (offset < sizeof(PNCacheHeader) || offset > file->size ||
+      size > file->size - offset) {
+    return NULL;
+  }
+  return file->data + offset;
+}
+
+/* Replaces an offset written by pn_cache_write_pointer with the pointer it
+ * stands for. */
+static PNBool pn_cache_fix_pointer(PNCacheFile* file, void** p, uint64_t size) {
+  if (!*p) {
+    return size == 0;
+  }
+  *p = pn_cache_get_data(file, (uintptr_t)*p, size);
+  return *p != NULL;
+}
+
+#define PN_CACHE_FIX_POINTER(file, p, size) \
+  pn_cache_fix_pointer(file, (void**)(p), size)
+
+static PNBool pn_cache_fix_function(PNCacheFile* file,
+                                    PNModule* module,
+                                    PNFunction* function) {
+  if (function->name) {
+    uintptr_t offset = (uintptr_t)function->name;
+    if (!pn_cache_get_data(file, offset, 0) ||
+        !memchr(file->data + offset, 0, file->size - offset)) {
+      return PN_FALSE;
+    }
+    function->name = file->data + offset;
+  }
+
+  uint64_t num_constant_pool_values = (uint64_t)function->num_constants +
+                                      function->num_module_value_slots;
+  if (function->lazy_bit_offset != 0 ||
+      (function->instructions == NULL) != function->is_proto ||
+      !PN_CACHE_FIX_POINTER(file, &function->constant_pool,
+                            sizeof(PNRuntimeValue) * num_constant_pool_values) ||
+      !PN_CACHE_FIX_POINTER(file, &function->relocs,
+                            sizeof(uint32_t) * (uint64_t)function->num_relocs) ||
+      !PN_CACHE_FIX_POINTER(file, &function->instructions,
+                            function->instructions_size)) {
+    return PN_FALSE;
+  }
+
+  uint32_t n;
+  for (n = 0; n < function->num_relocs; ++n) {
+    uint32_t offset = function->relocs[n] >> 1;
+    if (function->instructions_size < sizeof(void*) ||
+        offset > function->instructions_size - sizeof(void*)) {
+      return PN_FALSE;
+    }
+
+    void* p = function->instructions + offset;
+    uintptr_t value;
+    void* target;
+    memcpy(&value, p, sizeof(value));
+    if ((function->relocs[n] & 1) == PN_RELOC_CALLEE) {
+      if (value >= module->num_functions ||
+          module->functions[value].is_proto) {
+        return PN_FALSE;
+      }
+      target = &module->functions[value].callee;
+    } else {
+      if (value >= function->instructions_size) {
+        return PN_FALSE;
+      }
+      target = function->instructions + value;
+    }
+    memcpy(p, &target, sizeof(target));
+  }
+
+  if (!function->is_proto) {
+    pn_function_init_callee(module, function);
+  }
+#if PN_JIT
+  /* The run that wrote the cache may have used a different --jit-threshold */
+  function->jit_countdown = pn_function_get_jit_countdown();
+#endif /* PN_JIT */
+  return PN_TRUE;
+}
+
+/* Checks the cache file and fills in the module and memory from it. The
+ * module isn't changed unless the file is valid. */
+static PNBool pn_cache_load_file(PNModule* module,
+                                 PNCacheFile* file,
+                                 uint64_t pexe_hash,
+                                 uint64_t build_id) {
+  PNCacheHeader* header = file->data;
+  PNMemory* memory = module->memory;
+  if (header->magic != PN_CACHE_MAGIC ||
+      header->version != PN_CACHE_VERSION ||
+      header->pexe_hash != pexe_hash || header->build_id != build_id ||
+      header->file_size != file->size ||
+      header->globalvar_start > header->globalvar_end ||
+      header->globalvar_end > memory->size) {
+    return PN_FALSE;
+  }
+
+  uint32_t globalvar_size = header->globalvar_end - header->globalvar_start;
+  PNModule copy = *module;
+  copy.version = header->module_version;
+  copy.num_functions = header->num_functions;
+  copy.functions =
+      pn_cache_get_data(file, header->functions_offset,
+                        sizeof(PNFunction) * (uint64_t)header->num_functions);
+  copy.num_types = header->num_types;
+  copy.types = pn_cache_get_data(
+      file, header->types_offset, sizeof(PNType) * (uint64_t)header->num_types);
+  copy.num_values = header->num_values;
+  copy.values =
+      pn_cache_get_data(file, header->values_offset,
+                        sizeof(PNValue) * (uint64_t)header->num_values);
+  copy.num_global_vars = header->num_global_vars;
+  copy.global_vars = pn_cache_get_data(
+      file, header->global_vars_offset,
+      sizeof(PNGlobalVar) * (uint64_t)header->num_global_vars);
+  void* globalvar_data = pn_cache_get_data(
+      file, header->globalvar_data_offset, globalvar_size);
+  if (!copy.functions || !copy.types || !copy.values || !copy.global_vars ||
+      !globalvar_data) {
+    return PN_FALSE;
+  }
+
+  uint32_t n;
+  for (n = 0; n < PN_MAX_INTRINSICS; ++n) {
+    PNFunctionId function_id = header->known_functions[n];
+    if (function_id != PN_INVALID_FUNCTION_ID &&
+        function_id >= copy.num_functions) {
+      return PN_FALSE;
+    }
+    copy.known_functions[n] = function_id;
+  }
+
+  for (n = 0; n < copy.num_types; ++n) {
+    PNType* type = &copy.types[n];
+    if (type->code == PN_TYPE_CODE_FUNCTION &&
+        !PN_CACHE_FIX_POINTER(file, &type->arg_types,
+                              sizeof(PNTypeId) * (uint64_t)type->num_args)) {
+      return PN_FALSE;
+    }
+  }
+
+  for (n = 0; n < copy.num_functions; ++n) {
+    if (!pn_cache_fix_function(file, &copy, &copy.functions[n])) {
+      return PN_FALSE;
+    }
+  }
+
+  *module = copy;
+  memory->globalvar_start = header->globalvar_start;
+  memory->globalvar_end = header->globalvar_end;
+  memcpy(memory->data + memory->globalvar_start, globalvar_data,
+         globalvar_size);
+  return PN_TRUE;
+}
+
+/* Maps the cache file for this pexe and build, if there is one. Returns
+ * PN_FALSE if there is no valid one, in which case the module must be read.
+ * The file stays mapped for the life of the process. */
+static PNBool pn_cache_load(PNModule* module,
+                            const char* dirname,
+                            uint64_t pexe_hash,
+                            uint64_t build_id) {
+  PN_BEGIN_TIME(CACHE_LOAD);
+  char path[PATH_MAX];
+  pn_cache_get_path(path, sizeof(path), dirname, pexe_hash, build_id);
+
+  PNCacheFile file = {};
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    PN_END_TIME(CACHE_LOAD);
+    return PN_FALSE;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(PNCacheHeader) &&
+      st.st_size < 0x80000000) {
+    file.size = st.st_size;
+    /* Private and writable, for the fixups and the inline caches in the
+     * instruction streams. */
+    file.data =
+        mmap(NULL, file.size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (file.data == MAP_FAILED) {
+      file.data = NULL;
+    }
+  }
+  close(fd);
+
+  PNBool valid =
+      file.data && pn_cache_load_file(module, &file, pexe_hash, build_id);
+  if (valid) {
+    if (g_pn_verbose) {
+      PN_PRINT("Loaded cache %s.\n", path);
+    }
+  } else {
+    if (file.data) {
+      munmap(file.data, file.size);
+    }
+    if (g_pn_verbose) {
+      PN_PRINT("Ignoring invalid cache %s.\n", path);
+    }
+  }
+
+  PN_END_TIME(CACHE_LOAD);
+  return valid;
+}
+
+#endif /* PN_CACHE */
+
+#endif /* PN_CACHE_H_ */
@@ -0,0 +1,289 @@
+/* Copyright 2015 The Native Client Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. */
+
+#ifndef PN_CALCULATE_ADDRESS_MODES_H_
+#define PN_CALCULATE_ADDRESS_MODES_H_
+
+typedef struct PNAddressModeState {
+  /* Indexed by value id - module->num_values. */
+  uint32_t* num_uses;
+  uint32_t* num_address_uses;
+  PNInstructionBinop** binops; /* Only those defined in the current bb. */
+  PNBitSet dead;
+} PNAddressModeState;
+
+static PNBool pn_function_get_u32_constant(PNModule* module,
+                                           PNFunction* function,
+                                           PNValueId value_id,
+                                           uint32_t* out_value) {
+  if (value_id < module->num_values) {
+    return PN_FALSE;
+  }
+
+  PNValue* value = pn_function_get_value(module, function, value_id);
+  if (value->code != PN_VALUE_CODE_CONSTANT) {
+    return PN_FALSE;
+  }
+
+  PNConstant* constant = &function->constants[value->index];
+  if (constant->basic_type != PN_BASIC_TYPE_INT32) {
+    return PN_FALSE;
+  }
+
+  *out_value = constant->value.u32;
+  return PN_TRUE;
+}
+
+static PNBool pn_function_is_int32_value(PNModule* module,
+                                         PNFunction* function,
+                                         PNValueId value_id) {
+  PNValue* value = pn_function_get_value(module, function, value_id);
+  return value->type_id != PN_INVALID_TYPE_ID &&
+         module->types[value->type_id].basic_type == PN_BASIC_TYPE_INT32;
+}
+
+/* Returns the int32 add, mul or shl that defines |value_id| in the current
+ * basic block, or NULL. */
+static PNInstructionBinop* pn_address_mode_get_binop(
+    PNModule* module,
+    PNAddressModeState* state,
+    PNValueId value_id) {
+  if (value_id < module->num_values) {
+    return NULL;
+  }
+  return state->binops[value_id - module->num_values];
+}
+
+static void pn_address_mode_add_use(PNModule* module,
+                                    PNAddressModeState* state,
+                                    PNValueId value_id,
+                                    int32_t delta) {
+  if (value_id >= module->num_values) {
+    state->num_uses[value_id - module->num_values] += delta;
+  }
+}
+
+static void pn_function_count_value_uses(PNModule* module,
+                                         PNFunction* function,
+                                         PNAddressModeState* state) {
+  uint32_t n;
+  for (n = 0; n < function->num_bbs; ++n) {
+    PNBasicBlock* bb = &function->bbs[n];
+    PNInstruction* inst;
+    for (inst = bb->instructions; inst; inst = inst->next) {
+      PNValueId buffer[3];
+      uint32_t num_operands;
+      PNValueId* operands =
+          pn_instruction_get_slot_operands(inst, buffer, &num_operands);
+      uint32_t m;
+      for (m = 0; m < num_operands; ++m) {
+        if (operands[m] != PN_INVALID_VALUE_ID) {
+          pn_address_mode_add_use(module, state, operands[m], 1);
+        }
+      }
+
+      if (inst->code == PN_FUNCTION_CODE_INST_PHI) {
+        PNInstructionPhi* i = (PNInstructionPhi*)inst;
+        for (m = 0; m < i->num_incoming; ++m) {
+          pn_address_mode_add_use(module, state, i->incoming[m].value_id, 1);
+        }
+      } else if (inst->code == PN_FUNCTION_CODE_INST_CALL ||
+                 inst->code == PN_FUNCTION_CODE_INST_CALL_INDIRECT) {
+        PNInstructionCall* i = (PNInstructionCall*)inst;
+        if (i->is_indirect) {
+          pn_address_mode_add_use(module, state, i->callee_id, 1);
+        }
+      }
+    }
+  }
+}
+
+static PNValueId* pn_instruction_get_address(PNInstruction* inst) {
+  switch (inst->code) {
+    case PN_FUNCTION_CODE_INST_LOAD:
+      return &((PNInstructionLoad*)inst)->src_id;
+    case PN_FUNCTION_CODE_INST_STORE:
+      return &((PNInstructionStore*)inst)->dest_id;
+    default:
+      return NULL;
+  }
+}
+
+/* Folds the add that computes |*address_id| into the load or store that uses
+ * it, if every use of the add can be folded the same way. */
+static void pn_instruction_calculate_address_mode(PNModule* module,
+                                                  PNFunction* function,
+                                                  PNAddressModeState* state,
+                                                  PNValueId* address_id,
+                                                  PNValueId* out_index_id,
+                                                  uint32_t* out_scale,
+                                                  uint32_t* out_offset) {
+  PNInstructionBinop* add =
+      pn_address_mode_get_binop(module, state, *address_id);
+  if (!add || add->binop_opcode != PN_BINOP_ADD) {
+    return;
+  }
+
+  PNValueId rel_id = *address_id - module->num_values;
+  if (state->num_uses[rel_id] != state->num_address_uses[rel_id]) {
+    return;
+  }
+
+  PNValueId base_id = add->value0_id;
+  PNValueId other_id = add->value1_id;
+  uint32_t offset;
+  if (pn_function_get_u32_constant(module, function, base_id, &offset)) {
+    base_id = add->value1_id;
+    other_id = add->value0_id;
+  }
+
+  PNInstructionBinop* index_binop = NULL;
+  PNValueId index_id = PN_INVALID_VALUE_ID;
+  uint32_t scale = 1;
+  offset = 0;
+  if (!pn_function_get_u32_constant(module, function, other_id, &offset)) {
+    index_id = other_id;
+    index_binop = pn_address_mode_get_binop(module, state, other_id);
+    if (index_binop &&
+        state->num_uses[other_id - module->num_values] == 1) {
+      uint32_t value1;
+      if (pn_function_get_u32_constant(module, function,
+                                       index_binop->value1_id, &value1)) {
+        if (index_binop->binop_opcode == PN_BINOP_MUL) {
+          index_id = index_binop->value0_id;
+          scale = value1;
+        } else if (index_binop->binop_opcode == PN_BINOP_SHL && value1 < 32) {
+          index_id = index_binop->value0_id;
+          scale = 1U << value1;
+        }
+      }
+    }
+
+    if (index_id == other_id) {
+      index_binop = NULL;
+    }
+  }
+
+  *address_id = base_id;
+  *out_index_id = index_id;
+  *out_scale = scale;
+  *out_offset = offset;
+  pn_address_mode_add_use(module, state, base_id, 1);
+  if (index_id != PN_INVALID_VALUE_ID) {
+    pn_address_mode_add_use(module, state, index_id, 1);
+  }
+
+  /* The add is removed once its last use is folded. */
+  state->num_address_uses[rel_id]--;
+  if (--state->num_uses[rel_id] == 0) {
+    pn_bitset_set(&state->dead, rel_id, PN_TRUE);
+    pn_address_mode_add_use(module, state, add->value0_id, -1);
+    pn_address_mode_add_use(module, state, add->value1_id, -1);
+    if (index_binop) {
+      pn_bitset_set(&state->dead, other_id - module->num_values, PN_TRUE);
+      pn_address_mode_add_use(module, state, index_binop->value0_id, -1);
+      pn_address_mode_add_use(module, state, index_binop->value1_id, -1);
+    }
+  }
+}
+
+static void pn_basic_block_calculate_address_modes(PNModule* module,
+                                                   PNFunction* function,
+                                                   PNAddressModeState* state,
+                                                   PNBasicBlock* bb) {
+  PNInstruction* inst;
+  for (inst = bb->instructions; inst; inst = inst->next) {
+    if (inst->code == PN_FUNCTION_CODE_INST_BINOP) {
+      PNInstructionBinop* i = (PNInstructionBinop*)inst;
+      if ((i->binop_opcode == PN_BINOP_ADD ||
+           i->binop_opcode == PN_BINOP_MUL ||
+           i->binop_opcode == PN_BINOP_SHL) &&
+          pn_function_is_int32_value(module, function, i->value0_id) &&
+          pn_function_is_int32_value(module, function, i->value1_id)) {
+        state->binops[i->result_value_id - module->num_values] = i;
+      }
+    } else {
+      PNValueId* address_id = pn_instruction_get_address(inst);
+      if (address_id && *address_id >= module->num_values) {
+        state->num_address_uses[*address_id - module->num_values]++;
+      }
+    }
+  }
+
+  for (inst = bb->instructions; inst; inst = inst->next) {
+    if (inst->code == PN_FUNCTION_CODE_INST_LOAD) {
+      PNInstructionLoad* i = (PNInstructionLoad*)inst;
+      pn_instruction_calculate_address_mode(module, function, state,
+                                            &i->src_id, &i->index_id,
+                                            &i->scale, &i->offset);
+    } else if (inst->code == PN_FUNCTION_CODE_INST_STORE) {
+      PNInstructionStore* i = (PNInstructionStore*)inst;
+      pn_instruction_calculate_address_mode(module, function, state,
+                                            &i->dest_id, &i->index_id,
+                                            &i->scale, &i->offset);
+    }
+  }
+
+  PNInstruction* prev = NULL;
+  for (inst = bb->instructions; inst; inst = inst->next) {
+    if (inst->code == PN_FUNCTION_CODE_INST_BINOP) {
+      PNInstructionBinop* i = (PNInstructionBinop*)inst;
+      PNValueId rel_id = i->result_value_id - module->num_values;
+      state->binops[rel_id] = NULL;
+      if (pn_bitset_is_set(&state->dead, rel_id)) {
+        if (prev) {
+          prev->next = inst->next;
+        } else {
+          bb->instructions = inst->next;
+        }
+        if (bb->last_instruction == inst) {
+          bb->last_instruction = prev;
+        }
+        bb->num_instructions--;
+        continue;
+      }
+    }
+    prev = inst;
+  }
+}
+
+/* Folds int32 adds (and a mul or shl by a constant feeding them) into the
+ * loads and stores that use them as an address. */
+static void pn_function_calculate_address_modes(PNModule* module,
+                                                PNFunction* function) {
+#if PN_TRACING
+  /* Keep the traced instructions the same as the bitcode. */
+  if (PN_IS_TRACE(INSTRUCTIONS) || PN_IS_TRACE(EXECUTE)) {
+    return;
+  }
+#endif /* PN_TRACING */
+
+  PN_BEGIN_TIME(CALCULATE_ADDRESS_MODES);
+  PNAllocatorMark mark = pn_allocator_mark(&module->temp_allocator);
+
+  PNAddressModeState state;
+  state.num_uses = pn_allocator_allocz(
+      &module->temp_allocator, sizeof(uint32_t) * function->num_values,
+      sizeof(uint32_t));
+  state.num_address_uses = pn_allocator_allocz(
+      &module->temp_allocator, sizeof(uint32_t) * function->num_values,
+      sizeof(uint32_t));
+  state.binops = pn_allocator_allocz(
+      &module->temp_allocator,
+      sizeof(PNInstructionBinop*) * function->num_values, PN_DEFAULT_ALIGN);
+  pn_bitset_init(&module->temp_allocator, &state.dead, function->num_values);
+
+  pn_function_count_value_uses(module, function, &state);
+
+  uint32_t n;
+  for (n = 0; n < function->num_bbs; ++n) {
+    pn_basic_block_calculate_address_modes(module, function, &state,
+                                           &function->bbs[n]);
+  }
+
+  pn_allocator_reset_to_mark(&module->temp_allocator, mark);
+  PN_END_TIME(CALCULATE_ADDRESS_MODES);
+}
+
+#endif /* PN_CALCULATE_ADDRESS_MODES_H_ */
@@ -14,11 +14,8 @@ static void pn_basic_block_calculate_liveness_per_value(
     PNValueId rel_id) {
   PNValueId value_id = module->num_values + rel_id;
 
-  if (pn_bitset_is_set(&state->seen_values, rel_id)) {
-    return;
-  }
-  pn_bitset_set(&state->seen_values, rel_id, PN_TRUE);
-
+  /* Walk from every use, not just the first one seen; a value's predecessor
+   * chains from two uses can reach different basic blocks. */
   pn_bitset_clear(&state->livein);
   pn_bitset_clear(&state->seen_bbs);
   pn_bitset_set(&state->seen_bbs, initial_bb_id, PN_TRUE);
@@ -72,7 +69,7 @@ static void pn_basic_block_calculate_liveness(PNModule* module,
     PNPhiIncoming* incoming = &bb->phi_uses[n].incoming;
     if (incoming->value_id <
         module->num_values + function->num_args + function->num_constants) {
-      break;
+      continue;
     }
 
     PNValueId rel_id = incoming->value_id - module->num_values;
@@ -89,26 +86,69 @@ static void pn_basic_block_calculate_liveness(PNModule* module,
   }
 }
 
+static int pn_liveness_range_compare(const void* a, const void* b) {
+  const PNLivenessRange* range_a = *(PNLivenessRange* const*)a;
+  const PNLivenessRange* range_b = *(PNLivenessRange* const*)b;
+  if (range_a->first_bb_id != range_b->first_bb_id) {
+    return range_a->first_bb_id < range_b->first_bb_id ? -1 : 1;
+  }
+  /* Keep the sort stable, so slot assignment is deterministic */
+  return range_a < range_b ? -1 : range_a > range_b;
+}
+
+/* Assigns each local value a slot, sharing slots between values whose live
+ * ranges don't overlap, using a linear scan over the ranges sorted by start.
+ * Ranges are in basic block granularity, so values that are live in the same
+ * basic block never share a slot. */
 static void pn_function_make_slot_map(PNModule* module, PNFunction* function) {
-  PNBasicBlockId bb_id = 0;
+  uint32_t first_local = function->num_args + function->num_constants;
+  uint32_t num_locals = function->num_values - first_local;
+  uint32_t n;
 
-  uint32_t num_avail_slots = function->num_values;
+  if (PN_IS_TRACE(EXECUTE)) {
+    /* The tracer names operands by mapping slots back to values, so give
+     * each value its own slot. */
+    for (n = 0; n < num_locals; ++n) {
+      function->value_liveness_range[first_local + n].slot_id = n;
+    }
+    function->num_frame_slots = function->num_args + num_locals;
+    return;
+  }
+
+  PNLivenessRange** ranges = pn_allocator_alloc(
+      &module->temp_allocator, sizeof(PNLivenessRange*) * num_locals,
+      sizeof(PNLivenessRange*));
+  for (n = 0; n < num_locals; ++n) {
+    ranges[n] = &function->value_liveness_range[first_local + n];
+  }
+  qsort(ranges, num_locals, sizeof(PNLivenessRange*),
+        pn_liveness_range_compare);
+
+  uint32_t num_avail_slots = num_locals;
   PNValueId* avail_slots = pn_allocator_alloc(
-      &module->temp_allocator, sizeof(PNValueId) * function->num_values,
+      &module->temp_allocator, sizeof(PNValueId) * num_locals,
       sizeof(PNValueId));
-  uint32_t n;
-  for (n = 0; n < function->num_values; ++n) {
+  for (n = 0; n < num_locals; ++n) {
     avail_slots[n] = n;
   }
 
   uint32_t num_active = 0;
   PNLivenessRange* active = pn_allocator_alloc(
-      &module->temp_allocator, sizeof(PNLivenessRange) * function->num_values,
+      &module->temp_allocator, sizeof(PNLivenessRange) * num_locals,
       PN_DEFAULT_ALIGN);
 
-  for (n = function->num_args + function->num_constants;
-       n < function->num_values; ++n) {
-    PNLivenessRange* range = &function->value_liveness_range[n];
+  PNBasicBlockId bb_id = 0;
+  uint32_t num_slots = 0;
+  for (n = 0; n < num_locals; ++n) {
+    PNLivenessRange* range = ranges[n];
+    if (range->first_bb_id == PN_INVALID_BB_ID) {
+      /* Not live in any basic block, e.g. the scratch value used to break
+       * phi assign cycles, which is only live between basic blocks. These
+       * sort last; give each its own slot. */
+      range->slot_id = num_slots++;
+      continue;
+    }
+
     if (range->first_bb_id > bb_id) {
       /* Evict active intervals that are now finished */
       bb_id = range->first_bb_id;
@@ -117,7 +157,7 @@ static void pn_function_make_slot_map(PNModule* module, PNFunction* function) {
         if (active[m].last_bb_id < bb_id) {
           PNValueId slot_id = active[m].slot_id;
           /* Reheap avail */
-          assert(num_avail_slots < function->num_values);
+          assert(num_avail_slots < num_locals);
           uint32_t insert_at = num_avail_slots;
           uint32_t parent = (insert_at - 1) / 2;
           while (insert_at != 0 && avail_slots[parent] > slot_id) {
@@ -137,31 +177,32 @@ static void pn_function_make_slot_map(PNModule* module, PNFunction* function) {
     }
 
     /* Pop minimum slot id from heap */
+    assert(num_avail_slots > 0);
+    PNValueId slot_id = avail_slots[0];
+    PNValueId last_slot_id = avail_slots[--num_avail_slots];
     uint32_t slot_index = 0;
-    PNValueId slot_id = avail_slots[slot_index];
-    while (slot_index * 2 + 2 < num_avail_slots) {
-      PNValueId left_slot_id = avail_slots[slot_index * 2 + 1];
-      PNValueId right_slot_id = avail_slots[slot_index * 2 + 2];
-      if (left_slot_id < right_slot_id) {
-        avail_slots[slot_index] = left_slot_id;
-        slot_index = slot_index * 2 + 1;
-      } else {
-        avail_slots[slot_index] = right_slot_id;
-        slot_index = slot_index * 2 + 2;
+    while (slot_index * 2 + 1 < num_avail_slots) {
+      uint32_t child = slot_index * 2 + 1;
+      if (child + 1 < num_avail_slots &&
+          avail_slots[child + 1] < avail_slots[child]) {
+        child++;
       }
+      if (last_slot_id < avail_slots[child]) {
+        break;
+      }
+      avail_slots[slot_index] = avail_slots[child];
+      slot_index = child;
     }
-
-    if (slot_index * 2 + 1 < num_avail_slots) {
-      avail_slots[slot_index] = avail_slots[slot_index * 2 + 1];
-    }
-
-    num_avail_slots--;
+    avail_slots[slot_index] = last_slot_id;
 
     /* Append the new active range */
-    assert(num_active < function->num_values);
+    assert(num_active < num_locals);
     range->slot_id = slot_id;
     active[num_active++] = *range;
+    num_slots = pn_max(num_slots, slot_id + 1);
   }
+
+  function->num_frame_slots = function->num_args + num_slots;
 }
 
 static void pn_function_calculate_liveness(PNModule* module,
@@ -170,8 +211,6 @@ static void pn_function_calculate_liveness(PNModule* module,
   PNAllocatorMark mark = pn_allocator_mark(&module->temp_allocator);
 
   PNLivenessState state;
-  pn_bitset_init(&module->temp_allocator, &state.seen_values,
-                 function->num_values);
   pn_bitset_init(&module->temp_allocator, &state.seen_bbs, function->num_bbs);
   pn_bitset_init(&module->temp_allocator, &state.livein, function->num_bbs);
   state.bb_id_stack = pn_allocator_alloc(
@@ -208,6 +247,25 @@ static void pn_function_calculate_liveness(PNModule* module,
     pn_basic_block_calculate_liveness(module, function, &state, bb_id);
   }
 
+  /* A phi's value is assigned at the end of each incoming basic block, so it
+   * must not share a slot with anything live there. */
+  for (n = 0; n < function->num_bbs; ++n) {
+    PNBasicBlock* bb = &function->bbs[n];
+    uint32_t m;
+    for (m = 0; m < bb->num_phi_uses; ++m) {
+      PNPhiUse* use = &bb->phi_uses[m];
+      PNValueId rel_id = use->dest_value_id - module->num_values;
+      PNLivenessRange* range = &function->value_liveness_range[rel_id];
+      PNBasicBlockId pred_bb_id = use->incoming.bb_id;
+      if (pred_bb_id < range->first_bb_id) {
+        range->first_bb_id = pred_bb_id;
+      }
+      if (pred_bb_id > range->last_bb_id) {
+        range->last_bb_id = pred_bb_id;
+      }
+    }
+  }
+
   pn_function_make_slot_map(module, function);
 
   pn_allocator_reset_to_mark(&module->temp_allocator, mark);
@@ -5,13 +5,480 @@
 #ifndef PN_CALCULATE_OPCODES_H_
 #define PN_CALCULATE_OPCODES_H_
 
-static void* pn_basic_block_write_instruction_stream(PNModule* module,
-                                                     PNFunction* function,
-                                                     PNBasicBlock* bb,
-                                                     void** bb_offsets,
-                                                     void* offset,
-                                                     PNBool write) {
+#if PN_DIRECT_THREADED
+static void pn_executor_init_opcode_handlers(void);
+#endif /* PN_DIRECT_THREADED */
+
+static PNWideSlotId pn_function_get_slot(PNModule* module,
+                                         PNFunction* function,
+                                         PNValueId value_id) {
+  if (value_id == PN_INVALID_VALUE_ID) {
+    return PN_INVALID_WIDE_SLOT_ID;
+  } else if (value_id >= module->num_values) {
+    uint32_t index = value_id - module->num_values;
+    PNValue* value = &function->values[index];
+    if (value->code == PN_VALUE_CODE_CONSTANT) {
+      return PN_CONSTANT_SLOT(value->index);
+    } else if (index < function->num_args) {
+      return PN_FRAME_SLOT(index);
+    } else {
+#if PN_CALCULATE_LIVENESS
+      PNLivenessRange* range = &function->value_liveness_range[index];
+      index = function->num_args + range->slot_id;
+#else
+      index -= function->num_constants;
+#endif /* PN_CALCULATE_LIVENESS */
+      return PN_FRAME_SLOT(index + function->num_scratch_slots);
+    }
+  }
+
+  PNWideSlotId* slot = &module->module_value_slots[value_id];
+  if (*slot == PN_INVALID_WIDE_SLOT_ID) {
+    PNValueId* module_value_id = pn_allocator_realloc_add(
+        &module->allocator, (void**)&function->module_value_ids,
+        sizeof(PNValueId), sizeof(PNValueId));
+    *module_value_id = value_id;
+    *slot = PN_CONSTANT_SLOT(function->num_constants +
+                             function->num_module_value_slots++);
+  }
+  return *slot;
+}
+
+/* Returns the values |inst| reads through slot operands, either pointing into
+ * |inst| itself or into |buffer|, which must hold at least 3 ids. */
+static PNValueId* pn_instruction_get_slot_operands(PNInstruction* inst,
+                                                   PNValueId* buffer,
+                                                   uint32_t* out_num_operands) {
+  uint32_t n = 0;
+  switch (inst->code) {
+    case PN_FUNCTION_CODE_INST_BINOP: {
+      PNInstructionBinop* i = (PNInstructionBinop*)inst;
+      buffer[n++] = i->value0_id;
+      buffer[n++] = i->value1_id;
+      break;
+    }
+
+    case PN_FUNCTION_CODE_INST_CAST: {
+      PNInstructionCast* i = (PNInstructionCast*)inst;
+      buffer[n++] = i->value_id;
+      break;
+    }
+
+    case PN_FUNCTION_CODE_INST_RET: {
+      PNInstructionRet* i = (PNInstructionRet*)inst;
+      buffer[n++] = i->value_id;
+      break;
+    }
+
+    case PN_FUNCTION_CODE_INST_BR: {
+      PNInstructionBr* i = (PNInstructionBr*)inst;
+      buffer[n++] = i->value_id;
+      break;
+    }
+
+    case PN_FUNCTION_CODE_INST_SWITCH: {
+      PNInstructionSwitch* i = (PNInstructionSwitch*)inst;
+      buffer[n++] = i->value_id;
+      break;
+    }
+
+    case PN_FUNCTION_CODE_INST_ALLOCA: {
+      PNInstructionAlloca* i = (PNInstructionAlloca*)inst;
+      buffer[n++] = i->size_id;
+      break;
+    }
+
+    case PN_FUNCTION_CODE_INST_LOAD: {
+      PNInstructionLoad* i = (PNInstructionLoad*)inst;
+      buffer[n++] = i->src_id;
+      if (i->index_id != PN_INVALID_VALUE_ID) {
+        buffer[n++] = i->index_id;
+      }
+      break;
+    }
+
+    case PN_FUNCTION_CODE_INST_STORE: {
+      PNInstructionStore* i = (PNInstructionStore*)inst;
+      buffer[n++] = i->dest_id;
+      buffer[n++] = i->value_id;
+      if (i->index_id != PN_INVALID_VALUE_ID) {
+        buffer[n++] = i->index_id;
+      }
+      break;
+    }
+
+    case PN_FUNCTION_CODE_INST_CMP2: {
+      PNInstructionCmp2* i = (PNInstructionCmp2*)inst;
+      buffer[n++] = i->value0_id;
+      buffer[n++] = i->value1_id;
+      break;
+    }
+
+    case PN_FUNCTION_CODE_INST_VSELECT: {
+      PNInstructionVselect* i = (PNInstructionVselect*)inst;
+      buffer[n++] = i->cond_id;
+      buffer[n++] = i->true_value_id;
+      buffer[n++] = i->false_value_id;
+      break;
+    }
+
+    case PN_FUNCTION_CODE_INST_CALL:
+    case PN_FUNCTION_CODE_INST_CALL_INDIRECT: {
+      /* An indirect callee is stored as a PNWideSlotId */
+      PNInstructionCall* i = (PNInstructionCall*)inst;
+      *out_num_operands = i->num_args;
+      return i->arg_ids;
+    }
+
+    default:
+      break;
+  }
+
+  *out_num_operands = n;
+  return buffer;
+}
+
+static PNValueId pn_instruction_get_result_value_id(PNInstruction* inst) {
+  switch (inst->code) {
+    case PN_FUNCTION_CODE_INST_BINOP:
+      return ((PNInstructionBinop*)inst)->result_value_id;
+    case PN_FUNCTION_CODE_INST_CAST:
+      return ((PNInstructionCast*)inst)->result_value_id;
+    case PN_FUNCTION_CODE_INST_ALLOCA:
+      return ((PNInstructionAlloca*)inst)->result_value_id;
+    case PN_FUNCTION_CODE_INST_LOAD:
+      return ((PNInstructionLoad*)inst)->result_value_id;
+    case PN_FUNCTION_CODE_INST_CMP2:
+      return ((PNInstructionCmp2*)inst)->result_value_id;
+    case PN_FUNCTION_CODE_INST_VSELECT:
+      return ((PNInstructionVselect*)inst)->result_value_id;
+    case PN_FUNCTION_CODE_INST_CALL:
+    case PN_FUNCTION_CODE_INST_CALL_INDIRECT:
+      return ((PNInstructionCall*)inst)->result_value_id;
+    default:
+      return PN_INVALID_VALUE_ID;
+  }
+}
+
+/* Returns the number of scratch slots |function| needs; see
+ * PNFunction.num_scratch_slots. This is zero if every value fits in a
+ * PNSlotId, otherwise one for the result plus one per operand of the
+ * instruction with the most operands. */
+static uint32_t pn_function_count_scratch_slots(PNModule* module,
+                                                PNFunction* function) {
+  /* Upper bound on the module values in the constant pool */
+  uint32_t num_module_values = 0;
+  uint32_t max_operands = 0;
+  uint32_t n;
+  for (n = 0; n < function->num_bbs; ++n) {
+    PNBasicBlock* bb = &function->bbs[n];
+    PNInstruction* inst;
+    for (inst = bb->instructions; inst; inst = inst->next) {
+      PNValueId buffer[3];
+      uint32_t num_operands;
+      PNValueId* operands =
+          pn_instruction_get_slot_operands(inst, buffer, &num_operands);
+      uint32_t m;
+      for (m = 0; m < num_operands; ++m) {
+        num_module_values += operands[m] < module->num_values;
+      }
+      max_operands = pn_max(max_operands, num_operands);
+    }
+
+    uint32_t m;
+    for (m = 0; m < bb->num_phi_assigns; ++m) {
+      num_module_values +=
+          bb->phi_assigns[m].source_value_id < module->num_values;
+    }
+  }
+
+  if (function->num_frame_slots <= PN_MAX_SLOTS &&
+      function->num_constants + num_module_values <= PN_MAX_SLOTS) {
+    return 0;
+  }
+
+  PN_CHECK(function->num_args + 1 + max_operands <= PN_MAX_SLOTS);
+  return 1 + max_operands;
+}
+
+/* Returns the PNSlotId operand for |value_id|. Values that don't fit must
+ * have been staged in a scratch slot by pn_instruction_write_operand_moves.
+ */
+static PNSlotId pn_function_get_operand_slot(PNModule* module,
+                                             PNFunction* function,
+                                             PNValueId* scratch_value_ids,
+                                             PNValueId value_id) {
+  PNWideSlotId slot = pn_function_get_slot(module, function, value_id);
+  if (PN_WIDE_SLOT_FITS(slot) || slot == PN_INVALID_WIDE_SLOT_ID) {
+    return (PNSlotId)slot;
+  }
+
+  uint32_t n;
+  for (n = 0; n < function->num_scratch_slots; ++n) {
+    if (scratch_value_ids[n] == value_id) {
+      return PN_FRAME_SLOT(function->num_args + n);
+    }
+  }
+
+  PN_FATAL("Value %d has no slot operand\n", value_id);
+  return PN_INVALID_SLOT_ID;
+}
+
+static void* pn_runtime_instruction_write_move_wide(PNWideSlotId result,
+                                                    PNWideSlotId value,
+                                                    void* offset,
+                                                    PNBool write) {
+  if (write) {
+    PNRuntimeInstructionMoveWide* o = offset;
+    o->base.opcode = PN_OPCODE_MOVE_WIDE;
+#if PN_DIRECT_THREADED
+    o->base.handler = g_pn_opcode_handlers[o->base.opcode];
+#endif /* PN_DIRECT_THREADED */
+    o->result_value_id = result;
+    o->value_id = value;
+  }
+  return offset + sizeof(PNRuntimeInstructionMoveWide);
+}
+
+/* Writes a MOVE_WIDE before |inst| for each operand that doesn't fit in a
+ * PNSlotId, into scratch slots 1 and up. If the result doesn't fit either, it
+ * is assigned scratch slot 0 and must be moved out afterward; see
+ * pn_instruction_write_result_move. |scratch_value_ids| records the value
+ * each scratch slot holds. */
+static void* pn_instruction_write_operand_moves(PNModule* module,
+                                                PNFunction* function,
+                                                PNInstruction* inst,
+                                                PNValueId* scratch_value_ids,
+                                                void* offset,
+                                                PNBool write) {
+  PNValueId result_value_id = pn_instruction_get_result_value_id(inst);
+  PNWideSlotId result = pn_function_get_slot(module, function, result_value_id);
+  scratch_value_ids[0] = PN_WIDE_SLOT_FITS(result) ? PN_INVALID_VALUE_ID
+                                                   : result_value_id;
+
+  PNValueId buffer[3];
+  uint32_t num_operands;
+  PNValueId* operands =
+      pn_instruction_get_slot_operands(inst, buffer, &num_operands);
+  uint32_t num_scratch = 1;
+  uint32_t n;
+  for (n = 0; n < num_operands; ++n) {
+    PNWideSlotId slot = pn_function_get_slot(module, function, operands[n]);
+    if (PN_WIDE_SLOT_FITS(slot) || slot == PN_INVALID_WIDE_SLOT_ID) {
+      continue;
+    }
+
+    uint32_t m;
+    for (m = 1; m < num_scratch; ++m) {
+      if (scratch_value_ids[m] == operands[n]) {
+        break;
+      }
+    }
+
+    if (m == num_scratch) {
+      assert(num_scratch < function->num_scratch_slots);
+      scratch_value_ids[num_scratch++] = operands[n];
+      offset = pn_runtime_instruction_write_move_wide(
+          PN_FRAME_SLOT(function->num_args + m), slot, offset, write);
+    }
+  }
+
+  for (n = num_scratch; n < function->num_scratch_slots; ++n) {
+    scratch_value_ids[n] = PN_INVALID_VALUE_ID;
+  }
+  return offset;
+}
+
+static void* pn_instruction_write_result_move(PNModule* module,
+                                              PNFunction* function,
+                                              PNValueId* scratch_value_ids,
+                                              void* offset,
+                                              PNBool write) {
+  PNValueId result_value_id = scratch_value_ids[0];
+  if (result_value_id == PN_INVALID_VALUE_ID) {
+    return offset;
+  }
+
+  return pn_runtime_instruction_write_move_wide(
+      pn_function_get_slot(module, function, result_value_id),
+      PN_FRAME_SLOT(function->num_args), offset, write);
+}
+
+/* Returns the _IMM variant of |opcode|, or PN_MAX_OPCODE if there isn't one. */
+static PNOpcode pn_opcode_get_immediate(PNOpcode opcode) {
+  switch (opcode) {
+#define PN_OPCODE(e)            \
+  case PN_OPCODE_##e:           \
+    return PN_OPCODE_##e##_IMM;
+    PN_FOREACH_IMMEDIATE_OPCODE(PN_OPCODE)
+#undef PN_OPCODE
+    default:
+      return PN_MAX_OPCODE;
+  }
+}
+
+/* Returns the _INDEXED or _OFFSET variant of the load or store |opcode| that
+ * computes the address described by |index_id| and |offset|; see
+ * PNInstructionLoad. */
+static PNOpcode pn_opcode_get_address_mode(PNOpcode opcode,
+                                           PNValueId index_id,
+                                           uint32_t offset) {
+  switch (opcode) {
+#define PN_OPCODE(e)                          \
+  case PN_OPCODE_##e:                         \
+    if (index_id != PN_INVALID_VALUE_ID) {    \
+      return PN_OPCODE_##e##_INDEXED;         \
+    } else if (offset != 0) {                 \
+      return PN_OPCODE_##e##_OFFSET;          \
+    } else {                                  \
+      return opcode;                          \
+    }
+    PN_FOREACH_ADDRESS_MODE_OPCODE(PN_OPCODE)
+#undef PN_OPCODE
+    default:
+      return opcode;
+  }
+}
+
+/* Returns the superinstruction that runs |first| followed by |second|, or
+ * PN_MAX_OPCODE if there isn't one. */
+static PNOpcode pn_opcode_get_superinstruction(PNOpcode first,
+                                               PNOpcode second) {
+#define PN_SUPERINSTRUCTION(e0, e1, family, ...)             \
+  if (first == PN_OPCODE_##e0 && second == PN_OPCODE_##e1) { \
+    return PN_OPCODE_##e0##_THEN_##e1;                       \
+  }
+  PN_FOREACH_SUPERINSTRUCTION(PN_SUPERINSTRUCTION)
+#undef PN_SUPERINSTRUCTION
+  return PN_MAX_OPCODE;
+}
+
+/* Superinstructions are not used when instructions are traced or profiled one
+ * at a time. */
+static PNBool pn_superinstructions_enabled(void) {
+#if PN_TRACING
+  return !PN_IS_TRACE(EXECUTE) && !g_pn_opcode_pair_count;
+#else
+  return PN_TRUE;
+#endif /* PN_TRACING */
+}
+
+static int pn_runtime_switch_case_compare(const void* a, const void* b) {
+  int64_t value_a = ((const PNRuntimeSwitchCase*)a)->value;
+  int64_t value_b = ((const PNRuntimeSwitchCase*)b)->value;
+  return value_a < value_b ? -1 : value_a > value_b ? 1 : 0;
+}
+
+/* Chooses how a switch is searched at runtime. Small switches are scanned
+ * linearly, dense ones use a jump table and the rest are binary searched.
+ * |out_min_value| and |out_num_entries| are only set for
+ * PN_SWITCH_LAYOUT_TABLE. */
+static PNSwitchLayout pn_switch_choose_layout(PNInstructionSwitch* i,
+                                              PNBasicType basic_type,
+                                              int64_t* out_min_value,
+                                              uint32_t* out_num_entries) {
+  if (basic_type == PN_BASIC_TYPE_INT1 ||
+      i->num_cases <= PN_SWITCH_MAX_LINEAR_CASES) {
+    return PN_SWITCH_LAYOUT_LINEAR;
+  }
+
+  int64_t min_value = i->cases[0].value;
+  int64_t max_value = i->cases[0].value;
+  uint32_t c;
+  for (c = 1; c < i->num_cases; ++c) {
+    int64_t value = i->cases[c].value;
+    if (value < min_value) {
+      min_value = value;
+    }
+    if (value > max_value) {
+      max_value = value;
+    }
+  }
+
+  /* Computed unsigned, so a range spanning all of int64 wraps to 0. */
+  uint64_t range = (uint64_t)max_value - (uint64_t)min_value + 1;
+  if (range != 0 &&
+      range <= (uint64_t)i->num_cases * PN_SWITCH_MAX_TABLE_SPREAD) {
+    *out_min_value = min_value;
+    *out_num_entries = (uint32_t)range;
+    return PN_SWITCH_LAYOUT_TABLE;
+  }
+
+  return PN_SWITCH_LAYOUT_BSEARCH;
+}
+
+/* Returns whether |i| is directly followed by a return of its result (or a
+ * void return, if |i| returns void). The "tail" marker alone doesn't imply
+ * this. */
+static PNBool pn_instruction_call_is_in_tail_position(PNModule* module,
+                                                      PNInstructionCall* i) {
+  PNInstruction* next = i->base.next;
+  if (!next || next->code != PN_FUNCTION_CODE_INST_RET) {
+    return PN_FALSE;
+  }
+
+  PNInstructionRet* ret = (PNInstructionRet*)next;
+  PNType* return_type = &module->types[i->return_type_id];
+  if (return_type->code == PN_TYPE_CODE_VOID) {
+    return ret->value_id == PN_INVALID_VALUE_ID;
+  }
+  return ret->value_id == i->result_value_id;
+}
+
+/* Returns the instruction a branch from |bb| to |bb_id| should jump to. That
+ * is the edge's PHI_MOVES instruction if it has phi assigns (these are written
+ * at |phi_moves|, after the terminator), otherwise the basic block itself. */
+static void* pn_basic_block_get_edge_inst(PNBasicBlock* bb,
+                                          PNBasicBlockId bb_id,
+                                          void** bb_offsets,
+                                          void* phi_moves) {
+  uint32_t n = 0;
+  while (n < bb->num_phi_assigns) {
+    PNBasicBlockId edge_bb_id = bb->phi_assigns[n].bb_id;
+    uint32_t first = n;
+    while (n < bb->num_phi_assigns && bb->phi_assigns[n].bb_id == edge_bb_id) {
+      ++n;
+    }
+
+    if (edge_bb_id == bb_id) {
+      return phi_moves;
+    }
+
+    phi_moves += sizeof(PNRuntimeInstructionPhiMoves) +
+                 (n - first) * sizeof(PNRuntimePhiMove);
+  }
+  return bb_offsets[bb_id];
+}
+
+#if PN_CACHE
+static void pn_function_add_reloc(PNFunction* function,
+                                  PNRelocKind kind,
+                                  void* p) {
+  if (function->relocs) {
+    uint32_t offset = p - function->instructions;
+    function->relocs[function->num_relocs++] = (offset << 1) | kind;
+  }
+}
+
+#define PN_RELOC(kind, p) pn_function_add_reloc(function, PN_RELOC_##kind, p)
+#else
+#define PN_RELOC(kind, p) (void)0
+#endif /* PN_CACHE */
+
+static void* pn_basic_block_write_instruction_stream(
+    PNModule* module,
+    PNFunction* function,
+    PNBasicBlock* bb,
+    void** bb_offsets,
+    PNValueId* scratch_value_ids,
+    void* offset,
+    PNBool write) {
 #define PN_BEGIN_CASE_OPCODE(name) case PN_##name:
+#define PN_SLOT(id) \
+  pn_function_get_operand_slot(module, function, scratch_value_ids, id)
+#define PN_WIDE_SLOT(id) pn_function_get_slot(module, function, id)
+#define PN_EDGE_INST(bb_id, phi_moves) \
+  pn_basic_block_get_edge_inst(bb, bb_id, bb_offsets, phi_moves)
 
 #define PN_IF_TYPE(name, type0)                  \
   if (basic_type0 == PN_BASIC_TYPE_##type0) {    \
@@ -44,9 +511,18 @@ static void* pn_basic_block_write_instruction_stream(PNModule* module,
   }                                                                    \
   break;
 
-  PNBool write_phi_assigns = PN_FALSE;
+  PNBool write_phi_moves = PN_FALSE;
+  PNBool fuse = write && pn_superinstructions_enabled();
+  PNRuntimeInstruction* prev_inst = NULL;
+  void* prev_end = NULL;
   PNInstruction* inst;
   for (inst = bb->instructions; inst; inst = inst->next) {
+    if (function->num_scratch_slots) {
+      offset = pn_instruction_write_operand_moves(
+          module, function, inst, scratch_value_ids, offset, write);
+    }
+
+    void* inst_offset = offset;
     switch (inst->code) {
       case PN_FUNCTION_CODE_INST_BINOP: {
         if (write) {
@@ -168,9 +644,16 @@ static void* pn_basic_block_write_instruction_stream(PNModule* module,
             // clang-format on
           }
 
-          o->result_value_id = i->result_value_id;
-          o->value0_id = i->value0_id;
-          o->value1_id = i->value1_id;
+          o->result_value_id = PN_SLOT(i->result_value_id);
+          o->value0_id = PN_SLOT(i->value0_id);
+          PNOpcode imm_opcode = pn_opcode_get_immediate(o->base.opcode);
+          if (imm_opcode != PN_MAX_OPCODE &&
+              value1->code == PN_VALUE_CODE_CONSTANT) {
+            o->base.opcode = imm_opcode;
+            o->value1 = function->constants[value1->index].value.u32;
+          } else {
+            o->value1_id = PN_SLOT(i->value1_id);
+          }
         }
         offset += sizeof(PNRuntimeInstructionBinop);
         break;
@@ -288,8 +771,8 @@ static void* pn_basic_block_write_instruction_stream(PNModule* module,
             // clang-format on
           }
 
-          o->result_value_id = i->result_value_id;
-          o->value_id = i->value_id;
+          o->result_value_id = PN_SLOT(i->result_value_id);
+          o->value_id = PN_SLOT(i->value_id);
         }
         offset += sizeof(PNRuntimeInstructionCast);
         break;
@@ -302,7 +785,7 @@ static void* pn_basic_block_write_instruction_stream(PNModule* module,
             PNRuntimeInstructionRetValue* o =
                 (PNRuntimeInstructionRetValue*)offset;
             o->base.opcode = PN_OPCODE_RET_VALUE;
-            o->value_id = i->value_id;
+            o->value_id = PN_SLOT(i->value_id);
           }
           offset += sizeof(PNRuntimeInstructionRetValue);
         } else {
@@ -328,53 +811,119 @@ static void* pn_basic_block_write_instruction_stream(PNModule* module,
             PN_IF_TYPE(BR, INT1)
             PN_END_IF_TYPE(BR)
 
-            o->value_id = i->value_id;
-            o->true_inst = bb_offsets[i->true_bb_id];
-            o->false_inst = bb_offsets[i->false_bb_id];
+            void* phi_moves = offset + sizeof(PNRuntimeInstructionBrInt1);
+            o->value_id = PN_SLOT(i->value_id);
+            o->true_inst = PN_EDGE_INST(i->true_bb_id, phi_moves);
+            o->false_inst = PN_EDGE_INST(i->false_bb_id, phi_moves);
+            PN_RELOC(INSTRUCTION, &o->true_inst);
+            PN_RELOC(INSTRUCTION, &o->false_inst);
           }
           offset += sizeof(PNRuntimeInstructionBrInt1);
         } else {
           if (write) {
             PNRuntimeInstructionBr* o = (PNRuntimeInstructionBr*)offset;
+            void* phi_moves = offset + sizeof(PNRuntimeInstructionBr);
             o->base.opcode = PN_OPCODE_BR;
-            o->inst = bb_offsets[i->true_bb_id];
+            o->inst = PN_EDGE_INST(i->true_bb_id, phi_moves);
+            PN_RELOC(INSTRUCTION, &o->inst);
           }
           offset += sizeof(PNRuntimeInstructionBr);
         }
-        write_phi_assigns = PN_TRUE;
+        write_phi_moves = PN_TRUE;
         break;
       }
 
       case PN_FUNCTION_CODE_INST_SWITCH: {
         PNInstructionSwitch* i = (PNInstructionSwitch*)inst;
-        if (write) {
-          PNRuntimeInstructionSwitch* o = (PNRuntimeInstructionSwitch*)offset;
+        PNValue* value = pn_function_get_value(module, function, i->value_id);
+        PNBasicType basic_type0 = module->types[value->type_id].basic_type;
+        int64_t min_value = 0;
+        uint32_t num_entries = 0;
+        PNSwitchLayout layout =
+            pn_switch_choose_layout(i, basic_type0, &min_value, &num_entries);
+        uint32_t c;
 
-          PNValue* value = pn_function_get_value(module, function, i->value_id);
-          PNBasicType basic_type0 = module->types[value->type_id].basic_type;
+        if (layout == PN_SWITCH_LAYOUT_TABLE) {
+          void** table =
+              (void*)offset + sizeof(PNRuntimeInstructionSwitchTable);
+          if (write) {
+            PNRuntimeInstructionSwitchTable* o =
+                (PNRuntimeInstructionSwitchTable*)offset;
+
+            PN_IF_TYPE(SWITCH_TABLE, INT8)
+            PN_IF_TYPE(SWITCH_TABLE, INT16)
+            PN_IF_TYPE(SWITCH_TABLE, INT32)
+            PN_IF_TYPE(SWITCH_TABLE, INT64)
+            PN_END_IF_TYPE(SWITCH_TABLE)
+
+            void* phi_moves = &table[num_entries];
+            o->value_id = PN_SLOT(i->value_id);
+            o->default_inst = PN_EDGE_INST(i->default_bb_id, phi_moves);
+            o->min_value = min_value;
+            o->num_entries = num_entries;
+
+            for (c = 0; c < num_entries; ++c) {
+              table[c] = o->default_inst;
+            }
 
-          PN_IF_TYPE(SWITCH, INT1)
-          PN_IF_TYPE(SWITCH, INT8)
-          PN_IF_TYPE(SWITCH, INT16)
-          PN_IF_TYPE(SWITCH, INT32)
-          PN_IF_TYPE(SWITCH, INT64)
-          PN_END_IF_TYPE(SWITCH)
+            for (c = 0; c < i->num_cases; ++c) {
+              PNSwitchCase* switch_case = &i->cases[c];
+              uint64_t index =
+                  (uint64_t)switch_case->value - (uint64_t)min_value;
+              table[index] = PN_EDGE_INST(switch_case->bb_id, phi_moves);
+            }
 
-          o->value_id = i->value_id;
-          o->default_inst = bb_offsets[i->default_bb_id];
-          o->num_cases = i->num_cases;
-        }
-        offset += sizeof(PNRuntimeInstructionSwitch);
-        uint32_t c;
-        for (c = 0; c < i->num_cases; ++c) {
+            PN_RELOC(INSTRUCTION, &o->default_inst);
+            for (c = 0; c < num_entries; ++c) {
+              PN_RELOC(INSTRUCTION, &table[c]);
+            }
+          }
+          offset = (void*)table + num_entries * sizeof(void*);
+        } else {
+          PNRuntimeSwitchCase* cases =
+              (void*)offset + sizeof(PNRuntimeInstructionSwitch);
           if (write) {
-            PNRuntimeSwitchCase* switch_case =(PNRuntimeSwitchCase*)offset;
-            switch_case->value = i->cases[c].value;
-            switch_case->inst = bb_offsets[i->cases[c].bb_id];
+            PNRuntimeInstructionSwitch* o =
+                (PNRuntimeInstructionSwitch*)offset;
+
+            if (layout == PN_SWITCH_LAYOUT_BSEARCH) {
+              PN_IF_TYPE(SWITCH_BSEARCH, INT8)
+              PN_IF_TYPE(SWITCH_BSEARCH, INT16)
+              PN_IF_TYPE(SWITCH_BSEARCH, INT32)
+              PN_IF_TYPE(SWITCH_BSEARCH, INT64)
+              PN_END_IF_TYPE(SWITCH_BSEARCH)
+            } else {
+              PN_IF_TYPE(SWITCH, INT1)
+              PN_IF_TYPE(SWITCH, INT8)
+              PN_IF_TYPE(SWITCH, INT16)
+              PN_IF_TYPE(SWITCH, INT32)
+              PN_IF_TYPE(SWITCH, INT64)
+              PN_END_IF_TYPE(SWITCH)
+            }
+
+            void* phi_moves = &cases[i->num_cases];
+            o->value_id = PN_SLOT(i->value_id);
+            o->default_inst = PN_EDGE_INST(i->default_bb_id, phi_moves);
+            o->num_cases = i->num_cases;
+
+            for (c = 0; c < i->num_cases; ++c) {
+              cases[c].value = i->cases[c].value;
+              cases[c].inst = PN_EDGE_INST(i->cases[c].bb_id, phi_moves);
+            }
+
+            if (layout == PN_SWITCH_LAYOUT_BSEARCH) {
+              qsort(cases, i->num_cases, sizeof(PNRuntimeSwitchCase),
+                    pn_runtime_switch_case_compare);
+            }
+
+            PN_RELOC(INSTRUCTION, &o->default_inst);
+            for (c = 0; c < i->num_cases; ++c) {
+              PN_RELOC(INSTRUCTION, &cases[c].inst);
+            }
           }
-          offset += sizeof(PNRuntimeSwitchCase);
+          offset = (void*)cases + i->num_cases * sizeof(PNRuntimeSwitchCase);
         }
-        write_phi_assigns = PN_TRUE;
+        write_phi_moves = PN_TRUE;
         break;
       }
 
@@ -400,8 +949,8 @@ static void* pn_basic_block_write_instruction_stream(PNModule* module,
           PN_IF_TYPE(ALLOCA, INT32)
           PN_END_IF_TYPE(ALLOCA)
 
-          o->result_value_id = i->result_value_id;
-          o->size_id = i->size_id;
+          o->result_value_id = PN_SLOT(i->result_value_id);
+          o->size_id = PN_SLOT(i->size_id);
           o->alignment = i->alignment;
         }
         offset += sizeof(PNRuntimeInstructionAlloca);
@@ -409,8 +958,8 @@ static void* pn_basic_block_write_instruction_stream(PNModule* module,
       }
 
       case PN_FUNCTION_CODE_INST_LOAD: {
+        PNInstructionLoad* i = (PNInstructionLoad*)inst;
         if (write) {
-          PNInstructionLoad* i = (PNInstructionLoad*)inst;
           PNRuntimeInstructionLoad* o = (PNRuntimeInstructionLoad*)offset;
 
           PNBasicType basic_type0 = module->types[i->type_id].basic_type;
@@ -431,17 +980,34 @@ static void* pn_basic_block_write_instruction_stream(PNModule* module,
           PN_IF_TYPE(LOAD, INT64)
           PN_END_IF_TYPE(LOAD)
 
-          o->result_value_id = i->result_value_id;
-          o->src_id = i->src_id;
-          o->alignment = i->alignment;
+          o->base.opcode = pn_opcode_get_address_mode(o->base.opcode,
+                                                      i->index_id, i->offset);
+          o->result_value_id = PN_SLOT(i->result_value_id);
+          o->src_id = PN_SLOT(i->src_id);
+          if (i->index_id != PN_INVALID_VALUE_ID) {
+            PNRuntimeInstructionLoadIndexed* oi =
+                (PNRuntimeInstructionLoadIndexed*)o;
+            oi->index_id = PN_SLOT(i->index_id);
+            oi->scale = i->scale;
+          } else if (i->offset != 0) {
+            ((PNRuntimeInstructionLoadOffset*)o)->offset = i->offset;
+          } else {
+            o->alignment = i->alignment;
+          }
+        }
+        if (i->index_id != PN_INVALID_VALUE_ID) {
+          offset += sizeof(PNRuntimeInstructionLoadIndexed);
+        } else if (i->offset != 0) {
+          offset += sizeof(PNRuntimeInstructionLoadOffset);
+        } else {
+          offset += sizeof(PNRuntimeInstructionLoad);
         }
-        offset += sizeof(PNRuntimeInstructionLoad);
         break;
       }
 
       case PN_FUNCTION_CODE_INST_STORE: {
+        PNInstructionStore* i = (PNInstructionStore*)inst;
         if (write) {
-          PNInstructionStore* i = (PNInstructionStore*)inst;
           PNRuntimeInstructionStore* o = (PNRuntimeInstructionStore*)offset;
 
           PNValue* value = pn_function_get_value(module, function, i->value_id);
@@ -463,11 +1029,41 @@ static void* pn_basic_block_write_instruction_stream(PNModule* module,
           PN_IF_TYPE(STORE, INT64)
           PN_END_IF_TYPE(STORE)
 
-          o->dest_id = i->dest_id;
-          o->value_id = i->value_id;
-          o->alignment = i->alignment;
+          o->dest_id = PN_SLOT(i->dest_id);
+          if (i->index_id != PN_INVALID_VALUE_ID) {
+            PNRuntimeInstructionStoreIndexed* oi =
+                (PNRuntimeInstructionStoreIndexed*)o;
+            oi->base.opcode = pn_opcode_get_address_mode(
+                oi->base.opcode, i->index_id, i->offset);
+            oi->value_id = PN_SLOT(i->value_id);
+            oi->index_id = PN_SLOT(i->index_id);
+            oi->scale = i->scale;
+          } else if (i->offset != 0) {
+            PNRuntimeInstructionStoreOffset* oo =
+                (PNRuntimeInstructionStoreOffset*)o;
+            oo->base.opcode = pn_opcode_get_address_mode(
+                oo->base.opcode, i->index_id, i->offset);
+            oo->value_id = PN_SLOT(i->value_id);
+            oo->offset = i->offset;
+          } else {
+            PNOpcode imm_opcode = pn_opcode_get_immediate(o->base.opcode);
+            if (imm_opcode != PN_MAX_OPCODE &&
+                value->code == PN_VALUE_CODE_CONSTANT) {
+              o->base.opcode = imm_opcode;
+              o->value = function->constants[value->index].value.u32;
+            } else {
+              o->value_id = PN_SLOT(i->value_id);
+            }
+            o->alignment = i->alignment;
+          }
+        }
+        if (i->index_id != PN_INVALID_VALUE_ID) {
+          offset += sizeof(PNRuntimeInstructionStoreIndexed);
+        } else if (i->offset != 0) {
+          offset += sizeof(PNRuntimeInstructionStoreOffset);
+        } else {
+          offset += sizeof(PNRuntimeInstructionStore);
         }
-        offset += sizeof(PNRuntimeInstructionStore);
         break;
       }
 
@@ -639,9 +1235,16 @@ static void* pn_basic_block_write_instruction_stream(PNModule* module,
             // clang-format on
           }
 
-          o->result_value_id = i->result_value_id;
-          o->value0_id = i->value0_id;
-          o->value1_id = i->value1_id;
+          o->result_value_id = PN_SLOT(i->result_value_id);
+          o->value0_id = PN_SLOT(i->value0_id);
+          PNOpcode imm_opcode = pn_opcode_get_immediate(o->base.opcode);
+          if (imm_opcode != PN_MAX_OPCODE &&
+              value1->code == PN_VALUE_CODE_CONSTANT) {
+            o->base.opcode = imm_opcode;
+            o->value1 = function->constants[value1->index].value.u32;
+          } else {
+            o->value1_id = PN_SLOT(i->value1_id);
+          }
         }
         offset += sizeof(PNRuntimeInstructionCmp2);
         break;
@@ -675,10 +1278,10 @@ static void* pn_basic_block_write_instruction_stream(PNModule* module,
           }
 
           o->base.opcode = PN_OPCODE_VSELECT;
-          o->result_value_id = i->result_value_id;
-          o->cond_id = i->cond_id;
-          o->true_value_id = i->true_value_id;
-          o->false_value_id = i->false_value_id;
+          o->result_value_id = PN_SLOT(i->result_value_id);
+          o->cond_id = PN_SLOT(i->cond_id);
+          o->true_value_id = PN_SLOT(i->true_value_id);
+          o->false_value_id = PN_SLOT(i->false_value_id);
         }
         offset += sizeof(PNRuntimeInstructionVselect);
         break;
@@ -697,9 +1300,9 @@ static void* pn_basic_block_write_instruction_stream(PNModule* module,
             PNFunction* callee_function = &module->functions[callee->index];
             if (callee_function->intrinsic_id != PN_INTRINSIC_NULL) {
               switch (callee_function->intrinsic_id) {
-#define PN_INTRINSIC_CHECK(e, name)           \
-  case PN_INTRINSIC_##e:                      \
-    o->base.opcode = PN_OPCODE_INTRINSIC_##e; \
+#define PN_INTRINSIC_CHECK(e, name, num_args, result) \
+  case PN_INTRINSIC_##e:                              \
+    o->base.opcode = PN_OPCODE_INTRINSIC_##e;         \
     break;
               PN_FOREACH_INTRINSIC(PN_INTRINSIC_CHECK)
 #undef PN_INTRINSIC_CHECK
@@ -775,22 +1378,44 @@ static void* pn_basic_block_write_instruction_stream(PNModule* module,
 
           /* TODO(binji): check arg types against function type? */
           PNType* return_type = &module->types[i->return_type_id];
-          o->result_value_id = i->result_value_id;
-          o->callee_id = i->callee_id;
+          o->result_value_id = PN_SLOT(i->result_value_id);
+          o->callee_id =
+              i->is_indirect ? PN_WIDE_SLOT(i->callee_id) : i->callee_id;
           o->num_args = i->num_args;
           o->flags = (i->is_indirect ? PN_CALL_FLAGS_INDIRECT : 0);
           o->flags |= (i->is_tail_call ? PN_CALL_FLAGS_TAIL_CALL : 0);
           o->flags |= (return_type->code == PN_TYPE_CODE_VOID
                            ? PN_CALL_FLAGS_RETURN_TYPE_VOID
                            : 0);
+          if (o->base.opcode == PN_OPCODE_CALL && i->is_tail_call &&
+              pn_instruction_call_is_in_tail_position(module, i)) {
+            o->flags |= PN_CALL_FLAGS_REUSE_FRAME;
+          }
+          if (i->is_indirect) {
+            o->flags |= PN_CALL_FLAGS_CACHE_BUILTIN;
+            o->cache_pointer = 0;
+            o->cache_builtin = NULL;
+          } else if (o->base.opcode == PN_OPCODE_CALL) {
+            PNValue* callee =
+                pn_function_get_value(module, function, i->callee_id);
+            PNFunction* callee_function = &module->functions[callee->index];
+            if (callee_function->is_proto) {
+              /* Only intrinsics are declared without a body, and those are
+               * lowered to their own opcodes above. */
+              PN_CHECK(callee_function->name);
+              PN_FATAL("Unimplemented intrinsic: %s\n", callee_function->name);
+            }
+            o->callee = &callee_function->callee;
+            PN_RELOC(CALLEE, &o->callee);
+          }
         }
         offset += sizeof(PNRuntimeInstructionCall);
         uint32_t a;
         for (a = 0; a < i->num_args; ++a) {
           if (write) {
-            *(PNValueId*)offset = i->arg_ids[a];
+            *(PNSlotId*)offset = PN_SLOT(i->arg_ids[a]);
           }
-          offset += sizeof(PNValueId);
+          offset += sizeof(PNSlotId);
         }
         break;
       }
@@ -803,42 +1428,128 @@ static void* pn_basic_block_write_instruction_stream(PNModule* module,
         PN_FATAL("Invalid instruction code: %d\n", inst->code);
         break;
     }
-  }
-  if (write_phi_assigns) {
-    if (write) {
-      *(uint16_t*)offset = bb->num_phi_assigns;
-      *(uint16_t*)(offset + sizeof(uint16_t)) = bb->fast_phi_assign;
+
+    if (write && offset != inst_offset) {
+      PNRuntimeInstruction* o = inst_offset;
+#if PN_DIRECT_THREADED
+      o->handler = g_pn_opcode_handlers[o->opcode];
+#endif /* PN_DIRECT_THREADED */
+
+      /* Fuse with the previous instruction if nothing (e.g. a scratch move)
+       * was written between them. Only the first instruction is rewritten,
+       * so it is still fine to jump to the second. */
+      if (fuse && prev_inst && prev_end == inst_offset) {
+        PNOpcode opcode =
+            pn_opcode_get_superinstruction(prev_inst->opcode, o->opcode);
+        if (opcode != PN_MAX_OPCODE) {
+          prev_inst->opcode = opcode;
+#if PN_DIRECT_THREADED
+          prev_inst->handler = g_pn_opcode_handlers[opcode];
+#endif /* PN_DIRECT_THREADED */
+        }
+      }
+      prev_inst = o;
+      prev_end = offset;
+    }
+
+    if (function->num_scratch_slots) {
+      offset = pn_instruction_write_result_move(module, function,
+                                                scratch_value_ids, offset,
+                                                write);
     }
-    offset += sizeof(uint16_t) + sizeof(uint16_t);
-    uint32_t n;
-    for (n = 0; n < bb->num_phi_assigns; ++n) {
+  }
+  if (write_phi_moves) {
+    /* One PHI_MOVES instruction per outgoing edge that has phi assigns; see
+     * pn_basic_block_get_edge_inst. */
+    uint32_t n = 0;
+    while (n < bb->num_phi_assigns) {
+      PNBasicBlockId bb_id = bb->phi_assigns[n].bb_id;
+      PNRuntimeInstructionPhiMoves* o = (PNRuntimeInstructionPhiMoves*)offset;
+      PNRuntimePhiMove* moves = offset + sizeof(PNRuntimeInstructionPhiMoves);
+      uint32_t num_moves = 0;
+      for (; n < bb->num_phi_assigns && bb->phi_assigns[n].bb_id == bb_id;
+           ++n) {
+        if (write) {
+          PNRuntimePhiMove* move = &moves[num_moves];
+          move->source_value_id =
+              PN_WIDE_SLOT(bb->phi_assigns[n].source_value_id);
+          move->dest_value_id = PN_WIDE_SLOT(bb->phi_assigns[n].dest_value_id);
+        }
+        num_moves++;
+      }
+
       if (write) {
-        PNRuntimePhiAssign* o = (PNRuntimePhiAssign*)offset;
-        o->inst = bb_offsets[bb->phi_assigns[n].bb_id];
-        o->source_value_id = bb->phi_assigns[n].source_value_id;
-        o->dest_value_id = bb->phi_assigns[n].dest_value_id;
+        o->base.opcode = PN_OPCODE_PHI_MOVES;
+#if PN_DIRECT_THREADED
+        o->base.handler = g_pn_opcode_handlers[o->base.opcode];
+#endif /* PN_DIRECT_THREADED */
+        o->num_moves = num_moves;
+        o->inst = bb_offsets[bb_id];
+        PN_RELOC(INSTRUCTION, &o->inst);
       }
-      offset += sizeof(PNRuntimePhiAssign);
+      offset = &moves[num_moves];
     }
   }
   return offset;
 
 #undef PN_BEGIN_CASE_OPCODE
+#undef PN_SLOT
+#undef PN_WIDE_SLOT
+#undef PN_EDGE_INST
 #undef PN_IF_TYPE
 #undef PN_IF_TYPE2
 #undef PN_END_CASE_OPCODE
 #undef PN_END_CASE_OPCODE2
 }
 
+#undef PN_RELOC
+
+static void pn_function_init_callee(PNModule* module, PNFunction* function) {
+  PNCallee* callee = &function->callee;
+  callee->function = function;
+  callee->instructions = function->instructions;
+  callee->constant_pool = function->constant_pool;
+  callee->function_id = function - module->functions;
+  callee->num_args = function->num_args;
+  callee->frame_size =
+      pn_align_up(sizeof(PNCallFrame), PN_DEFAULT_ALIGN) +
+      sizeof(PNRuntimeValue) *
+          (function->num_frame_slots + function->num_scratch_slots);
+#if PN_NATIVE
+  callee->native = NULL;
+#endif /* PN_NATIVE */
+}
+
 static void pn_function_calculate_opcodes(PNModule* module,
                                           PNFunction* function) {
   PN_BEGIN_TIME(CALCULATE_OPCODES);
+#if PN_DIRECT_THREADED
+  if (!g_pn_opcode_handlers) {
+    pn_executor_init_opcode_handlers();
+  }
+#endif /* PN_DIRECT_THREADED */
   PNAllocatorMark mark = pn_allocator_mark(&module->temp_allocator);
 
   void** bb_offsets = pn_allocator_alloc(&module->temp_allocator,
                                          function->num_bbs * sizeof(void*),
                                          sizeof(PNBasicBlockId));
 
+  if (!module->module_value_slots) {
+    size_t size = module->num_values * sizeof(PNWideSlotId);
+    module->module_value_slots =
+        pn_allocator_alloc(&module->allocator, size, sizeof(PNWideSlotId));
+    memset(module->module_value_slots, 0xff, size);
+  }
+
+#if !PN_CALCULATE_LIVENESS
+  function->num_frame_slots = function->num_values - function->num_constants;
+#endif /* !PN_CALCULATE_LIVENESS */
+  function->num_scratch_slots =
+      pn_function_count_scratch_slots(module, function);
+  PNValueId* scratch_value_ids = pn_allocator_alloc(
+      &module->temp_allocator,
+      function->num_scratch_slots * sizeof(PNValueId), sizeof(PNValueId));
+
   void* offset = 0;
   uint32_t n;
   for (n = 0; n < function->num_bbs; ++n) {
@@ -846,7 +1557,8 @@ static void pn_function_calculate_opcodes(PNModule* module,
     offset = pn_align_up_pointer(offset, 4);
     bb_offsets[n] = offset;
     offset = pn_basic_block_write_instruction_stream(
-        module, function, &function->bbs[n], NULL, offset, PN_FALSE);
+        module, function, &function->bbs[n], NULL, scratch_value_ids, offset,
+        PN_FALSE);
   }
   /* Add size of trap instruction, to prevent falling off the end */
   offset += sizeof(PNRuntimeInstructionCall);
@@ -859,21 +1571,70 @@ static void pn_function_calculate_opcodes(PNModule* module,
     bb_offsets[n] = function->instructions + (size_t)bb_offsets[n];
   }
 
+#if PN_CACHE
+  function->num_relocs = 0;
+  function->relocs = NULL;
+  if (module->record_relocs) {
+    /* Each pointer takes sizeof(void*) bytes of the stream */
+    function->relocs = pn_allocator_alloc(
+        &module->temp_allocator,
+        (istream_size / sizeof(void*)) * sizeof(uint32_t), sizeof(uint32_t));
+  }
+#endif /* PN_CACHE */
+
   offset = function->instructions;
   for (n = 0; n < function->num_bbs; ++n) {
     offset = pn_align_up_pointer(offset, 4);
     PN_CHECK(offset == bb_offsets[n]);
     offset = pn_basic_block_write_instruction_stream(
-        module, function, &function->bbs[n], bb_offsets, offset, PN_TRUE);
+        module, function, &function->bbs[n], bb_offsets, scratch_value_ids,
+        offset, PN_TRUE);
   }
   /* Write trap instruction */
   PNRuntimeInstructionCall* trap = offset;
   trap->base.opcode = PN_OPCODE_INTRINSIC_LLVM_TRAP;
-  trap->result_value_id = PN_INVALID_VALUE_ID;
+  trap->result_value_id = PN_INVALID_SLOT_ID;
   trap->callee_id = PN_INVALID_VALUE_ID;
   trap->num_args = 0;
-  trap->flags = PN_CALL_FLAGS_INDIRECT | PN_CALL_FLAGS_RETURN_TYPE_VOID;
+  trap->flags = PN_CALL_FLAGS_INDIRECT | PN_CALL_FLAGS_RETURN_TYPE_VOID |
+                PN_CALL_FLAGS_CACHE_BUILTIN;
+  trap->cache_pointer = 0;
+  trap->cache_builtin = NULL;
+#if PN_DIRECT_THREADED
+  trap->base.handler = g_pn_opcode_handlers[trap->base.opcode];
+#endif /* PN_DIRECT_THREADED */
+
+#if PN_CACHE
+  if (function->relocs) {
+    uint32_t* relocs = pn_allocator_alloc(
+        &module->allocator, function->num_relocs * sizeof(uint32_t),
+        sizeof(uint32_t));
+    memcpy(relocs, function->relocs, function->num_relocs * sizeof(uint32_t));
+    function->relocs = relocs;
+  }
+#endif /* PN_CACHE */
+
+  function->instructions_size = istream_size;
+#if PN_JIT
+  function->jit_countdown = pn_function_get_jit_countdown();
+#endif /* PN_JIT */
+
+  function->constant_pool = pn_allocator_alloc(
+      &module->allocator,
+      sizeof(PNRuntimeValue) *
+          (function->num_constants + function->num_module_value_slots),
+      sizeof(PNRuntimeValue));
+  for (n = 0; n < function->num_constants; ++n) {
+    function->constant_pool[n] = function->constants[n].value;
+  }
+  for (n = 0; n < function->num_module_value_slots; ++n) {
+    PNValueId value_id = function->module_value_ids[n];
+    function->constant_pool[function->num_constants + n] =
+        pn_module_get_runtime_value(module, value_id);
+    module->module_value_slots[value_id] = PN_INVALID_WIDE_SLOT_ID;
+  }
 
+  pn_function_init_callee(module, function);
   pn_allocator_reset_to_mark(&module->temp_allocator, mark);
   PN_END_TIME(CALCULATE_OPCODES);
 }
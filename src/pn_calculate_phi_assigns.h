@@ -5,9 +5,98 @@
 #ifndef PN_CALCULATE_PHI_ASSIGNS_H_
 #define PN_CALCULATE_PHI_ASSIGNS_H_
 
+/* Appends the phi assigns of a single edge of |bb| to |bb->phi_assigns|,
+ * ordered so they can be executed one at a time. The phi assigns of an edge
+ * are a parallel copy; a move is only emitted once no other pending move
+ * reads its destination, and cycles are broken by moving one destination to
+ * a scratch value first. The scratch value is created on first use. */
+static void pn_basic_block_sequence_phi_assigns(PNModule* module,
+                                                PNFunction* function,
+                                                PNBasicBlock* bb,
+                                                PNPhiAssign* assigns,
+                                                uint32_t num_assigns,
+                                                PNValueId* scratch_value_id) {
+  PNAllocatorMark mark = pn_allocator_mark(&module->temp_allocator);
+  PNPhiAssign* pending = pn_allocator_alloc(
+      &module->temp_allocator, sizeof(PNPhiAssign) * num_assigns,
+      PN_DEFAULT_ALIGN);
+  uint32_t num_pending = 0;
+
+  uint32_t n;
+  for (n = 0; n < num_assigns; ++n) {
+    PNPhiAssign* assign = &assigns[n];
+    if (assign->source_value_id == assign->dest_value_id) {
+      continue;
+    }
+
+    /* Duplicate incoming edges from the same block produce the same
+     * assignment more than once. */
+    uint32_t m;
+    for (m = 0; m < num_pending; ++m) {
+      if (pending[m].dest_value_id == assign->dest_value_id) {
+        break;
+      }
+    }
+
+    if (m == num_pending) {
+      pending[num_pending++] = *assign;
+    }
+  }
+
+  while (num_pending > 0) {
+    PNBool progress = PN_FALSE;
+    for (n = 0; n < num_pending;) {
+      PNValueId dest_value_id = pending[n].dest_value_id;
+      uint32_t m;
+      for (m = 0; m < num_pending; ++m) {
+        if (m != n && pending[m].source_value_id == dest_value_id) {
+          break;
+        }
+      }
+
+      if (m == num_pending) {
+        bb->phi_assigns[bb->num_phi_assigns++] = pending[n];
+        pending[n] = pending[--num_pending];
+        progress = PN_TRUE;
+      } else {
+        ++n;
+      }
+    }
+
+    if (!progress) {
+      /* Every pending move is part of a cycle. */
+      PNValueId dest_value_id = pending[0].dest_value_id;
+      if (*scratch_value_id == PN_INVALID_VALUE_ID) {
+        PNValue* dest_value =
+            pn_function_get_value(module, function, dest_value_id);
+        PNTypeId type_id = dest_value->type_id;
+        PNValue* value =
+            pn_function_append_value(module, function, scratch_value_id);
+        value->code = PN_VALUE_CODE_LOCAL_VAR;
+        value->index = 0;
+        value->type_id = type_id;
+      }
+
+      PNPhiAssign* assign = &bb->phi_assigns[bb->num_phi_assigns++];
+      assign->bb_id = pending[0].bb_id;
+      assign->source_value_id = dest_value_id;
+      assign->dest_value_id = *scratch_value_id;
+
+      for (n = 0; n < num_pending; ++n) {
+        if (pending[n].source_value_id == dest_value_id) {
+          pending[n].source_value_id = *scratch_value_id;
+        }
+      }
+    }
+  }
+
+  pn_allocator_reset_to_mark(&module->temp_allocator, mark);
+}
+
 static void pn_function_calculate_phi_assigns(PNModule* module,
                                               PNFunction* function) {
   PN_BEGIN_TIME(CALCULATE_PHI_ASSIGNS);
+  PNAllocatorMark mark = pn_allocator_mark(&module->temp_allocator);
   uint32_t n;
   for (n = 0; n < function->num_bbs; ++n) {
     PNBasicBlock* bb = &function->bbs[n];
@@ -21,13 +110,21 @@ static void pn_function_calculate_phi_assigns(PNModule* module,
     }
   }
 
+  /* Gather the unordered assigns in temp memory; they are grouped by
+   * destination basic block because the outer loop is over the destination. */
+  PNPhiAssign** unordered_assigns = pn_allocator_alloc(
+      &module->temp_allocator, sizeof(PNPhiAssign*) * function->num_bbs,
+      PN_DEFAULT_ALIGN);
+  uint32_t* num_unordered_assigns = pn_allocator_alloc(
+      &module->temp_allocator, sizeof(uint32_t) * function->num_bbs,
+      PN_DEFAULT_ALIGN);
+
   for (n = 0; n < function->num_bbs; ++n) {
     PNBasicBlock* bb = &function->bbs[n];
-
-    bb->phi_assigns = pn_allocator_alloc(
-        &module->allocator, sizeof(PNPhiAssign) * bb->num_phi_assigns,
+    unordered_assigns[n] = pn_allocator_alloc(
+        &module->temp_allocator, sizeof(PNPhiAssign) * bb->num_phi_assigns,
         PN_DEFAULT_ALIGN);
-    bb->num_phi_assigns = 0;
+    num_unordered_assigns[n] = 0;
   }
 
   for (n = 0; n < function->num_bbs; ++n) {
@@ -35,9 +132,10 @@ static void pn_function_calculate_phi_assigns(PNModule* module,
     uint32_t m;
     for (m = 0; m < bb->num_phi_uses; ++m) {
       PNPhiUse* use = &bb->phi_uses[m];
-      PNBasicBlock* incoming_bb = &function->bbs[use->incoming.bb_id];
+      PNBasicBlockId incoming_bb_id = use->incoming.bb_id;
       PNPhiAssign* assign =
-          &incoming_bb->phi_assigns[incoming_bb->num_phi_assigns++];
+          &unordered_assigns[incoming_bb_id]
+                            [num_unordered_assigns[incoming_bb_id]++];
 
       assign->bb_id = n;
       assign->dest_value_id = use->dest_value_id;
@@ -45,41 +143,31 @@ static void pn_function_calculate_phi_assigns(PNModule* module,
     }
   }
 
-  PNAllocatorMark mark = pn_allocator_mark(&module->temp_allocator);
-  PNBitSet seen_bb;
-  pn_bitset_init(&module->temp_allocator, &seen_bb, function->num_bbs);
+  PNValueId scratch_value_id = PN_INVALID_VALUE_ID;
   for (n = 0; n < function->num_bbs; ++n) {
     PNBasicBlock* bb = &function->bbs[n];
-    pn_bitset_clear(&seen_bb);
+    PNPhiAssign* assigns = unordered_assigns[n];
+    uint32_t num_assigns = num_unordered_assigns[n];
 
-    bb->fast_phi_assign = PN_TRUE;
+    /* Breaking a cycle of length >= 2 takes one extra move. */
+    bb->phi_assigns = pn_allocator_alloc(
+        &module->allocator,
+        sizeof(PNPhiAssign) * (num_assigns + num_assigns / 2),
+        PN_DEFAULT_ALIGN);
+    bb->num_phi_assigns = 0;
 
-    uint32_t m;
     uint32_t first = 0;
-    PNBasicBlockId bb_id = PN_INVALID_BB_ID;
-    PNBool done = PN_FALSE;
-    for (m = 0; m < bb->num_phi_assigns && !done; ++m) {
-      PNPhiAssign* assign = &bb->phi_assigns[m];
-      if (bb_id == PN_INVALID_BB_ID &&
-          !pn_bitset_is_set(&seen_bb, assign->bb_id)) {
-        pn_bitset_set(&seen_bb, assign->bb_id, PN_TRUE);
-        bb_id = assign->bb_id;
+    uint32_t m;
+    for (m = 1; m <= num_assigns; ++m) {
+      if (m == num_assigns || assigns[m].bb_id != assigns[first].bb_id) {
+        pn_basic_block_sequence_phi_assigns(module, function, bb,
+                                            &assigns[first], m - first,
+                                            &scratch_value_id);
         first = m;
-      } else if (assign->bb_id == bb_id) {
-        /* Look backward to see if this assignment's source is a prior
-         * destination. If so, we won't be able to do this phi assign the
-         * fast way. */
-        uint32_t k;
-        for (k = first; k < m; ++k) {
-          if (assign->source_value_id == bb->phi_assigns[k].dest_value_id) {
-            bb->fast_phi_assign = PN_FALSE;
-            done = PN_TRUE;
-            break;
-          }
-        }
       }
     }
   }
+
   pn_allocator_reset_to_mark(&module->temp_allocator, mark);
   PN_END_TIME(CALCULATE_PHI_ASSIGNS);
 }
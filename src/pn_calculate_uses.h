@@ -9,6 +9,7 @@ static void pn_basic_block_calculate_uses(PNModule* module,
                                           PNFunction* function,
                                           PNBasicBlock* bb) {
 #if PN_CALCULATE_LIVENESS
+  PNAllocatorMark mark = pn_allocator_mark(&module->temp_allocator);
   PNValueId first_function_value_id =
       module->num_values + function->num_args + function->num_constants;
   PNBitSet uses;
@@ -81,6 +82,9 @@ static void pn_basic_block_calculate_uses(PNModule* module,
       case PN_FUNCTION_CODE_INST_LOAD: {
         PNInstructionLoad* i = (PNInstructionLoad*)inst;
         PN_SET_VALUE_USE(i->src_id);
+        if (i->index_id != PN_INVALID_VALUE_ID) {
+          PN_SET_VALUE_USE(i->index_id);
+        }
         break;
       }
 
@@ -88,6 +92,9 @@ static void pn_basic_block_calculate_uses(PNModule* module,
         PNInstructionStore* i = (PNInstructionStore*)inst;
         PN_SET_VALUE_USE(i->dest_id);
         PN_SET_VALUE_USE(i->value_id);
+        if (i->index_id != PN_INVALID_VALUE_ID) {
+          PN_SET_VALUE_USE(i->index_id);
+        }
         break;
       }
 
@@ -169,6 +176,7 @@ static void pn_basic_block_calculate_uses(PNModule* module,
       }
     }
   }
+  pn_allocator_reset_to_mark(&module->temp_allocator, mark);
 #endif /* PN_CALCULATE_LIVENESS */
 
 #undef PN_SET_VALUE_USE
@@ -27,33 +27,21 @@ PN_DEFINE_EXECUTOR_VALUE_CONSTRUCTOR(f64, double)
 
 #undef PN_DEFINE_EXECUTOR_VALUE_CONSTRUCTOR
 
-static PNRuntimeValue pn_thread_get_value(PNThread* thread,
-                                          PNValueId value_id) {
-  if (value_id >= thread->executor->module->num_values) {
-    value_id -= thread->executor->module->num_values;
-    return thread->current_frame->function_values[value_id];
-  } else {
-    return thread->executor->module_values[value_id];
-  }
+static PNRuntimeValue pn_frame_get_value(PNCallFrame* frame, PNSlotId slot) {
+  PNRuntimeValue* values =
+      PN_SLOT_IS_CONSTANT(slot) ? frame->constants : frame->function_values;
+  return values[PN_SLOT_INDEX(slot)];
 }
 
-static PNRuntimeValue pn_executor_get_value_from_frame(PNExecutor* executor,
-                                                       PNCallFrame* frame,
-                                                       PNValueId value_id) {
-  if (value_id >= executor->module->num_values) {
-    value_id -= executor->module->num_values;
-    return frame->function_values[value_id];
-  } else {
-    return executor->module_values[value_id];
-  }
+static PNRuntimeValue pn_thread_get_value(PNThread* thread, PNSlotId slot) {
+  return pn_frame_get_value(thread->current_frame, slot);
 }
 
 static void pn_thread_set_value(PNThread* thread,
-                                PNValueId value_id,
+                                PNSlotId slot,
                                 PNRuntimeValue value) {
-  assert(value_id >= thread->executor->module->num_values);
-  value_id -= thread->executor->module->num_values;
-  thread->current_frame->function_values[value_id] = value;
+  assert(!PN_SLOT_IS_CONSTANT(slot));
+  thread->current_frame->function_values[PN_SLOT_INDEX(slot)] = value;
 }
 
 static void pn_thread_set_param_value(PNThread* thread,
@@ -62,71 +50,65 @@ static void pn_thread_set_param_value(PNThread* thread,
   thread->current_frame->function_values[index] = value;
 }
 
-static void pn_executor_init_module_values(PNExecutor* executor) {
-  PNModule* module = executor->module;
-  executor->module_values = pn_allocator_alloc(
-      &executor->allocator, sizeof(PNRuntimeValue) * module->num_values,
-      sizeof(PNRuntimeValue));
-
-  PNValueId value_id;
-  for (value_id = 0; value_id < module->num_values; ++value_id) {
-    PNValue* value = &module->values[value_id];
-    switch (value->code) {
-      case PN_VALUE_CODE_FUNCTION:
-        executor->module_values[value_id].u32 =
-            pn_function_id_to_pointer(value->index);
-        break;
-
-      case PN_VALUE_CODE_GLOBAL_VAR: {
-        PNGlobalVar* global_var = &module->global_vars[value->index];
-        executor->module_values[value_id].u32 = global_var->offset;
-        break;
-      }
-
-      default:
-        PN_UNREACHABLE();
-        break;
-    }
-  }
-}
-
-static void pn_thread_push_function(PNThread* thread,
-                                    PNFunctionId function_id,
-                                    PNFunction* function) {
-  PNCallFrame* frame = pn_allocator_alloc(
-      &thread->allocator, sizeof(PNCallFrame), PN_DEFAULT_ALIGN);
+static void pn_thread_push_callee(PNThread* thread, PNCallee* callee) {
+  /* The frame's values are allocated directly after the frame */
+  PNCallFrame* frame =
+      pn_frame_stack_alloc(&thread->frame_stack, callee->frame_size);
   PNCallFrame* prev_frame = thread->current_frame;
 
-  frame->location.function_id = function_id;
-  frame->location.inst = function->instructions;
-  frame->function_values = pn_allocator_alloc(
-      &thread->allocator, sizeof(PNRuntimeValue) * function->num_values,
-      sizeof(PNRuntimeValue));
+  frame->location.function_id = callee->function_id;
+  frame->location.inst = callee->instructions;
+  frame->function_values =
+      (void*)frame + pn_align_up(sizeof(PNCallFrame), PN_DEFAULT_ALIGN);
+  frame->constants = callee->constant_pool;
   frame->memory_stack_top = prev_frame->memory_stack_top;
   frame->parent = prev_frame;
-  frame->jmpbuf_head = NULL;
-  frame->mark = pn_allocator_mark(&thread->allocator);
+  frame->jmpbuf_base = thread->num_jmpbufs;
 
   thread->current_frame = frame;
-  thread->function = function;
-  thread->inst = function->instructions;
-  if (thread->inst == NULL) {
-    PN_CHECK(function->name);
-    PN_FATAL("Unimplemented intrinsic: %s\n", function->name);
+  thread->function = callee->function;
+  thread->inst = callee->instructions;
+}
+
+/* Replaces the current frame, which belongs to |caller|, with a frame for
+ * |callee|. The frame's values are kept, so the caller must read the args
+ * before overwriting them. Returns PN_FALSE if the frame can't be reused: it
+ * isn't on top of the frame stack, or the callee's frame doesn't fit there. */
+static PNBool pn_thread_replace_frame(PNThread* thread,
+                                      PNFunction* caller,
+                                      PNCallee* callee) {
+  PNFrameStack* stack = &thread->frame_stack;
+  PNCallFrame* frame = thread->current_frame;
+  if ((void*)frame + caller->callee.frame_size != stack->top ||
+      callee->frame_size > (size_t)(stack->end - (void*)frame)) {
+    return PN_FALSE;
+  }
+
+  /* As far as its jmpbufs are concerned, the caller has returned */
+  thread->num_jmpbufs = frame->jmpbuf_base;
+  /* A tail call can't use the caller's allocas, so free them. A thread's
+   * first frame has its own stack top, not the sentinel's, so keep it. */
+  if (frame->parent != &thread->executor->sentinel_frame) {
+    frame->memory_stack_top = frame->parent->memory_stack_top;
   }
+  stack->top = (void*)frame + callee->frame_size;
+  frame->location.function_id = callee->function_id;
+  frame->location.inst = callee->instructions;
+  frame->constants = callee->constant_pool;
+  thread->function = callee->function;
+  thread->inst = callee->instructions;
+  return PN_TRUE;
+}
 
-  uint32_t n;
-  for (n = 0; n < function->num_constants; ++n) {
-    PNConstant* constant = &function->constants[n];
-    PNValueId value_id =
-        thread->executor->module->num_values + function->num_args + n;
-#ifndef NDEBUG
-    PNValue* value =
-        pn_function_get_value(thread->executor->module, function, value_id);
-    assert(value->code == PN_VALUE_CODE_CONSTANT);
-#endif /* NDEBUG */
-    pn_thread_set_value(thread, value_id, constant->value);
+static void pn_thread_push_function(PNThread* thread, PNFunction* function) {
+  if (function->instructions == NULL) {
+    if (function->lazy_bit_offset == 0) {
+      PN_CHECK(function->name);
+      PN_FATAL("Unimplemented intrinsic: %s\n", function->name);
+    }
+    pn_module_read_lazy_function(thread->module, function);
   }
+  pn_thread_push_callee(thread, &function->callee);
 }
 
 static PNFunction* pn_thread_push_function_pointer(PNThread* thread,
@@ -135,56 +117,23 @@ static PNFunction* pn_thread_push_function_pointer(PNThread* thread,
   function_id -= PN_MAX_BUILTINS;
   pn_function_id_check(thread->module, function_id);
   PNFunction* function = &thread->module->functions[function_id];
-  pn_thread_push_function(thread, function_id, function);
+  pn_thread_push_function(thread, function);
   return function;
 }
 
-static void pn_thread_do_phi_assigns(PNThread* thread,
-                                     PNFunction* function,
-                                     void* dest_inst) {
-  void* istream = thread->inst;
-  uint16_t num_phi_assigns = *(uint16_t*)istream;
-  istream += sizeof(uint16_t);
-  uint16_t fast_phi_assign = *(uint16_t*)istream;
-  istream += sizeof(uint16_t);
-  PNRuntimePhiAssign* phi_assigns = (PNRuntimePhiAssign*)istream;
-  istream += num_phi_assigns * sizeof(PNRuntimePhiAssign);
-
-  PNModule* module = thread->executor->module;
-  (void)module;
-
-  if (fast_phi_assign) {
-    uint32_t i;
-    for (i = 0; i < num_phi_assigns; ++i) {
-      PNRuntimePhiAssign* assign = &phi_assigns[i];
-      if (assign->inst == dest_inst) {
-        PNRuntimeValue value =
-            pn_thread_get_value(thread, phi_assigns[i].source_value_id);
-        pn_thread_set_value(thread, assign->dest_value_id, value);
-      }
-    }
-  } else {
-    PNAllocatorMark mark = pn_allocator_mark(&thread->allocator);
-    PNRuntimeValue* temp = pn_allocator_alloc(
-        &thread->allocator, sizeof(PNRuntimeValue) * num_phi_assigns,
-        sizeof(PNRuntimeValue));
-
-    /* First pass, read values to temp */
-    uint32_t i;
-    for (i = 0; i < num_phi_assigns; ++i) {
-      temp[i] = pn_thread_get_value(thread, phi_assigns[i].source_value_id);
-    }
-
-    /* Second pass, write values from temp */
-    for (i = 0; i < num_phi_assigns; ++i) {
-      PNRuntimePhiAssign* assign = &phi_assigns[i];
-      if (assign->inst == dest_inst) {
-        pn_thread_set_value(thread, assign->dest_value_id, temp[i]);
-      }
-    }
-
-    pn_allocator_reset_to_mark(&thread->allocator, mark);
+/* Chooses the cheapest executor variant that supports the flags in use. */
+static PNExecutorVariant pn_executor_get_variant(void) {
+#if PN_TRACING
+  if (PN_IS_TRACE(EXECUTE) || PN_IS_TRACE(INTRINSICS) || PN_IS_TRACE(MEMORY)) {
+    return PN_EXECUTOR_VARIANT_TRACING;
+  } else if (g_pn_opcode_pair_count) {
+    return PN_EXECUTOR_VARIANT_PROFILING;
+  }
+#endif /* PN_TRACING */
+  if (g_pn_print_opcode_counts || g_pn_print_stats) {
+    return PN_EXECUTOR_VARIANT_COUNTING;
   }
+  return PN_EXECUTOR_VARIANT_FAST;
 }
 
 void pn_executor_init(PNExecutor* executor, PNModule* module) {
@@ -195,8 +144,8 @@ void pn_executor_init(PNExecutor* executor, PNModule* module) {
   executor->heap_end = executor->memory->heap_start;
   executor->sentinel_frame.location.function_id = PN_INVALID_FUNCTION_ID;
   executor->sentinel_frame.memory_stack_top = executor->memory->stack_end;
-  executor->sentinel_frame.mark = pn_allocator_mark(&executor->allocator);
   executor->main_thread = &executor->start_thread;
+  executor->variant = pn_executor_get_variant();
 
   PN_CHECK(pn_is_aligned(executor->memory->size, PN_PAGESIZE));
   PN_CHECK(pn_is_aligned(executor->memory->heap_start, PN_PAGESIZE));
@@ -225,10 +174,7 @@ void pn_executor_init(PNExecutor* executor, PNModule* module) {
   executor->fd_map[1] = 1;
   executor->fd_map[2] = 2;
 
-  pn_executor_init_module_values(executor);
-
   PNThread* thread = &executor->start_thread;
-  pn_allocator_init(&thread->allocator, PN_MIN_CHUNKSIZE, "main thread");
   thread->current_frame = &executor->sentinel_frame;
   thread->tls = 0;
   thread->id = executor->next_thread_id++;
@@ -241,16 +187,14 @@ void pn_executor_init(PNExecutor* executor, PNModule* module) {
   PNFunctionId start_function_id = module->known_functions[PN_INTRINSIC_START];
   PN_CHECK(start_function_id != PN_INVALID_FUNCTION_ID);
   PNFunction* start_function = &module->functions[start_function_id];
-  PN_CHECK(start_function->instructions);
 
-  pn_thread_push_function(thread, start_function_id, start_function);
+  pn_thread_push_function(thread, start_function);
 
   PN_CHECK(start_function->num_args == 1);
 
-  PNValueId value_id = executor->module->num_values;
   PNRuntimeValue value;
   value.u32 = executor->memory->startinfo_start;
-  pn_thread_set_value(thread, value_id, value);
+  pn_thread_set_param_value(thread, 0, value);
 }
 
 #if PN_TRACING
@@ -277,1124 +221,180 @@ static void pn_thread_backtrace(PNThread* thread) {
 static void pn_thread_backtrace(PNThread* thread) {}
 #endif
 
-static void pn_thread_execute_instruction(PNThread* thread) {
-  PNModule* module = thread->module;
-  PNFunction* function = thread->function;
-  PNRuntimeInstruction* inst = thread->inst;
-
-  g_pn_opcode_count[inst->opcode]++;
-
-  switch (inst->opcode) {
-    case PN_OPCODE_ALLOCA_INT32: {
-      PNRuntimeInstructionAlloca* i = (PNRuntimeInstructionAlloca*)inst;
-      PNRuntimeValue size = pn_thread_get_value(thread, i->size_id);
-      thread->current_frame->memory_stack_top = pn_align_down(
-          thread->current_frame->memory_stack_top - size.i32, i->alignment);
-      if (thread == thread->executor->main_thread &&
-          thread->current_frame->memory_stack_top <
-              thread->executor->heap_end) {
-        PN_FATAL("Out of stack\n");
-        break;
-      }
-      PNRuntimeValue result;
-      result.u32 = thread->current_frame->memory_stack_top;
-      pn_thread_set_value(thread, i->result_value_id, result);
-      thread->inst += sizeof(PNRuntimeInstructionAlloca);
-      break;
-    }
-
-#define PN_OPCODE_BINOP(op, ty)                                             \
-  do {                                                                      \
-    PNRuntimeInstructionBinop* i = (PNRuntimeInstructionBinop*)inst;        \
-    PNRuntimeValue value0 = pn_thread_get_value(thread, i->value0_id);      \
-    PNRuntimeValue value1 = pn_thread_get_value(thread, i->value1_id);      \
-    PNRuntimeValue result = pn_executor_value_##ty(value0.ty op value1.ty); \
-    pn_thread_set_value(thread, i->result_value_id, result);                \
-    thread->inst += sizeof(PNRuntimeInstructionBinop);                      \
-  } while (0) /* no semicolon */
-
-    // clang-format off
-    case PN_OPCODE_BINOP_ADD_DOUBLE:  PN_OPCODE_BINOP(+, f64); break;
-    case PN_OPCODE_BINOP_ADD_FLOAT:   PN_OPCODE_BINOP(+, f32); break;
-    case PN_OPCODE_BINOP_ADD_INT8:    PN_OPCODE_BINOP(+, u8); break;
-    case PN_OPCODE_BINOP_ADD_INT16:   PN_OPCODE_BINOP(+, u16); break;
-    case PN_OPCODE_BINOP_ADD_INT32:   PN_OPCODE_BINOP(+, u32); break;
-    case PN_OPCODE_BINOP_ADD_INT64:   PN_OPCODE_BINOP(+, u64); break;
-    case PN_OPCODE_BINOP_AND_INT1:
-    case PN_OPCODE_BINOP_AND_INT8:    PN_OPCODE_BINOP(&, u8); break;
-    case PN_OPCODE_BINOP_AND_INT16:   PN_OPCODE_BINOP(&, u16); break;
-    case PN_OPCODE_BINOP_AND_INT32:   PN_OPCODE_BINOP(&, u32); break;
-    case PN_OPCODE_BINOP_AND_INT64:   PN_OPCODE_BINOP(&, u64); break;
-    case PN_OPCODE_BINOP_ASHR_INT8:   PN_OPCODE_BINOP(>>, i8); break;
-    case PN_OPCODE_BINOP_ASHR_INT16:  PN_OPCODE_BINOP(>>, i16); break;
-    case PN_OPCODE_BINOP_ASHR_INT32:  PN_OPCODE_BINOP(>>, i32); break;
-    case PN_OPCODE_BINOP_ASHR_INT64:  PN_OPCODE_BINOP(>>, i64); break;
-    case PN_OPCODE_BINOP_LSHR_INT8:   PN_OPCODE_BINOP(>>, u8); break;
-    case PN_OPCODE_BINOP_LSHR_INT16:  PN_OPCODE_BINOP(>>, u16); break;
-    case PN_OPCODE_BINOP_LSHR_INT32:  PN_OPCODE_BINOP(>>, u32); break;
-    case PN_OPCODE_BINOP_LSHR_INT64:  PN_OPCODE_BINOP(>>, u64); break;
-    case PN_OPCODE_BINOP_MUL_DOUBLE:  PN_OPCODE_BINOP(*, f64); break;
-    case PN_OPCODE_BINOP_MUL_FLOAT:   PN_OPCODE_BINOP(*, f32); break;
-    case PN_OPCODE_BINOP_MUL_INT8:    PN_OPCODE_BINOP(*, u8); break;
-    case PN_OPCODE_BINOP_MUL_INT16:   PN_OPCODE_BINOP(*, u16); break;
-    case PN_OPCODE_BINOP_MUL_INT32:   PN_OPCODE_BINOP(*, u32); break;
-    case PN_OPCODE_BINOP_MUL_INT64:   PN_OPCODE_BINOP(*, u64); break;
-    case PN_OPCODE_BINOP_OR_INT1:
-    case PN_OPCODE_BINOP_OR_INT8:     PN_OPCODE_BINOP(|, u8); break;
-    case PN_OPCODE_BINOP_OR_INT16:    PN_OPCODE_BINOP(|, u16); break;
-    case PN_OPCODE_BINOP_OR_INT32:    PN_OPCODE_BINOP(|, u32); break;
-    case PN_OPCODE_BINOP_OR_INT64:    PN_OPCODE_BINOP(|, u64); break;
-    case PN_OPCODE_BINOP_SDIV_DOUBLE: PN_OPCODE_BINOP(/, f64); break;
-    case PN_OPCODE_BINOP_SDIV_FLOAT:  PN_OPCODE_BINOP(/, f32); break;
-    case PN_OPCODE_BINOP_SDIV_INT32:  PN_OPCODE_BINOP(/, i32); break;
-    case PN_OPCODE_BINOP_SDIV_INT64:  PN_OPCODE_BINOP(/, i64); break;
-    case PN_OPCODE_BINOP_SHL_INT8:    PN_OPCODE_BINOP(<<, u8); break;
-    case PN_OPCODE_BINOP_SHL_INT16:   PN_OPCODE_BINOP(<<, u16); break;
-    case PN_OPCODE_BINOP_SHL_INT32:   PN_OPCODE_BINOP(<<, u32); break;
-    case PN_OPCODE_BINOP_SHL_INT64:   PN_OPCODE_BINOP(<<, u64); break;
-    case PN_OPCODE_BINOP_SREM_INT32:  PN_OPCODE_BINOP(%, i32); break;
-    case PN_OPCODE_BINOP_SREM_INT64:  PN_OPCODE_BINOP(%, i64); break;
-    case PN_OPCODE_BINOP_SUB_DOUBLE:  PN_OPCODE_BINOP(-, f64); break;
-    case PN_OPCODE_BINOP_SUB_FLOAT:   PN_OPCODE_BINOP(-, f32); break;
-    case PN_OPCODE_BINOP_SUB_INT8:    PN_OPCODE_BINOP(-, u8); break;
-    case PN_OPCODE_BINOP_SUB_INT16:   PN_OPCODE_BINOP(-, u16); break;
-    case PN_OPCODE_BINOP_SUB_INT32:   PN_OPCODE_BINOP(-, u32); break;
-    case PN_OPCODE_BINOP_SUB_INT64:   PN_OPCODE_BINOP(-, u64); break;
-    case PN_OPCODE_BINOP_UDIV_INT8:   PN_OPCODE_BINOP(/, u8); break;
-    case PN_OPCODE_BINOP_UDIV_INT16:  PN_OPCODE_BINOP(/, u16); break;
-    case PN_OPCODE_BINOP_UDIV_INT32:  PN_OPCODE_BINOP(/, u32); break;
-    case PN_OPCODE_BINOP_UDIV_INT64:  PN_OPCODE_BINOP(/, u64); break;
-    case PN_OPCODE_BINOP_UREM_INT8:   PN_OPCODE_BINOP(%, u8); break;
-    case PN_OPCODE_BINOP_UREM_INT16:  PN_OPCODE_BINOP(%, u16); break;
-    case PN_OPCODE_BINOP_UREM_INT32:  PN_OPCODE_BINOP(%, u32); break;
-    case PN_OPCODE_BINOP_UREM_INT64:  PN_OPCODE_BINOP(%, u64); break;
-    case PN_OPCODE_BINOP_XOR_INT1:
-    case PN_OPCODE_BINOP_XOR_INT8:    PN_OPCODE_BINOP(^, u8); break;
-    case PN_OPCODE_BINOP_XOR_INT16:   PN_OPCODE_BINOP(^, u16); break;
-    case PN_OPCODE_BINOP_XOR_INT32:   PN_OPCODE_BINOP(^, u32); break;
-    case PN_OPCODE_BINOP_XOR_INT64:   PN_OPCODE_BINOP(^, u64); break;
-// clang-format on
-
-#undef PN_OPCODE_BINOP
-
-    case PN_OPCODE_BR: {
-      PNRuntimeInstructionBr* i = (PNRuntimeInstructionBr*)inst;
-      void* new_inst = i->inst;
-      thread->inst += sizeof(PNRuntimeInstructionBr);
-      pn_thread_do_phi_assigns(thread, function, new_inst);
-      thread->inst = new_inst;
-      break;
-    }
-
-    case PN_OPCODE_BR_INT1: {
-      PNRuntimeInstructionBrInt1* i = (PNRuntimeInstructionBrInt1*)inst;
-      PNRuntimeValue value = pn_thread_get_value(thread, i->value_id);
-      void* new_inst = value.u8 ? i->true_inst : i->false_inst;
-      thread->inst += sizeof(PNRuntimeInstructionBrInt1);
-      pn_thread_do_phi_assigns(thread, function, new_inst);
-      thread->inst = new_inst;
-      break;
-    }
-
-    case PN_OPCODE_CALL: {
-      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
-      PNCallFrame* old_frame = thread->current_frame;
-      old_frame->location.inst = thread->inst;
-
-      PNFunctionId new_function_id;
-      if (i->flags & PN_CALL_FLAGS_INDIRECT) {
-        PNRuntimeValue function_value =
-            pn_thread_get_value(thread, i->callee_id);
-        PNFunctionId callee_function_id =
-            pn_function_pointer_to_index(function_value.u32);
-        if (callee_function_id < PN_MAX_BUILTINS) {
-          /* Builtin function. Call it directly, don't set up a new frame */
-          switch (callee_function_id) {
-#define PN_BUILTIN(e)                                           \
-  case PN_BUILTIN_##e: {                                        \
-    PNRuntimeValue result =                                     \
-        pn_builtin_##e(thread, function, i->num_args, arg_ids); \
-    if (i->result_value_id != PN_INVALID_VALUE_ID) {            \
-      pn_thread_set_value(thread, i->result_value_id, result);  \
-    }                                                           \
-    break;                                                      \
-  }
-            PN_FOREACH_BUILTIN(PN_BUILTIN)
+/* Indexed by PNBuiltinId. PN_BUILTIN_NULL has no handler. */
+static const PNBuiltin g_pn_builtins[PN_MAX_BUILTINS] = {
+#define PN_BUILTIN(e, flags) \
+  [PN_BUILTIN_##e] = {pn_builtin_##e, PN_BUILTIN_FLAGS_##flags},
+    PN_FOREACH_BUILTIN(PN_BUILTIN)
 #undef PN_BUILTIN
-            default:
-              PN_FATAL("Unknown builtin: %d\n", callee_function_id);
-              break;
-          }
-          /* If the builtin was PN_BUILTIN_NACL_IRT_FUTEX_WAIT_ABS, then this
-           * thread may have been blocked. If so, do not increment the
-           * instruction counter.
-           */
-          if (thread->state == PN_THREAD_RUNNING
-#if PN_PPAPI
-              /* Also don't increment the instruction counter when calling ppapi
-               * start; this will actually push a new function.*/
-              && callee_function_id != PN_BUILTIN_NACL_IRT_PPAPIHOOK_PPAPI_START
-#endif /* PN_PPAPI */
-              ) {
-            thread->inst += sizeof(PNRuntimeInstructionCall) +
-                            i->num_args * sizeof(PNValueId);
-          }
-          break;
-        } else {
-          new_function_id = callee_function_id - PN_MAX_BUILTINS;
-          assert(new_function_id < module->num_functions);
-        }
-      } else {
-        PNValue* function_value = &module->values[i->callee_id];
-        assert(function_value->code == PN_VALUE_CODE_FUNCTION);
-        new_function_id = function_value->index;
-      }
-
-      PNFunction* new_function = &module->functions[new_function_id];
-      pn_thread_push_function(thread, new_function_id, new_function);
-
-      uint32_t n;
-      for (n = 0; n < i->num_args; ++n) {
-        PNValueId value_id = module->num_values + n;
-        PNRuntimeValue arg = pn_executor_get_value_from_frame(
-            thread->executor, old_frame, arg_ids[n]);
-        pn_thread_set_value(thread, value_id, arg);
-      }
-      break;
-    }
-
-    case PN_OPCODE_CAST_BITCAST_DOUBLE_INT64:
-    case PN_OPCODE_CAST_BITCAST_FLOAT_INT32:
-    case PN_OPCODE_CAST_BITCAST_INT32_FLOAT:
-    case PN_OPCODE_CAST_BITCAST_INT64_DOUBLE: {
-      PNRuntimeInstructionCast* i = (PNRuntimeInstructionCast*)inst;
-      PNRuntimeValue result = pn_thread_get_value(thread, i->value_id);
-      pn_thread_set_value(thread, i->result_value_id, result);
-      thread->inst += sizeof(PNRuntimeInstructionCast);
-      break;
-    }
-
-#define PN_OPCODE_CAST(from, to)                                     \
-  do {                                                               \
-    PNRuntimeInstructionCast* i = (PNRuntimeInstructionCast*)inst;   \
-    PNRuntimeValue value = pn_thread_get_value(thread, i->value_id); \
-    PNRuntimeValue result = pn_executor_value_##to(value.from);      \
-    pn_thread_set_value(thread, i->result_value_id, result);         \
-    thread->inst += sizeof(PNRuntimeInstructionCast);                \
-  } while (0) /* no semicolon */
-
-#define PN_OPCODE_CAST_SEXT1(size)                                   \
-  do {                                                               \
-    PNRuntimeInstructionCast* i = (PNRuntimeInstructionCast*)inst;   \
-    PNRuntimeValue value = pn_thread_get_value(thread, i->value_id); \
-    PNRuntimeValue result =                                          \
-        pn_executor_value_i##size(-(int##size##_t)(value.u8 & 1));   \
-    pn_thread_set_value(thread, i->result_value_id, result);         \
-    thread->inst += sizeof(PNRuntimeInstructionCast);                \
-  } while (0) /* no semicolon */
-
-#define PN_OPCODE_CAST_TRUNC1(size)                                  \
-  do {                                                               \
-    PNRuntimeInstructionCast* i = (PNRuntimeInstructionCast*)inst;   \
-    PNRuntimeValue value = pn_thread_get_value(thread, i->value_id); \
-    PNRuntimeValue result = pn_executor_value_u8(value.u##size & 1); \
-    pn_thread_set_value(thread, i->result_value_id, result);         \
-    thread->inst += sizeof(PNRuntimeInstructionCast);                \
-  } while (0) /* no semicolon */
-
-#define PN_OPCODE_CAST_ZEXT1(size)                                   \
-  do {                                                               \
-    PNRuntimeInstructionCast* i = (PNRuntimeInstructionCast*)inst;   \
-    PNRuntimeValue value = pn_thread_get_value(thread, i->value_id); \
-    PNRuntimeValue result =                                          \
-        pn_executor_value_u##size((uint##size##_t)(value.u8 & 1));   \
-    pn_thread_set_value(thread, i->result_value_id, result);         \
-    thread->inst += sizeof(PNRuntimeInstructionCast);                \
-  } while (0) /* no semicolon */
-
-    // clang-format off
-    case PN_OPCODE_CAST_FPEXT_FLOAT_DOUBLE:   PN_OPCODE_CAST(f32, f64); break;
-    case PN_OPCODE_CAST_FPTOSI_DOUBLE_INT8:   PN_OPCODE_CAST(f64, i8); break;
-    case PN_OPCODE_CAST_FPTOSI_DOUBLE_INT16:  PN_OPCODE_CAST(f64, i16); break;
-    case PN_OPCODE_CAST_FPTOSI_DOUBLE_INT32:  PN_OPCODE_CAST(f64, i32); break;
-    case PN_OPCODE_CAST_FPTOSI_DOUBLE_INT64:  PN_OPCODE_CAST(f64, i64); break;
-    case PN_OPCODE_CAST_FPTOSI_FLOAT_INT8:    PN_OPCODE_CAST(f32, i8); break;
-    case PN_OPCODE_CAST_FPTOSI_FLOAT_INT16:   PN_OPCODE_CAST(f32, i16); break;
-    case PN_OPCODE_CAST_FPTOSI_FLOAT_INT32:   PN_OPCODE_CAST(f32, i32); break;
-    case PN_OPCODE_CAST_FPTOSI_FLOAT_INT64:   PN_OPCODE_CAST(f32, i64); break;
-    case PN_OPCODE_CAST_FPTOUI_DOUBLE_INT8:   PN_OPCODE_CAST(f64, u8); break;
-    case PN_OPCODE_CAST_FPTOUI_DOUBLE_INT16:  PN_OPCODE_CAST(f64, u16); break;
-    case PN_OPCODE_CAST_FPTOUI_DOUBLE_INT32:  PN_OPCODE_CAST(f64, u32); break;
-    case PN_OPCODE_CAST_FPTOUI_DOUBLE_INT64:  PN_OPCODE_CAST(f64, u64); break;
-    case PN_OPCODE_CAST_FPTOUI_FLOAT_INT8:    PN_OPCODE_CAST(f32, u8); break;
-    case PN_OPCODE_CAST_FPTOUI_FLOAT_INT16:   PN_OPCODE_CAST(f32, u16); break;
-    case PN_OPCODE_CAST_FPTOUI_FLOAT_INT32:   PN_OPCODE_CAST(f32, u32); break;
-    case PN_OPCODE_CAST_FPTOUI_FLOAT_INT64:   PN_OPCODE_CAST(f32, u64); break;
-    case PN_OPCODE_CAST_FPTRUNC_DOUBLE_FLOAT: PN_OPCODE_CAST(f64, f32); break;
-    case PN_OPCODE_CAST_SEXT_INT1_INT8:       PN_OPCODE_CAST_SEXT1(8); break;
-    case PN_OPCODE_CAST_SEXT_INT1_INT16:      PN_OPCODE_CAST_SEXT1(16); break;
-    case PN_OPCODE_CAST_SEXT_INT1_INT32:      PN_OPCODE_CAST_SEXT1(32); break;
-    case PN_OPCODE_CAST_SEXT_INT1_INT64:      PN_OPCODE_CAST_SEXT1(64); break;
-    case PN_OPCODE_CAST_SEXT_INT8_INT16:      PN_OPCODE_CAST(i8, i16); break;
-    case PN_OPCODE_CAST_SEXT_INT8_INT32:      PN_OPCODE_CAST(i8, i32); break;
-    case PN_OPCODE_CAST_SEXT_INT8_INT64:      PN_OPCODE_CAST(i8, i64); break;
-    case PN_OPCODE_CAST_SEXT_INT16_INT32:     PN_OPCODE_CAST(i16, i32); break;
-    case PN_OPCODE_CAST_SEXT_INT16_INT64:     PN_OPCODE_CAST(i16, i64); break;
-    case PN_OPCODE_CAST_SEXT_INT32_INT64:     PN_OPCODE_CAST(i32, i64); break;
-    case PN_OPCODE_CAST_SITOFP_INT8_DOUBLE:   PN_OPCODE_CAST(i8, f64); break;
-    case PN_OPCODE_CAST_SITOFP_INT8_FLOAT:    PN_OPCODE_CAST(i8, f32); break;
-    case PN_OPCODE_CAST_SITOFP_INT16_DOUBLE:  PN_OPCODE_CAST(i16, f64); break;
-    case PN_OPCODE_CAST_SITOFP_INT16_FLOAT:   PN_OPCODE_CAST(i16, f32); break;
-    case PN_OPCODE_CAST_SITOFP_INT32_DOUBLE:  PN_OPCODE_CAST(i32, f64); break;
-    case PN_OPCODE_CAST_SITOFP_INT32_FLOAT:   PN_OPCODE_CAST(i32, f32); break;
-    case PN_OPCODE_CAST_SITOFP_INT64_DOUBLE:  PN_OPCODE_CAST(i64, f64); break;
-    case PN_OPCODE_CAST_SITOFP_INT64_FLOAT:   PN_OPCODE_CAST(i64, f32); break;
-    case PN_OPCODE_CAST_TRUNC_INT8_INT1:      PN_OPCODE_CAST_TRUNC1(8); break;
-    case PN_OPCODE_CAST_TRUNC_INT16_INT1:     PN_OPCODE_CAST_TRUNC1(16); break;
-    case PN_OPCODE_CAST_TRUNC_INT16_INT8:     PN_OPCODE_CAST(i16, i8); break;
-    case PN_OPCODE_CAST_TRUNC_INT32_INT1:     PN_OPCODE_CAST_TRUNC1(32); break;
-    case PN_OPCODE_CAST_TRUNC_INT32_INT8:     PN_OPCODE_CAST(i32, i8); break;
-    case PN_OPCODE_CAST_TRUNC_INT32_INT16:    PN_OPCODE_CAST(i32, i16); break;
-    case PN_OPCODE_CAST_TRUNC_INT64_INT8:     PN_OPCODE_CAST(i64, i8); break;
-    case PN_OPCODE_CAST_TRUNC_INT64_INT16:    PN_OPCODE_CAST(i64, i16); break;
-    case PN_OPCODE_CAST_TRUNC_INT64_INT32:    PN_OPCODE_CAST(i64, i32); break;
-    case PN_OPCODE_CAST_UITOFP_INT8_DOUBLE:   PN_OPCODE_CAST(u8, f64); break;
-    case PN_OPCODE_CAST_UITOFP_INT8_FLOAT:    PN_OPCODE_CAST(u8, f32); break;
-    case PN_OPCODE_CAST_UITOFP_INT16_DOUBLE:  PN_OPCODE_CAST(u16, f64); break;
-    case PN_OPCODE_CAST_UITOFP_INT16_FLOAT:   PN_OPCODE_CAST(u16, f32); break;
-    case PN_OPCODE_CAST_UITOFP_INT32_DOUBLE:  PN_OPCODE_CAST(u32, f64); break;
-    case PN_OPCODE_CAST_UITOFP_INT32_FLOAT:   PN_OPCODE_CAST(u32, f32); break;
-    case PN_OPCODE_CAST_UITOFP_INT64_DOUBLE:  PN_OPCODE_CAST(u64, f64); break;
-    case PN_OPCODE_CAST_UITOFP_INT64_FLOAT:   PN_OPCODE_CAST(u64, f32); break;
-    case PN_OPCODE_CAST_ZEXT_INT1_INT8:       PN_OPCODE_CAST_ZEXT1(8); break;
-    case PN_OPCODE_CAST_ZEXT_INT1_INT16:      PN_OPCODE_CAST_ZEXT1(16); break;
-    case PN_OPCODE_CAST_ZEXT_INT1_INT32:      PN_OPCODE_CAST_ZEXT1(32); break;
-    case PN_OPCODE_CAST_ZEXT_INT1_INT64:      PN_OPCODE_CAST_ZEXT1(64); break;
-    case PN_OPCODE_CAST_ZEXT_INT8_INT16:      PN_OPCODE_CAST(u8, u16); break;
-    case PN_OPCODE_CAST_ZEXT_INT8_INT32:      PN_OPCODE_CAST(u8, u32); break;
-    case PN_OPCODE_CAST_ZEXT_INT8_INT64:      PN_OPCODE_CAST(u8, u64); break;
-    case PN_OPCODE_CAST_ZEXT_INT16_INT32:     PN_OPCODE_CAST(u16, u32); break;
-    case PN_OPCODE_CAST_ZEXT_INT16_INT64:     PN_OPCODE_CAST(u16, u64); break;
-    case PN_OPCODE_CAST_ZEXT_INT32_INT64:     PN_OPCODE_CAST(u32, u64); break;
-// clang-format on
-
-#undef PN_OPCODE_CAST
-#undef PN_OPCODE_CAST_SEXT1
-#undef PN_OPCODE_CAST_TRUNC1
-#undef PN_OPCODE_CAST_ZEXT1
-
-#define PN_OPCODE_CMP2(op, ty)                                            \
-  do {                                                                    \
-    PNRuntimeInstructionCmp2* i = (PNRuntimeInstructionCmp2*)inst;        \
-    PNRuntimeValue value0 = pn_thread_get_value(thread, i->value0_id);    \
-    PNRuntimeValue value1 = pn_thread_get_value(thread, i->value1_id);    \
-    PNRuntimeValue result = pn_executor_value_u8(value0.ty op value1.ty); \
-    pn_thread_set_value(thread, i->result_value_id, result);              \
-    thread->inst += sizeof(PNRuntimeInstructionCmp2);                     \
-  } while (0) /* no semicolon */
-
-#define PN_OPCODE_CMP2_NOT(op, ty)                                           \
-  do {                                                                       \
-    PNRuntimeInstructionCmp2* i = (PNRuntimeInstructionCmp2*)inst;           \
-    PNRuntimeValue value0 = pn_thread_get_value(thread, i->value0_id);       \
-    PNRuntimeValue value1 = pn_thread_get_value(thread, i->value1_id);       \
-    PNRuntimeValue result = pn_executor_value_u8(!(value0.ty op value1.ty)); \
-    pn_thread_set_value(thread, i->result_value_id, result);                 \
-    thread->inst += sizeof(PNRuntimeInstructionCmp2);                        \
-  } while (0) /* no semicolon */
-
-#define PN_OPCODE_CMP2_ORD(ty)                                             \
-  do {                                                                     \
-    PNRuntimeInstructionCmp2* i = (PNRuntimeInstructionCmp2*)inst;         \
-    PNRuntimeValue value0 = pn_thread_get_value(thread, i->value0_id);     \
-    PNRuntimeValue value1 = pn_thread_get_value(thread, i->value1_id);     \
-    PNRuntimeValue result = pn_executor_value_u8(value0.ty == value1.ty || \
-                                                 value0.ty != value1.ty);  \
-    pn_thread_set_value(thread, i->result_value_id, result);               \
-    thread->inst += sizeof(PNRuntimeInstructionCmp2);                      \
-  } while (0) /* no semicolon */
-
-#define PN_OPCODE_CMP2_UNO(ty)                                         \
-  do {                                                                 \
-    PNRuntimeInstructionCmp2* i = (PNRuntimeInstructionCmp2*)inst;     \
-    PNRuntimeValue value0 = pn_thread_get_value(thread, i->value0_id); \
-    PNRuntimeValue value1 = pn_thread_get_value(thread, i->value1_id); \
-    PNRuntimeValue result = pn_executor_value_u8(                      \
-        !(value0.ty == value1.ty || value0.ty != value1.ty));          \
-    pn_thread_set_value(thread, i->result_value_id, result);           \
-    thread->inst += sizeof(PNRuntimeInstructionCmp2);                  \
-  } while (0) /* no semicolon */
-
-    //        U L G E
-    // FALSE  0 0 0 0
-    // OEQ    0 0 0 1  A == B
-    // OGT    0 0 1 0  A > B
-    // OGE    0 0 1 1  A >= B
-    // OLT    0 1 0 0  A < B
-    // OLE    0 1 0 1  A <= B
-    // ONE    0 1 1 0  A != B
-    // ORD    0 1 1 1  A == B || A != B
-    // UNO    1 0 0 0  !(A == B || A != B)
-    // UEQ    1 0 0 1  !(A != B)
-    // UGT    1 0 1 0  !(A <= B)
-    // UGE    1 0 1 1  !(A < B)
-    // ULT    1 1 0 0  !(A >= B)
-    // ULE    1 1 0 1  !(A > B)
-    // UNE    1 1 1 0  !(A == B)
-    // TRUE   1 1 1 1
-
-    // clang-format off
-    case PN_OPCODE_FCMP_OEQ_DOUBLE: PN_OPCODE_CMP2(==, f64); break;
-    case PN_OPCODE_FCMP_OEQ_FLOAT:  PN_OPCODE_CMP2(==, f32); break;
-    case PN_OPCODE_FCMP_OGE_DOUBLE: PN_OPCODE_CMP2(>=, f64); break;
-    case PN_OPCODE_FCMP_OGE_FLOAT:  PN_OPCODE_CMP2(>=, f32); break;
-    case PN_OPCODE_FCMP_OGT_DOUBLE: PN_OPCODE_CMP2(>, f64); break;
-    case PN_OPCODE_FCMP_OGT_FLOAT:  PN_OPCODE_CMP2(>, f32); break;
-    case PN_OPCODE_FCMP_OLE_DOUBLE: PN_OPCODE_CMP2(<=, f64); break;
-    case PN_OPCODE_FCMP_OLE_FLOAT:  PN_OPCODE_CMP2(<=, f32); break;
-    case PN_OPCODE_FCMP_OLT_DOUBLE: PN_OPCODE_CMP2(<, f64); break;
-    case PN_OPCODE_FCMP_OLT_FLOAT:  PN_OPCODE_CMP2(<, f32); break;
-    case PN_OPCODE_FCMP_ONE_DOUBLE: PN_OPCODE_CMP2(!=, f64); break;
-    case PN_OPCODE_FCMP_ONE_FLOAT:  PN_OPCODE_CMP2(!=, f32); break;
-    case PN_OPCODE_FCMP_ORD_DOUBLE: PN_OPCODE_CMP2_ORD(f64); break;
-    case PN_OPCODE_FCMP_ORD_FLOAT:  PN_OPCODE_CMP2_ORD(f32); break;
-    case PN_OPCODE_FCMP_UEQ_DOUBLE: PN_OPCODE_CMP2_NOT(!=, f64); break;
-    case PN_OPCODE_FCMP_UEQ_FLOAT:  PN_OPCODE_CMP2_NOT(!=, f32); break;
-    case PN_OPCODE_FCMP_UGE_DOUBLE: PN_OPCODE_CMP2_NOT(<, f64); break;
-    case PN_OPCODE_FCMP_UGE_FLOAT:  PN_OPCODE_CMP2_NOT(<, f32); break;
-    case PN_OPCODE_FCMP_UGT_DOUBLE: PN_OPCODE_CMP2_NOT(<=, f64); break;
-    case PN_OPCODE_FCMP_UGT_FLOAT:  PN_OPCODE_CMP2_NOT(<=, f32); break;
-    case PN_OPCODE_FCMP_ULE_DOUBLE: PN_OPCODE_CMP2_NOT(>, f64); break;
-    case PN_OPCODE_FCMP_ULE_FLOAT:  PN_OPCODE_CMP2_NOT(>, f32); break;
-    case PN_OPCODE_FCMP_ULT_DOUBLE: PN_OPCODE_CMP2_NOT(>=, f64); break;
-    case PN_OPCODE_FCMP_ULT_FLOAT:  PN_OPCODE_CMP2_NOT(>=, f32); break;
-    case PN_OPCODE_FCMP_UNE_DOUBLE: PN_OPCODE_CMP2_NOT(==, f64); break;
-    case PN_OPCODE_FCMP_UNE_FLOAT:  PN_OPCODE_CMP2_NOT(==, f32); break;
-    case PN_OPCODE_FCMP_UNO_DOUBLE: PN_OPCODE_CMP2_UNO(f64); break;
-    case PN_OPCODE_FCMP_UNO_FLOAT:  PN_OPCODE_CMP2_UNO(f32); break;
-
-    case PN_OPCODE_ICMP_EQ_INT8:   PN_OPCODE_CMP2(==, u8); break;
-    case PN_OPCODE_ICMP_EQ_INT16:  PN_OPCODE_CMP2(==, u16); break;
-    case PN_OPCODE_ICMP_EQ_INT32:  PN_OPCODE_CMP2(==, u32); break;
-    case PN_OPCODE_ICMP_EQ_INT64:  PN_OPCODE_CMP2(==, u64); break;
-    case PN_OPCODE_ICMP_NE_INT8:   PN_OPCODE_CMP2(!=, u8); break;
-    case PN_OPCODE_ICMP_NE_INT16:  PN_OPCODE_CMP2(!=, u16); break;
-    case PN_OPCODE_ICMP_NE_INT32:  PN_OPCODE_CMP2(!=, u32); break;
-    case PN_OPCODE_ICMP_NE_INT64:  PN_OPCODE_CMP2(!=, u64); break;
-    case PN_OPCODE_ICMP_SGE_INT8:  PN_OPCODE_CMP2(>=, i8); break;
-    case PN_OPCODE_ICMP_SGE_INT16: PN_OPCODE_CMP2(>=, i16); break;
-    case PN_OPCODE_ICMP_SGE_INT32: PN_OPCODE_CMP2(>=, i32); break;
-    case PN_OPCODE_ICMP_SGE_INT64: PN_OPCODE_CMP2(>=, i64); break;
-    case PN_OPCODE_ICMP_SGT_INT8:  PN_OPCODE_CMP2(>, i8); break;
-    case PN_OPCODE_ICMP_SGT_INT16: PN_OPCODE_CMP2(>, i16); break;
-    case PN_OPCODE_ICMP_SGT_INT32: PN_OPCODE_CMP2(>, i32); break;
-    case PN_OPCODE_ICMP_SGT_INT64: PN_OPCODE_CMP2(>, i64); break;
-    case PN_OPCODE_ICMP_SLE_INT8:  PN_OPCODE_CMP2(<=, i8); break;
-    case PN_OPCODE_ICMP_SLE_INT16: PN_OPCODE_CMP2(<=, i16); break;
-    case PN_OPCODE_ICMP_SLE_INT32: PN_OPCODE_CMP2(<=, i32); break;
-    case PN_OPCODE_ICMP_SLE_INT64: PN_OPCODE_CMP2(<=, i64); break;
-    case PN_OPCODE_ICMP_SLT_INT8:  PN_OPCODE_CMP2(<, i8); break;
-    case PN_OPCODE_ICMP_SLT_INT16: PN_OPCODE_CMP2(<, i16); break;
-    case PN_OPCODE_ICMP_SLT_INT32: PN_OPCODE_CMP2(<, i32); break;
-    case PN_OPCODE_ICMP_SLT_INT64: PN_OPCODE_CMP2(<, i64); break;
-    case PN_OPCODE_ICMP_UGE_INT8:  PN_OPCODE_CMP2(>=, u8); break;
-    case PN_OPCODE_ICMP_UGE_INT16: PN_OPCODE_CMP2(>=, u16); break;
-    case PN_OPCODE_ICMP_UGE_INT32: PN_OPCODE_CMP2(>=, u32); break;
-    case PN_OPCODE_ICMP_UGE_INT64: PN_OPCODE_CMP2(>=, u64); break;
-    case PN_OPCODE_ICMP_UGT_INT8:  PN_OPCODE_CMP2(>, u8); break;
-    case PN_OPCODE_ICMP_UGT_INT16: PN_OPCODE_CMP2(>, u16); break;
-    case PN_OPCODE_ICMP_UGT_INT32: PN_OPCODE_CMP2(>, u32); break;
-    case PN_OPCODE_ICMP_UGT_INT64: PN_OPCODE_CMP2(>, u64); break;
-    case PN_OPCODE_ICMP_ULE_INT8:  PN_OPCODE_CMP2(<=, u8); break;
-    case PN_OPCODE_ICMP_ULE_INT16: PN_OPCODE_CMP2(<=, u16); break;
-    case PN_OPCODE_ICMP_ULE_INT32: PN_OPCODE_CMP2(<=, u32); break;
-    case PN_OPCODE_ICMP_ULE_INT64: PN_OPCODE_CMP2(<=, u64); break;
-    case PN_OPCODE_ICMP_ULT_INT8:  PN_OPCODE_CMP2(<, u8); break;
-    case PN_OPCODE_ICMP_ULT_INT16: PN_OPCODE_CMP2(<, u16); break;
-    case PN_OPCODE_ICMP_ULT_INT32: PN_OPCODE_CMP2(<, u32); break;
-    case PN_OPCODE_ICMP_ULT_INT64: PN_OPCODE_CMP2(<, u64); break;
-// clang-format on
-
-#undef PN_OPCODE_CMP2
-#undef PN_OPCODE_CMP2_NOT
-#undef PN_OPCODE_CMP2_ORD
-#undef PN_OPCODE_CMP2_UNO
-
-#define PN_ARG(i, ty) pn_thread_get_value(thread, arg_ids[i]).ty
-
-    case PN_OPCODE_INTRINSIC_LLVM_CTLZ_I32: {
-      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
-      PN_CHECK(i->num_args == 2);
-      uint32_t src = PN_ARG(0, u32);
-      uint32_t is_zero_undef = PN_ARG(1, u32);
-      uint32_t result = src == 0 ? 0 : __builtin_clz(src);
-      (void)is_zero_undef;
-      pn_thread_set_value(thread, i->result_value_id,
-                          pn_executor_value_u32(result));
-      thread->inst +=
-          sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNValueId);
-      break;
-    }
-
-    case PN_OPCODE_INTRINSIC_LLVM_CTLZ_I64: {
-      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
-      PN_CHECK(i->num_args == 2);
-      uint64_t src = PN_ARG(0, u64);
-      uint32_t is_zero_undef = PN_ARG(1, u32);
-      uint64_t result = src == 0 ? 0 : __builtin_clzll(src);
-      (void)is_zero_undef;
-      pn_thread_set_value(thread, i->result_value_id,
-                          pn_executor_value_u64(result));
-      thread->inst +=
-          sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNValueId);
-      break;
-    }
-
-    case PN_OPCODE_INTRINSIC_LLVM_CTTZ_I32: {
-      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
-      PN_CHECK(i->num_args == 2);
-      uint32_t src = PN_ARG(0, u32);
-      uint32_t is_zero_undef = PN_ARG(1, u32);
-      uint32_t result = src == 0 ? 0 : __builtin_ctz(src);
-      (void)is_zero_undef;
-      pn_thread_set_value(thread, i->result_value_id,
-                          pn_executor_value_u32(result));
-      thread->inst +=
-          sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNValueId);
-      break;
-    }
-
-    case PN_OPCODE_INTRINSIC_LLVM_CTTZ_I64: {
-      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
-      PN_CHECK(i->num_args == 2);
-      uint64_t src = PN_ARG(0, u64);
-      uint32_t is_zero_undef = PN_ARG(1, u32);
-      uint64_t result = src == 0 ? 0 : __builtin_ctzll(src);
-      (void)is_zero_undef;
-      pn_thread_set_value(thread, i->result_value_id,
-                          pn_executor_value_u64(result));
-      thread->inst +=
-          sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNValueId);
-      break;
-    }
-
-    case PN_OPCODE_INTRINSIC_LLVM_MEMCPY: {
-      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
-      PN_CHECK(i->num_args == 5);
-      PN_CHECK(i->result_value_id == PN_INVALID_VALUE_ID);
-      uint32_t dst_p = PN_ARG(0, u32);
-      uint32_t src_p = PN_ARG(1, u32);
-      uint32_t len = PN_ARG(2, u32);
-
-      if (len > 0) {
-        pn_memory_check(thread->executor->memory, dst_p, len);
-        pn_memory_check(thread->executor->memory, src_p, len);
-        void* dst_pointer = thread->executor->memory->data + dst_p;
-        void* src_pointer = thread->executor->memory->data + src_p;
-        memcpy(dst_pointer, src_pointer, len);
-      }
-      thread->inst +=
-          sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNValueId);
-      break;
-    }
-
-    case PN_OPCODE_INTRINSIC_LLVM_MEMSET: {
-      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
-      PN_CHECK(i->num_args == 5);
-      PN_CHECK(i->result_value_id == PN_INVALID_VALUE_ID);
-      uint32_t dst_p = PN_ARG(0, u32);
-      uint8_t value = PN_ARG(1, u8);
-      uint32_t len = PN_ARG(2, u32);
-
-      if (len > 0) {
-        pn_memory_check(thread->executor->memory, dst_p, len);
-        void* dst_pointer = thread->executor->memory->data + dst_p;
-        memset(dst_pointer, value, len);
-      }
-      thread->inst +=
-          sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNValueId);
-      break;
-    }
-
-    case PN_OPCODE_INTRINSIC_LLVM_MEMMOVE: {
-      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
-      PN_CHECK(i->num_args == 5);
-      PN_CHECK(i->result_value_id == PN_INVALID_VALUE_ID);
-      uint32_t dst_p = PN_ARG(0, u32);
-      uint32_t src_p = PN_ARG(1, u32);
-      uint32_t len = PN_ARG(2, u32);
-
-      if (len > 0) {
-        pn_memory_check(thread->executor->memory, dst_p, len);
-        pn_memory_check(thread->executor->memory, src_p, len);
-        void* dst_pointer = thread->executor->memory->data + dst_p;
-        void* src_pointer = thread->executor->memory->data + src_p;
-        memmove(dst_pointer, src_pointer, len);
-      }
-      thread->inst +=
-          sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNValueId);
-      break;
-    }
-
-#define PN_OPCODE_INTRINSIC_CMPXCHG(ty)                                     \
-  do {                                                                      \
-    PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;          \
-    PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);    \
-    PN_CHECK(i->num_args == 5);                                             \
-    uint32_t addr_p = PN_ARG(0, u32);                                       \
-    pn_##ty expected = PN_ARG(1, ty);                                       \
-    pn_##ty desired = PN_ARG(2, ty);                                        \
-    pn_##ty read = pn_memory_read_##ty(thread->executor->memory, addr_p);   \
-    PNRuntimeValue result = pn_executor_value_##ty(read);                   \
-    if (read == expected) {                                                 \
-      pn_memory_write_##ty(thread->executor->memory, addr_p, desired);      \
-    }                                                                       \
-    pn_thread_set_value(thread, i->result_value_id, result);                \
-    thread->inst +=                                                         \
-        sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNValueId); \
-  } while (0) /* no semicolon */
-
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_CMPXCHG_I8:
-      PN_OPCODE_INTRINSIC_CMPXCHG(u8);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_CMPXCHG_I16:
-      PN_OPCODE_INTRINSIC_CMPXCHG(u16);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_CMPXCHG_I32:
-      PN_OPCODE_INTRINSIC_CMPXCHG(u32);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_CMPXCHG_I64:
-      PN_OPCODE_INTRINSIC_CMPXCHG(u64);
-      break;
-
-#undef PN_OPCODE_INTRINSIC_CMPXCHG
-
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_FENCE_ALL: {
-      /* Do nothing. */
-      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
-      thread->inst +=
-          sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNValueId);
-      break;
-    }
-
-#define PN_OPCODE_INTRINSIC_LOAD(ty)                                        \
-  do {                                                                      \
-    PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;          \
-    PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);    \
-    PN_CHECK(i->num_args == 2);                                             \
-    uint32_t addr_p = PN_ARG(0, u32);                                       \
-    pn_##ty value = pn_memory_read_##ty(thread->executor->memory, addr_p);  \
-    PNRuntimeValue result = pn_executor_value_##ty(value);                  \
-    pn_thread_set_value(thread, i->result_value_id, result);                \
-    thread->inst +=                                                         \
-        sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNValueId); \
-  } while (0) /* no semicolon */
-
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_LOAD_I8:
-      PN_OPCODE_INTRINSIC_LOAD(u8);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_LOAD_I16:
-      PN_OPCODE_INTRINSIC_LOAD(u16);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_LOAD_I32:
-      PN_OPCODE_INTRINSIC_LOAD(u32);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_LOAD_I64:
-      PN_OPCODE_INTRINSIC_LOAD(u64);
-      break;
-
-#undef PN_OPCODE_INTRINSIC_LOAD
-
-#define PN_OPCODE_INTRINSIC_RMW(opval, op, ty)                                 \
-  do {                                                                         \
-    PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;             \
-    PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);       \
-    PN_CHECK(i->num_args == 4);                                                \
-    PN_CHECK(PN_ARG(0, u32) == opval);                                         \
-    uint32_t addr_p = PN_ARG(1, u32);                                          \
-    pn_##ty value = PN_ARG(2, ty);                                             \
-    pn_##ty old_value = pn_memory_read_##ty(thread->executor->memory, addr_p); \
-    pn_##ty new_value = old_value op value;                                    \
-    pn_memory_write_##ty(thread->executor->memory, addr_p, new_value);         \
-    PNRuntimeValue result = pn_executor_value_u32(old_value);                  \
-    pn_thread_set_value(thread, i->result_value_id, result);                   \
-    thread->inst +=                                                            \
-        sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNValueId);    \
-  } while (0) /* no semicolon */
-
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_ADD_I8:
-      PN_OPCODE_INTRINSIC_RMW(1, +, u8);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_ADD_I16:
-      PN_OPCODE_INTRINSIC_RMW(1, +, u16);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_ADD_I32:
-      PN_OPCODE_INTRINSIC_RMW(1, +, u32);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_ADD_I64:
-      PN_OPCODE_INTRINSIC_RMW(1, +, u64);
-      break;
-
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_SUB_I8:
-      PN_OPCODE_INTRINSIC_RMW(2, -, u8);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_SUB_I16:
-      PN_OPCODE_INTRINSIC_RMW(2, -, u16);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_SUB_I32:
-      PN_OPCODE_INTRINSIC_RMW(2, -, u32);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_SUB_I64:
-      PN_OPCODE_INTRINSIC_RMW(2, -, u64);
-      break;
-
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_AND_I8:
-      PN_OPCODE_INTRINSIC_RMW(3, &, u8);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_AND_I16:
-      PN_OPCODE_INTRINSIC_RMW(3, &, u16);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_AND_I32:
-      PN_OPCODE_INTRINSIC_RMW(3, &, u32);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_AND_I64:
-      PN_OPCODE_INTRINSIC_RMW(3, &, u64);
-      break;
-
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_OR_I8:
-      PN_OPCODE_INTRINSIC_RMW(4, |, u8);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_OR_I16:
-      PN_OPCODE_INTRINSIC_RMW(4, |, u16);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_OR_I32:
-      PN_OPCODE_INTRINSIC_RMW(4, |, u32);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_OR_I64:
-      PN_OPCODE_INTRINSIC_RMW(4, |, u64);
-      break;
-
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_XOR_I8:
-      PN_OPCODE_INTRINSIC_RMW(5, ^, u8);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_XOR_I16:
-      PN_OPCODE_INTRINSIC_RMW(5, ^, u16);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_XOR_I32:
-      PN_OPCODE_INTRINSIC_RMW(5, ^, u32);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_XOR_I64:
-      PN_OPCODE_INTRINSIC_RMW(5, ^, u64);
-      break;
-
-#define PN_OPCODE_INTRINSIC_EXCHANGE(opval, ty)                                \
-  do {                                                                         \
-    PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;             \
-    PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);       \
-    PN_CHECK(i->num_args == 4);                                                \
-    PN_CHECK(PN_ARG(0, u32) == opval);                                         \
-    uint32_t addr_p = PN_ARG(1, u32);                                          \
-    pn_##ty value = PN_ARG(2, ty);                                             \
-    pn_##ty old_value = pn_memory_read_##ty(thread->executor->memory, addr_p); \
-    pn_##ty new_value = value;                                                 \
-    pn_memory_write_##ty(thread->executor->memory, addr_p, new_value);         \
-    PNRuntimeValue result = pn_executor_value_u32(old_value);                  \
-    pn_thread_set_value(thread, i->result_value_id, result);                   \
-    thread->inst +=                                                            \
-        sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNValueId);    \
-  } while (0) /* no semicolon */
-
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_EXCHANGE_I8:
-      PN_OPCODE_INTRINSIC_EXCHANGE(6, u8);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_EXCHANGE_I16:
-      PN_OPCODE_INTRINSIC_EXCHANGE(6, u16);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_EXCHANGE_I32:
-      PN_OPCODE_INTRINSIC_EXCHANGE(6, u32);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_EXCHANGE_I64:
-      PN_OPCODE_INTRINSIC_EXCHANGE(6, u64);
-      break;
-
-#undef PN_OPCODE_INTRINSIC_RMW
-#undef PN_OPCODE_INTRINSIC_EXCHANGE
-
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_LONGJMP: {
-      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
-      PN_CHECK(i->num_args == 2);
-      PN_CHECK(i->result_value_id == PN_INVALID_VALUE_ID);
-      uint32_t jmpbuf_p = PN_ARG(0, u32);
-      PNRuntimeValue value = pn_thread_get_value(thread, arg_ids[1]);
-
-      PNJmpBufId id = pn_memory_read_u32(thread->executor->memory, jmpbuf_p);
-
-      /* Search the call stack for the matching jmpbuf id */
-      PNCallFrame* f = thread->current_frame;
-      while (f != &thread->executor->sentinel_frame) {
-        PNJmpBuf* buf = f->jmpbuf_head;
-        while (buf) {
-          if (buf->id == id) {
-            /* Found it */
-            thread->current_frame = f;
-            pn_allocator_reset_to_mark(&thread->allocator, f->mark);
-            /* Reset the frame to its original state */
-            *thread->current_frame = buf->frame;
-            PNLocation* location = &thread->current_frame->location;
-            /* Set the return value */
-            PNRuntimeInstructionCall* c = location->inst;
-            pn_thread_set_value(thread, c->result_value_id, value);
-            thread->inst = location->inst + sizeof(PNRuntimeInstructionCall) +
-                           c->num_args * sizeof(PNValueId);
-            thread->function = &module->functions[location->function_id];
-            goto longjmp_done;
-          }
-          buf = buf->next;
-        }
-        f = f->parent;
-      }
-      PN_FATAL("Invalid jmpbuf target: %d\n", id);
-    longjmp_done:
-      break;
-    }
+};
 
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_SETJMP: {
-      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
-      PN_CHECK(i->num_args == 1);
-      PN_CHECK(i->result_value_id != PN_INVALID_VALUE_ID);
-      thread->current_frame->location.inst = thread->inst;
-      uint32_t jmpbuf_p = PN_ARG(0, u32);
-      PNJmpBuf* buf = pn_allocator_alloc(&thread->allocator, sizeof(PNJmpBuf),
-                                         PN_DEFAULT_ALIGN);
-      buf->id = thread->executor->next_jmpbuf_id++;
-      buf->frame = *thread->current_frame;
-      buf->next = thread->current_frame->jmpbuf_head;
-      thread->current_frame->jmpbuf_head = buf;
-      pn_memory_write_u32(thread->executor->memory, jmpbuf_p, buf->id);
-      PNRuntimeValue result = pn_executor_value_u32(0);
-      pn_thread_set_value(thread, i->result_value_id, result);
-      thread->inst +=
-          sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNValueId);
-      break;
-    }
-
-#define PN_OPCODE_INTRINSIC_STORE(ty)                                       \
-  do {                                                                      \
-    PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;          \
-    PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);    \
-    PN_CHECK(i->num_args == 3);                                             \
-    PN_CHECK(i->result_value_id == PN_INVALID_VALUE_ID);                    \
-    uint32_t value = PN_ARG(0, ty);                                         \
-    uint32_t addr_p = PN_ARG(1, u32);                                       \
-    pn_memory_write_u32(thread->executor->memory, addr_p, value);           \
-    thread->inst +=                                                         \
-        sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNValueId); \
-  } while (0) /* no semicolon */
-
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_STORE_I8:
-      PN_OPCODE_INTRINSIC_STORE(u8);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_STORE_I16:
-      PN_OPCODE_INTRINSIC_STORE(u16);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_STORE_I32:
-      PN_OPCODE_INTRINSIC_STORE(u32);
-      break;
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_ATOMIC_STORE_I64:
-      PN_OPCODE_INTRINSIC_STORE(u64);
-      break;
-
-#undef PN_OPCODE_INTRINSIC_STORE
-
-    case PN_OPCODE_INTRINSIC_LLVM_NACL_READ_TP: {
-      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
-      PN_CHECK(i->num_args == 0);
-      PN_CHECK(i->result_value_id != PN_INVALID_VALUE_ID);
-      PNRuntimeValue result = pn_executor_value_u32(thread->tls);
-      pn_thread_set_value(thread, i->result_value_id, result);
-      thread->inst +=
-          sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNValueId);
-      break;
-    }
-
-    case PN_OPCODE_INTRINSIC_LLVM_SQRT_F32: {
-      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
-      PN_CHECK(i->num_args == 1);
-      PN_CHECK(i->result_value_id != PN_INVALID_VALUE_ID);
-      float value = PN_ARG(0, f32);
-      PNRuntimeValue result = pn_executor_value_f32(sqrtf(value));
-      pn_thread_set_value(thread, i->result_value_id, result);
-      thread->inst +=
-          sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNValueId);
-      break;
-    }
-
-    case PN_OPCODE_INTRINSIC_LLVM_SQRT_F64: {
-      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
-      PN_CHECK(i->num_args == 1);
-      PN_CHECK(i->result_value_id != PN_INVALID_VALUE_ID);
-      double value = PN_ARG(0, f64);
-      PNRuntimeValue result = pn_executor_value_f64(sqrt(value));
-      pn_thread_set_value(thread, i->result_value_id, result);
-      thread->inst +=
-          sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNValueId);
-      break;
-    }
-
-    case PN_OPCODE_INTRINSIC_LLVM_STACKRESTORE: {
-      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
-      PN_CHECK(i->num_args == 1);
-      PN_CHECK(i->result_value_id == PN_INVALID_VALUE_ID);
-      uint32_t value = PN_ARG(0, u32);
-      /* TODO(binji): validate stack pointer */
-      thread->current_frame->memory_stack_top = value;
-      thread->inst +=
-          sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNValueId);
-      break;
-    }
-
-    case PN_OPCODE_INTRINSIC_LLVM_STACKSAVE: {
-      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
-      PN_CHECK(i->num_args == 0);
-      PN_CHECK(i->result_value_id != PN_INVALID_VALUE_ID);
-      PNRuntimeValue result =
-          pn_executor_value_u32(thread->current_frame->memory_stack_top);
-      pn_thread_set_value(thread, i->result_value_id, result);
-      thread->inst +=
-          sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNValueId);
-      break;
-    }
-
-    case PN_OPCODE_INTRINSIC_LLVM_TRAP: {
-      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
-      PN_CHECK(i->num_args == 0);
-      thread->executor->exit_code = -1;
-      thread->executor->exiting = PN_TRUE;
-      thread->state = PN_THREAD_DEAD;
-      break;
-    }
-
-#define PN_OPCODE_INTRINSIC_STUB(name)                \
-  case PN_OPCODE_INTRINSIC_##name: {                  \
-    PN_FATAL("Unimplemented intrinsic: %s\n", #name); \
-    break;                                            \
+/* Resolves the function pointer |func| called through the indirect call |i|,
+ * and stores it in the call's inline cache. */
+static void pn_call_cache_update(PNModule* module,
+                                 PNRuntimeInstructionCall* i,
+                                 uint32_t func) {
+  PNFunctionId function_id = pn_function_pointer_to_index(func);
+  i->cache_pointer = func;
+  if (function_id < PN_MAX_BUILTINS) {
+    i->flags |= PN_CALL_FLAGS_CACHE_BUILTIN;
+    i->cache_builtin = &g_pn_builtins[function_id];
+    return;
   }
 
-      PN_OPCODE_INTRINSIC_STUB(LLVM_BSWAP_I16)
-      PN_OPCODE_INTRINSIC_STUB(LLVM_BSWAP_I32)
-      PN_OPCODE_INTRINSIC_STUB(LLVM_BSWAP_I64)
-      PN_OPCODE_INTRINSIC_STUB(LLVM_FABS_F32)
-      PN_OPCODE_INTRINSIC_STUB(LLVM_FABS_F64)
-      PN_OPCODE_INTRINSIC_STUB(LLVM_NACL_ATOMIC_RMW_I8)
-      PN_OPCODE_INTRINSIC_STUB(LLVM_NACL_ATOMIC_RMW_I16)
-      PN_OPCODE_INTRINSIC_STUB(LLVM_NACL_ATOMIC_RMW_I32)
-      PN_OPCODE_INTRINSIC_STUB(LLVM_NACL_ATOMIC_RMW_I64)
-      PN_OPCODE_INTRINSIC_STUB(START)
-
-#undef PN_ARG
-
-#define PN_OPCODE_LOAD(ty)                                         \
-  do {                                                             \
-    PNRuntimeInstructionLoad* i = (PNRuntimeInstructionLoad*)inst; \
-    PNRuntimeValue src = pn_thread_get_value(thread, i->src_id);   \
-    PNRuntimeValue result = pn_executor_value_##ty(                \
-        pn_memory_read_##ty(thread->executor->memory, src.u32));   \
-    pn_thread_set_value(thread, i->result_value_id, result);       \
-    thread->inst += sizeof(PNRuntimeInstructionLoad);              \
-  } while (0) /*no semicolon */
-
-    // clang-format off
-    case PN_OPCODE_LOAD_DOUBLE: PN_OPCODE_LOAD(f64); break;
-    case PN_OPCODE_LOAD_FLOAT: PN_OPCODE_LOAD(f32); break;
-    case PN_OPCODE_LOAD_INT8: PN_OPCODE_LOAD(u8); break;
-    case PN_OPCODE_LOAD_INT16: PN_OPCODE_LOAD(u16); break;
-    case PN_OPCODE_LOAD_INT32: PN_OPCODE_LOAD(u32); break;
-    case PN_OPCODE_LOAD_INT64: PN_OPCODE_LOAD(u64); break;
-// clang-format on
-
-#undef PN_OPCODE_LOAD
-
-    case PN_OPCODE_RET: {
-      thread->current_frame = thread->current_frame->parent;
-      PNLocation* location = &thread->current_frame->location;
-
-      if (location->function_id != PN_INVALID_FUNCTION_ID) {
-        PNFunction* new_function = &module->functions[location->function_id];
-        PNRuntimeInstructionCall* c = location->inst;
-
-        pn_allocator_reset_to_mark(&thread->allocator,
-                                   thread->current_frame->mark);
-        thread->inst = location->inst + sizeof(PNRuntimeInstructionCall) +
-                       c->num_args * sizeof(PNValueId);
-        thread->function = new_function;
-      } else {
-        /* Returning from the top frame of a thread. This shouldn't happen in
-         * most cases; the main thread should be exited by calling
-         * NACL_IRT_BASIC_EXIT, and a thread should be exited by calling
-         * NACL_IRT_THREAD_EXIT. In either case, there is nothing left to run
-         * on this thread, so it should finish. */
-        thread->state = PN_THREAD_DEAD;
-        if (thread == &thread->executor->start_thread) {
-          thread->executor->exit_code = 0;
-          thread->executor->exiting = PN_TRUE;
-        }
-      }
-      break;
-    }
-
-    case PN_OPCODE_RET_VALUE: {
-      PNRuntimeInstructionRetValue* i = (PNRuntimeInstructionRetValue*)inst;
-      PNRuntimeValue value = pn_thread_get_value(thread, i->value_id);
-
-      thread->current_frame = thread->current_frame->parent;
-      PNLocation* location = &thread->current_frame->location;
-
-      if (location->function_id != PN_INVALID_FUNCTION_ID) {
-        PNFunction* new_function = &module->functions[location->function_id];
-        PNRuntimeInstructionCall* c = location->inst;
-        pn_thread_set_value(thread, c->result_value_id, value);
-        pn_allocator_reset_to_mark(&thread->allocator,
-                                   thread->current_frame->mark);
-        thread->inst = location->inst + sizeof(PNRuntimeInstructionCall) +
-                       c->num_args * sizeof(PNValueId);
-        thread->function = new_function;
-      } else {
-        /* See comment in PN_OPCODE_RET. */
-        thread->state = PN_THREAD_DEAD;
-        if (thread == &thread->executor->start_thread) {
-          thread->executor->exit_code = value.i32;
-          thread->executor->exiting = PN_TRUE;
-        }
-#if PN_PPAPI
-        else {
-          /* Return value from an event being processed in a PPAPI app */
-          thread->exit_value = value;
-        }
-#endif /* PN_PPAPI */
-      }
-
-      break;
-    }
+  function_id -= PN_MAX_BUILTINS;
+  assert(function_id < module->num_functions);
+  PNFunction* function = &module->functions[function_id];
+  if (function->instructions == NULL && function->lazy_bit_offset == 0) {
+    PN_CHECK(function->name);
+    PN_FATAL("Unimplemented intrinsic: %s\n", function->name);
+  }
+  i->flags &= ~PN_CALL_FLAGS_CACHE_BUILTIN;
+  i->cache_callee = &function->callee;
+}
 
-#define PN_OPCODE_STORE(ty)                                             \
-  do {                                                                  \
-    PNRuntimeInstructionStore* i = (PNRuntimeInstructionStore*)inst;    \
-    PNRuntimeValue dest = pn_thread_get_value(thread, i->dest_id);      \
-    PNRuntimeValue value = pn_thread_get_value(thread, i->value_id);    \
-    pn_memory_write_##ty(thread->executor->memory, dest.u32, value.ty); \
-    thread->inst += sizeof(PNRuntimeInstructionStore);                  \
-  } while (0) /*no semicolon */
+/* The executor loop is compiled once for each PNExecutorVariant, so the fast
+ * variant has no instrumentation at all. */
+#define PN_EXECUTOR_LOOP_NAME pn_thread_run_quantum_fast
+#define PN_EXECUTOR_LOOP_HANDLERS 1
+#define PN_EXECUTOR_LOOP_COUNTING 0
+#define PN_EXECUTOR_LOOP_SINGLE_STEP 0
+#define PN_EXECUTOR_LOOP_TRACING 0
+#define PN_EXECUTOR_LOOP_JIT PN_JIT
+#define PN_EXECUTOR_LOOP_NATIVE PN_NATIVE
+#include "pn_executor_loop.h"
+
+#define PN_EXECUTOR_LOOP_NAME pn_thread_run_quantum_counting
+#define PN_EXECUTOR_LOOP_HANDLERS 0
+#define PN_EXECUTOR_LOOP_COUNTING 1
+#define PN_EXECUTOR_LOOP_SINGLE_STEP 0
+#define PN_EXECUTOR_LOOP_TRACING 0
+#define PN_EXECUTOR_LOOP_JIT 0
+#define PN_EXECUTOR_LOOP_NATIVE 0
+#include "pn_executor_loop.h"
 
-    // clang-format off
-    case PN_OPCODE_STORE_DOUBLE: PN_OPCODE_STORE(f64); break;
-    case PN_OPCODE_STORE_FLOAT: PN_OPCODE_STORE(f32); break;
-    case PN_OPCODE_STORE_INT8: PN_OPCODE_STORE(u8); break;
-    case PN_OPCODE_STORE_INT16: PN_OPCODE_STORE(u16); break;
-    case PN_OPCODE_STORE_INT32: PN_OPCODE_STORE(u32); break;
-    case PN_OPCODE_STORE_INT64: PN_OPCODE_STORE(u64); break;
-// clang-format on
+#if PN_TRACING
+#define PN_EXECUTOR_LOOP_NAME pn_thread_run_quantum_profiling
+#define PN_EXECUTOR_LOOP_HANDLERS 0
+#define PN_EXECUTOR_LOOP_COUNTING 1
+#define PN_EXECUTOR_LOOP_SINGLE_STEP 1
+#define PN_EXECUTOR_LOOP_TRACING 0
+#define PN_EXECUTOR_LOOP_JIT 0
+#define PN_EXECUTOR_LOOP_NATIVE 0
+#include "pn_executor_loop.h"
+
+#define PN_EXECUTOR_LOOP_NAME pn_thread_run_quantum_tracing
+#define PN_EXECUTOR_LOOP_HANDLERS 0
+#define PN_EXECUTOR_LOOP_COUNTING 1
+#define PN_EXECUTOR_LOOP_SINGLE_STEP 1
+#define PN_EXECUTOR_LOOP_TRACING 1
+#define PN_EXECUTOR_LOOP_JIT 0
+#define PN_EXECUTOR_LOOP_NATIVE 0
+#include "pn_executor_loop.h"
+#endif /* PN_TRACING */
 
-#undef PN_OPCODE_STORE
 
-#define PN_OPCODE_SWITCH(ty)                                           \
-  do {                                                                 \
-    PNRuntimeInstructionSwitch* i = (PNRuntimeInstructionSwitch*)inst; \
-    PNRuntimeSwitchCase* cases =                                       \
-        (void*)inst + sizeof(PNRuntimeInstructionSwitch);              \
-    PNRuntimeValue value = pn_thread_get_value(thread, i->value_id);   \
-    void* new_inst = i->default_inst;                                  \
-    uint32_t c;                                                        \
-    for (c = 0; c < i->num_cases; ++c) {                               \
-      PNRuntimeSwitchCase* switch_case = &cases[c];                    \
-      if (value.ty == switch_case->value) {                            \
-        new_inst = switch_case->inst;                                  \
-        break;                                                         \
-      }                                                                \
-    }                                                                  \
-    thread->inst += sizeof(PNRuntimeInstructionSwitch) +               \
-                    i->num_cases * sizeof(PNSwitchCase);               \
-    pn_thread_do_phi_assigns(thread, function, new_inst);              \
-    thread->inst = new_inst;                                           \
-  } while (0) /* no semicolon */
+static void pn_executor_init_opcode_handlers(void) {
+  pn_thread_run_quantum_fast(NULL, 0, PN_FALSE);
+}
 
-    // clang-format off
+#if PN_TRACING
+/* Returns whether |opcode| always continues with the instruction after it.
+ * Only these can be the first half of a superinstruction. */
+static PNBool pn_opcode_falls_through(PNOpcode opcode) {
+  switch (opcode) {
+    case PN_OPCODE_BR:
+    case PN_OPCODE_BR_INT1:
+    case PN_OPCODE_PHI_MOVES:
+    case PN_OPCODE_SWITCH_BSEARCH_INT8:
+    case PN_OPCODE_SWITCH_BSEARCH_INT16:
+    case PN_OPCODE_SWITCH_BSEARCH_INT32:
+    case PN_OPCODE_SWITCH_BSEARCH_INT64:
     case PN_OPCODE_SWITCH_INT1:
-    case PN_OPCODE_SWITCH_INT8:  PN_OPCODE_SWITCH(i8); break;
-    case PN_OPCODE_SWITCH_INT16: PN_OPCODE_SWITCH(i16); break;
-    case PN_OPCODE_SWITCH_INT32: PN_OPCODE_SWITCH(i32); break;
-    case PN_OPCODE_SWITCH_INT64: PN_OPCODE_SWITCH(i64); break;
-// clang-format on
-
-#undef PN_OPCODE_SWITCH
-
+    case PN_OPCODE_SWITCH_INT8:
+    case PN_OPCODE_SWITCH_INT16:
+    case PN_OPCODE_SWITCH_INT32:
+    case PN_OPCODE_SWITCH_INT64:
+    case PN_OPCODE_SWITCH_TABLE_INT8:
+    case PN_OPCODE_SWITCH_TABLE_INT16:
+    case PN_OPCODE_SWITCH_TABLE_INT32:
+    case PN_OPCODE_SWITCH_TABLE_INT64:
     case PN_OPCODE_UNREACHABLE:
-      PN_FATAL("Reached unreachable instruction!\n");
-      break;
-
-    case PN_OPCODE_VSELECT: {
-      PNRuntimeInstructionVselect* i = (PNRuntimeInstructionVselect*)inst;
-      PNRuntimeValue cond = pn_thread_get_value(thread, i->cond_id);
-      PNValueId value_id = (cond.u8 & 1) ? i->true_value_id : i->false_value_id;
-      PNRuntimeValue result = pn_thread_get_value(thread, value_id);
-      pn_thread_set_value(thread, i->result_value_id, result);
-      thread->inst += sizeof(PNRuntimeInstructionVselect);
-      break;
-    }
+      return PN_FALSE;
 
     default:
-      PN_FATAL("Invalid opcode: %d\n", inst->opcode);
-      break;
+      return PN_TRUE;
   }
 }
+#endif /* PN_TRACING */
 
 #if PN_PPAPI
 static void pn_event_finish(PNThread* thread);
 static void pn_event_handle_next(PNThread* thread);
 #endif /* PN_PPAPI */
 
-PNThread* pn_executor_run_step(PNExecutor* executor, PNThread* thread) {
-  uint32_t i;
+/* Runs |thread| until it has passed |num_safepoints| safepoints or stops
+ * running, then returns the next thread to run, or NULL if the program has
+ * exited. */
+static PNThread* pn_executor_run_safepoints(PNExecutor* executor,
+                                            PNThread* thread,
+                                            uint32_t num_safepoints) {
+  switch (executor->variant) {
+    case PN_EXECUTOR_VARIANT_FAST:
+      pn_thread_run_quantum_fast(thread, num_safepoints, PN_FALSE);
+      break;
 
-#define PN_FOR_THREAD_QUANTUM \
-  for (i = 0;                 \
-       i < PN_INSTRUCTIONS_QUANTUM && thread->state == PN_THREAD_RUNNING; ++i)
+    case PN_EXECUTOR_VARIANT_COUNTING:
+      pn_thread_run_quantum_counting(thread, num_safepoints, PN_FALSE);
+      break;
 
 #if PN_TRACING
-  if (PN_IS_TRACE(EXECUTE)) {
-    PN_FOR_THREAD_QUANTUM {
-      PNFunction* function = thread->function;
-      PNCallFrame* frame = thread->current_frame;
-      PNRuntimeInstruction* inst = thread->inst;
-      g_pn_trace_indent += 2;
-      pn_runtime_instruction_trace(thread->module, function, inst);
-      g_pn_trace_indent -= 2;
-      pn_thread_execute_instruction(thread);
-      pn_runtime_instruction_trace_intrinsics(thread, inst);
-      pn_runtime_instruction_trace_values(thread, function, frame, inst);
-    }
-  } else if (PN_IS_TRACE(INTRINSICS)) {
-    PN_FOR_THREAD_QUANTUM {
-      PNRuntimeInstruction* inst = thread->inst;
-      pn_thread_execute_instruction(thread);
-      pn_runtime_instruction_trace_intrinsics(thread, inst);
-    }
-  } else
+    case PN_EXECUTOR_VARIANT_PROFILING:
+      /* Count each opcode that falls through together with the one after it;
+       * calls and returns are skipped since they change frames. */
+      while (num_safepoints > 0 && thread->state == PN_THREAD_RUNNING) {
+        PNCallFrame* frame = thread->current_frame;
+        PNRuntimeInstruction* inst = thread->inst;
+        num_safepoints =
+            pn_thread_run_quantum_profiling(thread, num_safepoints, PN_TRUE);
+        if (thread->state == PN_THREAD_RUNNING &&
+            thread->current_frame == frame &&
+            pn_opcode_falls_through(inst->opcode)) {
+          PNRuntimeInstruction* next = thread->inst;
+          g_pn_opcode_pair_count[inst->opcode * PN_MAX_OPCODE +
+                                 next->opcode]++;
+        }
+      }
+      break;
+
+    case PN_EXECUTOR_VARIANT_TRACING:
+      /* Tracing is done between instructions, so run one instruction at a
+       * time. */
+      if (PN_IS_TRACE(EXECUTE)) {
+        while (num_safepoints > 0 && thread->state == PN_THREAD_RUNNING) {
+          PNFunction* function = thread->function;
+          PNCallFrame* frame = thread->current_frame;
+          PNRuntimeInstruction* inst = thread->inst;
+          g_pn_trace_indent += 2;
+          pn_runtime_instruction_trace(thread->module, function, inst);
+          g_pn_trace_indent -= 2;
+          num_safepoints =
+              pn_thread_run_quantum_tracing(thread, num_safepoints, PN_TRUE);
+          pn_runtime_instruction_trace_intrinsics(thread, inst);
+          pn_runtime_instruction_trace_values(thread, function, frame, inst);
+        }
+      } else if (PN_IS_TRACE(INTRINSICS)) {
+        while (num_safepoints > 0 && thread->state == PN_THREAD_RUNNING) {
+          PNRuntimeInstruction* inst = thread->inst;
+          num_safepoints =
+              pn_thread_run_quantum_tracing(thread, num_safepoints, PN_TRUE);
+          pn_runtime_instruction_trace_intrinsics(thread, inst);
+        }
+      } else {
+        pn_thread_run_quantum_tracing(thread, num_safepoints, PN_FALSE);
+      }
+      break;
 #endif /* PN_TRACING */
-  {
-    PN_FOR_THREAD_QUANTUM { pn_thread_execute_instruction(thread); }
   }
 
   if (executor->exiting) {
@@ -1474,8 +474,32 @@ PNThread* pn_executor_run_step(PNExecutor* executor, PNThread* thread) {
   return thread;
 }
 
-void pn_executor_run(PNExecutor* executor) {
-  PNThread* thread = executor->main_thread;
+PNThread* pn_executor_run_step(PNExecutor* executor, PNThread* thread) {
+  /* A lone thread has nothing to yield to. Its quantum is cut short if it
+   * creates another thread. */
+  uint32_t num_safepoints =
+      thread->next == thread ? UINT32_MAX : PN_SAFEPOINT_QUANTUM;
+  return pn_executor_run_safepoints(executor, thread, num_safepoints);
+}
+
+#if PN_SNAPSHOT
+/* Runs from |thread| until a thread is about to run the first instruction of
+ * |function|, and returns that thread, or NULL if the program exits first.
+ * Entering a function is a safepoint, so this stops at every safepoint; it is
+ * only used until the snapshot is written. Calls made by functions loaded
+ * with --load-native aren't seen. */
+static PNThread* pn_executor_run_until_entered(PNExecutor* executor,
+                                               PNThread* thread,
+                                               PNFunction* function) {
+  while (thread && (thread->function != function ||
+                    thread->inst != function->instructions)) {
+    thread = pn_executor_run_safepoints(executor, thread, 1);
+  }
+  return thread;
+}
+#endif /* PN_SNAPSHOT */
+
+static void pn_executor_run_from(PNExecutor* executor, PNThread* thread) {
   uint32_t last_thread_id = thread->id;
   while (PN_TRUE) {
     thread = pn_executor_run_step(executor, thread);
@@ -1491,6 +515,10 @@ void pn_executor_run(PNExecutor* executor) {
   }
 }
 
+void pn_executor_run(PNExecutor* executor) {
+  pn_executor_run_from(executor, executor->main_thread);
+}
+
 #undef PN_VALUE_DESCRIBE
 
 #endif /* PN_EXECUTOR_H_ */
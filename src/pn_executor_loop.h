@@ -0,0 +1,1545 @@
+/* Copyright 2015 The Native Client Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. */
+
+/* No include guard; pn_executor.h includes this once per executor variant,
+ * with these defined:
+ *
+ *   PN_EXECUTOR_LOOP_NAME: the name of the function.
+ *   PN_EXECUTOR_LOOP_HANDLERS: dispatch through PNRuntimeInstruction.handler.
+ *   PN_EXECUTOR_LOOP_COUNTING: update g_pn_opcode_count and the call cache
+ *     statistics.
+ *   PN_EXECUTOR_LOOP_SINGLE_STEP: honor the |single_step| argument.
+ *   PN_EXECUTOR_LOOP_TRACING: trace memory accesses with --trace-memory.
+ *   PN_EXECUTOR_LOOP_JIT: compile hot functions with pn_jit_compile_function,
+ *     and run their compiled code at jumps and safepoints.
+ *   PN_EXECUTOR_LOOP_NATIVE: call functions loaded with --load-native.
+ *
+ * They are undefined again at the end of this file. */
+
+/* Runs |thread| until it has passed |num_safepoints| safepoints or is no
+ * longer running. Safepoints are backward jumps, calls and returns; every
+ * loop or recursion passes through one, so straight-line code runs without
+ * checking the scheduler at all. If |single_step| is set (only in variants
+ * with PN_EXECUTOR_LOOP_SINGLE_STEP), stops after one instruction instead.
+ * Returns the number of safepoints left. The instruction pointer and values of
+ * the current frame are cached in locals, and only written back to |thread|
+ * when leaving the loop or calling out of it.
+ *
+ * When PN_DIRECT_THREADED is set, each handler dispatches directly to the next
+ * one. The variant with PN_EXECUTOR_LOOP_HANDLERS uses the handler offset
+ * stored in the instruction; calling it with a NULL |thread| initializes
+ * g_pn_opcode_handlers, which is used by pn_function_calculate_opcodes to fill
+ * in those offsets. The other variants look up their own offsets by opcode. */
+static PN_NOINLINE uint32_t PN_EXECUTOR_LOOP_NAME(PNThread* thread,
+                                                  uint32_t num_safepoints,
+                                                  PNBool single_step) {
+#if PN_EXECUTOR_LOOP_COUNTING
+#define PN_COUNT(counter) (counter)++
+#else
+#define PN_COUNT(counter) (void)0
+#endif /* PN_EXECUTOR_LOOP_COUNTING */
+
+#if PN_EXECUTOR_LOOP_TRACING
+#define PN_MEMORY_READ(ty) pn_memory_read_##ty
+#define PN_MEMORY_WRITE(ty) pn_memory_write_##ty
+#else
+#define PN_MEMORY_READ(ty) pn_memory_read_untraced_##ty
+#define PN_MEMORY_WRITE(ty) pn_memory_write_untraced_##ty
+#endif /* PN_EXECUTOR_LOOP_TRACING */
+
+#if PN_DIRECT_THREADED
+#define PN_OPCODE_CASE(name) pn_opcode_##name
+#if PN_EXECUTOR_LOOP_HANDLERS
+#define PN_HANDLER() inst->handler
+#else
+#define PN_HANDLER() s_handlers[inst->opcode]
+#endif /* PN_EXECUTOR_LOOP_HANDLERS */
+#define PN_DISPATCH()                                \
+  do {                                               \
+    PN_COUNT(g_pn_opcode_count[inst->opcode]);       \
+    goto *(&&pn_opcode_ALLOCA_INT32 + PN_HANDLER()); \
+  } while (0) /* no semicolon */
+
+#define PN_OPCODE_HANDLER(e)                                    \
+  [PN_OPCODE_##e] = &&pn_opcode_##e - &&pn_opcode_ALLOCA_INT32,
+#define PN_INTRINSIC_HANDLER(e, name, num_args, result) \
+  PN_OPCODE_HANDLER(INTRINSIC_##e)
+#define PN_ATOMIC_RMW_HANDLER(e) PN_OPCODE_HANDLER(INTRINSIC_##e)
+#define PN_SUPERINSTRUCTION_HANDLER(first, second, family, ...) \
+  PN_OPCODE_HANDLER(first##_THEN_##second)
+  static const int32_t s_handlers[PN_MAX_OPCODE] = {
+      PN_FOREACH_OPCODE(PN_OPCODE_HANDLER)
+      PN_FOREACH_INTRINSIC(PN_INTRINSIC_HANDLER)
+      PN_FOREACH_ATOMIC_RMW_INTRINSIC_OPCODE(PN_ATOMIC_RMW_HANDLER)
+      PN_FOREACH_SUPERINSTRUCTION(PN_SUPERINSTRUCTION_HANDLER)
+  };
+#undef PN_SUPERINSTRUCTION_HANDLER
+#undef PN_ATOMIC_RMW_HANDLER
+#undef PN_INTRINSIC_HANDLER
+#undef PN_OPCODE_HANDLER
+
+#if PN_EXECUTOR_LOOP_HANDLERS
+  if (thread == NULL) {
+    g_pn_opcode_handlers = s_handlers;
+    return 0;
+  }
+#endif /* PN_EXECUTOR_LOOP_HANDLERS */
+#else
+/* Each case also gets the label it has when direct threaded, so
+ * superinstructions can jump to their second handler the same way. */
+#define PN_OPCODE_CASE(name)                     \
+  pn_opcode_##name: __attribute__((unused));     \
+  case PN_OPCODE_##name
+#define PN_DISPATCH() goto next_instruction
+
+  if (thread == NULL) {
+    return 0;
+  }
+#endif /* PN_DIRECT_THREADED */
+
+#define PN_GET_VALUE(slot) \
+  (PN_SLOT_IS_CONSTANT(slot) ? constants : function_values)[PN_SLOT_INDEX(slot)]
+#define PN_SET_VALUE(slot, value) function_values[PN_SLOT_INDEX(slot)] = value
+
+/* Reload the cached state after something that can change the current frame,
+ * e.g. pushing or popping a function. */
+#define PN_LOAD_STATE()                                       \
+  do {                                                        \
+    function = thread->function;                              \
+    inst = thread->inst;                                      \
+    function_values = thread->current_frame->function_values; \
+    constants = thread->current_frame->constants;             \
+  } while (0) /* no semicolon */
+
+#if PN_EXECUTOR_LOOP_SINGLE_STEP
+#define PN_STEP()      \
+  do {                 \
+    if (single_step) { \
+      goto done;       \
+    }                  \
+  } while (0) /* no semicolon */
+#else
+#define PN_STEP() (void)0
+#endif /* PN_EXECUTOR_LOOP_SINGLE_STEP */
+
+#if PN_EXECUTOR_LOOP_JIT
+/* Continues at |inst|, in compiled code if the function has any. */
+#define PN_JIT_DISPATCH()         \
+  do {                            \
+    if (function->jit_entries) {  \
+      goto pn_jit_enter;          \
+    }                             \
+    PN_DISPATCH();                \
+  } while (0) /* no semicolon */
+
+/* Every safepoint counts towards compiling the current function. */
+#define PN_JIT_TIER_UP()                                                   \
+  do {                                                                     \
+    if (!function->jit_entries && --function->jit_countdown == 0) {        \
+      pn_jit_compile_function(thread, function);                           \
+    }                                                                      \
+  } while (0) /* no semicolon */
+#else
+#define PN_JIT_DISPATCH() PN_DISPATCH()
+#define PN_JIT_TIER_UP() (void)0
+#endif /* PN_EXECUTOR_LOOP_JIT */
+
+/* Counts a safepoint, then continues at |inst|. */
+#define PN_SAFEPOINT()           \
+  do {                           \
+    if (--num_safepoints == 0) { \
+      goto done;                 \
+    }                            \
+    PN_STEP();                   \
+    PN_JIT_TIER_UP();            \
+    PN_JIT_DISPATCH();           \
+  } while (0) /* no semicolon */
+
+/* Instructions are laid out in basic block order, so every loop includes a
+ * jump that doesn't go forward; only those are safepoints. */
+#define PN_JUMP(new_inst)                                   \
+  do {                                                      \
+    PNRuntimeInstruction* target = (new_inst);              \
+    PNBool is_backward = (void*)target <= (void*)inst;      \
+    inst = target;                                          \
+    if (is_backward) {                                      \
+      PN_SAFEPOINT();                                       \
+    }                                                       \
+    PN_STEP();                                              \
+    PN_JIT_DISPATCH();                                      \
+  } while (0) /* no semicolon */
+
+#define PN_NEXT(size)            \
+  do {                           \
+    inst = (void*)inst + (size); \
+    PN_STEP();                   \
+    PN_DISPATCH();               \
+  } while (0) /* no semicolon */
+
+  PNModule* module = thread->module;
+  PNFunction* function;
+  PNRuntimeInstruction* inst;
+  PNRuntimeValue* function_values;
+  PNRuntimeValue* constants;
+
+  if (num_safepoints == 0 || thread->state != PN_THREAD_RUNNING) {
+    return num_safepoints;
+  }
+
+  PN_LOAD_STATE();
+
+#if PN_DIRECT_THREADED
+  PN_DISPATCH();
+  {
+#else
+  for (;;) {
+    PN_COUNT(g_pn_opcode_count[inst->opcode]);
+    switch (inst->opcode) {
+#endif /* PN_DIRECT_THREADED */
+    PN_OPCODE_CASE(ALLOCA_INT32): {
+      PNRuntimeInstructionAlloca* i = (PNRuntimeInstructionAlloca*)inst;
+      PNRuntimeValue size = PN_GET_VALUE(i->size_id);
+      thread->current_frame->memory_stack_top = pn_align_down(
+          thread->current_frame->memory_stack_top - size.i32, i->alignment);
+      if (thread == thread->executor->main_thread &&
+          thread->current_frame->memory_stack_top <
+              thread->executor->heap_end) {
+        PN_FATAL("Out of stack\n");
+      }
+      PNRuntimeValue result;
+      result.u32 = thread->current_frame->memory_stack_top;
+      PN_SET_VALUE(i->result_value_id, result);
+      PN_NEXT(sizeof(PNRuntimeInstructionAlloca));
+    }
+
+#define PN_OPCODE_BINOP(op, ty)                                             \
+  do {                                                                      \
+    PNRuntimeInstructionBinop* i = (PNRuntimeInstructionBinop*)inst;        \
+    PNRuntimeValue value0 = PN_GET_VALUE(i->value0_id);                     \
+    PNRuntimeValue value1 = PN_GET_VALUE(i->value1_id);                     \
+    PNRuntimeValue result = pn_executor_value_##ty(value0.ty op value1.ty); \
+    PN_SET_VALUE(i->result_value_id, result);                               \
+    PN_NEXT(sizeof(PNRuntimeInstructionBinop));                             \
+  } while (0) /* no semicolon */
+
+    // clang-format off
+    PN_OPCODE_CASE(BINOP_ADD_DOUBLE):  PN_OPCODE_BINOP(+, f64);
+    PN_OPCODE_CASE(BINOP_ADD_FLOAT):   PN_OPCODE_BINOP(+, f32);
+    PN_OPCODE_CASE(BINOP_ADD_INT8):    PN_OPCODE_BINOP(+, u8);
+    PN_OPCODE_CASE(BINOP_ADD_INT16):   PN_OPCODE_BINOP(+, u16);
+    PN_OPCODE_CASE(BINOP_ADD_INT32):   PN_OPCODE_BINOP(+, u32);
+    PN_OPCODE_CASE(BINOP_ADD_INT64):   PN_OPCODE_BINOP(+, u64);
+    PN_OPCODE_CASE(BINOP_AND_INT1):
+    PN_OPCODE_CASE(BINOP_AND_INT8):    PN_OPCODE_BINOP(&, u8);
+    PN_OPCODE_CASE(BINOP_AND_INT16):   PN_OPCODE_BINOP(&, u16);
+    PN_OPCODE_CASE(BINOP_AND_INT32):   PN_OPCODE_BINOP(&, u32);
+    PN_OPCODE_CASE(BINOP_AND_INT64):   PN_OPCODE_BINOP(&, u64);
+    PN_OPCODE_CASE(BINOP_ASHR_INT8):   PN_OPCODE_BINOP(>>, i8);
+    PN_OPCODE_CASE(BINOP_ASHR_INT16):  PN_OPCODE_BINOP(>>, i16);
+    PN_OPCODE_CASE(BINOP_ASHR_INT32):  PN_OPCODE_BINOP(>>, i32);
+    PN_OPCODE_CASE(BINOP_ASHR_INT64):  PN_OPCODE_BINOP(>>, i64);
+    PN_OPCODE_CASE(BINOP_LSHR_INT8):   PN_OPCODE_BINOP(>>, u8);
+    PN_OPCODE_CASE(BINOP_LSHR_INT16):  PN_OPCODE_BINOP(>>, u16);
+    PN_OPCODE_CASE(BINOP_LSHR_INT32):  PN_OPCODE_BINOP(>>, u32);
+    PN_OPCODE_CASE(BINOP_LSHR_INT64):  PN_OPCODE_BINOP(>>, u64);
+    PN_OPCODE_CASE(BINOP_MUL_DOUBLE):  PN_OPCODE_BINOP(*, f64);
+    PN_OPCODE_CASE(BINOP_MUL_FLOAT):   PN_OPCODE_BINOP(*, f32);
+    PN_OPCODE_CASE(BINOP_MUL_INT8):    PN_OPCODE_BINOP(*, u8);
+    PN_OPCODE_CASE(BINOP_MUL_INT16):   PN_OPCODE_BINOP(*, u16);
+    PN_OPCODE_CASE(BINOP_MUL_INT32):   PN_OPCODE_BINOP(*, u32);
+    PN_OPCODE_CASE(BINOP_MUL_INT64):   PN_OPCODE_BINOP(*, u64);
+    PN_OPCODE_CASE(BINOP_OR_INT1):
+    PN_OPCODE_CASE(BINOP_OR_INT8):     PN_OPCODE_BINOP(|, u8);
+    PN_OPCODE_CASE(BINOP_OR_INT16):    PN_OPCODE_BINOP(|, u16);
+    PN_OPCODE_CASE(BINOP_OR_INT32):    PN_OPCODE_BINOP(|, u32);
+    PN_OPCODE_CASE(BINOP_OR_INT64):    PN_OPCODE_BINOP(|, u64);
+    PN_OPCODE_CASE(BINOP_SDIV_DOUBLE): PN_OPCODE_BINOP(/, f64);
+    PN_OPCODE_CASE(BINOP_SDIV_FLOAT):  PN_OPCODE_BINOP(/, f32);
+    PN_OPCODE_CASE(BINOP_SDIV_INT32):  PN_OPCODE_BINOP(/, i32);
+    PN_OPCODE_CASE(BINOP_SDIV_INT64):  PN_OPCODE_BINOP(/, i64);
+    PN_OPCODE_CASE(BINOP_SHL_INT8):    PN_OPCODE_BINOP(<<, u8);
+    PN_OPCODE_CASE(BINOP_SHL_INT16):   PN_OPCODE_BINOP(<<, u16);
+    PN_OPCODE_CASE(BINOP_SHL_INT32):   PN_OPCODE_BINOP(<<, u32);
+    PN_OPCODE_CASE(BINOP_SHL_INT64):   PN_OPCODE_BINOP(<<, u64);
+    PN_OPCODE_CASE(BINOP_SREM_INT32):  PN_OPCODE_BINOP(%, i32);
+    PN_OPCODE_CASE(BINOP_SREM_INT64):  PN_OPCODE_BINOP(%, i64);
+    PN_OPCODE_CASE(BINOP_SUB_DOUBLE):  PN_OPCODE_BINOP(-, f64);
+    PN_OPCODE_CASE(BINOP_SUB_FLOAT):   PN_OPCODE_BINOP(-, f32);
+    PN_OPCODE_CASE(BINOP_SUB_INT8):    PN_OPCODE_BINOP(-, u8);
+    PN_OPCODE_CASE(BINOP_SUB_INT16):   PN_OPCODE_BINOP(-, u16);
+    PN_OPCODE_CASE(BINOP_SUB_INT32):   PN_OPCODE_BINOP(-, u32);
+    PN_OPCODE_CASE(BINOP_SUB_INT64):   PN_OPCODE_BINOP(-, u64);
+    PN_OPCODE_CASE(BINOP_UDIV_INT8):   PN_OPCODE_BINOP(/, u8);
+    PN_OPCODE_CASE(BINOP_UDIV_INT16):  PN_OPCODE_BINOP(/, u16);
+    PN_OPCODE_CASE(BINOP_UDIV_INT32):  PN_OPCODE_BINOP(/, u32);
+    PN_OPCODE_CASE(BINOP_UDIV_INT64):  PN_OPCODE_BINOP(/, u64);
+    PN_OPCODE_CASE(BINOP_UREM_INT8):   PN_OPCODE_BINOP(%, u8);
+    PN_OPCODE_CASE(BINOP_UREM_INT16):  PN_OPCODE_BINOP(%, u16);
+    PN_OPCODE_CASE(BINOP_UREM_INT32):  PN_OPCODE_BINOP(%, u32);
+    PN_OPCODE_CASE(BINOP_UREM_INT64):  PN_OPCODE_BINOP(%, u64);
+    PN_OPCODE_CASE(BINOP_XOR_INT1):
+    PN_OPCODE_CASE(BINOP_XOR_INT8):    PN_OPCODE_BINOP(^, u8);
+    PN_OPCODE_CASE(BINOP_XOR_INT16):   PN_OPCODE_BINOP(^, u16);
+    PN_OPCODE_CASE(BINOP_XOR_INT32):   PN_OPCODE_BINOP(^, u32);
+    PN_OPCODE_CASE(BINOP_XOR_INT64):   PN_OPCODE_BINOP(^, u64);
+// clang-format on
+
+#define PN_OPCODE_BINOP_IMM(op, ty)                                         \
+  do {                                                                      \
+    PNRuntimeInstructionBinop* i = (PNRuntimeInstructionBinop*)inst;        \
+    PNRuntimeValue value0 = PN_GET_VALUE(i->value0_id);                     \
+    PNRuntimeValue value1;                                                  \
+    value1.u32 = i->value1;                                                 \
+    PNRuntimeValue result = pn_executor_value_##ty(value0.ty op value1.ty); \
+    PN_SET_VALUE(i->result_value_id, result);                               \
+    PN_NEXT(sizeof(PNRuntimeInstructionBinop));                             \
+  } while (0) /* no semicolon */
+
+    // clang-format off
+    PN_OPCODE_CASE(BINOP_ADD_INT32_IMM):  PN_OPCODE_BINOP_IMM(+, u32);
+    PN_OPCODE_CASE(BINOP_AND_INT32_IMM):  PN_OPCODE_BINOP_IMM(&, u32);
+    PN_OPCODE_CASE(BINOP_ASHR_INT32_IMM): PN_OPCODE_BINOP_IMM(>>, i32);
+    PN_OPCODE_CASE(BINOP_LSHR_INT32_IMM): PN_OPCODE_BINOP_IMM(>>, u32);
+    PN_OPCODE_CASE(BINOP_MUL_INT32_IMM):  PN_OPCODE_BINOP_IMM(*, u32);
+    PN_OPCODE_CASE(BINOP_OR_INT32_IMM):   PN_OPCODE_BINOP_IMM(|, u32);
+    PN_OPCODE_CASE(BINOP_SDIV_INT32_IMM): PN_OPCODE_BINOP_IMM(/, i32);
+    PN_OPCODE_CASE(BINOP_SHL_INT32_IMM):  PN_OPCODE_BINOP_IMM(<<, u32);
+    PN_OPCODE_CASE(BINOP_SREM_INT32_IMM): PN_OPCODE_BINOP_IMM(%, i32);
+    PN_OPCODE_CASE(BINOP_SUB_INT32_IMM):  PN_OPCODE_BINOP_IMM(-, u32);
+    PN_OPCODE_CASE(BINOP_UDIV_INT32_IMM): PN_OPCODE_BINOP_IMM(/, u32);
+    PN_OPCODE_CASE(BINOP_UREM_INT32_IMM): PN_OPCODE_BINOP_IMM(%, u32);
+    PN_OPCODE_CASE(BINOP_XOR_INT32_IMM):  PN_OPCODE_BINOP_IMM(^, u32);
+// clang-format on
+
+    PN_OPCODE_CASE(BR): {
+      PNRuntimeInstructionBr* i = (PNRuntimeInstructionBr*)inst;
+      PN_JUMP(i->inst);
+    }
+
+    PN_OPCODE_CASE(BR_INT1): {
+      PNRuntimeInstructionBrInt1* i = (PNRuntimeInstructionBrInt1*)inst;
+      PNRuntimeValue value = PN_GET_VALUE(i->value_id);
+      void* new_inst = value.u8 ? i->true_inst : i->false_inst;
+      PN_JUMP(new_inst);
+    }
+
+    PN_OPCODE_CASE(CALL): {
+      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      PNCallFrame* old_frame = thread->current_frame;
+      old_frame->location.inst = inst;
+      thread->inst = inst;
+
+      PNCallee* callee;
+      if (!(i->flags & PN_CALL_FLAGS_INDIRECT)) {
+        callee = i->callee;
+      } else {
+        PNRuntimeValue function_value = PN_GET_VALUE(i->callee_id);
+        if (function_value.u32 == i->cache_pointer) {
+          PN_COUNT(g_pn_call_cache_hits);
+        } else {
+          pn_call_cache_update(module, i, function_value.u32);
+          PN_COUNT(g_pn_call_cache_misses);
+        }
+
+        if (i->flags & PN_CALL_FLAGS_CACHE_BUILTIN) {
+          /* Builtin function. Call it directly, don't set up a new frame */
+          const PNBuiltin* builtin = i->cache_builtin;
+          if (builtin == NULL || builtin->func == NULL) {
+            PN_FATAL("Unknown builtin: %d\n",
+                     pn_function_pointer_to_index(function_value.u32));
+          }
+
+          PNRuntimeValue result =
+              builtin->func(thread, function, i->num_args, arg_ids);
+          if (i->result_value_id != PN_INVALID_SLOT_ID) {
+            PN_SET_VALUE(i->result_value_id, result);
+          }
+
+          uint32_t call_size =
+              sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNSlotId);
+          if (builtin->flags == PN_BUILTIN_FLAGS_NONE) {
+            PN_NEXT(call_size);
+          }
+
+          if ((builtin->flags & PN_BUILTIN_FLAGS_CREATES_THREAD) &&
+              num_safepoints > PN_SAFEPOINT_QUANTUM) {
+            /* This may have been the only thread, which never yields. */
+            num_safepoints = PN_SAFEPOINT_QUANTUM;
+          }
+
+          /* If the builtin blocked this thread (e.g. FUTEX_WAIT_ABS), stay on
+           * the call so it is run again when the thread wakes. Also don't
+           * step over it when the builtin replaced the frame (PPAPI start); it
+           * pushed a new function. Otherwise this is a safepoint. */
+          if (!(builtin->flags & PN_BUILTIN_FLAGS_REPLACES_FRAME) &&
+              thread->state == PN_THREAD_RUNNING) {
+            inst = (void*)inst + call_size;
+            PN_SAFEPOINT();
+          }
+          PN_LOAD_STATE();
+          goto done;
+        }
+
+        callee = i->cache_callee;
+      }
+
+#if PN_EXECUTOR_LOOP_NATIVE
+      if (callee->native) {
+        PNRuntimeValue args[UINT8_MAX];
+        uint32_t n;
+        for (n = 0; n < i->num_args; ++n) {
+          args[n] = PN_GET_VALUE(arg_ids[n]);
+        }
+
+        PNRuntimeValue result = pn_thread_call_native(thread, callee, args);
+        if (i->result_value_id != PN_INVALID_SLOT_ID) {
+          PN_SET_VALUE(i->result_value_id, result);
+        }
+        inst = (void*)inst + sizeof(PNRuntimeInstructionCall) +
+               i->num_args * sizeof(PNSlotId);
+        PN_SAFEPOINT();
+      }
+#endif /* PN_EXECUTOR_LOOP_NATIVE */
+
+      if (callee->instructions == NULL) {
+        /* Skipped by lazy lowering, and not called until now */
+        pn_module_read_lazy_function(module, callee->function);
+      }
+
+      if ((i->flags & PN_CALL_FLAGS_REUSE_FRAME) &&
+          i->num_args <= PN_MAX_TAIL_CALL_ARGS) {
+        PNRuntimeValue args[PN_MAX_TAIL_CALL_ARGS];
+        uint32_t n;
+        for (n = 0; n < i->num_args; ++n) {
+          args[n] = PN_GET_VALUE(arg_ids[n]);
+        }
+
+        if (pn_thread_replace_frame(thread, function, callee)) {
+          memcpy(function_values, args, i->num_args * sizeof(PNRuntimeValue));
+          PN_LOAD_STATE();
+          PN_SAFEPOINT();
+        }
+      }
+
+      pn_thread_push_callee(thread, callee);
+
+      /* The caller's frame doesn't move when the callee is pushed, so the
+       * arguments can be read through the cached state and written directly
+       * into the callee's argument slots. */
+      PNRuntimeValue* args = thread->current_frame->function_values;
+      uint32_t n;
+      for (n = 0; n < i->num_args; ++n) {
+        args[n] = PN_GET_VALUE(arg_ids[n]);
+      }
+      PN_LOAD_STATE();
+      PN_SAFEPOINT();
+    }
+
+    PN_OPCODE_CASE(CAST_BITCAST_DOUBLE_INT64):
+    PN_OPCODE_CASE(CAST_BITCAST_FLOAT_INT32):
+    PN_OPCODE_CASE(CAST_BITCAST_INT32_FLOAT):
+    PN_OPCODE_CASE(CAST_BITCAST_INT64_DOUBLE): {
+      PNRuntimeInstructionCast* i = (PNRuntimeInstructionCast*)inst;
+      PNRuntimeValue result = PN_GET_VALUE(i->value_id);
+      PN_SET_VALUE(i->result_value_id, result);
+      PN_NEXT(sizeof(PNRuntimeInstructionCast));
+    }
+
+#define PN_OPCODE_CAST(from, to)                                   \
+  do {                                                             \
+    PNRuntimeInstructionCast* i = (PNRuntimeInstructionCast*)inst; \
+    PNRuntimeValue value = PN_GET_VALUE(i->value_id);              \
+    PNRuntimeValue result = pn_executor_value_##to(value.from);    \
+    PN_SET_VALUE(i->result_value_id, result);                      \
+    PN_NEXT(sizeof(PNRuntimeInstructionCast));                     \
+  } while (0) /* no semicolon */
+
+#define PN_OPCODE_CAST_SEXT1(size)                                 \
+  do {                                                             \
+    PNRuntimeInstructionCast* i = (PNRuntimeInstructionCast*)inst; \
+    PNRuntimeValue value = PN_GET_VALUE(i->value_id);              \
+    PNRuntimeValue result =                                        \
+        pn_executor_value_i##size(-(int##size##_t)(value.u8 & 1)); \
+    PN_SET_VALUE(i->result_value_id, result);                      \
+    PN_NEXT(sizeof(PNRuntimeInstructionCast));                     \
+  } while (0) /* no semicolon */
+
+#define PN_OPCODE_CAST_TRUNC1(size)                                  \
+  do {                                                               \
+    PNRuntimeInstructionCast* i = (PNRuntimeInstructionCast*)inst;   \
+    PNRuntimeValue value = PN_GET_VALUE(i->value_id);                \
+    PNRuntimeValue result = pn_executor_value_u8(value.u##size & 1); \
+    PN_SET_VALUE(i->result_value_id, result);                        \
+    PN_NEXT(sizeof(PNRuntimeInstructionCast));                       \
+  } while (0) /* no semicolon */
+
+#define PN_OPCODE_CAST_ZEXT1(size)                                 \
+  do {                                                             \
+    PNRuntimeInstructionCast* i = (PNRuntimeInstructionCast*)inst; \
+    PNRuntimeValue value = PN_GET_VALUE(i->value_id);              \
+    PNRuntimeValue result =                                        \
+        pn_executor_value_u##size((uint##size##_t)(value.u8 & 1)); \
+    PN_SET_VALUE(i->result_value_id, result);                      \
+    PN_NEXT(sizeof(PNRuntimeInstructionCast));                     \
+  } while (0) /* no semicolon */
+
+    // clang-format off
+    PN_OPCODE_CASE(CAST_FPEXT_FLOAT_DOUBLE):   PN_OPCODE_CAST(f32, f64);
+    PN_OPCODE_CASE(CAST_FPTOSI_DOUBLE_INT8):   PN_OPCODE_CAST(f64, i8);
+    PN_OPCODE_CASE(CAST_FPTOSI_DOUBLE_INT16):  PN_OPCODE_CAST(f64, i16);
+    PN_OPCODE_CASE(CAST_FPTOSI_DOUBLE_INT32):  PN_OPCODE_CAST(f64, i32);
+    PN_OPCODE_CASE(CAST_FPTOSI_DOUBLE_INT64):  PN_OPCODE_CAST(f64, i64);
+    PN_OPCODE_CASE(CAST_FPTOSI_FLOAT_INT8):    PN_OPCODE_CAST(f32, i8);
+    PN_OPCODE_CASE(CAST_FPTOSI_FLOAT_INT16):   PN_OPCODE_CAST(f32, i16);
+    PN_OPCODE_CASE(CAST_FPTOSI_FLOAT_INT32):   PN_OPCODE_CAST(f32, i32);
+    PN_OPCODE_CASE(CAST_FPTOSI_FLOAT_INT64):   PN_OPCODE_CAST(f32, i64);
+    PN_OPCODE_CASE(CAST_FPTOUI_DOUBLE_INT8):   PN_OPCODE_CAST(f64, u8);
+    PN_OPCODE_CASE(CAST_FPTOUI_DOUBLE_INT16):  PN_OPCODE_CAST(f64, u16);
+    PN_OPCODE_CASE(CAST_FPTOUI_DOUBLE_INT32):  PN_OPCODE_CAST(f64, u32);
+    PN_OPCODE_CASE(CAST_FPTOUI_DOUBLE_INT64):  PN_OPCODE_CAST(f64, u64);
+    PN_OPCODE_CASE(CAST_FPTOUI_FLOAT_INT8):    PN_OPCODE_CAST(f32, u8);
+    PN_OPCODE_CASE(CAST_FPTOUI_FLOAT_INT16):   PN_OPCODE_CAST(f32, u16);
+    PN_OPCODE_CASE(CAST_FPTOUI_FLOAT_INT32):   PN_OPCODE_CAST(f32, u32);
+    PN_OPCODE_CASE(CAST_FPTOUI_FLOAT_INT64):   PN_OPCODE_CAST(f32, u64);
+    PN_OPCODE_CASE(CAST_FPTRUNC_DOUBLE_FLOAT): PN_OPCODE_CAST(f64, f32);
+    PN_OPCODE_CASE(CAST_SEXT_INT1_INT8):       PN_OPCODE_CAST_SEXT1(8);
+    PN_OPCODE_CASE(CAST_SEXT_INT1_INT16):      PN_OPCODE_CAST_SEXT1(16);
+    PN_OPCODE_CASE(CAST_SEXT_INT1_INT32):      PN_OPCODE_CAST_SEXT1(32);
+    PN_OPCODE_CASE(CAST_SEXT_INT1_INT64):      PN_OPCODE_CAST_SEXT1(64);
+    PN_OPCODE_CASE(CAST_SEXT_INT8_INT16):      PN_OPCODE_CAST(i8, i16);
+    PN_OPCODE_CASE(CAST_SEXT_INT8_INT32):      PN_OPCODE_CAST(i8, i32);
+    PN_OPCODE_CASE(CAST_SEXT_INT8_INT64):      PN_OPCODE_CAST(i8, i64);
+    PN_OPCODE_CASE(CAST_SEXT_INT16_INT32):     PN_OPCODE_CAST(i16, i32);
+    PN_OPCODE_CASE(CAST_SEXT_INT16_INT64):     PN_OPCODE_CAST(i16, i64);
+    PN_OPCODE_CASE(CAST_SEXT_INT32_INT64):     PN_OPCODE_CAST(i32, i64);
+    PN_OPCODE_CASE(CAST_SITOFP_INT8_DOUBLE):   PN_OPCODE_CAST(i8, f64);
+    PN_OPCODE_CASE(CAST_SITOFP_INT8_FLOAT):    PN_OPCODE_CAST(i8, f32);
+    PN_OPCODE_CASE(CAST_SITOFP_INT16_DOUBLE):  PN_OPCODE_CAST(i16, f64);
+    PN_OPCODE_CASE(CAST_SITOFP_INT16_FLOAT):   PN_OPCODE_CAST(i16, f32);
+    PN_OPCODE_CASE(CAST_SITOFP_INT32_DOUBLE):  PN_OPCODE_CAST(i32, f64);
+    PN_OPCODE_CASE(CAST_SITOFP_INT32_FLOAT):   PN_OPCODE_CAST(i32, f32);
+    PN_OPCODE_CASE(CAST_SITOFP_INT64_DOUBLE):  PN_OPCODE_CAST(i64, f64);
+    PN_OPCODE_CASE(CAST_SITOFP_INT64_FLOAT):   PN_OPCODE_CAST(i64, f32);
+    PN_OPCODE_CASE(CAST_TRUNC_INT8_INT1):      PN_OPCODE_CAST_TRUNC1(8);
+    PN_OPCODE_CASE(CAST_TRUNC_INT16_INT1):     PN_OPCODE_CAST_TRUNC1(16);
+    PN_OPCODE_CASE(CAST_TRUNC_INT16_INT8):     PN_OPCODE_CAST(i16, i8);
+    PN_OPCODE_CASE(CAST_TRUNC_INT32_INT1):     PN_OPCODE_CAST_TRUNC1(32);
+    PN_OPCODE_CASE(CAST_TRUNC_INT32_INT8):     PN_OPCODE_CAST(i32, i8);
+    PN_OPCODE_CASE(CAST_TRUNC_INT32_INT16):    PN_OPCODE_CAST(i32, i16);
+    PN_OPCODE_CASE(CAST_TRUNC_INT64_INT8):     PN_OPCODE_CAST(i64, i8);
+    PN_OPCODE_CASE(CAST_TRUNC_INT64_INT16):    PN_OPCODE_CAST(i64, i16);
+    PN_OPCODE_CASE(CAST_TRUNC_INT64_INT32):    PN_OPCODE_CAST(i64, i32);
+    PN_OPCODE_CASE(CAST_UITOFP_INT8_DOUBLE):   PN_OPCODE_CAST(u8, f64);
+    PN_OPCODE_CASE(CAST_UITOFP_INT8_FLOAT):    PN_OPCODE_CAST(u8, f32);
+    PN_OPCODE_CASE(CAST_UITOFP_INT16_DOUBLE):  PN_OPCODE_CAST(u16, f64);
+    PN_OPCODE_CASE(CAST_UITOFP_INT16_FLOAT):   PN_OPCODE_CAST(u16, f32);
+    PN_OPCODE_CASE(CAST_UITOFP_INT32_DOUBLE):  PN_OPCODE_CAST(u32, f64);
+    PN_OPCODE_CASE(CAST_UITOFP_INT32_FLOAT):   PN_OPCODE_CAST(u32, f32);
+    PN_OPCODE_CASE(CAST_UITOFP_INT64_DOUBLE):  PN_OPCODE_CAST(u64, f64);
+    PN_OPCODE_CASE(CAST_UITOFP_INT64_FLOAT):   PN_OPCODE_CAST(u64, f32);
+    PN_OPCODE_CASE(CAST_ZEXT_INT1_INT8):       PN_OPCODE_CAST_ZEXT1(8);
+    PN_OPCODE_CASE(CAST_ZEXT_INT1_INT16):      PN_OPCODE_CAST_ZEXT1(16);
+    PN_OPCODE_CASE(CAST_ZEXT_INT1_INT32):      PN_OPCODE_CAST_ZEXT1(32);
+    PN_OPCODE_CASE(CAST_ZEXT_INT1_INT64):      PN_OPCODE_CAST_ZEXT1(64);
+    PN_OPCODE_CASE(CAST_ZEXT_INT8_INT16):      PN_OPCODE_CAST(u8, u16);
+    PN_OPCODE_CASE(CAST_ZEXT_INT8_INT32):      PN_OPCODE_CAST(u8, u32);
+    PN_OPCODE_CASE(CAST_ZEXT_INT8_INT64):      PN_OPCODE_CAST(u8, u64);
+    PN_OPCODE_CASE(CAST_ZEXT_INT16_INT32):     PN_OPCODE_CAST(u16, u32);
+    PN_OPCODE_CASE(CAST_ZEXT_INT16_INT64):     PN_OPCODE_CAST(u16, u64);
+    PN_OPCODE_CASE(CAST_ZEXT_INT32_INT64):     PN_OPCODE_CAST(u32, u64);
+// clang-format on
+
+#define PN_OPCODE_CMP2(op, ty)                                            \
+  do {                                                                    \
+    PNRuntimeInstructionCmp2* i = (PNRuntimeInstructionCmp2*)inst;        \
+    PNRuntimeValue value0 = PN_GET_VALUE(i->value0_id);                   \
+    PNRuntimeValue value1 = PN_GET_VALUE(i->value1_id);                   \
+    PNRuntimeValue result = pn_executor_value_u8(value0.ty op value1.ty); \
+    PN_SET_VALUE(i->result_value_id, result);                             \
+    PN_NEXT(sizeof(PNRuntimeInstructionCmp2));                            \
+  } while (0) /* no semicolon */
+
+#define PN_OPCODE_CMP2_NOT(op, ty)                                           \
+  do {                                                                       \
+    PNRuntimeInstructionCmp2* i = (PNRuntimeInstructionCmp2*)inst;           \
+    PNRuntimeValue value0 = PN_GET_VALUE(i->value0_id);                      \
+    PNRuntimeValue value1 = PN_GET_VALUE(i->value1_id);                      \
+    PNRuntimeValue result = pn_executor_value_u8(!(value0.ty op value1.ty)); \
+    PN_SET_VALUE(i->result_value_id, result);                                \
+    PN_NEXT(sizeof(PNRuntimeInstructionCmp2));                               \
+  } while (0) /* no semicolon */
+
+#define PN_OPCODE_CMP2_ORD(ty)                                             \
+  do {                                                                     \
+    PNRuntimeInstructionCmp2* i = (PNRuntimeInstructionCmp2*)inst;         \
+    PNRuntimeValue value0 = PN_GET_VALUE(i->value0_id);                    \
+    PNRuntimeValue value1 = PN_GET_VALUE(i->value1_id);                    \
+    PNRuntimeValue result = pn_executor_value_u8(value0.ty == value1.ty || \
+                                                 value0.ty != value1.ty);  \
+    PN_SET_VALUE(i->result_value_id, result);                              \
+    PN_NEXT(sizeof(PNRuntimeInstructionCmp2));                             \
+  } while (0) /* no semicolon */
+
+#define PN_OPCODE_CMP2_UNO(ty)                                     \
+  do {                                                             \
+    PNRuntimeInstructionCmp2* i = (PNRuntimeInstructionCmp2*)inst; \
+    PNRuntimeValue value0 = PN_GET_VALUE(i->value0_id);            \
+    PNRuntimeValue value1 = PN_GET_VALUE(i->value1_id);            \
+    PNRuntimeValue result = pn_executor_value_u8(                  \
+        !(value0.ty == value1.ty || value0.ty != value1.ty));      \
+    PN_SET_VALUE(i->result_value_id, result);                      \
+    PN_NEXT(sizeof(PNRuntimeInstructionCmp2));                     \
+  } while (0) /* no semicolon */
+
+    //        U L G E
+    // FALSE  0 0 0 0
+    // OEQ    0 0 0 1  A == B
+    // OGT    0 0 1 0  A > B
+    // OGE    0 0 1 1  A >= B
+    // OLT    0 1 0 0  A < B
+    // OLE    0 1 0 1  A <= B
+    // ONE    0 1 1 0  A != B
+    // ORD    0 1 1 1  A == B || A != B
+    // UNO    1 0 0 0  !(A == B || A != B)
+    // UEQ    1 0 0 1  !(A != B)
+    // UGT    1 0 1 0  !(A <= B)
+    // UGE    1 0 1 1  !(A < B)
+    // ULT    1 1 0 0  !(A >= B)
+    // ULE    1 1 0 1  !(A > B)
+    // UNE    1 1 1 0  !(A == B)
+    // TRUE   1 1 1 1
+
+    // clang-format off
+    PN_OPCODE_CASE(FCMP_OEQ_DOUBLE): PN_OPCODE_CMP2(==, f64);
+    PN_OPCODE_CASE(FCMP_OEQ_FLOAT):  PN_OPCODE_CMP2(==, f32);
+    PN_OPCODE_CASE(FCMP_OGE_DOUBLE): PN_OPCODE_CMP2(>=, f64);
+    PN_OPCODE_CASE(FCMP_OGE_FLOAT):  PN_OPCODE_CMP2(>=, f32);
+    PN_OPCODE_CASE(FCMP_OGT_DOUBLE): PN_OPCODE_CMP2(>, f64);
+    PN_OPCODE_CASE(FCMP_OGT_FLOAT):  PN_OPCODE_CMP2(>, f32);
+    PN_OPCODE_CASE(FCMP_OLE_DOUBLE): PN_OPCODE_CMP2(<=, f64);
+    PN_OPCODE_CASE(FCMP_OLE_FLOAT):  PN_OPCODE_CMP2(<=, f32);
+    PN_OPCODE_CASE(FCMP_OLT_DOUBLE): PN_OPCODE_CMP2(<, f64);
+    PN_OPCODE_CASE(FCMP_OLT_FLOAT):  PN_OPCODE_CMP2(<, f32);
+    PN_OPCODE_CASE(FCMP_ONE_DOUBLE): PN_OPCODE_CMP2(!=, f64);
+    PN_OPCODE_CASE(FCMP_ONE_FLOAT):  PN_OPCODE_CMP2(!=, f32);
+    PN_OPCODE_CASE(FCMP_ORD_DOUBLE): PN_OPCODE_CMP2_ORD(f64);
+    PN_OPCODE_CASE(FCMP_ORD_FLOAT):  PN_OPCODE_CMP2_ORD(f32);
+    PN_OPCODE_CASE(FCMP_UEQ_DOUBLE): PN_OPCODE_CMP2_NOT(!=, f64);
+    PN_OPCODE_CASE(FCMP_UEQ_FLOAT):  PN_OPCODE_CMP2_NOT(!=, f32);
+    PN_OPCODE_CASE(FCMP_UGE_DOUBLE): PN_OPCODE_CMP2_NOT(<, f64);
+    PN_OPCODE_CASE(FCMP_UGE_FLOAT):  PN_OPCODE_CMP2_NOT(<, f32);
+    PN_OPCODE_CASE(FCMP_UGT_DOUBLE): PN_OPCODE_CMP2_NOT(<=, f64);
+    PN_OPCODE_CASE(FCMP_UGT_FLOAT):  PN_OPCODE_CMP2_NOT(<=, f32);
+    PN_OPCODE_CASE(FCMP_ULE_DOUBLE): PN_OPCODE_CMP2_NOT(>, f64);
+    PN_OPCODE_CASE(FCMP_ULE_FLOAT):  PN_OPCODE_CMP2_NOT(>, f32);
+    PN_OPCODE_CASE(FCMP_ULT_DOUBLE): PN_OPCODE_CMP2_NOT(>=, f64);
+    PN_OPCODE_CASE(FCMP_ULT_FLOAT):  PN_OPCODE_CMP2_NOT(>=, f32);
+    PN_OPCODE_CASE(FCMP_UNE_DOUBLE): PN_OPCODE_CMP2_NOT(==, f64);
+    PN_OPCODE_CASE(FCMP_UNE_FLOAT):  PN_OPCODE_CMP2_NOT(==, f32);
+    PN_OPCODE_CASE(FCMP_UNO_DOUBLE): PN_OPCODE_CMP2_UNO(f64);
+    PN_OPCODE_CASE(FCMP_UNO_FLOAT):  PN_OPCODE_CMP2_UNO(f32);
+
+    PN_OPCODE_CASE(ICMP_EQ_INT8):   PN_OPCODE_CMP2(==, u8);
+    PN_OPCODE_CASE(ICMP_EQ_INT16):  PN_OPCODE_CMP2(==, u16);
+    PN_OPCODE_CASE(ICMP_EQ_INT32):  PN_OPCODE_CMP2(==, u32);
+    PN_OPCODE_CASE(ICMP_EQ_INT64):  PN_OPCODE_CMP2(==, u64);
+    PN_OPCODE_CASE(ICMP_NE_INT8):   PN_OPCODE_CMP2(!=, u8);
+    PN_OPCODE_CASE(ICMP_NE_INT16):  PN_OPCODE_CMP2(!=, u16);
+    PN_OPCODE_CASE(ICMP_NE_INT32):  PN_OPCODE_CMP2(!=, u32);
+    PN_OPCODE_CASE(ICMP_NE_INT64):  PN_OPCODE_CMP2(!=, u64);
+    PN_OPCODE_CASE(ICMP_SGE_INT8):  PN_OPCODE_CMP2(>=, i8);
+    PN_OPCODE_CASE(ICMP_SGE_INT16): PN_OPCODE_CMP2(>=, i16);
+    PN_OPCODE_CASE(ICMP_SGE_INT32): PN_OPCODE_CMP2(>=, i32);
+    PN_OPCODE_CASE(ICMP_SGE_INT64): PN_OPCODE_CMP2(>=, i64);
+    PN_OPCODE_CASE(ICMP_SGT_INT8):  PN_OPCODE_CMP2(>, i8);
+    PN_OPCODE_CASE(ICMP_SGT_INT16): PN_OPCODE_CMP2(>, i16);
+    PN_OPCODE_CASE(ICMP_SGT_INT32): PN_OPCODE_CMP2(>, i32);
+    PN_OPCODE_CASE(ICMP_SGT_INT64): PN_OPCODE_CMP2(>, i64);
+    PN_OPCODE_CASE(ICMP_SLE_INT8):  PN_OPCODE_CMP2(<=, i8);
+    PN_OPCODE_CASE(ICMP_SLE_INT16): PN_OPCODE_CMP2(<=, i16);
+    PN_OPCODE_CASE(ICMP_SLE_INT32): PN_OPCODE_CMP2(<=, i32);
+    PN_OPCODE_CASE(ICMP_SLE_INT64): PN_OPCODE_CMP2(<=, i64);
+    PN_OPCODE_CASE(ICMP_SLT_INT8):  PN_OPCODE_CMP2(<, i8);
+    PN_OPCODE_CASE(ICMP_SLT_INT16): PN_OPCODE_CMP2(<, i16);
+    PN_OPCODE_CASE(ICMP_SLT_INT32): PN_OPCODE_CMP2(<, i32);
+    PN_OPCODE_CASE(ICMP_SLT_INT64): PN_OPCODE_CMP2(<, i64);
+    PN_OPCODE_CASE(ICMP_UGE_INT8):  PN_OPCODE_CMP2(>=, u8);
+    PN_OPCODE_CASE(ICMP_UGE_INT16): PN_OPCODE_CMP2(>=, u16);
+    PN_OPCODE_CASE(ICMP_UGE_INT32): PN_OPCODE_CMP2(>=, u32);
+    PN_OPCODE_CASE(ICMP_UGE_INT64): PN_OPCODE_CMP2(>=, u64);
+    PN_OPCODE_CASE(ICMP_UGT_INT8):  PN_OPCODE_CMP2(>, u8);
+    PN_OPCODE_CASE(ICMP_UGT_INT16): PN_OPCODE_CMP2(>, u16);
+    PN_OPCODE_CASE(ICMP_UGT_INT32): PN_OPCODE_CMP2(>, u32);
+    PN_OPCODE_CASE(ICMP_UGT_INT64): PN_OPCODE_CMP2(>, u64);
+    PN_OPCODE_CASE(ICMP_ULE_INT8):  PN_OPCODE_CMP2(<=, u8);
+    PN_OPCODE_CASE(ICMP_ULE_INT16): PN_OPCODE_CMP2(<=, u16);
+    PN_OPCODE_CASE(ICMP_ULE_INT32): PN_OPCODE_CMP2(<=, u32);
+    PN_OPCODE_CASE(ICMP_ULE_INT64): PN_OPCODE_CMP2(<=, u64);
+    PN_OPCODE_CASE(ICMP_ULT_INT8):  PN_OPCODE_CMP2(<, u8);
+    PN_OPCODE_CASE(ICMP_ULT_INT16): PN_OPCODE_CMP2(<, u16);
+    PN_OPCODE_CASE(ICMP_ULT_INT32): PN_OPCODE_CMP2(<, u32);
+    PN_OPCODE_CASE(ICMP_ULT_INT64): PN_OPCODE_CMP2(<, u64);
+// clang-format on
+
+#define PN_OPCODE_CMP2_IMM(op, ty)                                        \
+  do {                                                                    \
+    PNRuntimeInstructionCmp2* i = (PNRuntimeInstructionCmp2*)inst;        \
+    PNRuntimeValue value0 = PN_GET_VALUE(i->value0_id);                   \
+    PNRuntimeValue value1;                                                \
+    value1.u32 = i->value1;                                               \
+    PNRuntimeValue result = pn_executor_value_u8(value0.ty op value1.ty); \
+    PN_SET_VALUE(i->result_value_id, result);                             \
+    PN_NEXT(sizeof(PNRuntimeInstructionCmp2));                            \
+  } while (0) /* no semicolon */
+
+    // clang-format off
+    PN_OPCODE_CASE(ICMP_EQ_INT32_IMM):  PN_OPCODE_CMP2_IMM(==, u32);
+    PN_OPCODE_CASE(ICMP_NE_INT32_IMM):  PN_OPCODE_CMP2_IMM(!=, u32);
+    PN_OPCODE_CASE(ICMP_SGE_INT32_IMM): PN_OPCODE_CMP2_IMM(>=, i32);
+    PN_OPCODE_CASE(ICMP_SGT_INT32_IMM): PN_OPCODE_CMP2_IMM(>, i32);
+    PN_OPCODE_CASE(ICMP_SLE_INT32_IMM): PN_OPCODE_CMP2_IMM(<=, i32);
+    PN_OPCODE_CASE(ICMP_SLT_INT32_IMM): PN_OPCODE_CMP2_IMM(<, i32);
+    PN_OPCODE_CASE(ICMP_UGE_INT32_IMM): PN_OPCODE_CMP2_IMM(>=, u32);
+    PN_OPCODE_CASE(ICMP_UGT_INT32_IMM): PN_OPCODE_CMP2_IMM(>, u32);
+    PN_OPCODE_CASE(ICMP_ULE_INT32_IMM): PN_OPCODE_CMP2_IMM(<=, u32);
+    PN_OPCODE_CASE(ICMP_ULT_INT32_IMM): PN_OPCODE_CMP2_IMM(<, u32);
+// clang-format on
+
+/* Intrinsic handlers don't check their argument count or result; calls are
+ * verified against the intrinsic's signature in PN_FOREACH_INTRINSIC by
+ * pn_function_verify when the function is loaded. */
+#define PN_ARG(i, ty) PN_GET_VALUE(arg_ids[i]).ty
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_CTLZ_I32): {
+      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      uint32_t src = PN_ARG(0, u32);
+      uint32_t is_zero_undef = PN_ARG(1, u32);
+      uint32_t result = src == 0 ? 0 : __builtin_clz(src);
+      (void)is_zero_undef;
+      PN_SET_VALUE(i->result_value_id, pn_executor_value_u32(result));
+      PN_NEXT(sizeof(PNRuntimeInstructionCall) +
+              i->num_args * sizeof(PNSlotId));
+    }
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_CTLZ_I64): {
+      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      uint64_t src = PN_ARG(0, u64);
+      uint32_t is_zero_undef = PN_ARG(1, u32);
+      uint64_t result = src == 0 ? 0 : __builtin_clzll(src);
+      (void)is_zero_undef;
+      PN_SET_VALUE(i->result_value_id, pn_executor_value_u64(result));
+      PN_NEXT(sizeof(PNRuntimeInstructionCall) +
+              i->num_args * sizeof(PNSlotId));
+    }
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_CTTZ_I32): {
+      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      uint32_t src = PN_ARG(0, u32);
+      uint32_t is_zero_undef = PN_ARG(1, u32);
+      uint32_t result = src == 0 ? 0 : __builtin_ctz(src);
+      (void)is_zero_undef;
+      PN_SET_VALUE(i->result_value_id, pn_executor_value_u32(result));
+      PN_NEXT(sizeof(PNRuntimeInstructionCall) +
+              i->num_args * sizeof(PNSlotId));
+    }
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_CTTZ_I64): {
+      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      uint64_t src = PN_ARG(0, u64);
+      uint32_t is_zero_undef = PN_ARG(1, u32);
+      uint64_t result = src == 0 ? 0 : __builtin_ctzll(src);
+      (void)is_zero_undef;
+      PN_SET_VALUE(i->result_value_id, pn_executor_value_u64(result));
+      PN_NEXT(sizeof(PNRuntimeInstructionCall) +
+              i->num_args * sizeof(PNSlotId));
+    }
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_MEMCPY): {
+      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      uint32_t dst_p = PN_ARG(0, u32);
+      uint32_t src_p = PN_ARG(1, u32);
+      uint32_t len = PN_ARG(2, u32);
+
+      if (len > 0) {
+        pn_memory_check(thread->executor->memory, dst_p, len);
+        pn_memory_check(thread->executor->memory, src_p, len);
+        void* dst_pointer = thread->executor->memory->data + dst_p;
+        void* src_pointer = thread->executor->memory->data + src_p;
+        memcpy(dst_pointer, src_pointer, len);
+      }
+      PN_NEXT(sizeof(PNRuntimeInstructionCall) +
+              i->num_args * sizeof(PNSlotId));
+    }
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_MEMSET): {
+      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      uint32_t dst_p = PN_ARG(0, u32);
+      uint8_t value = PN_ARG(1, u8);
+      uint32_t len = PN_ARG(2, u32);
+
+      if (len > 0) {
+        pn_memory_check(thread->executor->memory, dst_p, len);
+        void* dst_pointer = thread->executor->memory->data + dst_p;
+        memset(dst_pointer, value, len);
+      }
+      PN_NEXT(sizeof(PNRuntimeInstructionCall) +
+              i->num_args * sizeof(PNSlotId));
+    }
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_MEMMOVE): {
+      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      uint32_t dst_p = PN_ARG(0, u32);
+      uint32_t src_p = PN_ARG(1, u32);
+      uint32_t len = PN_ARG(2, u32);
+
+      if (len > 0) {
+        pn_memory_check(thread->executor->memory, dst_p, len);
+        pn_memory_check(thread->executor->memory, src_p, len);
+        void* dst_pointer = thread->executor->memory->data + dst_p;
+        void* src_pointer = thread->executor->memory->data + src_p;
+        memmove(dst_pointer, src_pointer, len);
+      }
+      PN_NEXT(sizeof(PNRuntimeInstructionCall) +
+              i->num_args * sizeof(PNSlotId));
+    }
+
+#define PN_OPCODE_INTRINSIC_CMPXCHG(ty)                                      \
+  do {                                                                       \
+    PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;           \
+    PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);     \
+    uint32_t addr_p = PN_ARG(0, u32);                                        \
+    pn_##ty expected = PN_ARG(1, ty);                                        \
+    pn_##ty desired = PN_ARG(2, ty);                                         \
+    pn_##ty read = PN_MEMORY_READ(ty)(thread->executor->memory, addr_p);     \
+    PNRuntimeValue result = pn_executor_value_##ty(read);                    \
+    if (read == expected) {                                                  \
+      PN_MEMORY_WRITE(ty)(thread->executor->memory, addr_p, desired);        \
+    }                                                                        \
+    PN_SET_VALUE(i->result_value_id, result);                                \
+    PN_NEXT(                                                                 \
+        sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNSlotId)); \
+  } while (0) /* no semicolon */
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_CMPXCHG_I8):
+      PN_OPCODE_INTRINSIC_CMPXCHG(u8);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_CMPXCHG_I16):
+      PN_OPCODE_INTRINSIC_CMPXCHG(u16);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_CMPXCHG_I32):
+      PN_OPCODE_INTRINSIC_CMPXCHG(u32);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_CMPXCHG_I64):
+      PN_OPCODE_INTRINSIC_CMPXCHG(u64);
+
+#undef PN_OPCODE_INTRINSIC_CMPXCHG
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_FENCE_ALL): {
+      /* Do nothing. */
+      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
+      PN_NEXT(sizeof(PNRuntimeInstructionCall) +
+              i->num_args * sizeof(PNSlotId));
+    }
+
+#define PN_OPCODE_INTRINSIC_LOAD(ty)                                         \
+  do {                                                                       \
+    PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;           \
+    PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);     \
+    uint32_t addr_p = PN_ARG(0, u32);                                        \
+    pn_##ty value = PN_MEMORY_READ(ty)(thread->executor->memory, addr_p);    \
+    PNRuntimeValue result = pn_executor_value_##ty(value);                   \
+    PN_SET_VALUE(i->result_value_id, result);                                \
+    PN_NEXT(                                                                 \
+        sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNSlotId)); \
+  } while (0) /* no semicolon */
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_LOAD_I8):
+      PN_OPCODE_INTRINSIC_LOAD(u8);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_LOAD_I16):
+      PN_OPCODE_INTRINSIC_LOAD(u16);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_LOAD_I32):
+      PN_OPCODE_INTRINSIC_LOAD(u32);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_LOAD_I64):
+      PN_OPCODE_INTRINSIC_LOAD(u64);
+
+#undef PN_OPCODE_INTRINSIC_LOAD
+
+/* The first arg is the constant |opval|; the opcode was chosen from it when
+ * the call was lowered. */
+#define PN_OPCODE_INTRINSIC_RMW(opval, op, ty)                                 \
+  do {                                                                         \
+    PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;             \
+    PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);       \
+    uint32_t addr_p = PN_ARG(1, u32);                                          \
+    pn_##ty value = PN_ARG(2, ty);                                             \
+    pn_##ty old_value = PN_MEMORY_READ(ty)(thread->executor->memory, addr_p);  \
+    pn_##ty new_value = old_value op value;                                    \
+    PN_MEMORY_WRITE(ty)(thread->executor->memory, addr_p, new_value);          \
+    PNRuntimeValue result = pn_executor_value_u32(old_value);                  \
+    PN_SET_VALUE(i->result_value_id, result);                                  \
+    PN_NEXT(                                                                   \
+        sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNSlotId));   \
+  } while (0) /* no semicolon */
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_ADD_I8):
+      PN_OPCODE_INTRINSIC_RMW(1, +, u8);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_ADD_I16):
+      PN_OPCODE_INTRINSIC_RMW(1, +, u16);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_ADD_I32):
+      PN_OPCODE_INTRINSIC_RMW(1, +, u32);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_ADD_I64):
+      PN_OPCODE_INTRINSIC_RMW(1, +, u64);
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_SUB_I8):
+      PN_OPCODE_INTRINSIC_RMW(2, -, u8);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_SUB_I16):
+      PN_OPCODE_INTRINSIC_RMW(2, -, u16);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_SUB_I32):
+      PN_OPCODE_INTRINSIC_RMW(2, -, u32);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_SUB_I64):
+      PN_OPCODE_INTRINSIC_RMW(2, -, u64);
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_AND_I8):
+      PN_OPCODE_INTRINSIC_RMW(3, &, u8);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_AND_I16):
+      PN_OPCODE_INTRINSIC_RMW(3, &, u16);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_AND_I32):
+      PN_OPCODE_INTRINSIC_RMW(3, &, u32);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_AND_I64):
+      PN_OPCODE_INTRINSIC_RMW(3, &, u64);
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_OR_I8):
+      PN_OPCODE_INTRINSIC_RMW(4, |, u8);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_OR_I16):
+      PN_OPCODE_INTRINSIC_RMW(4, |, u16);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_OR_I32):
+      PN_OPCODE_INTRINSIC_RMW(4, |, u32);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_OR_I64):
+      PN_OPCODE_INTRINSIC_RMW(4, |, u64);
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_XOR_I8):
+      PN_OPCODE_INTRINSIC_RMW(5, ^, u8);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_XOR_I16):
+      PN_OPCODE_INTRINSIC_RMW(5, ^, u16);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_XOR_I32):
+      PN_OPCODE_INTRINSIC_RMW(5, ^, u32);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_XOR_I64):
+      PN_OPCODE_INTRINSIC_RMW(5, ^, u64);
+
+#define PN_OPCODE_INTRINSIC_EXCHANGE(opval, ty)                                \
+  do {                                                                         \
+    PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;             \
+    PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);       \
+    uint32_t addr_p = PN_ARG(1, u32);                                          \
+    pn_##ty value = PN_ARG(2, ty);                                             \
+    pn_##ty old_value = PN_MEMORY_READ(ty)(thread->executor->memory, addr_p);  \
+    pn_##ty new_value = value;                                                 \
+    PN_MEMORY_WRITE(ty)(thread->executor->memory, addr_p, new_value);          \
+    PNRuntimeValue result = pn_executor_value_u32(old_value);                  \
+    PN_SET_VALUE(i->result_value_id, result);                                  \
+    PN_NEXT(                                                                   \
+        sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNSlotId));   \
+  } while (0) /* no semicolon */
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_EXCHANGE_I8):
+      PN_OPCODE_INTRINSIC_EXCHANGE(6, u8);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_EXCHANGE_I16):
+      PN_OPCODE_INTRINSIC_EXCHANGE(6, u16);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_EXCHANGE_I32):
+      PN_OPCODE_INTRINSIC_EXCHANGE(6, u32);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_EXCHANGE_I64):
+      PN_OPCODE_INTRINSIC_EXCHANGE(6, u64);
+
+#undef PN_OPCODE_INTRINSIC_RMW
+#undef PN_OPCODE_INTRINSIC_EXCHANGE
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_LONGJMP): {
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      uint32_t jmpbuf_p = PN_ARG(0, u32);
+      PNRuntimeValue value = PN_GET_VALUE(arg_ids[1]);
+
+      PNJmpBufId id = PN_MEMORY_READ(u32)(thread->executor->memory, jmpbuf_p);
+
+      uint32_t index =
+          PN_MEMORY_READ(u32)(thread->executor->memory, jmpbuf_p + 4);
+      if (index >= thread->num_jmpbufs || thread->jmpbufs[index].id != id) {
+        PN_FATAL("Invalid jmpbuf target: %d\n", id);
+      }
+
+      /* Unwind to the setjmp's frame, dropping the frames it called and
+       * their jmpbufs. A jmpbuf re-armed in this frame keeps its old index,
+       * so jmpbufs after it may still belong to this frame; keep those. */
+      PNJmpBuf* buf = &thread->jmpbufs[index];
+      PNCallFrame* frame = buf->frame;
+      pn_frame_stack_free_to(&thread->frame_stack, buf->frame_stack_top);
+      uint32_t num_jmpbufs = index + 1;
+      while (num_jmpbufs < thread->num_jmpbufs &&
+             thread->jmpbufs[num_jmpbufs].frame == frame) {
+        num_jmpbufs++;
+      }
+      thread->num_jmpbufs = num_jmpbufs;
+      thread->current_frame = frame;
+      frame->location.inst = buf->inst;
+      frame->memory_stack_top = buf->memory_stack_top;
+
+      PNRuntimeInstructionCall* c = buf->inst;
+      thread->inst = buf->inst + sizeof(PNRuntimeInstructionCall) +
+                     c->num_args * sizeof(PNSlotId);
+      thread->function = &module->functions[frame->location.function_id];
+      PN_LOAD_STATE();
+      /* Set the return value */
+      PN_SET_VALUE(c->result_value_id, value);
+      PN_SAFEPOINT();
+    }
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_SETJMP): {
+      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      uint32_t jmpbuf_p = PN_ARG(0, u32);
+
+      /* Re-arming a jmpbuf that was set in this frame (e.g. setjmp in a loop)
+       * reuses its entry, so the table doesn't grow until the frame returns.
+       */
+      PNJmpBufId old_id =
+          PN_MEMORY_READ(u32)(thread->executor->memory, jmpbuf_p);
+      uint32_t index =
+          PN_MEMORY_READ(u32)(thread->executor->memory, jmpbuf_p + 4);
+      if (index < thread->current_frame->jmpbuf_base ||
+          index >= thread->num_jmpbufs ||
+          thread->jmpbufs[index].id != old_id) {
+        if (thread->num_jmpbufs == thread->max_jmpbufs) {
+          thread->max_jmpbufs =
+              thread->max_jmpbufs ? thread->max_jmpbufs * 2 : 16;
+          thread->jmpbufs = pn_realloc(
+              thread->jmpbufs, thread->max_jmpbufs * sizeof(PNJmpBuf));
+        }
+        index = thread->num_jmpbufs++;
+        thread->jmpbufs[index].id = thread->executor->next_jmpbuf_id++;
+      }
+
+      PNJmpBuf* buf = &thread->jmpbufs[index];
+      buf->memory_stack_top = thread->current_frame->memory_stack_top;
+      buf->frame = thread->current_frame;
+      buf->inst = inst;
+      buf->frame_stack_top = thread->frame_stack.top;
+      PN_MEMORY_WRITE(u32)(thread->executor->memory, jmpbuf_p, buf->id);
+      PN_MEMORY_WRITE(u32)(thread->executor->memory, jmpbuf_p + 4, index);
+      PNRuntimeValue result = pn_executor_value_u32(0);
+      PN_SET_VALUE(i->result_value_id, result);
+      PN_NEXT(sizeof(PNRuntimeInstructionCall) +
+              i->num_args * sizeof(PNSlotId));
+    }
+
+#define PN_OPCODE_INTRINSIC_STORE(ty)                                        \
+  do {                                                                       \
+    PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;           \
+    PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);     \
+    uint32_t value = PN_ARG(0, ty);                                          \
+    uint32_t addr_p = PN_ARG(1, u32);                                        \
+    PN_MEMORY_WRITE(u32)(thread->executor->memory, addr_p, value);           \
+    PN_NEXT(                                                                 \
+        sizeof(PNRuntimeInstructionCall) + i->num_args * sizeof(PNSlotId)); \
+  } while (0) /* no semicolon */
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_STORE_I8):
+      PN_OPCODE_INTRINSIC_STORE(u8);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_STORE_I16):
+      PN_OPCODE_INTRINSIC_STORE(u16);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_STORE_I32):
+      PN_OPCODE_INTRINSIC_STORE(u32);
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_ATOMIC_STORE_I64):
+      PN_OPCODE_INTRINSIC_STORE(u64);
+
+#undef PN_OPCODE_INTRINSIC_STORE
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_NACL_READ_TP): {
+      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
+      PNRuntimeValue result = pn_executor_value_u32(thread->tls);
+      PN_SET_VALUE(i->result_value_id, result);
+      PN_NEXT(sizeof(PNRuntimeInstructionCall) +
+              i->num_args * sizeof(PNSlotId));
+    }
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_SQRT_F32): {
+      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      float value = PN_ARG(0, f32);
+      PNRuntimeValue result = pn_executor_value_f32(sqrtf(value));
+      PN_SET_VALUE(i->result_value_id, result);
+      PN_NEXT(sizeof(PNRuntimeInstructionCall) +
+              i->num_args * sizeof(PNSlotId));
+    }
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_SQRT_F64): {
+      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      double value = PN_ARG(0, f64);
+      PNRuntimeValue result = pn_executor_value_f64(sqrt(value));
+      PN_SET_VALUE(i->result_value_id, result);
+      PN_NEXT(sizeof(PNRuntimeInstructionCall) +
+              i->num_args * sizeof(PNSlotId));
+    }
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_STACKRESTORE): {
+      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      uint32_t value = PN_ARG(0, u32);
+      /* TODO(binji): validate stack pointer */
+      thread->current_frame->memory_stack_top = value;
+      PN_NEXT(sizeof(PNRuntimeInstructionCall) +
+              i->num_args * sizeof(PNSlotId));
+    }
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_STACKSAVE): {
+      PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
+      PNRuntimeValue result =
+          pn_executor_value_u32(thread->current_frame->memory_stack_top);
+      PN_SET_VALUE(i->result_value_id, result);
+      PN_NEXT(sizeof(PNRuntimeInstructionCall) +
+              i->num_args * sizeof(PNSlotId));
+    }
+
+    PN_OPCODE_CASE(INTRINSIC_LLVM_TRAP): {
+      thread->executor->exit_code = -1;
+      thread->executor->exiting = PN_TRUE;
+      thread->state = PN_THREAD_DEAD;
+      goto done;
+    }
+
+#define PN_OPCODE_INTRINSIC_STUB(name)                \
+  PN_OPCODE_CASE(INTRINSIC_##name) : {                \
+    PN_FATAL("Unimplemented intrinsic: %s\n", #name); \
+    goto done;                                        \
+  }
+
+      PN_OPCODE_INTRINSIC_STUB(LLVM_BSWAP_I16)
+      PN_OPCODE_INTRINSIC_STUB(LLVM_BSWAP_I32)
+      PN_OPCODE_INTRINSIC_STUB(LLVM_BSWAP_I64)
+      PN_OPCODE_INTRINSIC_STUB(LLVM_FABS_F32)
+      PN_OPCODE_INTRINSIC_STUB(LLVM_FABS_F64)
+      PN_OPCODE_INTRINSIC_STUB(LLVM_NACL_ATOMIC_RMW_I8)
+      PN_OPCODE_INTRINSIC_STUB(LLVM_NACL_ATOMIC_RMW_I16)
+      PN_OPCODE_INTRINSIC_STUB(LLVM_NACL_ATOMIC_RMW_I32)
+      PN_OPCODE_INTRINSIC_STUB(LLVM_NACL_ATOMIC_RMW_I64)
+      PN_OPCODE_INTRINSIC_STUB(START)
+
+#undef PN_ARG
+
+#define PN_OPCODE_LOAD(ty)                                         \
+  do {                                                             \
+    PNRuntimeInstructionLoad* i = (PNRuntimeInstructionLoad*)inst; \
+    PNRuntimeValue src = PN_GET_VALUE(i->src_id);                  \
+    PNRuntimeValue result = pn_executor_value_##ty(                \
+        PN_MEMORY_READ(ty)(thread->executor->memory, src.u32));    \
+    PN_SET_VALUE(i->result_value_id, result);                      \
+    PN_NEXT(sizeof(PNRuntimeInstructionLoad));                     \
+  } while (0) /*no semicolon */
+
+    // clang-format off
+    PN_OPCODE_CASE(LOAD_DOUBLE): PN_OPCODE_LOAD(f64);
+    PN_OPCODE_CASE(LOAD_FLOAT): PN_OPCODE_LOAD(f32);
+    PN_OPCODE_CASE(LOAD_INT8): PN_OPCODE_LOAD(u8);
+    PN_OPCODE_CASE(LOAD_INT16): PN_OPCODE_LOAD(u16);
+    PN_OPCODE_CASE(LOAD_INT32): PN_OPCODE_LOAD(u32);
+    PN_OPCODE_CASE(LOAD_INT64): PN_OPCODE_LOAD(u64);
+// clang-format on
+
+#define PN_OPCODE_LOAD_OFFSET(ty)                                          \
+  do {                                                                     \
+    PNRuntimeInstructionLoadOffset* i =                                    \
+        (PNRuntimeInstructionLoadOffset*)inst;                             \
+    PNRuntimeValue src = PN_GET_VALUE(i->src_id);                          \
+    PNRuntimeValue result = pn_executor_value_##ty(PN_MEMORY_READ(ty)(     \
+        thread->executor->memory, src.u32 + i->offset));                   \
+    PN_SET_VALUE(i->result_value_id, result);                              \
+    PN_NEXT(sizeof(PNRuntimeInstructionLoadOffset));                       \
+  } while (0) /*no semicolon */
+
+    // clang-format off
+    PN_OPCODE_CASE(LOAD_DOUBLE_OFFSET): PN_OPCODE_LOAD_OFFSET(f64);
+    PN_OPCODE_CASE(LOAD_FLOAT_OFFSET): PN_OPCODE_LOAD_OFFSET(f32);
+    PN_OPCODE_CASE(LOAD_INT8_OFFSET): PN_OPCODE_LOAD_OFFSET(u8);
+    PN_OPCODE_CASE(LOAD_INT16_OFFSET): PN_OPCODE_LOAD_OFFSET(u16);
+    PN_OPCODE_CASE(LOAD_INT32_OFFSET): PN_OPCODE_LOAD_OFFSET(u32);
+    PN_OPCODE_CASE(LOAD_INT64_OFFSET): PN_OPCODE_LOAD_OFFSET(u64);
+// clang-format on
+
+#define PN_OPCODE_LOAD_INDEXED(ty)                                         \
+  do {                                                                     \
+    PNRuntimeInstructionLoadIndexed* i =                                   \
+        (PNRuntimeInstructionLoadIndexed*)inst;                            \
+    PNRuntimeValue src = PN_GET_VALUE(i->src_id);                          \
+    PNRuntimeValue index = PN_GET_VALUE(i->index_id);                      \
+    PNRuntimeValue result = pn_executor_value_##ty(PN_MEMORY_READ(ty)(     \
+        thread->executor->memory, src.u32 + index.u32 * i->scale));        \
+    PN_SET_VALUE(i->result_value_id, result);                              \
+    PN_NEXT(sizeof(PNRuntimeInstructionLoadIndexed));                      \
+  } while (0) /*no semicolon */
+
+    // clang-format off
+    PN_OPCODE_CASE(LOAD_DOUBLE_INDEXED): PN_OPCODE_LOAD_INDEXED(f64);
+    PN_OPCODE_CASE(LOAD_FLOAT_INDEXED): PN_OPCODE_LOAD_INDEXED(f32);
+    PN_OPCODE_CASE(LOAD_INT8_INDEXED): PN_OPCODE_LOAD_INDEXED(u8);
+    PN_OPCODE_CASE(LOAD_INT16_INDEXED): PN_OPCODE_LOAD_INDEXED(u16);
+    PN_OPCODE_CASE(LOAD_INT32_INDEXED): PN_OPCODE_LOAD_INDEXED(u32);
+    PN_OPCODE_CASE(LOAD_INT64_INDEXED): PN_OPCODE_LOAD_INDEXED(u64);
+// clang-format on
+
+    PN_OPCODE_CASE(MOVE_WIDE): {
+      PNRuntimeInstructionMoveWide* i = (PNRuntimeInstructionMoveWide*)inst;
+      PNRuntimeValue value = PN_GET_VALUE(i->value_id);
+      PN_SET_VALUE(i->result_value_id, value);
+      PN_NEXT(sizeof(PNRuntimeInstructionMoveWide));
+    }
+
+    PN_OPCODE_CASE(PHI_MOVES): {
+      PNRuntimeInstructionPhiMoves* i = (PNRuntimeInstructionPhiMoves*)inst;
+      PNRuntimePhiMove* moves = (void*)inst + sizeof(*i);
+      uint32_t n;
+      for (n = 0; n < i->num_moves; ++n) {
+        PNRuntimeValue value = PN_GET_VALUE(moves[n].source_value_id);
+        PN_SET_VALUE(moves[n].dest_value_id, value);
+      }
+      PN_JUMP(i->inst);
+    }
+
+    PN_OPCODE_CASE(RET): {
+      PNCallFrame* frame = thread->current_frame;
+      thread->current_frame = frame->parent;
+      thread->num_jmpbufs = frame->jmpbuf_base;
+      pn_frame_stack_free_to(&thread->frame_stack, frame);
+      PNLocation* location = &thread->current_frame->location;
+
+      if (location->function_id != PN_INVALID_FUNCTION_ID) {
+        PNFunction* new_function = &module->functions[location->function_id];
+        PNRuntimeInstructionCall* c = location->inst;
+
+        thread->inst = location->inst + sizeof(PNRuntimeInstructionCall) +
+                       c->num_args * sizeof(PNSlotId);
+        thread->function = new_function;
+        PN_LOAD_STATE();
+        PN_SAFEPOINT();
+      } else {
+        /* Returning from the top frame of a thread. This shouldn't happen in
+         * most cases; the main thread should be exited by calling
+         * NACL_IRT_BASIC_EXIT, and a thread should be exited by calling
+         * NACL_IRT_THREAD_EXIT. In either case, there is nothing left to run
+         * on this thread, so it should finish. */
+        thread->state = PN_THREAD_DEAD;
+        if (thread == &thread->executor->start_thread) {
+          thread->executor->exit_code = 0;
+          thread->executor->exiting = PN_TRUE;
+        }
+      }
+      goto done;
+    }
+
+    PN_OPCODE_CASE(RET_VALUE): {
+      PNRuntimeInstructionRetValue* i = (PNRuntimeInstructionRetValue*)inst;
+      PNRuntimeValue value = PN_GET_VALUE(i->value_id);
+
+      PNCallFrame* frame = thread->current_frame;
+      thread->current_frame = frame->parent;
+      thread->num_jmpbufs = frame->jmpbuf_base;
+      pn_frame_stack_free_to(&thread->frame_stack, frame);
+      PNLocation* location = &thread->current_frame->location;
+
+      if (location->function_id != PN_INVALID_FUNCTION_ID) {
+        PNFunction* new_function = &module->functions[location->function_id];
+        PNRuntimeInstructionCall* c = location->inst;
+        thread->inst = location->inst + sizeof(PNRuntimeInstructionCall) +
+                       c->num_args * sizeof(PNSlotId);
+        thread->function = new_function;
+        PN_LOAD_STATE();
+        PN_SET_VALUE(c->result_value_id, value);
+        PN_SAFEPOINT();
+      } else {
+        /* See comment in PN_OPCODE_RET. */
+        thread->state = PN_THREAD_DEAD;
+        if (thread == &thread->executor->start_thread) {
+          thread->executor->exit_code = value.i32;
+          thread->executor->exiting = PN_TRUE;
+        }
+#if PN_PPAPI
+        else {
+          /* Return value from an event being processed in a PPAPI app */
+          thread->exit_value = value;
+        }
+#endif /* PN_PPAPI */
+      }
+      goto done;
+    }
+
+#define PN_OPCODE_STORE(ty)                                             \
+  do {                                                                  \
+    PNRuntimeInstructionStore* i = (PNRuntimeInstructionStore*)inst;    \
+    PNRuntimeValue dest = PN_GET_VALUE(i->dest_id);                     \
+    PNRuntimeValue value = PN_GET_VALUE(i->value_id);                   \
+    PN_MEMORY_WRITE(ty)(thread->executor->memory, dest.u32, value.ty);  \
+    PN_NEXT(sizeof(PNRuntimeInstructionStore));                         \
+  } while (0) /*no semicolon */
+
+    // clang-format off
+    PN_OPCODE_CASE(STORE_DOUBLE): PN_OPCODE_STORE(f64);
+    PN_OPCODE_CASE(STORE_FLOAT): PN_OPCODE_STORE(f32);
+    PN_OPCODE_CASE(STORE_INT8): PN_OPCODE_STORE(u8);
+    PN_OPCODE_CASE(STORE_INT16): PN_OPCODE_STORE(u16);
+    PN_OPCODE_CASE(STORE_INT32): PN_OPCODE_STORE(u32);
+    PN_OPCODE_CASE(STORE_INT64): PN_OPCODE_STORE(u64);
+// clang-format on
+
+#define PN_OPCODE_STORE_OFFSET(ty)                                         \
+  do {                                                                     \
+    PNRuntimeInstructionStoreOffset* i =                                   \
+        (PNRuntimeInstructionStoreOffset*)inst;                            \
+    PNRuntimeValue dest = PN_GET_VALUE(i->dest_id);                        \
+    PNRuntimeValue value = PN_GET_VALUE(i->value_id);                      \
+    PN_MEMORY_WRITE(ty)(thread->executor->memory, dest.u32 + i->offset,    \
+                         value.ty);                                        \
+    PN_NEXT(sizeof(PNRuntimeInstructionStoreOffset));                      \
+  } while (0) /*no semicolon */
+
+    // clang-format off
+    PN_OPCODE_CASE(STORE_DOUBLE_OFFSET): PN_OPCODE_STORE_OFFSET(f64);
+    PN_OPCODE_CASE(STORE_FLOAT_OFFSET): PN_OPCODE_STORE_OFFSET(f32);
+    PN_OPCODE_CASE(STORE_INT8_OFFSET): PN_OPCODE_STORE_OFFSET(u8);
+    PN_OPCODE_CASE(STORE_INT16_OFFSET): PN_OPCODE_STORE_OFFSET(u16);
+    PN_OPCODE_CASE(STORE_INT32_OFFSET): PN_OPCODE_STORE_OFFSET(u32);
+    PN_OPCODE_CASE(STORE_INT64_OFFSET): PN_OPCODE_STORE_OFFSET(u64);
+// clang-format on
+
+#define PN_OPCODE_STORE_INDEXED(ty)                                        \
+  do {                                                                     \
+    PNRuntimeInstructionStoreIndexed* i =                                  \
+        (PNRuntimeInstructionStoreIndexed*)inst;                           \
+    PNRuntimeValue dest = PN_GET_VALUE(i->dest_id);                        \
+    PNRuntimeValue value = PN_GET_VALUE(i->value_id);                      \
+    PNRuntimeValue index = PN_GET_VALUE(i->index_id);                      \
+    PN_MEMORY_WRITE(ty)(thread->executor->memory,                          \
+                         dest.u32 + index.u32 * i->scale, value.ty);       \
+    PN_NEXT(sizeof(PNRuntimeInstructionStoreIndexed));                     \
+  } while (0) /*no semicolon */
+
+    // clang-format off
+    PN_OPCODE_CASE(STORE_DOUBLE_INDEXED): PN_OPCODE_STORE_INDEXED(f64);
+    PN_OPCODE_CASE(STORE_FLOAT_INDEXED): PN_OPCODE_STORE_INDEXED(f32);
+    PN_OPCODE_CASE(STORE_INT8_INDEXED): PN_OPCODE_STORE_INDEXED(u8);
+    PN_OPCODE_CASE(STORE_INT16_INDEXED): PN_OPCODE_STORE_INDEXED(u16);
+    PN_OPCODE_CASE(STORE_INT32_INDEXED): PN_OPCODE_STORE_INDEXED(u32);
+    PN_OPCODE_CASE(STORE_INT64_INDEXED): PN_OPCODE_STORE_INDEXED(u64);
+// clang-format on
+
+#define PN_OPCODE_STORE_IMM(ty)                                          \
+  do {                                                                   \
+    PNRuntimeInstructionStore* i = (PNRuntimeInstructionStore*)inst;     \
+    PNRuntimeValue dest = PN_GET_VALUE(i->dest_id);                      \
+    PN_MEMORY_WRITE(ty)(thread->executor->memory, dest.u32, i->value);   \
+    PN_NEXT(sizeof(PNRuntimeInstructionStore));                          \
+  } while (0) /*no semicolon */
+
+    // clang-format off
+    PN_OPCODE_CASE(STORE_INT8_IMM):  PN_OPCODE_STORE_IMM(u8);
+    PN_OPCODE_CASE(STORE_INT16_IMM): PN_OPCODE_STORE_IMM(u16);
+    PN_OPCODE_CASE(STORE_INT32_IMM): PN_OPCODE_STORE_IMM(u32);
+// clang-format on
+
+#define PN_OPCODE_SWITCH(ty)                                           \
+  do {                                                                 \
+    PNRuntimeInstructionSwitch* i = (PNRuntimeInstructionSwitch*)inst; \
+    PNRuntimeSwitchCase* cases =                                       \
+        (void*)inst + sizeof(PNRuntimeInstructionSwitch);              \
+    PNRuntimeValue value = PN_GET_VALUE(i->value_id);                  \
+    void* new_inst = i->default_inst;                                  \
+    uint32_t c;                                                        \
+    for (c = 0; c < i->num_cases; ++c) {                               \
+      PNRuntimeSwitchCase* switch_case = &cases[c];                    \
+      if (value.ty == switch_case->value) {                            \
+        new_inst = switch_case->inst;                                  \
+        break;                                                         \
+      }                                                                \
+    }                                                                  \
+    PN_JUMP(new_inst);                                                 \
+  } while (0) /* no semicolon */
+
+    // clang-format off
+    PN_OPCODE_CASE(SWITCH_INT1):
+    PN_OPCODE_CASE(SWITCH_INT8):  PN_OPCODE_SWITCH(i8);
+    PN_OPCODE_CASE(SWITCH_INT16): PN_OPCODE_SWITCH(i16);
+    PN_OPCODE_CASE(SWITCH_INT32): PN_OPCODE_SWITCH(i32);
+    PN_OPCODE_CASE(SWITCH_INT64): PN_OPCODE_SWITCH(i64);
+// clang-format on
+
+#undef PN_OPCODE_SWITCH
+
+#define PN_OPCODE_SWITCH_BSEARCH(ty)                                       \
+  do {                                                                     \
+    PNRuntimeInstructionSwitch* i = (PNRuntimeInstructionSwitch*)inst;     \
+    PNRuntimeSwitchCase* cases =                                           \
+        (void*)inst + sizeof(PNRuntimeInstructionSwitch);                  \
+    PNRuntimeValue value = PN_GET_VALUE(i->value_id);                      \
+    int64_t key = value.ty;                                                \
+    void* new_inst = i->default_inst;                                      \
+    uint32_t lo = 0;                                                       \
+    uint32_t hi = i->num_cases;                                            \
+    while (lo < hi) {                                                      \
+      uint32_t mid = lo + (hi - lo) / 2;                                   \
+      if (cases[mid].value < key) {                                        \
+        lo = mid + 1;                                                      \
+      } else {                                                             \
+        hi = mid;                                                          \
+      }                                                                    \
+    }                                                                      \
+    if (lo < i->num_cases && cases[lo].value == key) {                     \
+      new_inst = cases[lo].inst;                                           \
+    }                                                                      \
+    PN_JUMP(new_inst);                                                     \
+  } while (0) /* no semicolon */
+
+    // clang-format off
+    PN_OPCODE_CASE(SWITCH_BSEARCH_INT8):  PN_OPCODE_SWITCH_BSEARCH(i8);
+    PN_OPCODE_CASE(SWITCH_BSEARCH_INT16): PN_OPCODE_SWITCH_BSEARCH(i16);
+    PN_OPCODE_CASE(SWITCH_BSEARCH_INT32): PN_OPCODE_SWITCH_BSEARCH(i32);
+    PN_OPCODE_CASE(SWITCH_BSEARCH_INT64): PN_OPCODE_SWITCH_BSEARCH(i64);
+// clang-format on
+
+#undef PN_OPCODE_SWITCH_BSEARCH
+
+#define PN_OPCODE_SWITCH_TABLE(ty)                                         \
+  do {                                                                     \
+    PNRuntimeInstructionSwitchTable* i =                                   \
+        (PNRuntimeInstructionSwitchTable*)inst;                            \
+    void** table = (void*)inst + sizeof(PNRuntimeInstructionSwitchTable);  \
+    PNRuntimeValue value = PN_GET_VALUE(i->value_id);                      \
+    uint64_t index = (uint64_t)(int64_t)value.ty - (uint64_t)i->min_value; \
+    void* new_inst =                                                       \
+        index < i->num_entries ? table[index] : i->default_inst;           \
+    PN_JUMP(new_inst);                                                     \
+  } while (0) /* no semicolon */
+
+    // clang-format off
+    PN_OPCODE_CASE(SWITCH_TABLE_INT8):  PN_OPCODE_SWITCH_TABLE(i8);
+    PN_OPCODE_CASE(SWITCH_TABLE_INT16): PN_OPCODE_SWITCH_TABLE(i16);
+    PN_OPCODE_CASE(SWITCH_TABLE_INT32): PN_OPCODE_SWITCH_TABLE(i32);
+    PN_OPCODE_CASE(SWITCH_TABLE_INT64): PN_OPCODE_SWITCH_TABLE(i64);
+// clang-format on
+
+#undef PN_OPCODE_SWITCH_TABLE
+
+    PN_OPCODE_CASE(UNREACHABLE):
+      PN_FATAL("Reached unreachable instruction!\n");
+      goto done;
+
+    PN_OPCODE_CASE(VSELECT): {
+      PNRuntimeInstructionVselect* i = (PNRuntimeInstructionVselect*)inst;
+      PNRuntimeValue cond = PN_GET_VALUE(i->cond_id);
+      PNSlotId slot = (cond.u8 & 1) ? i->true_value_id : i->false_value_id;
+      PNRuntimeValue result = PN_GET_VALUE(slot);
+      PN_SET_VALUE(i->result_value_id, result);
+      PN_NEXT(sizeof(PNRuntimeInstructionVselect));
+    }
+
+/* A superinstruction runs its first instruction's handler, but instead of
+ * dispatching, continues with the second's. PN_NEXT is redefined for that; the
+ * handlers below this point must not use it. */
+#undef PN_NEXT
+#define PN_NEXT(size)              \
+  do {                             \
+    inst = (void*)inst + (size);   \
+    goto pn_superinstruction_next; \
+  } while (0) /* no semicolon */
+
+/* The second instruction isn't dispatched, so it isn't counted by
+ * --print-opcode-counts; only the superinstruction is. */
+#define PN_SUPERINSTRUCTION(first, second, family, ...) \
+  PN_OPCODE_CASE(first##_THEN_##second): {              \
+    __label__ pn_superinstruction_next;                 \
+    PN_OPCODE_##family(__VA_ARGS__);                    \
+  pn_superinstruction_next:                             \
+    goto pn_opcode_##second;                            \
+  }
+
+    PN_FOREACH_SUPERINSTRUCTION(PN_SUPERINSTRUCTION)
+
+#undef PN_SUPERINSTRUCTION
+#undef PN_OPCODE_BINOP
+#undef PN_OPCODE_BINOP_IMM
+#undef PN_OPCODE_CAST
+#undef PN_OPCODE_CAST_SEXT1
+#undef PN_OPCODE_CAST_TRUNC1
+#undef PN_OPCODE_CAST_ZEXT1
+#undef PN_OPCODE_CMP2
+#undef PN_OPCODE_CMP2_NOT
+#undef PN_OPCODE_CMP2_ORD
+#undef PN_OPCODE_CMP2_UNO
+#undef PN_OPCODE_CMP2_IMM
+#undef PN_OPCODE_LOAD
+#undef PN_OPCODE_LOAD_INDEXED
+#undef PN_OPCODE_LOAD_OFFSET
+#undef PN_OPCODE_STORE
+#undef PN_OPCODE_STORE_IMM
+#undef PN_OPCODE_STORE_INDEXED
+#undef PN_OPCODE_STORE_OFFSET
+
+#if !PN_DIRECT_THREADED
+      default:
+        PN_FATAL("Invalid opcode: %d\n", inst->opcode);
+        goto done;
+    }
+
+  next_instruction:
+    continue;
+#endif /* !PN_DIRECT_THREADED */
+  }
+
+#if PN_EXECUTOR_LOOP_JIT
+pn_jit_enter: {
+  /* Run compiled code until it reaches an instruction it can't run. */
+  uint32_t offset = pn_jit_get_entry(function, inst);
+  if (offset) {
+    PNJitResult result = pn_jit_run(thread, offset, function_values,
+                                    constants, num_safepoints);
+    inst = result.inst;
+    num_safepoints = (uint32_t)result.num_safepoints;
+    if (num_safepoints == 0) {
+      goto done;
+    }
+  }
+  PN_DISPATCH();
+}
+#endif /* PN_EXECUTOR_LOOP_JIT */
+
+done:
+  thread->inst = inst;
+  thread->function = function;
+  return num_safepoints;
+
+#undef PN_NEXT
+#undef PN_JUMP
+#undef PN_SAFEPOINT
+#undef PN_JIT_TIER_UP
+#undef PN_JIT_DISPATCH
+#undef PN_STEP
+#undef PN_LOAD_STATE
+#undef PN_SET_VALUE
+#undef PN_GET_VALUE
+#undef PN_DISPATCH
+#undef PN_HANDLER
+#undef PN_OPCODE_CASE
+#undef PN_MEMORY_WRITE
+#undef PN_MEMORY_READ
+#undef PN_COUNT
+}
+
+#undef PN_EXECUTOR_LOOP_JIT
+#undef PN_EXECUTOR_LOOP_NATIVE
+#undef PN_EXECUTOR_LOOP_TRACING
+#undef PN_EXECUTOR_LOOP_SINGLE_STEP
+#undef PN_EXECUTOR_LOOP_COUNTING
+#undef PN_EXECUTOR_LOOP_HANDLERS
+#undef PN_EXECUTOR_LOOP_NAME
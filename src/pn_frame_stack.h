@@ -0,0 +1,79 @@
+/* Copyright 2015 The Native Client Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. */
+
+#ifndef PN_FRAME_STACK_H_
+#define PN_FRAME_STACK_H_
+
+static void* pn_frame_stack_chunk_start(PNFrameStackChunk* chunk) {
+  return pn_align_up_pointer((void*)chunk + sizeof(PNFrameStackChunk),
+                             PN_DEFAULT_ALIGN);
+}
+
+/* Moves |stack| to the chunk after the current one, allocating it if there is
+ * no next chunk or it is too small for |size| bytes. Chunks are never freed,
+ * so a call depth that oscillates around a chunk boundary doesn't allocate. */
+static PN_NOINLINE void pn_frame_stack_grow(PNFrameStack* stack, size_t size) {
+  PNFrameStackChunk* chunk = stack->chunk ? stack->chunk->next : NULL;
+  if (!chunk ||
+      pn_frame_stack_chunk_start(chunk) + size > chunk->end) {
+    size_t chunk_size = pn_next_power_of_two(pn_max(
+        size + sizeof(PNFrameStackChunk) + PN_DEFAULT_ALIGN - 1,
+        PN_FRAME_STACK_CHUNKSIZE));
+    PNFrameStackChunk* new_chunk = pn_malloc(chunk_size);
+    new_chunk->end = (void*)new_chunk + chunk_size;
+    new_chunk->prev = stack->chunk;
+    new_chunk->next = chunk;
+    if (stack->chunk) {
+      stack->chunk->next = new_chunk;
+    }
+    if (chunk) {
+      chunk->prev = new_chunk;
+    }
+    chunk = new_chunk;
+  }
+
+  stack->chunk = chunk;
+  stack->top = pn_frame_stack_chunk_start(chunk);
+  stack->end = chunk->end;
+}
+
+static void* pn_frame_stack_alloc(PNFrameStack* stack, size_t size) {
+  size = pn_align_up(size, PN_DEFAULT_ALIGN);
+  if (size > (size_t)(stack->end - stack->top)) {
+    pn_frame_stack_grow(stack, size);
+  }
+
+  void* ret = stack->top;
+  stack->top += size;
+  return ret;
+}
+
+/* Frees everything allocated at or after |p|, which must have been returned
+ * by pn_frame_stack_alloc. */
+static void pn_frame_stack_free_to(PNFrameStack* stack, void* p) {
+  while (p < pn_frame_stack_chunk_start(stack->chunk) ||
+         p > stack->chunk->end) {
+    stack->chunk = stack->chunk->prev;
+    assert(stack->chunk);
+  }
+
+  stack->top = p;
+  stack->end = stack->chunk->end;
+}
+
+/* Frees all frames, but keeps the chunks for reuse. */
+static void pn_frame_stack_reset(PNFrameStack* stack) {
+  if (!stack->chunk) {
+    return;
+  }
+
+  while (stack->chunk->prev) {
+    stack->chunk = stack->chunk->prev;
+  }
+
+  stack->top = pn_frame_stack_chunk_start(stack->chunk);
+  stack->end = stack->chunk->end;
+}
+
+#endif /* PN_FRAME_STACK_H_ */
@@ -5,6 +5,13 @@
 #ifndef PN_FUNCTION_H_
 #define PN_FUNCTION_H_
 
+#if PN_JIT
+/* The number of safepoints a function passes before it is compiled. */
+static uint32_t pn_function_get_jit_countdown(void) {
+  return g_pn_jit_threshold ? g_pn_jit_threshold : UINT32_MAX;
+}
+#endif /* PN_JIT */
+
 static PNConstant* pn_function_append_constant(PNModule* module,
                                                PNFunction* function,
                                                PNConstantId* out_constant_id) {
@@ -43,6 +50,29 @@ static PNValue* pn_function_append_value(PNModule* module,
   return ret;
 }
 
+/* Inverse of the slot assignment done in pn_function_calculate_opcodes. This
+ * only holds if values don't share slots, which is the case when tracing
+ * execution; see pn_function_make_slot_map. */
+static PNValueId pn_function_slot_to_value_id(PNModule* module,
+                                              PNFunction* function,
+                                              PNWideSlotId slot) {
+  uint32_t index = PN_SLOT_INDEX(slot);
+  if (PN_SLOT_IS_CONSTANT(slot)) {
+    if (index < function->num_constants) {
+      return module->num_values + function->num_args + index;
+    }
+    return function->module_value_ids[index - function->num_constants];
+  } else if (index < function->num_args) {
+    return module->num_values + index;
+  } else if (index < function->num_args + function->num_scratch_slots) {
+    /* Scratch slots don't hold any particular value */
+    return PN_INVALID_VALUE_ID;
+  } else {
+    return module->num_values + function->num_constants + index -
+           function->num_scratch_slots;
+  }
+}
+
 static uint32_t pn_function_num_values(PNModule* module, PNFunction* function) {
   return module->num_values + function->num_values;
 }
@@ -0,0 +1,1228 @@
+/* Copyright 2015 The Native Client Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. */
+
+#ifndef PN_JIT_H_
+#define PN_JIT_H_
+
+#if PN_JIT
+
+/* A baseline compiler from a function's runtime instructions to x86-64
+ * machine code. Each instruction is translated on its own; its operands are
+ * read from and its result written to the same frame slots the interpreter
+ * uses, so the interpreter can continue after any instruction, and compiled
+ * code keeps no state of its own between instructions.
+ *
+ * Compiled code runs with these registers:
+ *
+ *   rbx: the frame's function_values
+ *   r12: the frame's constants
+ *   r13: memory->data
+ *   r14: memory->size
+ *   r15: the number of safepoints left
+ *
+ * Instructions that aren't compiled (calls, returns, allocas, switches and
+ * intrinsics) and loads and stores that fail their bounds check return to the
+ * interpreter, which runs that instruction itself. The interpreter enters
+ * compiled code again at the next jump or safepoint. */
+
+#define PN_JIT_RAX 0
+#define PN_JIT_RCX 1
+#define PN_JIT_RDX 2
+#define PN_JIT_RBX 3
+#define PN_JIT_RSI 6
+#define PN_JIT_RDI 7
+#define PN_JIT_R8 8
+#define PN_JIT_R9 9
+#define PN_JIT_R12 12
+#define PN_JIT_R13 13
+#define PN_JIT_R14 14
+#define PN_JIT_R15 15
+#define PN_JIT_XMM0 0
+
+#define PN_JIT_VALUES PN_JIT_RBX
+#define PN_JIT_CONSTANTS PN_JIT_R12
+#define PN_JIT_MEMORY_DATA PN_JIT_R13
+#define PN_JIT_MEMORY_SIZE PN_JIT_R14
+#define PN_JIT_SAFEPOINTS PN_JIT_R15
+
+/* Flags for pn_jit_op_*: the low byte is a legacy prefix (0x66, 0xf2 or
+ * 0xf3) to emit before the REX prefix. */
+#define PN_JIT_W 0x100
+#define PN_JIT_66 0x66
+#define PN_JIT_F2 0xf2
+#define PN_JIT_F3 0xf3
+
+/* Condition codes, for jcc and setcc. */
+#define PN_JIT_CC_B 0x2
+#define PN_JIT_CC_AE 0x3
+#define PN_JIT_CC_E 0x4
+#define PN_JIT_CC_NE 0x5
+#define PN_JIT_CC_BE 0x6
+#define PN_JIT_CC_A 0x7
+#define PN_JIT_CC_P 0xa
+#define PN_JIT_CC_NP 0xb
+#define PN_JIT_CC_L 0xc
+#define PN_JIT_CC_GE 0xd
+#define PN_JIT_CC_LE 0xe
+#define PN_JIT_CC_G 0xf
+
+#define PN_JIT_NO_OFFSET ((uint32_t)~0)
+
+typedef enum PNJitPatchKind {
+  /* A rel32 to the code for |inst|, which is compiled if it isn't already.
+   * With PN_JIT_NO_OFFSET, only compiles |inst|. */
+  PN_JIT_PATCH_JUMP,
+  /* A rel32 to a stub that returns to the interpreter at |inst|. */
+  PN_JIT_PATCH_EXIT,
+} PNJitPatchKind;
+
+typedef struct PNJitPatch {
+  PNJitPatchKind kind;
+  uint32_t offset;
+  void* inst;
+} PNJitPatch;
+
+typedef struct PNJitCompiler {
+  PNModule* module;
+  PNFunction* function;
+  PNJit* jit;
+  uint8_t* p;
+  uint8_t* end;
+  uint32_t* entries;
+  PNJitPatch* patches;
+  uint32_t num_patches;
+  PNBool failed;
+} PNJitCompiler;
+
+typedef enum PNJitIntOp {
+  PN_JIT_ADD,
+  PN_JIT_AND,
+  PN_JIT_ASHR,
+  PN_JIT_LSHR,
+  PN_JIT_MUL,
+  PN_JIT_OR,
+  PN_JIT_SDIV,
+  PN_JIT_SHL,
+  PN_JIT_SREM,
+  PN_JIT_SUB,
+  PN_JIT_UDIV,
+  PN_JIT_UREM,
+  PN_JIT_XOR,
+} PNJitIntOp;
+
+typedef enum PNJitFcmpCombine {
+  PN_JIT_FCMP_CC,        /* cc */
+  PN_JIT_FCMP_CC_AND_NP, /* cc && ordered */
+  PN_JIT_FCMP_CC_OR_P,   /* cc || unordered */
+} PNJitFcmpCombine;
+
+/* Returned in rax and rdx by the code at PNJit.code. */
+typedef struct PNJitResult {
+  PNRuntimeInstruction* inst;
+  uint64_t num_safepoints;
+} PNJitResult;
+
+typedef PNJitResult (*PNJitTrampoline)(void* code,
+                                       PNRuntimeValue* function_values,
+                                       PNRuntimeValue* constants,
+                                       void* memory_data,
+                                       uint64_t memory_size,
+                                       uint64_t num_safepoints);
+
+static uint32_t pn_jit_get_offset(PNJitCompiler* c) {
+  return (uint32_t)(c->p - c->jit->code);
+}
+
+static void pn_jit_emit_u8(PNJitCompiler* c, uint8_t x) {
+  if (c->p < c->end) {
+    *c->p++ = x;
+  } else {
+    c->failed = PN_TRUE;
+  }
+}
+
+static void pn_jit_emit_u32(PNJitCompiler* c, uint32_t x) {
+  uint32_t n;
+  for (n = 0; n < 4; ++n) {
+    pn_jit_emit_u8(c, x >> (n * 8));
+  }
+}
+
+static void pn_jit_emit_u64(PNJitCompiler* c, uint64_t x) {
+  pn_jit_emit_u32(c, (uint32_t)x);
+  pn_jit_emit_u32(c, (uint32_t)(x >> 32));
+}
+
+/* Writes the rel32 at |offset| so that it jumps to |target_offset|. */
+static void pn_jit_patch_rel32(PNJitCompiler* c,
+                               uint32_t offset,
+                               uint32_t target_offset) {
+  if (c->failed) {
+    return;
+  }
+  int32_t rel = (int32_t)(target_offset - (offset + 4));
+  memcpy(c->jit->code + offset, &rel, sizeof(rel));
+}
+
+static void pn_jit_add_patch(PNJitCompiler* c,
+                             PNJitPatchKind kind,
+                             uint32_t offset,
+                             void* inst) {
+  PNJitPatch* patch = pn_allocator_realloc_add(
+      &c->module->temp_allocator, (void**)&c->patches, sizeof(PNJitPatch),
+      PN_DEFAULT_ALIGN);
+  patch->kind = kind;
+  patch->offset = offset;
+  patch->inst = inst;
+  c->num_patches++;
+}
+
+/* Emits the prefixes and opcode of an instruction whose ModRM has |reg|,
+ * |base| and |index| (-1 if none). Opcodes above 0xff are two bytes,
+ * starting with 0x0f. */
+static void pn_jit_emit_opcode(PNJitCompiler* c,
+                               uint32_t flags,
+                               uint32_t opcode,
+                               int reg,
+                               int base,
+                               int index) {
+  if (flags & 0xff) {
+    pn_jit_emit_u8(c, flags & 0xff);
+  }
+
+  uint8_t rex = 0x40;
+  if (flags & PN_JIT_W) {
+    rex |= 8;
+  }
+  if (reg & 8) {
+    rex |= 4;
+  }
+  if (index >= 0 && (index & 8)) {
+    rex |= 2;
+  }
+  if (base & 8) {
+    rex |= 1;
+  }
+  if (rex != 0x40) {
+    pn_jit_emit_u8(c, rex);
+  }
+
+  if (opcode > 0xff) {
+    pn_jit_emit_u8(c, opcode >> 8);
+  }
+  pn_jit_emit_u8(c, opcode);
+}
+
+/* op reg, rm (or op rm, reg; the opcode decides). */
+static void pn_jit_op_reg(PNJitCompiler* c,
+                          uint32_t flags,
+                          uint32_t opcode,
+                          int reg,
+                          int rm) {
+  pn_jit_emit_opcode(c, flags, opcode, reg, rm, -1);
+  pn_jit_emit_u8(c, 0xc0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+/* op reg, [base + index + disp] */
+static void pn_jit_op_mem(PNJitCompiler* c,
+                          uint32_t flags,
+                          uint32_t opcode,
+                          int reg,
+                          int base,
+                          int index,
+                          int32_t disp) {
+  pn_jit_emit_opcode(c, flags, opcode, reg, base, index);
+
+  uint8_t mod;
+  if (disp == 0 && (base & 7) != 5) {
+    mod = 0;
+  } else if (disp >= -128 && disp <= 127) {
+    mod = 1;
+  } else {
+    mod = 2;
+  }
+
+  if (index < 0 && (base & 7) != 4) {
+    pn_jit_emit_u8(c, (mod << 6) | ((reg & 7) << 3) | (base & 7));
+  } else {
+    pn_jit_emit_u8(c, (mod << 6) | ((reg & 7) << 3) | 4);
+    pn_jit_emit_u8(c, (((index < 0 ? 4 : index) & 7) << 3) | (base & 7));
+  }
+
+  if (mod == 1) {
+    pn_jit_emit_u8(c, (uint8_t)disp);
+  } else if (mod == 2) {
+    pn_jit_emit_u32(c, (uint32_t)disp);
+  }
+}
+
+/* op reg, <value in |slot|> */
+static void pn_jit_op_slot(PNJitCompiler* c,
+                           uint32_t flags,
+                           uint32_t opcode,
+                           int reg,
+                           PNWideSlotId slot) {
+  uint32_t index = PN_SLOT_INDEX(slot);
+  if (index > INT32_MAX / sizeof(PNRuntimeValue)) {
+    c->failed = PN_TRUE;
+    return;
+  }
+  int base = PN_SLOT_IS_CONSTANT(slot) ? PN_JIT_CONSTANTS : PN_JIT_VALUES;
+  pn_jit_op_mem(c, flags, opcode, reg, base, -1,
+                (int32_t)(index * sizeof(PNRuntimeValue)));
+}
+
+/* Loads the |size| byte int in |slot| into |reg|, extended to 64 bits. */
+static void pn_jit_load_int(PNJitCompiler* c,
+                            int reg,
+                            PNSlotId slot,
+                            uint32_t size,
+                            PNBool is_signed) {
+  switch (size) {
+    case 1:
+      pn_jit_op_slot(c, is_signed ? PN_JIT_W : 0, is_signed ? 0x0fbe : 0x0fb6,
+                     reg, slot);
+      break;
+    case 2:
+      pn_jit_op_slot(c, is_signed ? PN_JIT_W : 0, is_signed ? 0x0fbf : 0x0fb7,
+                     reg, slot);
+      break;
+    case 4:
+      pn_jit_op_slot(c, is_signed ? PN_JIT_W : 0, is_signed ? 0x63 : 0x8b, reg,
+                     slot);
+      break;
+    default:
+      pn_jit_op_slot(c, PN_JIT_W, 0x8b, reg, slot);
+      break;
+  }
+}
+
+/* Stores |reg| into |slot|. Values narrower than 32 bits are stored as 32
+ * bits; only their low bits are ever read. */
+static void pn_jit_store_int(PNJitCompiler* c,
+                             int reg,
+                             PNSlotId slot,
+                             uint32_t size) {
+  pn_jit_op_slot(c, size == 8 ? PN_JIT_W : 0, 0x89, reg, slot);
+}
+
+static void pn_jit_mov_imm32(PNJitCompiler* c, int reg, uint32_t value) {
+  pn_jit_emit_opcode(c, 0, 0xb8 + (reg & 7), 0, reg, -1);
+  pn_jit_emit_u32(c, value);
+}
+
+/* Returns to the interpreter at |inst|. */
+static void pn_jit_exit(PNJitCompiler* c, void* inst) {
+  pn_jit_emit_opcode(c, PN_JIT_W, 0xb8, 0, PN_JIT_RAX, -1);
+  pn_jit_emit_u64(c, (uint64_t)(uintptr_t)inst);
+  pn_jit_emit_u8(c, 0xe9);
+  uint32_t offset = pn_jit_get_offset(c);
+  pn_jit_emit_u32(c, 0);
+  pn_jit_patch_rel32(c, offset, c->jit->exit_offset);
+}
+
+static void pn_jit_jcc_exit(PNJitCompiler* c, uint8_t cc, void* inst) {
+  pn_jit_emit_u8(c, 0x0f);
+  pn_jit_emit_u8(c, 0x80 | cc);
+  pn_jit_add_patch(c, PN_JIT_PATCH_EXIT, pn_jit_get_offset(c), inst);
+  pn_jit_emit_u32(c, 0);
+}
+
+/* Emits a jcc (or jmp, if |cc| is -1) with a rel32 to be patched with
+ * pn_jit_patch_here. Returns the rel32's offset. */
+static uint32_t pn_jit_jump_forward(PNJitCompiler* c, int cc) {
+  if (cc < 0) {
+    pn_jit_emit_u8(c, 0xe9);
+  } else {
+    pn_jit_emit_u8(c, 0x0f);
+    pn_jit_emit_u8(c, 0x80 | cc);
+  }
+  uint32_t offset = pn_jit_get_offset(c);
+  pn_jit_emit_u32(c, 0);
+  return offset;
+}
+
+static void pn_jit_patch_here(PNJitCompiler* c, uint32_t offset) {
+  pn_jit_patch_rel32(c, offset, pn_jit_get_offset(c));
+}
+
+/* Jumps from |inst| to |target|. As in the interpreter, a jump that doesn't go
+ * forward is a safepoint, and returns to the interpreter if it is the last
+ * one. */
+static void pn_jit_jump(PNJitCompiler* c, void* inst, void* target) {
+  if (target <= inst) {
+    /* sub r15d, 1; jz exit */
+    pn_jit_op_reg(c, 0, 0x83, 5, PN_JIT_SAFEPOINTS);
+    pn_jit_emit_u8(c, 1);
+    pn_jit_jcc_exit(c, PN_JIT_CC_E, target);
+  }
+
+  pn_jit_emit_u8(c, 0xe9);
+  pn_jit_add_patch(c, PN_JIT_PATCH_JUMP, pn_jit_get_offset(c), target);
+  pn_jit_emit_u32(c, 0);
+}
+
+static void pn_jit_int_binop(PNJitCompiler* c,
+                             PNRuntimeInstructionBinop* i,
+                             PNJitIntOp op,
+                             uint32_t size,
+                             PNBool is_imm) {
+  PNBool is_signed = op == PN_JIT_ASHR || op == PN_JIT_SDIV ||
+                     op == PN_JIT_SREM;
+  uint32_t w = size == 8 ? PN_JIT_W : 0;
+  pn_jit_load_int(c, PN_JIT_RAX, i->value0_id, size, is_signed);
+  if (is_imm) {
+    pn_jit_mov_imm32(c, PN_JIT_RCX, i->value1);
+  } else {
+    pn_jit_load_int(c, PN_JIT_RCX, i->value1_id, size, is_signed);
+  }
+
+  int result = PN_JIT_RAX;
+  switch (op) {
+    case PN_JIT_ADD: pn_jit_op_reg(c, w, 0x01, PN_JIT_RCX, PN_JIT_RAX); break;
+    case PN_JIT_AND: pn_jit_op_reg(c, w, 0x21, PN_JIT_RCX, PN_JIT_RAX); break;
+    case PN_JIT_OR: pn_jit_op_reg(c, w, 0x09, PN_JIT_RCX, PN_JIT_RAX); break;
+    case PN_JIT_SUB: pn_jit_op_reg(c, w, 0x29, PN_JIT_RCX, PN_JIT_RAX); break;
+    case PN_JIT_XOR: pn_jit_op_reg(c, w, 0x31, PN_JIT_RCX, PN_JIT_RAX); break;
+    case PN_JIT_MUL:
+      pn_jit_op_reg(c, w, 0x0faf, PN_JIT_RAX, PN_JIT_RCX);
+      break;
+    case PN_JIT_SHL: pn_jit_op_reg(c, w, 0xd3, 4, PN_JIT_RAX); break;
+    case PN_JIT_LSHR: pn_jit_op_reg(c, w, 0xd3, 5, PN_JIT_RAX); break;
+    case PN_JIT_ASHR: pn_jit_op_reg(c, w, 0xd3, 7, PN_JIT_RAX); break;
+    case PN_JIT_UDIV:
+    case PN_JIT_UREM:
+      /* xor edx, edx; div rcx */
+      pn_jit_op_reg(c, 0, 0x31, PN_JIT_RDX, PN_JIT_RDX);
+      pn_jit_op_reg(c, w, 0xf7, 6, PN_JIT_RCX);
+      result = op == PN_JIT_UREM ? PN_JIT_RDX : PN_JIT_RAX;
+      break;
+    case PN_JIT_SDIV:
+    case PN_JIT_SREM:
+      /* cdq or cqo; idiv rcx */
+      pn_jit_emit_opcode(c, w, 0x99, 0, 0, -1);
+      pn_jit_op_reg(c, w, 0xf7, 7, PN_JIT_RCX);
+      result = op == PN_JIT_SREM ? PN_JIT_RDX : PN_JIT_RAX;
+      break;
+  }
+  pn_jit_store_int(c, result, i->result_value_id, size);
+}
+
+static void pn_jit_float_binop(PNJitCompiler* c,
+                               PNRuntimeInstructionBinop* i,
+                               uint8_t opcode,
+                               PNBool is_double) {
+  uint32_t prefix = is_double ? PN_JIT_F2 : PN_JIT_F3;
+  pn_jit_op_slot(c, prefix, 0x0f10, PN_JIT_XMM0, i->value0_id);
+  pn_jit_op_slot(c, prefix, 0x0f00 | opcode, PN_JIT_XMM0, i->value1_id);
+  pn_jit_op_slot(c, prefix, 0x0f11, PN_JIT_XMM0, i->result_value_id);
+}
+
+/* Stores the flag in al as an i1 result. */
+static void pn_jit_store_i1(PNJitCompiler* c, PNSlotId slot) {
+  pn_jit_op_reg(c, 0, 0x0fb6, PN_JIT_RAX, PN_JIT_RAX);
+  pn_jit_store_int(c, PN_JIT_RAX, slot, 4);
+}
+
+static void pn_jit_icmp(PNJitCompiler* c,
+                        PNRuntimeInstructionCmp2* i,
+                        uint8_t cc,
+                        uint32_t size,
+                        PNBool is_signed,
+                        PNBool is_imm) {
+  pn_jit_load_int(c, PN_JIT_RAX, i->value0_id, size, is_signed);
+  if (is_imm) {
+    pn_jit_mov_imm32(c, PN_JIT_RCX, i->value1);
+  } else {
+    pn_jit_load_int(c, PN_JIT_RCX, i->value1_id, size, is_signed);
+  }
+  pn_jit_op_reg(c, size == 8 ? PN_JIT_W : 0, 0x39, PN_JIT_RCX, PN_JIT_RAX);
+  pn_jit_op_reg(c, 0, 0x0f90 | cc, 0, PN_JIT_RAX);
+  pn_jit_store_i1(c, i->result_value_id);
+}
+
+/* Compares with ucomisd or ucomiss, swapping the operands if |swap| is set,
+ * then sets the result from |cc| and |combine|. This matches the C
+ * comparisons the interpreter uses, including for NaNs. */
+static void pn_jit_fcmp(PNJitCompiler* c,
+                        PNRuntimeInstructionCmp2* i,
+                        PNBool is_double,
+                        PNBool swap,
+                        uint8_t cc,
+                        PNJitFcmpCombine combine) {
+  PNSlotId value0_id = swap ? i->value1_id : i->value0_id;
+  PNSlotId value1_id = swap ? i->value0_id : i->value1_id;
+  pn_jit_op_slot(c, is_double ? PN_JIT_F2 : PN_JIT_F3, 0x0f10, PN_JIT_XMM0,
+                 value0_id);
+  pn_jit_op_slot(c, is_double ? PN_JIT_66 : 0, 0x0f2e, PN_JIT_XMM0,
+                 value1_id);
+  pn_jit_op_reg(c, 0, 0x0f90 | cc, 0, PN_JIT_RAX);
+  switch (combine) {
+    case PN_JIT_FCMP_CC:
+      break;
+    case PN_JIT_FCMP_CC_AND_NP:
+      /* setnp cl; and al, cl */
+      pn_jit_op_reg(c, 0, 0x0f90 | PN_JIT_CC_NP, 0, PN_JIT_RCX);
+      pn_jit_op_reg(c, 0, 0x20, PN_JIT_RCX, PN_JIT_RAX);
+      break;
+    case PN_JIT_FCMP_CC_OR_P:
+      /* setp cl; or al, cl */
+      pn_jit_op_reg(c, 0, 0x0f90 | PN_JIT_CC_P, 0, PN_JIT_RCX);
+      pn_jit_op_reg(c, 0, 0x08, PN_JIT_RCX, PN_JIT_RAX);
+      break;
+  }
+  pn_jit_store_i1(c, i->result_value_id);
+}
+
+static void pn_jit_cast_int(PNJitCompiler* c,
+                            PNRuntimeInstructionCast* i,
+                            uint32_t from_size,
+                            PNBool is_signed,
+                            uint32_t to_size) {
+  pn_jit_load_int(c, PN_JIT_RAX, i->value_id, from_size, is_signed);
+  pn_jit_store_int(c, PN_JIT_RAX, i->result_value_id, to_size);
+}
+
+/* The low bit of an i1, sign extended to |to_size| bytes if |is_signed|. */
+static void pn_jit_cast_i1(PNJitCompiler* c,
+                           PNRuntimeInstructionCast* i,
+                           PNBool is_signed,
+                           uint32_t to_size) {
+  uint32_t w = to_size == 8 ? PN_JIT_W : 0;
+  pn_jit_load_int(c, PN_JIT_RAX, i->value_id, 1, PN_FALSE);
+  pn_jit_op_reg(c, 0, 0x83, 4, PN_JIT_RAX);
+  pn_jit_emit_u8(c, 1);
+  if (is_signed) {
+    pn_jit_op_reg(c, w, 0xf7, 3, PN_JIT_RAX);
+  }
+  pn_jit_store_int(c, PN_JIT_RAX, i->result_value_id, to_size);
+}
+
+static void pn_jit_cast_int_to_fp(PNJitCompiler* c,
+                                  PNRuntimeInstructionCast* i,
+                                  uint32_t from_size,
+                                  PNBool is_signed,
+                                  PNBool is_double) {
+  uint32_t prefix = is_double ? PN_JIT_F2 : PN_JIT_F3;
+  /* Every value fits in an int64, so convert that. */
+  pn_jit_load_int(c, PN_JIT_RAX, i->value_id, from_size, is_signed);
+  pn_jit_op_reg(c, prefix | PN_JIT_W, 0x0f2a, PN_JIT_XMM0, PN_JIT_RAX);
+  pn_jit_op_slot(c, prefix, 0x0f11, PN_JIT_XMM0, i->result_value_id);
+}
+
+static void pn_jit_cast_fp_to_int(PNJitCompiler* c,
+                                  PNRuntimeInstructionCast* i,
+                                  PNBool is_double,
+                                  uint32_t to_size,
+                                  PNBool is_signed) {
+  uint32_t flags = is_double ? PN_JIT_F2 : PN_JIT_F3;
+  /* An unsigned int32 is converted through an int64. */
+  if (to_size == 8 || (to_size == 4 && !is_signed)) {
+    flags |= PN_JIT_W;
+  }
+  pn_jit_op_slot(c, flags, 0x0f2c, PN_JIT_RAX, i->value_id);
+  pn_jit_store_int(c, PN_JIT_RAX, i->result_value_id, to_size);
+}
+
+static void pn_jit_cast_fp(PNJitCompiler* c,
+                           PNRuntimeInstructionCast* i,
+                           PNBool from_double) {
+  pn_jit_op_slot(c, from_double ? PN_JIT_F2 : PN_JIT_F3, 0x0f5a, PN_JIT_XMM0,
+                 i->value_id);
+  pn_jit_op_slot(c, from_double ? PN_JIT_F3 : PN_JIT_F2, 0x0f11, PN_JIT_XMM0,
+                 i->result_value_id);
+}
+
+static void pn_jit_move(PNJitCompiler* c,
+                        PNWideSlotId result_value_id,
+                        PNWideSlotId value_id) {
+  pn_jit_op_slot(c, PN_JIT_W, 0x8b, PN_JIT_RAX, value_id);
+  pn_jit_op_slot(c, PN_JIT_W, 0x89, PN_JIT_RAX, result_value_id);
+}
+
+/* Computes base + index * scale + offset into eax, and returns to the
+ * interpreter at |inst| if |size| bytes there are out of bounds, so it can
+ * report the error. */
+static void pn_jit_address(PNJitCompiler* c,
+                           void* inst,
+                           PNSlotId base_id,
+                           PNSlotId index_id,
+                           uint32_t scale,
+                           uint32_t offset,
+                           uint32_t size) {
+  pn_jit_load_int(c, PN_JIT_RAX, base_id, 4, PN_FALSE);
+  if (index_id != PN_INVALID_SLOT_ID) {
+    pn_jit_load_int(c, PN_JIT_RCX, index_id, 4, PN_FALSE);
+    if (scale != 1) {
+      /* imul ecx, ecx, scale */
+      pn_jit_op_reg(c, 0, 0x69, PN_JIT_RCX, PN_JIT_RCX);
+      pn_jit_emit_u32(c, scale);
+    }
+    pn_jit_op_reg(c, 0, 0x01, PN_JIT_RCX, PN_JIT_RAX);
+  }
+  if (offset != 0) {
+    /* add eax, offset */
+    pn_jit_op_reg(c, 0, 0x81, 0, PN_JIT_RAX);
+    pn_jit_emit_u32(c, offset);
+  }
+
+  /* cmp eax, PN_MEMORY_GUARD_SIZE; jb exit */
+  pn_jit_op_reg(c, 0, 0x81, 7, PN_JIT_RAX);
+  pn_jit_emit_u32(c, PN_MEMORY_GUARD_SIZE);
+  pn_jit_jcc_exit(c, PN_JIT_CC_B, inst);
+  /* lea rdx, [rax + size]; cmp rdx, r14; ja exit */
+  pn_jit_op_mem(c, PN_JIT_W, 0x8d, PN_JIT_RDX, PN_JIT_RAX, -1, size);
+  pn_jit_op_reg(c, PN_JIT_W, 0x3b, PN_JIT_RDX, PN_JIT_MEMORY_SIZE);
+  pn_jit_jcc_exit(c, PN_JIT_CC_A, inst);
+}
+
+static void pn_jit_load(PNJitCompiler* c,
+                        void* inst,
+                        PNSlotId result_id,
+                        PNSlotId src_id,
+                        PNSlotId index_id,
+                        uint32_t scale,
+                        uint32_t offset,
+                        uint32_t size) {
+  pn_jit_address(c, inst, src_id, index_id, scale, offset, size);
+  uint32_t flags = 0;
+  uint32_t opcode;
+  switch (size) {
+    case 1: opcode = 0x0fb6; break;
+    case 2: opcode = 0x0fb7; break;
+    case 4: opcode = 0x8b; break;
+    default: opcode = 0x8b; flags = PN_JIT_W; break;
+  }
+  pn_jit_op_mem(c, flags, opcode, PN_JIT_RAX, PN_JIT_MEMORY_DATA, PN_JIT_RAX,
+                0);
+  pn_jit_store_int(c, PN_JIT_RAX, result_id, size);
+}
+
+/* Stores the value in |value_id|, or |value| if it is PN_INVALID_SLOT_ID. */
+static void pn_jit_store(PNJitCompiler* c,
+                         void* inst,
+                         PNSlotId dest_id,
+                         PNSlotId value_id,
+                         uint32_t value,
+                         PNSlotId index_id,
+                         uint32_t scale,
+                         uint32_t offset,
+                         uint32_t size) {
+  pn_jit_address(c, inst, dest_id, index_id, scale, offset, size);
+  if (value_id != PN_INVALID_SLOT_ID) {
+    pn_jit_op_slot(c, size == 8 ? PN_JIT_W : 0, 0x8b, PN_JIT_RCX, value_id);
+  } else {
+    pn_jit_mov_imm32(c, PN_JIT_RCX, value);
+  }
+  uint32_t flags = 0;
+  uint32_t opcode = 0x89;
+  switch (size) {
+    case 1: opcode = 0x88; break;
+    case 2: flags = PN_JIT_66; break;
+    case 4: break;
+    default: flags = PN_JIT_W; break;
+  }
+  pn_jit_op_mem(c, flags, opcode, PN_JIT_RCX, PN_JIT_MEMORY_DATA, PN_JIT_RAX,
+                0);
+}
+
+/* Superinstructions are compiled as their first instruction; the second
+ * follows it in the instruction stream. */
+static PNOpcode pn_jit_get_base_opcode(PNOpcode opcode) {
+  switch (opcode) {
+#define PN_SUPERINSTRUCTION(first, second, family, ...) \
+  case PN_OPCODE_##first##_THEN_##second:               \
+    return PN_OPCODE_##first;
+    PN_FOREACH_SUPERINSTRUCTION(PN_SUPERINSTRUCTION)
+#undef PN_SUPERINSTRUCTION
+    default:
+      return opcode;
+  }
+}
+
+/* Compiles the instruction at |inst|. Returns its size, or 0 if it doesn't
+ * continue with the next instruction. */
+static uint32_t pn_jit_compile_instruction(PNJitCompiler* c, void* inst) {
+  PNRuntimeInstruction* base = inst;
+  PNOpcode opcode = pn_jit_get_base_opcode(base->opcode);
+  switch (opcode) {
+#define PN_JIT_BINOP(name, op, size, is_imm)              \
+  case PN_OPCODE_BINOP_##name:                            \
+    pn_jit_int_binop(c, inst, PN_JIT_##op, size, is_imm); \
+    return sizeof(PNRuntimeInstructionBinop);
+#define PN_JIT_BINOP_INT(name, op)            \
+  PN_JIT_BINOP(name##_INT8, op, 1, PN_FALSE)  \
+  PN_JIT_BINOP(name##_INT16, op, 2, PN_FALSE) \
+  PN_JIT_BINOP(name##_INT32, op, 4, PN_FALSE) \
+  PN_JIT_BINOP(name##_INT64, op, 8, PN_FALSE)
+#define PN_JIT_BINOP_FLOAT(name, opcode)           \
+  case PN_OPCODE_BINOP_##name##_DOUBLE:            \
+    pn_jit_float_binop(c, inst, opcode, PN_TRUE);  \
+    return sizeof(PNRuntimeInstructionBinop);      \
+  case PN_OPCODE_BINOP_##name##_FLOAT:             \
+    pn_jit_float_binop(c, inst, opcode, PN_FALSE); \
+    return sizeof(PNRuntimeInstructionBinop);
+
+    // clang-format off
+    PN_JIT_BINOP_INT(ADD, ADD)
+    PN_JIT_BINOP_INT(AND, AND)
+    PN_JIT_BINOP_INT(ASHR, ASHR)
+    PN_JIT_BINOP_INT(LSHR, LSHR)
+    PN_JIT_BINOP_INT(MUL, MUL)
+    PN_JIT_BINOP_INT(OR, OR)
+    PN_JIT_BINOP_INT(SHL, SHL)
+    PN_JIT_BINOP_INT(SUB, SUB)
+    PN_JIT_BINOP_INT(UDIV, UDIV)
+    PN_JIT_BINOP_INT(UREM, UREM)
+    PN_JIT_BINOP_INT(XOR, XOR)
+    PN_JIT_BINOP(AND_INT1, AND, 1, PN_FALSE)
+    PN_JIT_BINOP(OR_INT1, OR, 1, PN_FALSE)
+    PN_JIT_BINOP(XOR_INT1, XOR, 1, PN_FALSE)
+    PN_JIT_BINOP(SDIV_INT32, SDIV, 4, PN_FALSE)
+    PN_JIT_BINOP(SDIV_INT64, SDIV, 8, PN_FALSE)
+    PN_JIT_BINOP(SREM_INT32, SREM, 4, PN_FALSE)
+    PN_JIT_BINOP(SREM_INT64, SREM, 8, PN_FALSE)
+    PN_JIT_BINOP(ADD_INT32_IMM, ADD, 4, PN_TRUE)
+    PN_JIT_BINOP(AND_INT32_IMM, AND, 4, PN_TRUE)
+    PN_JIT_BINOP(ASHR_INT32_IMM, ASHR, 4, PN_TRUE)
+    PN_JIT_BINOP(LSHR_INT32_IMM, LSHR, 4, PN_TRUE)
+    PN_JIT_BINOP(MUL_INT32_IMM, MUL, 4, PN_TRUE)
+    PN_JIT_BINOP(OR_INT32_IMM, OR, 4, PN_TRUE)
+    PN_JIT_BINOP(SDIV_INT32_IMM, SDIV, 4, PN_TRUE)
+    PN_JIT_BINOP(SHL_INT32_IMM, SHL, 4, PN_TRUE)
+    PN_JIT_BINOP(SREM_INT32_IMM, SREM, 4, PN_TRUE)
+    PN_JIT_BINOP(SUB_INT32_IMM, SUB, 4, PN_TRUE)
+    PN_JIT_BINOP(UDIV_INT32_IMM, UDIV, 4, PN_TRUE)
+    PN_JIT_BINOP(UREM_INT32_IMM, UREM, 4, PN_TRUE)
+    PN_JIT_BINOP(XOR_INT32_IMM, XOR, 4, PN_TRUE)
+    PN_JIT_BINOP_FLOAT(ADD, 0x58)
+    PN_JIT_BINOP_FLOAT(MUL, 0x59)
+    PN_JIT_BINOP_FLOAT(SDIV, 0x5e)
+    PN_JIT_BINOP_FLOAT(SUB, 0x5c)
+// clang-format on
+
+#undef PN_JIT_BINOP_FLOAT
+#undef PN_JIT_BINOP_INT
+#undef PN_JIT_BINOP
+
+    case PN_OPCODE_BR: {
+      PNRuntimeInstructionBr* i = inst;
+      pn_jit_jump(c, inst, i->inst);
+      return 0;
+    }
+
+    case PN_OPCODE_BR_INT1: {
+      PNRuntimeInstructionBrInt1* i = inst;
+      /* cmp byte [value], 0; je false */
+      pn_jit_op_slot(c, 0, 0x80, 7, i->value_id);
+      pn_jit_emit_u8(c, 0);
+      uint32_t false_offset = pn_jit_jump_forward(c, PN_JIT_CC_E);
+      pn_jit_jump(c, inst, i->true_inst);
+      pn_jit_patch_here(c, false_offset);
+      pn_jit_jump(c, inst, i->false_inst);
+      return 0;
+    }
+
+    case PN_OPCODE_CAST_BITCAST_DOUBLE_INT64:
+    case PN_OPCODE_CAST_BITCAST_FLOAT_INT32:
+    case PN_OPCODE_CAST_BITCAST_INT32_FLOAT:
+    case PN_OPCODE_CAST_BITCAST_INT64_DOUBLE: {
+      PNRuntimeInstructionCast* i = inst;
+      pn_jit_move(c, i->result_value_id, i->value_id);
+      return sizeof(PNRuntimeInstructionCast);
+    }
+
+#define PN_JIT_CAST(name, call) \
+  case PN_OPCODE_CAST_##name:   \
+    call;                       \
+    return sizeof(PNRuntimeInstructionCast);
+
+    // clang-format off
+    PN_JIT_CAST(FPEXT_FLOAT_DOUBLE, pn_jit_cast_fp(c, inst, PN_FALSE))
+    PN_JIT_CAST(FPTRUNC_DOUBLE_FLOAT, pn_jit_cast_fp(c, inst, PN_TRUE))
+    PN_JIT_CAST(FPTOSI_DOUBLE_INT8, pn_jit_cast_fp_to_int(c, inst, 1, 1, 1))
+    PN_JIT_CAST(FPTOSI_DOUBLE_INT16, pn_jit_cast_fp_to_int(c, inst, 1, 2, 1))
+    PN_JIT_CAST(FPTOSI_DOUBLE_INT32, pn_jit_cast_fp_to_int(c, inst, 1, 4, 1))
+    PN_JIT_CAST(FPTOSI_DOUBLE_INT64, pn_jit_cast_fp_to_int(c, inst, 1, 8, 1))
+    PN_JIT_CAST(FPTOSI_FLOAT_INT8, pn_jit_cast_fp_to_int(c, inst, 0, 1, 1))
+    PN_JIT_CAST(FPTOSI_FLOAT_INT16, pn_jit_cast_fp_to_int(c, inst, 0, 2, 1))
+    PN_JIT_CAST(FPTOSI_FLOAT_INT32, pn_jit_cast_fp_to_int(c, inst, 0, 4, 1))
+    PN_JIT_CAST(FPTOSI_FLOAT_INT64, pn_jit_cast_fp_to_int(c, inst, 0, 8, 1))
+    PN_JIT_CAST(FPTOUI_DOUBLE_INT8, pn_jit_cast_fp_to_int(c, inst, 1, 1, 0))
+    PN_JIT_CAST(FPTOUI_DOUBLE_INT16, pn_jit_cast_fp_to_int(c, inst, 1, 2, 0))
+    PN_JIT_CAST(FPTOUI_DOUBLE_INT32, pn_jit_cast_fp_to_int(c, inst, 1, 4, 0))
+    PN_JIT_CAST(FPTOUI_FLOAT_INT8, pn_jit_cast_fp_to_int(c, inst, 0, 1, 0))
+    PN_JIT_CAST(FPTOUI_FLOAT_INT16, pn_jit_cast_fp_to_int(c, inst, 0, 2, 0))
+    PN_JIT_CAST(FPTOUI_FLOAT_INT32, pn_jit_cast_fp_to_int(c, inst, 0, 4, 0))
+    PN_JIT_CAST(SEXT_INT1_INT8, pn_jit_cast_i1(c, inst, 1, 1))
+    PN_JIT_CAST(SEXT_INT1_INT16, pn_jit_cast_i1(c, inst, 1, 2))
+    PN_JIT_CAST(SEXT_INT1_INT32, pn_jit_cast_i1(c, inst, 1, 4))
+    PN_JIT_CAST(SEXT_INT1_INT64, pn_jit_cast_i1(c, inst, 1, 8))
+    PN_JIT_CAST(SEXT_INT8_INT16, pn_jit_cast_int(c, inst, 1, 1, 2))
+    PN_JIT_CAST(SEXT_INT8_INT32, pn_jit_cast_int(c, inst, 1, 1, 4))
+    PN_JIT_CAST(SEXT_INT8_INT64, pn_jit_cast_int(c, inst, 1, 1, 8))
+    PN_JIT_CAST(SEXT_INT16_INT32, pn_jit_cast_int(c, inst, 2, 1, 4))
+    PN_JIT_CAST(SEXT_INT16_INT64, pn_jit_cast_int(c, inst, 2, 1, 8))
+    PN_JIT_CAST(SEXT_INT32_INT64, pn_jit_cast_int(c, inst, 4, 1, 8))
+    PN_JIT_CAST(SITOFP_INT8_DOUBLE, pn_jit_cast_int_to_fp(c, inst, 1, 1, 1))
+    PN_JIT_CAST(SITOFP_INT8_FLOAT, pn_jit_cast_int_to_fp(c, inst, 1, 1, 0))
+    PN_JIT_CAST(SITOFP_INT16_DOUBLE, pn_jit_cast_int_to_fp(c, inst, 2, 1, 1))
+    PN_JIT_CAST(SITOFP_INT16_FLOAT, pn_jit_cast_int_to_fp(c, inst, 2, 1, 0))
+    PN_JIT_CAST(SITOFP_INT32_DOUBLE, pn_jit_cast_int_to_fp(c, inst, 4, 1, 1))
+    PN_JIT_CAST(SITOFP_INT32_FLOAT, pn_jit_cast_int_to_fp(c, inst, 4, 1, 0))
+    PN_JIT_CAST(SITOFP_INT64_DOUBLE, pn_jit_cast_int_to_fp(c, inst, 8, 1, 1))
+    PN_JIT_CAST(SITOFP_INT64_FLOAT, pn_jit_cast_int_to_fp(c, inst, 8, 1, 0))
+    PN_JIT_CAST(TRUNC_INT8_INT1, pn_jit_cast_i1(c, inst, 0, 1))
+    PN_JIT_CAST(TRUNC_INT16_INT1, pn_jit_cast_i1(c, inst, 0, 1))
+    PN_JIT_CAST(TRUNC_INT16_INT8, pn_jit_cast_int(c, inst, 2, 0, 1))
+    PN_JIT_CAST(TRUNC_INT32_INT1, pn_jit_cast_i1(c, inst, 0, 1))
+    PN_JIT_CAST(TRUNC_INT32_INT8, pn_jit_cast_int(c, inst, 4, 0, 1))
+    PN_JIT_CAST(TRUNC_INT32_INT16, pn_jit_cast_int(c, inst, 4, 0, 2))
+    PN_JIT_CAST(TRUNC_INT64_INT8, pn_jit_cast_int(c, inst, 8, 0, 1))
+    PN_JIT_CAST(TRUNC_INT64_INT16, pn_jit_cast_int(c, inst, 8, 0, 2))
+    PN_JIT_CAST(TRUNC_INT64_INT32, pn_jit_cast_int(c, inst, 8, 0, 4))
+    PN_JIT_CAST(UITOFP_INT8_DOUBLE, pn_jit_cast_int_to_fp(c, inst, 1, 0, 1))
+    PN_JIT_CAST(UITOFP_INT8_FLOAT, pn_jit_cast_int_to_fp(c, inst, 1, 0, 0))
+    PN_JIT_CAST(UITOFP_INT16_DOUBLE, pn_jit_cast_int_to_fp(c, inst, 2, 0, 1))
+    PN_JIT_CAST(UITOFP_INT16_FLOAT, pn_jit_cast_int_to_fp(c, inst, 2, 0, 0))
+    PN_JIT_CAST(UITOFP_INT32_DOUBLE, pn_jit_cast_int_to_fp(c, inst, 4, 0, 1))
+    PN_JIT_CAST(UITOFP_INT32_FLOAT, pn_jit_cast_int_to_fp(c, inst, 4, 0, 0))
+    PN_JIT_CAST(ZEXT_INT1_INT8, pn_jit_cast_i1(c, inst, 0, 1))
+    PN_JIT_CAST(ZEXT_INT1_INT16, pn_jit_cast_i1(c, inst, 0, 2))
+    PN_JIT_CAST(ZEXT_INT1_INT32, pn_jit_cast_i1(c, inst, 0, 4))
+    PN_JIT_CAST(ZEXT_INT1_INT64, pn_jit_cast_i1(c, inst, 0, 8))
+    PN_JIT_CAST(ZEXT_INT8_INT16, pn_jit_cast_int(c, inst, 1, 0, 2))
+    PN_JIT_CAST(ZEXT_INT8_INT32, pn_jit_cast_int(c, inst, 1, 0, 4))
+    PN_JIT_CAST(ZEXT_INT8_INT64, pn_jit_cast_int(c, inst, 1, 0, 8))
+    PN_JIT_CAST(ZEXT_INT16_INT32, pn_jit_cast_int(c, inst, 2, 0, 4))
+    PN_JIT_CAST(ZEXT_INT16_INT64, pn_jit_cast_int(c, inst, 2, 0, 8))
+    PN_JIT_CAST(ZEXT_INT32_INT64, pn_jit_cast_int(c, inst, 4, 0, 8))
+// clang-format on
+
+#undef PN_JIT_CAST
+
+#define PN_JIT_FCMP(name, swap, cc, combine)             \
+  case PN_OPCODE_FCMP_##name##_DOUBLE:                   \
+    pn_jit_fcmp(c, inst, PN_TRUE, swap, PN_JIT_CC_##cc,  \
+                PN_JIT_FCMP_##combine);                  \
+    return sizeof(PNRuntimeInstructionCmp2);             \
+  case PN_OPCODE_FCMP_##name##_FLOAT:                    \
+    pn_jit_fcmp(c, inst, PN_FALSE, swap, PN_JIT_CC_##cc, \
+                PN_JIT_FCMP_##combine);                  \
+    return sizeof(PNRuntimeInstructionCmp2);
+
+    // clang-format off
+    PN_JIT_FCMP(OEQ, PN_FALSE, E, CC_AND_NP)  /* a == b */
+    PN_JIT_FCMP(OGE, PN_FALSE, AE, CC)        /* a >= b */
+    PN_JIT_FCMP(OGT, PN_FALSE, A, CC)         /* a > b */
+    PN_JIT_FCMP(OLE, PN_TRUE, AE, CC)         /* b >= a */
+    PN_JIT_FCMP(OLT, PN_TRUE, A, CC)          /* b > a */
+    PN_JIT_FCMP(ONE, PN_FALSE, NE, CC_OR_P)   /* a != b */
+    PN_JIT_FCMP(ORD, PN_FALSE, NP, CC)
+    PN_JIT_FCMP(UEQ, PN_FALSE, E, CC_AND_NP)  /* !(a != b) */
+    PN_JIT_FCMP(UGE, PN_TRUE, BE, CC)         /* !(a < b) */
+    PN_JIT_FCMP(UGT, PN_TRUE, B, CC)          /* !(a <= b) */
+    PN_JIT_FCMP(ULE, PN_FALSE, BE, CC)        /* !(a > b) */
+    PN_JIT_FCMP(ULT, PN_FALSE, B, CC)         /* !(a >= b) */
+    PN_JIT_FCMP(UNE, PN_FALSE, NE, CC_OR_P)   /* !(a == b) */
+    PN_JIT_FCMP(UNO, PN_FALSE, P, CC)
+// clang-format on
+
+#undef PN_JIT_FCMP
+
+#define PN_JIT_ICMP(name, cc, size, is_signed, is_imm)             \
+  case PN_OPCODE_ICMP_##name:                                      \
+    pn_jit_icmp(c, inst, PN_JIT_CC_##cc, size, is_signed, is_imm); \
+    return sizeof(PNRuntimeInstructionCmp2);
+#define PN_JIT_ICMP_INT(name, cc, is_signed)     \
+  PN_JIT_ICMP(name##_INT8, cc, 1, is_signed, 0)  \
+  PN_JIT_ICMP(name##_INT16, cc, 2, is_signed, 0) \
+  PN_JIT_ICMP(name##_INT32, cc, 4, is_signed, 0) \
+  PN_JIT_ICMP(name##_INT64, cc, 8, is_signed, 0) \
+  PN_JIT_ICMP(name##_INT32_IMM, cc, 4, is_signed, 1)
+
+    // clang-format off
+    PN_JIT_ICMP_INT(EQ, E, 0)
+    PN_JIT_ICMP_INT(NE, NE, 0)
+    PN_JIT_ICMP_INT(SGE, GE, 1)
+    PN_JIT_ICMP_INT(SGT, G, 1)
+    PN_JIT_ICMP_INT(SLE, LE, 1)
+    PN_JIT_ICMP_INT(SLT, L, 1)
+    PN_JIT_ICMP_INT(UGE, AE, 0)
+    PN_JIT_ICMP_INT(UGT, A, 0)
+    PN_JIT_ICMP_INT(ULE, BE, 0)
+    PN_JIT_ICMP_INT(ULT, B, 0)
+// clang-format on
+
+#undef PN_JIT_ICMP_INT
+#undef PN_JIT_ICMP
+
+#define PN_JIT_LOAD(name, size)                                      \
+  case PN_OPCODE_LOAD_##name: {                                      \
+    PNRuntimeInstructionLoad* i = inst;                              \
+    pn_jit_load(c, inst, i->result_value_id, i->src_id,              \
+                PN_INVALID_SLOT_ID, 1, 0, size);                     \
+    return sizeof(*i);                                               \
+  }                                                                  \
+  case PN_OPCODE_LOAD_##name##_OFFSET: {                             \
+    PNRuntimeInstructionLoadOffset* i = inst;                        \
+    pn_jit_load(c, inst, i->result_value_id, i->src_id,              \
+                PN_INVALID_SLOT_ID, 1, i->offset, size);             \
+    return sizeof(*i);                                               \
+  }                                                                  \
+  case PN_OPCODE_LOAD_##name##_INDEXED: {                            \
+    PNRuntimeInstructionLoadIndexed* i = inst;                       \
+    pn_jit_load(c, inst, i->result_value_id, i->src_id, i->index_id, \
+                i->scale, 0, size);                                  \
+    return sizeof(*i);                                               \
+  }
+
+#define PN_JIT_STORE(name, size)                                          \
+  case PN_OPCODE_STORE_##name: {                                          \
+    PNRuntimeInstructionStore* i = inst;                                  \
+    pn_jit_store(c, inst, i->dest_id, i->value_id, 0, PN_INVALID_SLOT_ID, \
+                 1, 0, size);                                             \
+    return sizeof(*i);                                                    \
+  }                                                                       \
+  case PN_OPCODE_STORE_##name##_OFFSET: {                                 \
+    PNRuntimeInstructionStoreOffset* i = inst;                            \
+    pn_jit_store(c, inst, i->dest_id, i->value_id, 0, PN_INVALID_SLOT_ID, \
+                 1, i->offset, size);                                     \
+    return sizeof(*i);                                                    \
+  }                                                                       \
+  case PN_OPCODE_STORE_##name##_INDEXED: {                                \
+    PNRuntimeInstructionStoreIndexed* i = inst;                           \
+    pn_jit_store(c, inst, i->dest_id, i->value_id, 0, i->index_id,        \
+                 i->scale, 0, size);                                      \
+    return sizeof(*i);                                                    \
+  }
+
+#define PN_JIT_STORE_IMM(name, size)                                \
+  case PN_OPCODE_STORE_##name##_IMM: {                              \
+    PNRuntimeInstructionStore* i = inst;                            \
+    pn_jit_store(c, inst, i->dest_id, PN_INVALID_SLOT_ID, i->value, \
+                 PN_INVALID_SLOT_ID, 1, 0, size);                   \
+    return sizeof(*i);                                              \
+  }
+
+    // clang-format off
+    PN_JIT_LOAD(DOUBLE, 8)
+    PN_JIT_LOAD(FLOAT, 4)
+    PN_JIT_LOAD(INT8, 1)
+    PN_JIT_LOAD(INT16, 2)
+    PN_JIT_LOAD(INT32, 4)
+    PN_JIT_LOAD(INT64, 8)
+    PN_JIT_STORE(DOUBLE, 8)
+    PN_JIT_STORE(FLOAT, 4)
+    PN_JIT_STORE(INT8, 1)
+    PN_JIT_STORE(INT16, 2)
+    PN_JIT_STORE(INT32, 4)
+    PN_JIT_STORE(INT64, 8)
+    PN_JIT_STORE_IMM(INT8, 1)
+    PN_JIT_STORE_IMM(INT16, 2)
+    PN_JIT_STORE_IMM(INT32, 4)
+// clang-format on
+
+#undef PN_JIT_STORE_IMM
+#undef PN_JIT_STORE
+#undef PN_JIT_LOAD
+
+    case PN_OPCODE_MOVE_WIDE: {
+      PNRuntimeInstructionMoveWide* i = inst;
+      pn_jit_move(c, i->result_value_id, i->value_id);
+      return sizeof(*i);
+    }
+
+    case PN_OPCODE_PHI_MOVES: {
+      PNRuntimeInstructionPhiMoves* i = inst;
+      PNRuntimePhiMove* moves = inst + sizeof(*i);
+      uint32_t n;
+      for (n = 0; n < i->num_moves; ++n) {
+        pn_jit_move(c, moves[n].dest_value_id, moves[n].source_value_id);
+      }
+      pn_jit_jump(c, inst, i->inst);
+      return 0;
+    }
+
+    case PN_OPCODE_VSELECT: {
+      PNRuntimeInstructionVselect* i = inst;
+      /* test byte [cond], 1; cmovne rax, [true] */
+      pn_jit_op_slot(c, PN_JIT_W, 0x8b, PN_JIT_RAX, i->false_value_id);
+      pn_jit_op_slot(c, 0, 0xf6, 0, i->cond_id);
+      pn_jit_emit_u8(c, 1);
+      pn_jit_op_slot(c, PN_JIT_W, 0x0f45, PN_JIT_RAX, i->true_value_id);
+      pn_jit_op_slot(c, PN_JIT_W, 0x89, PN_JIT_RAX, i->result_value_id);
+      return sizeof(*i);
+    }
+
+    case PN_OPCODE_SWITCH_INT1:
+    case PN_OPCODE_SWITCH_INT8:
+    case PN_OPCODE_SWITCH_INT16:
+    case PN_OPCODE_SWITCH_INT32:
+    case PN_OPCODE_SWITCH_INT64:
+    case PN_OPCODE_SWITCH_BSEARCH_INT8:
+    case PN_OPCODE_SWITCH_BSEARCH_INT16:
+    case PN_OPCODE_SWITCH_BSEARCH_INT32:
+    case PN_OPCODE_SWITCH_BSEARCH_INT64: {
+      /* The interpreter picks the case, then continues in compiled code. */
+      PNRuntimeInstructionSwitch* i = inst;
+      PNRuntimeSwitchCase* cases = inst + sizeof(*i);
+      uint32_t n;
+      pn_jit_exit(c, inst);
+      pn_jit_add_patch(c, PN_JIT_PATCH_JUMP, PN_JIT_NO_OFFSET,
+                       i->default_inst);
+      for (n = 0; n < i->num_cases; ++n) {
+        pn_jit_add_patch(c, PN_JIT_PATCH_JUMP, PN_JIT_NO_OFFSET,
+                         cases[n].inst);
+      }
+      return 0;
+    }
+
+    case PN_OPCODE_SWITCH_TABLE_INT8:
+    case PN_OPCODE_SWITCH_TABLE_INT16:
+    case PN_OPCODE_SWITCH_TABLE_INT32:
+    case PN_OPCODE_SWITCH_TABLE_INT64: {
+      PNRuntimeInstructionSwitchTable* i = inst;
+      void** entries = inst + sizeof(*i);
+      uint32_t n;
+      pn_jit_exit(c, inst);
+      pn_jit_add_patch(c, PN_JIT_PATCH_JUMP, PN_JIT_NO_OFFSET,
+                       i->default_inst);
+      for (n = 0; n < i->num_entries; ++n) {
+        if (entries[n] != i->default_inst) {
+          pn_jit_add_patch(c, PN_JIT_PATCH_JUMP, PN_JIT_NO_OFFSET,
+                           entries[n]);
+        }
+      }
+      return 0;
+    }
+
+    case PN_OPCODE_RET:
+    case PN_OPCODE_RET_VALUE:
+    case PN_OPCODE_UNREACHABLE:
+      pn_jit_exit(c, inst);
+      return 0;
+
+    case PN_OPCODE_ALLOCA_INT32:
+      pn_jit_exit(c, inst);
+      return sizeof(PNRuntimeInstructionAlloca);
+
+    case PN_OPCODE_CAST_FPTOUI_DOUBLE_INT64:
+    case PN_OPCODE_CAST_FPTOUI_FLOAT_INT64:
+    case PN_OPCODE_CAST_UITOFP_INT64_DOUBLE:
+    case PN_OPCODE_CAST_UITOFP_INT64_FLOAT:
+      pn_jit_exit(c, inst);
+      return sizeof(PNRuntimeInstructionCast);
+
+    default: {
+      /* Calls and intrinsics. The interpreter continues with the next
+       * instruction when the call returns. */
+      PNRuntimeInstructionCall* i = inst;
+      PN_CHECK(opcode == PN_OPCODE_CALL || opcode > PN_OPCODE_VSELECT);
+      pn_jit_exit(c, inst);
+      return sizeof(*i) + i->num_args * sizeof(PNSlotId);
+    }
+  }
+}
+
+/* Compiles the instructions from |inst| until one doesn't continue with the
+ * next instruction, or one is already compiled. */
+static void pn_jit_compile_run(PNJitCompiler* c, void* inst) {
+  void* end = c->function->instructions + c->function->instructions_size;
+  while (!c->failed) {
+    if (inst >= end) {
+      /* Only the trap at the end of the function is followed by nothing. */
+      c->failed = PN_TRUE;
+      return;
+    }
+
+    uint32_t* entry =
+        &c->entries[(inst - c->function->instructions) / 2];
+    if (*entry) {
+      pn_jit_emit_u8(c, 0xe9);
+      uint32_t offset = pn_jit_get_offset(c);
+      pn_jit_emit_u32(c, 0);
+      pn_jit_patch_rel32(c, offset, *entry);
+      return;
+    }
+
+    *entry = pn_jit_get_offset(c);
+    uint32_t size = pn_jit_compile_instruction(c, inst);
+    if (size == 0) {
+      return;
+    }
+    inst += size;
+  }
+}
+
+/* Writes the code at the start of PNJit.code, which is called as a
+ * PNJitTrampoline. It sets up the registers and jumps to |code|; compiled
+ * code jumps back to PNJit.exit_offset with the instruction to continue at in
+ * rax. */
+static void pn_jit_write_trampoline(PNJitCompiler* c) {
+  static const int s_saved_regs[] = {PN_JIT_RBX, PN_JIT_R12, PN_JIT_R13,
+                                     PN_JIT_R14, PN_JIT_R15};
+  const int num_saved_regs = PN_ARRAY_SIZE(s_saved_regs);
+  int n;
+  for (n = 0; n < num_saved_regs; ++n) {
+    /* push reg */
+    pn_jit_emit_opcode(c, 0, 0x50 + (s_saved_regs[n] & 7), 0,
+                       s_saved_regs[n], -1);
+  }
+  pn_jit_op_reg(c, PN_JIT_W, 0x89, PN_JIT_RSI, PN_JIT_VALUES);
+  pn_jit_op_reg(c, PN_JIT_W, 0x89, PN_JIT_RDX, PN_JIT_CONSTANTS);
+  pn_jit_op_reg(c, PN_JIT_W, 0x89, PN_JIT_RCX, PN_JIT_MEMORY_DATA);
+  pn_jit_op_reg(c, PN_JIT_W, 0x89, PN_JIT_R8, PN_JIT_MEMORY_SIZE);
+  pn_jit_op_reg(c, PN_JIT_W, 0x89, PN_JIT_R9, PN_JIT_SAFEPOINTS);
+  /* jmp rdi */
+  pn_jit_op_reg(c, 0, 0xff, 4, PN_JIT_RDI);
+
+  c->jit->exit_offset = pn_jit_get_offset(c);
+  pn_jit_op_reg(c, PN_JIT_W, 0x89, PN_JIT_SAFEPOINTS, PN_JIT_RDX);
+  for (n = num_saved_regs - 1; n >= 0; --n) {
+    /* pop reg */
+    pn_jit_emit_opcode(c, 0, 0x58 + (s_saved_regs[n] & 7), 0,
+                       s_saved_regs[n], -1);
+  }
+  /* ret */
+  pn_jit_emit_u8(c, 0xc3);
+}
+
+/* The code buffer is never writable and executable at once. Code up to
+ * PNJit.code_size is executable; the pages after it stay writable, and the
+ * last page of code is made writable again while a function is appended.
+ * (The JIT is x86-64 only, where host pages are PN_PAGESIZE.) */
+static PNBool pn_jit_protect(PNJit* jit,
+                             uint32_t start,
+                             uint32_t end,
+                             int prot) {
+  start = pn_align_down(start, PN_PAGESIZE);
+  end = pn_align_up(end, PN_PAGESIZE);
+  if (start == end || mprotect(jit->code + start, end - start, prot) == 0) {
+    return PN_TRUE;
+  }
+
+  jit->failed = PN_TRUE;
+  return PN_FALSE;
+}
+
+static PNBool pn_jit_init(PNJit* jit) {
+  jit->code = mmap(NULL, PN_JIT_CODE_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (jit->code == MAP_FAILED) {
+    jit->code = NULL;
+    jit->failed = PN_TRUE;
+    return PN_FALSE;
+  }
+
+  PNJitCompiler c;
+  memset(&c, 0, sizeof(c));
+  c.jit = jit;
+  c.p = jit->code;
+  c.end = jit->code + PN_JIT_CODE_SIZE;
+  pn_jit_write_trampoline(&c);
+  jit->code_size = pn_jit_get_offset(&c);
+  return pn_jit_protect(jit, 0, jit->code_size, PROT_READ | PROT_EXEC);
+}
+
+/* Compiles |function|, starting from its first instruction and following
+ * every jump. If the code doesn't fit, the function stays interpreted. */
+static void pn_jit_compile_function(PNThread* thread, PNFunction* function) {
+  PNJit* jit = &thread->executor->jit;
+  /* Don't try again, whether or not this succeeds. */
+  function->jit_countdown = UINT32_MAX;
+  if (g_pn_jit_threshold == 0 || jit->failed ||
+      (!jit->code && !pn_jit_init(jit)) ||
+      !pn_jit_protect(jit, jit->code_size, jit->code_size + 1,
+                      PROT_READ | PROT_WRITE)) {
+    return;
+  }
+
+  PN_BEGIN_TIME(JIT_COMPILE);
+  PNModule* module = thread->module;
+  PNAllocatorMark mark = pn_allocator_mark(&module->temp_allocator);
+
+  PNJitCompiler c;
+  memset(&c, 0, sizeof(c));
+  c.module = module;
+  c.function = function;
+  c.jit = jit;
+  c.p = jit->code + jit->code_size;
+  c.end = jit->code + PN_JIT_CODE_SIZE;
+  size_t entries_size = (function->instructions_size / 2) * sizeof(uint32_t);
+  c.entries = pn_allocator_allocz(&module->temp_allocator, entries_size,
+                                  sizeof(uint32_t));
+
+  pn_jit_compile_run(&c, function->instructions);
+  uint32_t n;
+  for (n = 0; n < c.num_patches; ++n) {
+    PNJitPatch* patch = &c.patches[n];
+    if (patch->kind == PN_JIT_PATCH_JUMP) {
+      void* inst = patch->inst;
+      if (!c.entries[(inst - function->instructions) / 2]) {
+        pn_jit_compile_run(&c, inst);
+      }
+    }
+  }
+
+  for (n = 0; n < c.num_patches; ++n) {
+    PNJitPatch* patch = &c.patches[n];
+    if (patch->kind == PN_JIT_PATCH_EXIT) {
+      pn_jit_patch_here(&c, patch->offset);
+      pn_jit_exit(&c, patch->inst);
+    } else if (patch->offset != PN_JIT_NO_OFFSET) {
+      void* inst = patch->inst;
+      pn_jit_patch_rel32(&c, patch->offset,
+                         c.entries[(inst - function->instructions) / 2]);
+    }
+  }
+
+  uint32_t old_code_size = jit->code_size;
+  if (!c.failed) {
+    jit->code_size = pn_jit_get_offset(&c);
+    function->jit_entries = pn_allocator_alloc(
+        &module->allocator, entries_size, sizeof(uint32_t));
+    memcpy(function->jit_entries, c.entries, entries_size);
+  }
+
+  /* If this fails, |failed| is set and nothing more is compiled, but the
+   * code that is already executable stays usable. */
+  pn_jit_protect(jit, old_code_size, jit->code_size, PROT_READ | PROT_EXEC);
+  pn_allocator_reset_to_mark(&module->temp_allocator, mark);
+  PN_END_TIME(JIT_COMPILE);
+}
+
+static PNJitResult pn_jit_run(PNThread* thread,
+                              uint32_t offset,
+                              PNRuntimeValue* function_values,
+                              PNRuntimeValue* constants,
+                              uint32_t num_safepoints) {
+  PNJit* jit = &thread->executor->jit;
+  PNMemory* memory = thread->executor->memory;
+  PNJitTrampoline trampoline = (PNJitTrampoline)(void*)jit->code;
+  return trampoline(jit->code + offset, function_values, constants,
+                    memory->data, memory->size, num_safepoints);
+}
+
+static uint32_t pn_jit_get_entry(PNFunction* function, void* inst) {
+  return function->jit_entries[(inst - function->instructions) / 2];
+}
+
+#undef PN_JIT_RAX
+#undef PN_JIT_RCX
+#undef PN_JIT_RDX
+#undef PN_JIT_RBX
+#undef PN_JIT_RSI
+#undef PN_JIT_RDI
+#undef PN_JIT_R8
+#undef PN_JIT_R9
+#undef PN_JIT_R12
+#undef PN_JIT_R13
+#undef PN_JIT_R14
+#undef PN_JIT_R15
+#undef PN_JIT_XMM0
+
+#endif /* PN_JIT */
+
+#endif /* PN_JIT_H_ */
@@ -18,25 +18,49 @@
 #include <time.h>
 #include <unistd.h>
 
+#if PN_JIT || PN_CACHE
+#include <sys/mman.h>
+#endif /* PN_JIT || PN_CACHE */
+
+#if PN_CACHE
+#include <fcntl.h>
+#endif /* PN_CACHE */
+
+#if PN_NATIVE
+#include <dlfcn.h>
+#endif /* PN_NATIVE */
+
 /**** GLOBAL VARIABLES ********************************************************/
 
 static int g_pn_verbose;
 static PNBool g_pn_dedupe_phi_nodes = PN_TRUE;
+static PNBool g_pn_print_stats;
+static PNBool g_pn_print_opcode_counts;
 static uint32_t g_pn_opcode_count[PN_MAX_OPCODE];
+static uint64_t g_pn_call_cache_hits;
+static uint64_t g_pn_call_cache_misses;
+#if PN_DIRECT_THREADED
+static const int32_t* g_pn_opcode_handlers;
+#endif /* PN_DIRECT_THREADED */
 #if PN_PPAPI
 static PNBool g_pn_ppapi = PN_FALSE;
 #endif /* PN_PPAPI */
+#if PN_JIT
+static uint32_t g_pn_jit_threshold = PN_JIT_THRESHOLD;
+#endif /* PN_JIT */
 
 #if PN_TRACING
 static const char* g_pn_trace_function_filter;
 static int g_pn_trace_indent;
+static uint32_t* g_pn_opcode_pair_count;
 #define PN_TRACE_DEFINE(name, flag) static PNBool g_pn_trace_##name;
 PN_FOREACH_TRACE(PN_TRACE_DEFINE)
 #undef PN_TRACE_DEFINE
 #endif /* PN_TRACING */
 
 #if PN_TIMERS
-static struct timespec g_pn_timer_times[PN_NUM_TIMERS];
+/* Per thread, so the --load-threads workers can be timed too */
+static __thread struct timespec g_pn_timer_times[PN_NUM_TIMERS];
 #endif /* PN_TIMERS */
 
 /**** SOURCES *****************************************************************/
@@ -45,6 +69,7 @@ static struct timespec g_pn_timer_times[PN_NUM_TIMERS];
 #include "pn_malloc.h"
 #include "pn_timespec.h"
 #include "pn_allocator.h"
+#include "pn_frame_stack.h"
 #include "pn_bitset.h"
 #include "pn_bitstream.h"
 #include "pn_record.h"
@@ -55,14 +80,20 @@ static struct timespec g_pn_timer_times[PN_NUM_TIMERS];
 #include "pn_trace.h"
 #include "pn_calculate_result_value_types.h"
 #include "pn_calculate_opcodes.h"
+#include "pn_calculate_address_modes.h"
 #include "pn_calculate_uses.h"
 #include "pn_calculate_pred_bbs.h"
 #include "pn_calculate_phi_assigns.h"
 #include "pn_calculate_liveness.h"
+#include "pn_verify.h"
 #include "pn_read.h"
+#include "pn_jit.h"
+#include "pn_native.h"
+#include "pn_cache.h"
 #include "pn_executor.h"
 #include "pn_builtins.h"
 #include "pn_ppapi.h"
+#include "pn_snapshot.h"
 
 static void pn_lib_dummy(void) {
   g_pn_trace_FLAGS = PN_FALSE;
@@ -44,33 +44,47 @@ static void pn_memory_check_pointer(PNMemory* memory, void* p, uint32_t size) {
 #define PN_FORMAT_i32 "%d"
 #define PN_FORMAT_i64 "%" PRId64
 
-#define PN_DEFINE_MEMORY_READ(ty, ctype)                                \
-  static ctype pn_memory_read_##ty(PNMemory* memory, uint32_t offset) { \
-    pn_memory_check(memory, offset, sizeof(ctype));                     \
-    ctype* m = (ctype*)(memory->data + offset);                         \
-    PN_TRACE(MEMORY, "     read." #ty " [%8u] >= " PN_FORMAT_##ty "\n", \
-             offset, *m);                                               \
-    if (pn_is_aligned_pointer(m, sizeof(ctype))) {                      \
-      return *m;                                                        \
-    } else {                                                            \
-      ctype ret;                                                        \
-      memcpy(&ret, m, sizeof(ctype));                                   \
-      return ret;                                                       \
-    }                                                                   \
+/* The _untraced variants are used by the executor when memory tracing is
+ * off, so the fast path doesn't test the trace flag. */
+#define PN_DEFINE_MEMORY_READ(ty, ctype)                                  \
+  static ctype pn_memory_read_untraced_##ty(PNMemory* memory,             \
+                                            uint32_t offset) {            \
+    pn_memory_check(memory, offset, sizeof(ctype));                       \
+    ctype* m = (ctype*)(memory->data + offset);                           \
+    if (pn_is_aligned_pointer(m, sizeof(ctype))) {                        \
+      return *m;                                                          \
+    } else {                                                              \
+      ctype ret;                                                          \
+      memcpy(&ret, m, sizeof(ctype));                                     \
+      return ret;                                                         \
+    }                                                                     \
+  }                                                                       \
+                                                                          \
+  static ctype pn_memory_read_##ty(PNMemory* memory, uint32_t offset) {   \
+    ctype value = pn_memory_read_untraced_##ty(memory, offset);           \
+    PN_TRACE(MEMORY, "     read." #ty " [%8u] >= " PN_FORMAT_##ty "\n",   \
+             offset, value);                                              \
+    return value;                                                         \
   }
 
-#define PN_DEFINE_MEMORY_WRITE(ty, ctype)                               \
-  static void pn_memory_write_##ty(PNMemory* memory, uint32_t offset,   \
-                                   ctype value) {                       \
-    pn_memory_check(memory, offset, sizeof(ctype));                     \
-    ctype* m = (ctype*)(memory->data + offset);                         \
-    PN_TRACE(MEMORY, "    write." #ty " [%8u] <= " PN_FORMAT_##ty "\n", \
-             offset, value);                                            \
-    if (pn_is_aligned_pointer(m, sizeof(ctype))) {                      \
-      *m = value;                                                       \
-    } else {                                                            \
-      memcpy(m, &value, sizeof(ctype));                                 \
-    }                                                                   \
+#define PN_DEFINE_MEMORY_WRITE(ty, ctype)                                 \
+  static void pn_memory_write_untraced_##ty(PNMemory* memory,             \
+                                            uint32_t offset,              \
+                                            ctype value) {                \
+    pn_memory_check(memory, offset, sizeof(ctype));                       \
+    ctype* m = (ctype*)(memory->data + offset);                           \
+    if (pn_is_aligned_pointer(m, sizeof(ctype))) {                        \
+      *m = value;                                                         \
+    } else {                                                              \
+      memcpy(m, &value, sizeof(ctype));                                   \
+    }                                                                     \
+  }                                                                       \
+                                                                          \
+  static void pn_memory_write_##ty(PNMemory* memory, uint32_t offset,     \
+                                   ctype value) {                         \
+    pn_memory_write_untraced_##ty(memory, offset, value);                 \
+    PN_TRACE(MEMORY, "    write." #ty " [%8u] <= " PN_FORMAT_##ty "\n",   \
+             offset, value);                                              \
   }
 
 PN_DEFINE_MEMORY_READ(i8, int8_t)
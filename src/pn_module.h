@@ -20,13 +20,15 @@ void pn_module_init(PNModule* module, PNMemory* memory) {
 
 void pn_module_reset(PNModule* module) {
   PNModule copy = *module;
-  /* Keep the allocators and memory, clear everything else */
+  /* Keep the allocators, memory and options, clear everything else */
   memset(module, 0, sizeof(PNModule));
   module->allocator = copy.allocator;
   module->value_allocator = copy.value_allocator;
   module->instruction_allocator = copy.instruction_allocator;
   module->temp_allocator = copy.temp_allocator;
   module->memory = copy.memory;
+  module->lazy_lowering = copy.lazy_lowering;
+  module->load_threads = copy.load_threads;
 
   /* Reset the allocators */
   pn_allocator_reset(&module->allocator);
@@ -65,6 +67,30 @@ static void pn_function_id_check(PNModule* module, PNFunctionId function_id) {
   PN_CHECK(function_id < module->num_functions);
 }
 
+/* Finds a function given its name, or its id if |name| starts with a digit.
+ * Fails if there is no such function. */
+static PNFunctionId pn_module_find_function(PNModule* module,
+                                            const char* name) {
+  PNFunctionId function_id;
+  if (name[0] >= '0' && name[0] <= '9') {
+    function_id = atoi(name);
+    if (function_id >= module->num_functions) {
+      PN_FATAL("Invalid function id: %d\n", function_id);
+    }
+    return function_id;
+  }
+
+  for (function_id = 0; function_id < module->num_functions; ++function_id) {
+    PNFunction* function = &module->functions[function_id];
+    if (function->name && strcmp(function->name, name) == 0) {
+      return function_id;
+    }
+  }
+
+  PN_FATAL("Invalid function name: \"%s\"\n", name);
+  return PN_INVALID_FUNCTION_ID;
+}
+
 static void pn_global_var_id_check(PNModule* module,
                                    PNGlobalVarId global_var_id) {
   PN_CHECK(global_var_id < module->num_global_vars);
@@ -83,4 +109,27 @@ static PNValue* pn_module_append_value(PNModule* module,
   return ret;
 }
 
+/* Returns the value of a function or global variable as seen by the executor:
+ * a function pointer or the address of the global. */
+static PNRuntimeValue pn_module_get_runtime_value(PNModule* module,
+                                                  PNValueId value_id) {
+  PNValue* value = &module->values[value_id];
+  PNRuntimeValue ret;
+  switch (value->code) {
+    case PN_VALUE_CODE_FUNCTION:
+      ret.u32 = pn_function_id_to_pointer(value->index);
+      break;
+
+    case PN_VALUE_CODE_GLOBAL_VAR:
+      ret.u32 = module->global_vars[value->index].offset;
+      break;
+
+    default:
+      PN_UNREACHABLE();
+      ret.u32 = 0;
+      break;
+  }
+  return ret;
+}
+
 #endif /* PN_MODULE_H_ */
@@ -0,0 +1,1150 @@
+/* Copyright 2015 The Native Client Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. */
+
+#ifndef PN_NATIVE_H_
+#define PN_NATIVE_H_
+
+#if PN_NATIVE
+
+/* --emit-c writes the module's functions as one C file, which can be built
+ * as a shared object:
+ *
+ *   cc -O2 -shared -fPIC -o foo.so foo.c
+ *
+ * --load-native loads that shared object and calls its functions instead of
+ * interpreting them. Each emitted function takes its args as typed C params
+ * and uses the PNMemory data directly, so a pointer in the module is an
+ * offset from PNNativeContext.memory, exactly as in the interpreter.
+ *
+ * Functions that allocate stack memory, call through a function pointer, or
+ * call a builtin or an intrinsic the emitter doesn't support are not
+ * emitted, nor are functions that call them; the interpreter runs those.
+ * Compiled code doesn't reach safepoints, so other threads don't run while
+ * it runs. */
+
+typedef struct PNNativeFunctionInfo {
+  PNBool is_emitted;
+  /* The function's C definition, written while the function's instructions
+   * are still loaded. */
+  char* body;
+  size_t body_size;
+  /* Functions it calls directly, other than intrinsics */
+  uint32_t num_callee_ids;
+  PNFunctionId* callee_ids;
+} PNNativeFunctionInfo;
+
+typedef struct PNNativeWriter {
+  const char* filename;
+  FILE* f;
+  PNModule* module;
+  PNFunction* function;
+  uint32_t num_functions;
+  PNNativeFunctionInfo* infos; /* Indexed by function id */
+  /* The after_function_block callback that was replaced */
+  void (*after_function_block)(PNModule* module,
+                               PNFunctionId function_id,
+                               PNFunction* function,
+                               void* user_data);
+} PNNativeWriter;
+
+static const char* pn_native_get_ctype(PNBasicType basic_type) {
+  switch (basic_type) {
+    case PN_BASIC_TYPE_INT1:
+    case PN_BASIC_TYPE_INT8:
+      return "uint8_t";
+    case PN_BASIC_TYPE_INT16:
+      return "uint16_t";
+    case PN_BASIC_TYPE_INT32:
+      return "uint32_t";
+    case PN_BASIC_TYPE_INT64:
+      return "uint64_t";
+    case PN_BASIC_TYPE_FLOAT:
+      return "float";
+    case PN_BASIC_TYPE_DOUBLE:
+      return "double";
+    default:
+      return "void";
+  }
+}
+
+static const char* pn_native_get_signed_ctype(PNBasicType basic_type) {
+  switch (basic_type) {
+    case PN_BASIC_TYPE_INT1:
+    case PN_BASIC_TYPE_INT8:
+      return "int8_t";
+    case PN_BASIC_TYPE_INT16:
+      return "int16_t";
+    case PN_BASIC_TYPE_INT32:
+      return "int32_t";
+    case PN_BASIC_TYPE_INT64:
+      return "int64_t";
+    default:
+      return pn_native_get_ctype(basic_type);
+  }
+}
+
+/* The PNRuntimeValue field that holds a value of |basic_type|. */
+static const char* pn_native_get_field(PNBasicType basic_type) {
+  switch (basic_type) {
+    case PN_BASIC_TYPE_INT1:
+    case PN_BASIC_TYPE_INT8:
+      return "u8";
+    case PN_BASIC_TYPE_INT16:
+      return "u16";
+    case PN_BASIC_TYPE_INT32:
+      return "u32";
+    case PN_BASIC_TYPE_INT64:
+      return "u64";
+    case PN_BASIC_TYPE_FLOAT:
+      return "f32";
+    case PN_BASIC_TYPE_DOUBLE:
+      return "f64";
+    default:
+      PN_UNREACHABLE();
+      return NULL;
+  }
+}
+
+/* FNV-1a, used to check that a shared object was built from this pexe. */
+static uint32_t pn_native_checksum(const void* data, size_t size) {
+  const uint8_t* p = data;
+  uint32_t hash = 2166136261U;
+  size_t n;
+  for (n = 0; n < size; ++n) {
+    hash = (hash ^ p[n]) * 16777619U;
+  }
+  return hash;
+}
+
+static PNBasicType pn_native_get_value_basic_type(PNModule* module,
+                                                  PNFunction* function,
+                                                  PNValueId value_id) {
+  PNValue* value = pn_function_get_value(module, function, value_id);
+  if (value->type_id == PN_INVALID_TYPE_ID) {
+    return PN_BASIC_TYPE_VOID;
+  }
+  return module->types[value->type_id].basic_type;
+}
+
+static PNBool pn_native_is_intrinsic_supported(PNIntrinsicId intrinsic_id) {
+  switch (intrinsic_id) {
+    case PN_INTRINSIC_LLVM_CTLZ_I32:
+    case PN_INTRINSIC_LLVM_CTLZ_I64:
+    case PN_INTRINSIC_LLVM_CTTZ_I32:
+    case PN_INTRINSIC_LLVM_CTTZ_I64:
+    case PN_INTRINSIC_LLVM_MEMCPY:
+    case PN_INTRINSIC_LLVM_MEMMOVE:
+    case PN_INTRINSIC_LLVM_MEMSET:
+    case PN_INTRINSIC_LLVM_SQRT_F32:
+    case PN_INTRINSIC_LLVM_SQRT_F64:
+    case PN_INTRINSIC_LLVM_TRAP:
+      return PN_TRUE;
+    default:
+      return PN_FALSE;
+  }
+}
+
+/* Returns PN_FALSE if |function| can't be emitted. Direct calls to other
+ * functions are allowed here, and checked by pn_native_writer_finish once
+ * every function has been read. */
+static PNBool pn_function_is_native_supported(PNModule* module,
+                                              PNFunction* function) {
+  if (function->intrinsic_id != PN_INTRINSIC_NULL) {
+    return PN_FALSE;
+  }
+
+  uint32_t n;
+  for (n = 0; n < function->num_bbs; ++n) {
+    PNInstruction* inst;
+    for (inst = function->bbs[n].instructions; inst; inst = inst->next) {
+      switch (inst->code) {
+        case PN_FUNCTION_CODE_INST_ALLOCA:
+          return PN_FALSE;
+
+        case PN_FUNCTION_CODE_INST_CALL:
+        case PN_FUNCTION_CODE_INST_CALL_INDIRECT: {
+          PNInstructionCall* i = (PNInstructionCall*)inst;
+          if (i->is_indirect) {
+            return PN_FALSE;
+          }
+
+          PNValue* callee =
+              pn_function_get_value(module, function, i->callee_id);
+          PNFunction* callee_function = &module->functions[callee->index];
+          if (callee_function->intrinsic_id != PN_INTRINSIC_NULL) {
+            if (!pn_native_is_intrinsic_supported(
+                    callee_function->intrinsic_id)) {
+              return PN_FALSE;
+            }
+          } else if (callee_function->is_proto) {
+            return PN_FALSE;
+          }
+          break;
+        }
+
+        default:
+          break;
+      }
+    }
+  }
+  return PN_TRUE;
+}
+
+static void pn_native_collect_callee_ids(PNModule* module,
+                                         PNFunction* function,
+                                         PNNativeFunctionInfo* info) {
+  uint32_t pass;
+  for (pass = 0; pass < 2; ++pass) {
+    info->num_callee_ids = 0;
+    uint32_t n;
+    for (n = 0; n < function->num_bbs; ++n) {
+      PNInstruction* inst;
+      for (inst = function->bbs[n].instructions; inst; inst = inst->next) {
+        if (inst->code != PN_FUNCTION_CODE_INST_CALL) {
+          continue;
+        }
+
+        PNInstructionCall* i = (PNInstructionCall*)inst;
+        PNValue* callee = pn_function_get_value(module, function, i->callee_id);
+        if (module->functions[callee->index].intrinsic_id ==
+            PN_INTRINSIC_NULL) {
+          if (pass == 1) {
+            info->callee_ids[info->num_callee_ids] = callee->index;
+          }
+          info->num_callee_ids++;
+        }
+      }
+    }
+
+    if (pass == 0) {
+      info->callee_ids =
+          info->num_callee_ids
+              ? pn_malloc(info->num_callee_ids * sizeof(PNFunctionId))
+              : NULL;
+    }
+  }
+}
+
+static void pn_native_write_float_constant(PNNativeWriter* w,
+                                           PNBasicType basic_type,
+                                           PNRuntimeValue value) {
+  if (basic_type == PN_BASIC_TYPE_FLOAT) {
+    fprintf(w->f, "pn_f32(%" PRIu32 "u)", value.u32);
+  } else {
+    fprintf(w->f, "pn_f64(UINT64_C(%" PRIu64 "))", value.u64);
+  }
+}
+
+static void pn_native_write_value(PNNativeWriter* w, PNValueId value_id) {
+  PNModule* module = w->module;
+  PNFunction* function = w->function;
+  if (value_id < module->num_values) {
+    fprintf(w->f, "%" PRIu32 "u",
+            pn_module_get_runtime_value(module, value_id).u32);
+    return;
+  }
+
+  PNValue* value = pn_function_get_value(module, function, value_id);
+  switch (value->code) {
+    case PN_VALUE_CODE_CONSTANT: {
+      PNConstant* constant = &function->constants[value->index];
+      switch (constant->basic_type) {
+        case PN_BASIC_TYPE_INT1:
+        case PN_BASIC_TYPE_INT8:
+          fprintf(w->f, "(uint8_t)%" PRIu8, constant->value.u8);
+          break;
+        case PN_BASIC_TYPE_INT16:
+          fprintf(w->f, "(uint16_t)%" PRIu16, constant->value.u16);
+          break;
+        case PN_BASIC_TYPE_INT32:
+          fprintf(w->f, "%" PRIu32 "u", constant->value.u32);
+          break;
+        case PN_BASIC_TYPE_INT64:
+          fprintf(w->f, "UINT64_C(%" PRIu64 ")", constant->value.u64);
+          break;
+        case PN_BASIC_TYPE_FLOAT:
+        case PN_BASIC_TYPE_DOUBLE:
+          pn_native_write_float_constant(w, constant->basic_type,
+                                         constant->value);
+          break;
+        default:
+          PN_UNREACHABLE();
+          break;
+      }
+      break;
+    }
+
+    case PN_VALUE_CODE_FUNCTION_ARG:
+      fprintf(w->f, "a%u", value->index);
+      break;
+
+    case PN_VALUE_CODE_LOCAL_VAR:
+      fprintf(w->f, "v%u", value_id);
+      break;
+
+    default:
+      PN_UNREACHABLE();
+      break;
+  }
+}
+
+static void pn_native_write_address(PNNativeWriter* w,
+                                    PNValueId base_id,
+                                    PNValueId index_id,
+                                    uint32_t scale,
+                                    uint32_t offset) {
+  if (index_id != PN_INVALID_VALUE_ID) {
+    fprintf(w->f, "(uint32_t)(");
+    pn_native_write_value(w, base_id);
+    fprintf(w->f, " + ");
+    pn_native_write_value(w, index_id);
+    fprintf(w->f, " * %uu)", scale);
+  } else if (offset != 0) {
+    fprintf(w->f, "(uint32_t)(");
+    pn_native_write_value(w, base_id);
+    fprintf(w->f, " + %uu)", offset);
+  } else {
+    pn_native_write_value(w, base_id);
+  }
+}
+
+/* Writes the phi assignments for the edge from |bb| to |dest_bb_id|, then
+ * jumps to it. */
+static void pn_native_write_edge(PNNativeWriter* w,
+                                 PNBasicBlock* bb,
+                                 PNBasicBlockId dest_bb_id,
+                                 const char* indent) {
+  uint32_t n;
+  for (n = 0; n < bb->num_phi_assigns; ++n) {
+    PNPhiAssign* assign = &bb->phi_assigns[n];
+    if (assign->bb_id == dest_bb_id) {
+      fprintf(w->f, "%sv%u = ", indent, assign->dest_value_id);
+      pn_native_write_value(w, assign->source_value_id);
+      fprintf(w->f, ";\n");
+    }
+  }
+  fprintf(w->f, "%sgoto b%u;\n", indent, dest_bb_id);
+}
+
+static void pn_native_write_binop(PNNativeWriter* w, PNInstructionBinop* i) {
+  PNBasicType basic_type =
+      pn_native_get_value_basic_type(w->module, w->function, i->value0_id);
+  const char* op;
+  PNBool is_signed = PN_FALSE;
+  switch (i->binop_opcode) {
+    case PN_BINOP_ADD: op = "+"; break;
+    case PN_BINOP_SUB: op = "-"; break;
+    case PN_BINOP_MUL: op = "*"; break;
+    case PN_BINOP_UDIV: op = "/"; break;
+    case PN_BINOP_SDIV: op = "/"; is_signed = PN_TRUE; break;
+    case PN_BINOP_UREM: op = "%"; break;
+    case PN_BINOP_SREM: op = "%"; is_signed = PN_TRUE; break;
+    case PN_BINOP_SHL: op = "<<"; break;
+    case PN_BINOP_LSHR: op = ">>"; break;
+    case PN_BINOP_ASHR: op = ">>"; is_signed = PN_TRUE; break;
+    case PN_BINOP_AND: op = "&"; break;
+    case PN_BINOP_OR: op = "|"; break;
+    case PN_BINOP_XOR: op = "^"; break;
+    default:
+      PN_UNREACHABLE();
+      op = NULL;
+      break;
+  }
+
+  fprintf(w->f, "  v%u = ", i->result_value_id);
+  if (basic_type == PN_BASIC_TYPE_FLOAT ||
+      basic_type == PN_BASIC_TYPE_DOUBLE) {
+    pn_native_write_value(w, i->value0_id);
+    fprintf(w->f, " %s ", op);
+    pn_native_write_value(w, i->value1_id);
+    fprintf(w->f, ";\n");
+    return;
+  }
+
+  /* Operate on at least 32 bits without overflowing a signed int, as the
+   * interpreter does after C's integer promotions. */
+  const char* operand_type;
+  const char* wide_type;
+  if (is_signed) {
+    operand_type = pn_native_get_signed_ctype(basic_type);
+    wide_type = basic_type == PN_BASIC_TYPE_INT64 ? "int64_t" : "int32_t";
+  } else {
+    operand_type = pn_native_get_ctype(basic_type);
+    wide_type = basic_type == PN_BASIC_TYPE_INT64 ? "uint64_t" : "uint32_t";
+  }
+  fprintf(w->f, "(%s)((%s)(%s)", pn_native_get_ctype(basic_type), wide_type,
+          operand_type);
+  pn_native_write_value(w, i->value0_id);
+  fprintf(w->f, " %s (%s)(%s)", op, wide_type, operand_type);
+  pn_native_write_value(w, i->value1_id);
+  fprintf(w->f, ");\n");
+}
+
+static void pn_native_write_cast(PNNativeWriter* w, PNInstructionCast* i) {
+  PNBasicType from =
+      pn_native_get_value_basic_type(w->module, w->function, i->value_id);
+  PNBasicType to = w->module->types[i->type_id].basic_type;
+  const char* to_ctype = pn_native_get_ctype(to);
+
+  fprintf(w->f, "  v%u = ", i->result_value_id);
+  switch (i->cast_opcode) {
+    case PN_CAST_TRUNC:
+      if (to == PN_BASIC_TYPE_INT1) {
+        fprintf(w->f, "(uint8_t)(");
+        pn_native_write_value(w, i->value_id);
+        fprintf(w->f, " & 1)");
+      } else {
+        fprintf(w->f, "(%s)", to_ctype);
+        pn_native_write_value(w, i->value_id);
+      }
+      break;
+
+    case PN_CAST_ZEXT:
+    case PN_CAST_SEXT:
+      if (from == PN_BASIC_TYPE_INT1) {
+        fprintf(w->f, "(%s)(%s(%s)(", to_ctype,
+                i->cast_opcode == PN_CAST_SEXT ? "-" : "",
+                i->cast_opcode == PN_CAST_SEXT
+                    ? pn_native_get_signed_ctype(to)
+                    : to_ctype);
+        pn_native_write_value(w, i->value_id);
+        fprintf(w->f, " & 1))");
+      } else if (i->cast_opcode == PN_CAST_SEXT) {
+        fprintf(w->f, "(%s)(%s)(%s)", to_ctype, pn_native_get_signed_ctype(to),
+                pn_native_get_signed_ctype(from));
+        pn_native_write_value(w, i->value_id);
+      } else {
+        fprintf(w->f, "(%s)", to_ctype);
+        pn_native_write_value(w, i->value_id);
+      }
+      break;
+
+    case PN_CAST_FPTOSI:
+    case PN_CAST_SITOFP:
+      fprintf(w->f, "(%s)(%s)", to_ctype, pn_native_get_signed_ctype(to));
+      fprintf(w->f, "(%s)", pn_native_get_signed_ctype(from));
+      pn_native_write_value(w, i->value_id);
+      break;
+
+    case PN_CAST_FPTOUI:
+    case PN_CAST_UITOFP:
+    case PN_CAST_FPTRUNC:
+    case PN_CAST_FPEXT:
+      fprintf(w->f, "(%s)", to_ctype);
+      pn_native_write_value(w, i->value_id);
+      break;
+
+    case PN_CAST_BITCAST:
+      fprintf(w->f, "pn_%s(", pn_native_get_field(to));
+      pn_native_write_value(w, i->value_id);
+      fprintf(w->f, ")");
+      break;
+
+    default:
+      PN_UNREACHABLE();
+      break;
+  }
+  fprintf(w->f, ";\n");
+}
+
+static void pn_native_write_cmp2(PNNativeWriter* w, PNInstructionCmp2* i) {
+  PNBasicType basic_type =
+      pn_native_get_value_basic_type(w->module, w->function, i->value0_id);
+  const char* operand_type = "";
+  const char* op;
+  const char* prefix = "";
+  switch (i->cmp2_opcode) {
+    case PN_FCMP_OEQ: op = "=="; break;
+    case PN_FCMP_OGT: op = ">"; break;
+    case PN_FCMP_OGE: op = ">="; break;
+    case PN_FCMP_OLT: op = "<"; break;
+    case PN_FCMP_OLE: op = "<="; break;
+    case PN_FCMP_ONE: op = "!="; break;
+    case PN_FCMP_UEQ: op = "!="; prefix = "!"; break;
+    case PN_FCMP_UGT: op = "<="; prefix = "!"; break;
+    case PN_FCMP_UGE: op = "<"; prefix = "!"; break;
+    case PN_FCMP_ULT: op = ">="; prefix = "!"; break;
+    case PN_FCMP_ULE: op = ">"; prefix = "!"; break;
+    case PN_FCMP_UNE: op = "=="; prefix = "!"; break;
+
+    case PN_FCMP_ORD:
+    case PN_FCMP_UNO:
+      fprintf(w->f, "  v%u = %s(", i->result_value_id,
+              i->cmp2_opcode == PN_FCMP_UNO ? "!" : "");
+      pn_native_write_value(w, i->value0_id);
+      fprintf(w->f, " == ");
+      pn_native_write_value(w, i->value1_id);
+      fprintf(w->f, " || ");
+      pn_native_write_value(w, i->value0_id);
+      fprintf(w->f, " != ");
+      pn_native_write_value(w, i->value1_id);
+      fprintf(w->f, ");\n");
+      return;
+
+    case PN_ICMP_EQ: op = "=="; break;
+    case PN_ICMP_NE: op = "!="; break;
+    case PN_ICMP_UGT: op = ">"; break;
+    case PN_ICMP_UGE: op = ">="; break;
+    case PN_ICMP_ULT: op = "<"; break;
+    case PN_ICMP_ULE: op = "<="; break;
+    case PN_ICMP_SGT: op = ">"; operand_type = "s"; break;
+    case PN_ICMP_SGE: op = ">="; operand_type = "s"; break;
+    case PN_ICMP_SLT: op = "<"; operand_type = "s"; break;
+    case PN_ICMP_SLE: op = "<="; operand_type = "s"; break;
+    default:
+      PN_UNREACHABLE();
+      op = NULL;
+      break;
+  }
+
+  fprintf(w->f, "  v%u = %s(", i->result_value_id, prefix);
+  if (operand_type[0]) {
+    operand_type = pn_native_get_signed_ctype(basic_type);
+    fprintf(w->f, "(%s)", operand_type);
+    pn_native_write_value(w, i->value0_id);
+    fprintf(w->f, " %s (%s)", op, operand_type);
+  } else {
+    pn_native_write_value(w, i->value0_id);
+    fprintf(w->f, " %s ", op);
+  }
+  pn_native_write_value(w, i->value1_id);
+  fprintf(w->f, ");\n");
+}
+
+static void pn_native_write_call(PNNativeWriter* w, PNInstructionCall* i) {
+  PNValue* callee = pn_function_get_value(w->module, w->function, i->callee_id);
+  PNFunction* callee_function = &w->module->functions[callee->index];
+  PNValueId* args = i->arg_ids;
+
+  fprintf(w->f, "  ");
+  if (i->result_value_id != PN_INVALID_VALUE_ID) {
+    fprintf(w->f, "v%u = ", i->result_value_id);
+  }
+
+  switch (callee_function->intrinsic_id) {
+    case PN_INTRINSIC_NULL: {
+      fprintf(w->f, "f%u(ctx", callee->index);
+      uint32_t n;
+      for (n = 0; n < i->num_args; ++n) {
+        fprintf(w->f, ", ");
+        pn_native_write_value(w, args[n]);
+      }
+      fprintf(w->f, ");\n");
+      break;
+    }
+
+    case PN_INTRINSIC_LLVM_CTLZ_I32:
+    case PN_INTRINSIC_LLVM_CTLZ_I64:
+    case PN_INTRINSIC_LLVM_CTTZ_I32:
+    case PN_INTRINSIC_LLVM_CTTZ_I64: {
+      PNIntrinsicId id = callee_function->intrinsic_id;
+      fprintf(w->f, "pn_%s%s(",
+              id == PN_INTRINSIC_LLVM_CTLZ_I32 ||
+                      id == PN_INTRINSIC_LLVM_CTLZ_I64
+                  ? "ctlz"
+                  : "cttz",
+              id == PN_INTRINSIC_LLVM_CTLZ_I32 ||
+                      id == PN_INTRINSIC_LLVM_CTTZ_I32
+                  ? "32"
+                  : "64");
+      pn_native_write_value(w, args[0]);
+      fprintf(w->f, ");\n");
+      break;
+    }
+
+    case PN_INTRINSIC_LLVM_MEMCPY:
+    case PN_INTRINSIC_LLVM_MEMMOVE:
+    case PN_INTRINSIC_LLVM_MEMSET: {
+      PNIntrinsicId id = callee_function->intrinsic_id;
+      fprintf(w->f, "pn_%s(ctx, mem, mem_size, ",
+              id == PN_INTRINSIC_LLVM_MEMCPY
+                  ? "memcpy"
+                  : id == PN_INTRINSIC_LLVM_MEMMOVE ? "memmove" : "memset");
+      pn_native_write_value(w, args[0]);
+      fprintf(w->f, ", ");
+      pn_native_write_value(w, args[1]);
+      fprintf(w->f, ", ");
+      pn_native_write_value(w, args[2]);
+      fprintf(w->f, ");\n");
+      break;
+    }
+
+    case PN_INTRINSIC_LLVM_SQRT_F32:
+    case PN_INTRINSIC_LLVM_SQRT_F64:
+      fprintf(w->f, "%s(", callee_function->intrinsic_id ==
+                                   PN_INTRINSIC_LLVM_SQRT_F32
+                               ? "sqrtf"
+                               : "sqrt");
+      pn_native_write_value(w, args[0]);
+      fprintf(w->f, ");\n");
+      break;
+
+    case PN_INTRINSIC_LLVM_TRAP:
+      fprintf(w->f, "pn_trap(ctx);\n");
+      break;
+
+    default:
+      PN_UNREACHABLE();
+      break;
+  }
+}
+
+static void pn_native_write_instruction(PNNativeWriter* w,
+                                        PNBasicBlock* bb,
+                                        PNInstruction* inst) {
+  switch (inst->code) {
+    case PN_FUNCTION_CODE_INST_BINOP:
+      pn_native_write_binop(w, (PNInstructionBinop*)inst);
+      break;
+
+    case PN_FUNCTION_CODE_INST_CAST:
+      pn_native_write_cast(w, (PNInstructionCast*)inst);
+      break;
+
+    case PN_FUNCTION_CODE_INST_RET: {
+      PNInstructionRet* i = (PNInstructionRet*)inst;
+      if (i->value_id == PN_INVALID_VALUE_ID) {
+        fprintf(w->f, "  return;\n");
+      } else {
+        fprintf(w->f, "  return ");
+        pn_native_write_value(w, i->value_id);
+        fprintf(w->f, ";\n");
+      }
+      break;
+    }
+
+    case PN_FUNCTION_CODE_INST_BR: {
+      PNInstructionBr* i = (PNInstructionBr*)inst;
+      if (i->false_bb_id == PN_INVALID_BB_ID) {
+        pn_native_write_edge(w, bb, i->true_bb_id, "  ");
+      } else {
+        fprintf(w->f, "  if (");
+        pn_native_write_value(w, i->value_id);
+        fprintf(w->f, ") {\n");
+        pn_native_write_edge(w, bb, i->true_bb_id, "    ");
+        fprintf(w->f, "  } else {\n");
+        pn_native_write_edge(w, bb, i->false_bb_id, "    ");
+        fprintf(w->f, "  }\n");
+      }
+      break;
+    }
+
+    case PN_FUNCTION_CODE_INST_SWITCH: {
+      PNInstructionSwitch* i = (PNInstructionSwitch*)inst;
+      const char* ctype =
+          pn_native_get_ctype(w->module->types[i->type_id].basic_type);
+      fprintf(w->f, "  switch (");
+      pn_native_write_value(w, i->value_id);
+      fprintf(w->f, ") {\n");
+      uint32_t n;
+      for (n = 0; n < i->num_cases; ++n) {
+        PNSwitchCase* c = &i->cases[n];
+        fprintf(w->f, "    case (%s)UINT64_C(%" PRIu64 "): {\n", ctype,
+                (uint64_t)c->value);
+        pn_native_write_edge(w, bb, c->bb_id, "      ");
+        fprintf(w->f, "    }\n");
+      }
+      fprintf(w->f, "    default: {\n");
+      pn_native_write_edge(w, bb, i->default_bb_id, "      ");
+      fprintf(w->f, "    }\n  }\n");
+      break;
+    }
+
+    case PN_FUNCTION_CODE_INST_UNREACHABLE:
+      fprintf(w->f, "  ctx->unreachable(ctx);\n");
+      break;
+
+    case PN_FUNCTION_CODE_INST_LOAD: {
+      PNInstructionLoad* i = (PNInstructionLoad*)inst;
+      fprintf(w->f, "  v%u = pn_load_%s(ctx, mem, mem_size, ",
+              i->result_value_id,
+              pn_native_get_field(w->module->types[i->type_id].basic_type));
+      pn_native_write_address(w, i->src_id, i->index_id, i->scale, i->offset);
+      fprintf(w->f, ");\n");
+      break;
+    }
+
+    case PN_FUNCTION_CODE_INST_STORE: {
+      PNInstructionStore* i = (PNInstructionStore*)inst;
+      PNBasicType basic_type =
+          pn_native_get_value_basic_type(w->module, w->function, i->value_id);
+      fprintf(w->f, "  pn_store_%s(ctx, mem, mem_size, ",
+              pn_native_get_field(basic_type));
+      pn_native_write_address(w, i->dest_id, i->index_id, i->scale,
+                              i->offset);
+      fprintf(w->f, ", ");
+      pn_native_write_value(w, i->value_id);
+      fprintf(w->f, ");\n");
+      break;
+    }
+
+    case PN_FUNCTION_CODE_INST_CMP2:
+      pn_native_write_cmp2(w, (PNInstructionCmp2*)inst);
+      break;
+
+    case PN_FUNCTION_CODE_INST_VSELECT: {
+      PNInstructionVselect* i = (PNInstructionVselect*)inst;
+      fprintf(w->f, "  v%u = (", i->result_value_id);
+      pn_native_write_value(w, i->cond_id);
+      fprintf(w->f, " & 1) ? ");
+      pn_native_write_value(w, i->true_value_id);
+      fprintf(w->f, " : ");
+      pn_native_write_value(w, i->false_value_id);
+      fprintf(w->f, ";\n");
+      break;
+    }
+
+    case PN_FUNCTION_CODE_INST_CALL:
+      pn_native_write_call(w, (PNInstructionCall*)inst);
+      break;
+
+    case PN_FUNCTION_CODE_INST_PHI:
+      /* Assigned on the incoming edges */
+      break;
+
+    case PN_FUNCTION_CODE_INST_FORWARDTYPEREF:
+      break;
+
+    default:
+      PN_FATAL("Unexpected instruction code: %d\n", inst->code);
+      break;
+  }
+}
+
+static void pn_native_write_signature(PNNativeWriter* w,
+                                      PNFunctionId function_id) {
+  PNModule* module = w->module;
+  PNFunction* function = &module->functions[function_id];
+  PNType* type = &module->types[function->type_id];
+  fprintf(w->f, "static %s f%u(PNNativeContext* ctx",
+          pn_native_get_ctype(module->types[type->return_type].basic_type),
+          function_id);
+  uint32_t n;
+  for (n = 0; n < type->num_args; ++n) {
+    fprintf(w->f, ", %s a%u",
+            pn_native_get_ctype(module->types[type->arg_types[n]].basic_type),
+            n);
+  }
+  fprintf(w->f, ")");
+}
+
+static void pn_native_write_function(PNNativeWriter* w,
+                                     PNFunctionId function_id) {
+  PNModule* module = w->module;
+  PNFunction* function = &module->functions[function_id];
+  w->function = function;
+
+  if (function->name && function->name[0]) {
+    fprintf(w->f, "/* %s */\n", function->name);
+  }
+  pn_native_write_signature(w, function_id);
+  fprintf(w->f, " {\n");
+  fprintf(w->f, "  uint8_t* mem = ctx->memory;\n");
+  fprintf(w->f, "  uint32_t mem_size = ctx->memory_size;\n");
+  fprintf(w->f, "  (void)mem;\n  (void)mem_size;\n");
+
+  /* Only declare the locals that are still assigned; e.g. folded address
+   * arithmetic has been removed. */
+  PNBool* is_assigned = pn_calloc(function->num_values, sizeof(PNBool));
+  uint32_t n;
+  for (n = 0; n < function->num_bbs; ++n) {
+    PNBasicBlock* bb = &function->bbs[n];
+    PNInstruction* inst;
+    for (inst = bb->instructions; inst; inst = inst->next) {
+      PNValueId value_id = pn_instruction_get_result_value_id(inst);
+      if (value_id != PN_INVALID_VALUE_ID) {
+        is_assigned[value_id - module->num_values] = PN_TRUE;
+      }
+    }
+
+    uint32_t m;
+    for (m = 0; m < bb->num_phi_assigns; ++m) {
+      PNValueId value_id = bb->phi_assigns[m].dest_value_id;
+      is_assigned[value_id - module->num_values] = PN_TRUE;
+    }
+  }
+
+  for (n = 0; n < function->num_values; ++n) {
+    PNValue* value = &function->values[n];
+    if (is_assigned[n]) {
+      fprintf(w->f, "  %s v%u;\n",
+              pn_native_get_ctype(module->types[value->type_id].basic_type),
+              module->num_values + n);
+    }
+  }
+  pn_free(is_assigned);
+
+  for (n = 0; n < function->num_bbs; ++n) {
+    PNBasicBlock* bb = &function->bbs[n];
+    /* The entry block has no predecessors. */
+    if (n != 0) {
+      fprintf(w->f, "b%u:;\n", n);
+    }
+    PNInstruction* inst;
+    for (inst = bb->instructions; inst; inst = inst->next) {
+      pn_native_write_instruction(w, bb, inst);
+    }
+  }
+  fprintf(w->f, "}\n\n");
+}
+
+/* Adapts the typed function to PNNativeFunction. */
+static void pn_native_write_wrapper(PNNativeWriter* w,
+                                    PNFunctionId function_id) {
+  PNModule* module = w->module;
+  PNType* type = &module->types[module->functions[function_id].type_id];
+  PNBasicType return_type = module->types[type->return_type].basic_type;
+  fprintf(w->f,
+          "static void w%u(PNNativeContext* ctx, const PNRuntimeValue* args,\n"
+          "    PNRuntimeValue* result) {\n  ",
+          function_id);
+  if (return_type != PN_BASIC_TYPE_VOID) {
+    fprintf(w->f, "result->%s = ", pn_native_get_field(return_type));
+  } else {
+    fprintf(w->f, "(void)result;\n  ");
+  }
+  fprintf(w->f, "f%u(ctx", function_id);
+  uint32_t n;
+  for (n = 0; n < type->num_args; ++n) {
+    fprintf(w->f, ", args[%u].%s", n,
+            pn_native_get_field(module->types[type->arg_types[n]].basic_type));
+  }
+  fprintf(w->f, ");\n}\n\n");
+}
+
+static void pn_native_write_prelude(PNNativeWriter* w, uint32_t checksum) {
+  fprintf(w->f,
+          "/* Generated by pnacl --emit-c; pexe checksum 0x%08x. Build with\n"
+          " *   cc -O2 -shared -fPIC -o foo.so foo.c\n"
+          " * and run with pnacl --load-native=foo.so. */\n\n",
+          checksum);
+  fprintf(w->f,
+          "#include <math.h>\n"
+          "#include <stdint.h>\n"
+          "#include <string.h>\n\n"
+          "typedef union PNRuntimeValue {\n"
+          "  int8_t i8;\n  uint8_t u8;\n  int16_t i16;\n  uint16_t u16;\n"
+          "  int32_t i32;\n  uint32_t u32;\n  int64_t i64;\n  uint64_t u64;\n"
+          "  float f32;\n  double f64;\n"
+          "} PNRuntimeValue;\n\n"
+          "typedef struct PNNativeContext {\n"
+          "  uint8_t* memory;\n"
+          "  uint32_t memory_size;\n"
+          "  void (*memory_error)(struct PNNativeContext* context,\n"
+          "                       uint32_t offset,\n"
+          "                       uint32_t size);\n"
+          "  void (*unreachable)(struct PNNativeContext* context);\n"
+          "  void* user_data;\n"
+          "} PNNativeContext;\n\n"
+          "typedef void (*PNNativeFunction)(PNNativeContext* context,\n"
+          "                                 const PNRuntimeValue* args,\n"
+          "                                 PNRuntimeValue* result);\n\n"
+          "typedef struct PNNativeModule {\n"
+          "  uint32_t abi_version;\n"
+          "  uint32_t checksum;\n"
+          "  uint32_t num_functions;\n"
+          "  const PNNativeFunction* functions;\n"
+          "} PNNativeModule;\n\n");
+  fprintf(w->f,
+          "static inline void pn_check(PNNativeContext* ctx, uint32_t "
+          "mem_size,\n"
+          "    uint32_t offset, uint32_t size) {\n"
+          "  if (offset < %uu || (uint64_t)offset + size > mem_size) {\n"
+          "    ctx->memory_error(ctx, offset, size);\n"
+          "  }\n"
+          "}\n\n",
+          PN_MEMORY_GUARD_SIZE);
+
+#define PN_NATIVE_WRITE_MEMORY_HELPERS(field, ctype)                         \
+  fprintf(w->f,                                                              \
+          "static inline " ctype " pn_load_" field                           \
+          "(PNNativeContext* ctx, uint8_t* mem,\n"                           \
+          "    uint32_t mem_size, uint32_t offset) {\n"                      \
+          "  " ctype " value;\n"                                             \
+          "  pn_check(ctx, mem_size, offset, sizeof(value));\n"              \
+          "  memcpy(&value, mem + offset, sizeof(value));\n"                 \
+          "  return value;\n"                                                \
+          "}\n\n"                                                            \
+          "static inline void pn_store_" field                               \
+          "(PNNativeContext* ctx, uint8_t* mem,\n"                           \
+          "    uint32_t mem_size, uint32_t offset, " ctype " value) {\n"     \
+          "  pn_check(ctx, mem_size, offset, sizeof(value));\n"              \
+          "  memcpy(mem + offset, &value, sizeof(value));\n"                 \
+          "}\n\n")
+
+  PN_NATIVE_WRITE_MEMORY_HELPERS("u8", "uint8_t");
+  PN_NATIVE_WRITE_MEMORY_HELPERS("u16", "uint16_t");
+  PN_NATIVE_WRITE_MEMORY_HELPERS("u32", "uint32_t");
+  PN_NATIVE_WRITE_MEMORY_HELPERS("u64", "uint64_t");
+  PN_NATIVE_WRITE_MEMORY_HELPERS("f32", "float");
+  PN_NATIVE_WRITE_MEMORY_HELPERS("f64", "double");
+
+#undef PN_NATIVE_WRITE_MEMORY_HELPERS
+
+#define PN_NATIVE_WRITE_BITCAST_HELPER(field, to, from)                   \
+  fprintf(w->f, "static inline " to " pn_" field "(" from " x) {\n"       \
+                "  " to " y;\n"                                           \
+                "  memcpy(&y, &x, sizeof(y));\n"                          \
+                "  return y;\n"                                           \
+                "}\n\n")
+
+  PN_NATIVE_WRITE_BITCAST_HELPER("f32", "float", "uint32_t");
+  PN_NATIVE_WRITE_BITCAST_HELPER("f64", "double", "uint64_t");
+  PN_NATIVE_WRITE_BITCAST_HELPER("u32", "uint32_t", "float");
+  PN_NATIVE_WRITE_BITCAST_HELPER("u64", "uint64_t", "double");
+
+#undef PN_NATIVE_WRITE_BITCAST_HELPER
+
+  fprintf(w->f,
+          "static inline uint32_t pn_ctlz32(uint32_t x) {\n"
+          "  return x == 0 ? 0 : (uint32_t)__builtin_clz(x);\n"
+          "}\n\n"
+          "static inline uint64_t pn_ctlz64(uint64_t x) {\n"
+          "  return x == 0 ? 0 : (uint64_t)__builtin_clzll(x);\n"
+          "}\n\n"
+          "static inline uint32_t pn_cttz32(uint32_t x) {\n"
+          "  return x == 0 ? 0 : (uint32_t)__builtin_ctz(x);\n"
+          "}\n\n"
+          "static inline uint64_t pn_cttz64(uint64_t x) {\n"
+          "  return x == 0 ? 0 : (uint64_t)__builtin_ctzll(x);\n"
+          "}\n\n"
+          "static inline void pn_memcpy(PNNativeContext* ctx, uint8_t* mem,\n"
+          "    uint32_t mem_size, uint32_t dst, uint32_t src, uint32_t len) "
+          "{\n"
+          "  if (len > 0) {\n"
+          "    pn_check(ctx, mem_size, dst, len);\n"
+          "    pn_check(ctx, mem_size, src, len);\n"
+          "    memcpy(mem + dst, mem + src, len);\n"
+          "  }\n"
+          "}\n\n"
+          "static inline void pn_memmove(PNNativeContext* ctx, uint8_t* mem,\n"
+          "    uint32_t mem_size, uint32_t dst, uint32_t src, uint32_t len) "
+          "{\n"
+          "  if (len > 0) {\n"
+          "    pn_check(ctx, mem_size, dst, len);\n"
+          "    pn_check(ctx, mem_size, src, len);\n"
+          "    memmove(mem + dst, mem + src, len);\n"
+          "  }\n"
+          "}\n\n"
+          "static inline void pn_memset(PNNativeContext* ctx, uint8_t* mem,\n"
+          "    uint32_t mem_size, uint32_t dst, uint8_t value, uint32_t len) "
+          "{\n"
+          "  if (len > 0) {\n"
+          "    pn_check(ctx, mem_size, dst, len);\n"
+          "    memset(mem + dst, value, len);\n"
+          "  }\n"
+          "}\n\n"
+          "static inline void pn_trap(PNNativeContext* ctx) {\n"
+          "  ctx->unreachable(ctx);\n"
+          "}\n\n");
+}
+
+static void pn_native_after_function_block(PNModule* module,
+                                           PNFunctionId function_id,
+                                           PNFunction* function,
+                                           void* user_data) {
+  PNNativeWriter* w = user_data;
+  if (w->after_function_block) {
+    w->after_function_block(module, function_id, function, user_data);
+  }
+
+  if (!w->infos) {
+    w->num_functions = module->num_functions;
+    w->infos = pn_calloc(w->num_functions, sizeof(PNNativeFunctionInfo));
+  }
+
+  /* With --repeat-load, the last load wins. */
+  PNNativeFunctionInfo* info = &w->infos[function_id];
+  pn_free(info->body);
+  pn_free(info->callee_ids);
+  memset(info, 0, sizeof(*info));
+
+  if (!pn_function_is_native_supported(module, function)) {
+    return;
+  }
+
+  info->is_emitted = PN_TRUE;
+  pn_native_collect_callee_ids(module, function, info);
+
+  w->f = open_memstream(&info->body, &info->body_size);
+  if (!w->f) {
+    PN_FATAL("Out of memory.\n");
+  }
+  w->module = module;
+  pn_native_write_function(w, function_id);
+  fclose(w->f);
+  w->f = NULL;
+}
+
+/* Hooks |read_context| so each function is written as C as it is read; the
+ * instructions are freed after that. */
+static void pn_native_writer_init(PNNativeWriter* w,
+                                  PNReadContext* read_context,
+                                  const char* filename) {
+  memset(w, 0, sizeof(*w));
+  w->filename = filename;
+  w->after_function_block = read_context->after_function_block;
+  read_context->after_function_block = pn_native_after_function_block;
+  read_context->user_data = w;
+}
+
+static void pn_native_writer_finish(PNNativeWriter* w,
+                                    PNModule* module,
+                                    uint32_t checksum) {
+  uint32_t n;
+  if (!w->infos) {
+    w->num_functions = module->num_functions;
+    w->infos = pn_calloc(w->num_functions, sizeof(PNNativeFunctionInfo));
+  }
+
+  /* A function is only emitted if everything it calls is too. */
+  PNBool changed;
+  do {
+    changed = PN_FALSE;
+    for (n = 0; n < w->num_functions; ++n) {
+      PNNativeFunctionInfo* info = &w->infos[n];
+      uint32_t m;
+      for (m = 0; info->is_emitted && m < info->num_callee_ids; ++m) {
+        if (!w->infos[info->callee_ids[m]].is_emitted) {
+          info->is_emitted = PN_FALSE;
+          changed = PN_TRUE;
+        }
+      }
+    }
+  } while (changed);
+
+  w->f = fopen(w->filename, "w");
+  if (!w->f) {
+    PN_FATAL("unable to open %s for writing\n", w->filename);
+  }
+  w->module = module;
+  pn_native_write_prelude(w, checksum);
+
+  uint32_t num_emitted = 0;
+  for (n = 0; n < w->num_functions; ++n) {
+    if (w->infos[n].is_emitted) {
+      pn_native_write_signature(w, n);
+      fprintf(w->f, ";\n");
+      num_emitted++;
+    }
+  }
+  fprintf(w->f, "\n");
+
+  for (n = 0; n < w->num_functions; ++n) {
+    PNNativeFunctionInfo* info = &w->infos[n];
+    if (info->is_emitted) {
+      fwrite(info->body, 1, info->body_size, w->f);
+      pn_native_write_wrapper(w, n);
+    }
+  }
+
+  fprintf(w->f, "static const PNNativeFunction pn_functions[] = {\n");
+  for (n = 0; n < w->num_functions; ++n) {
+    if (w->infos[n].is_emitted) {
+      fprintf(w->f, "  w%u,\n", n);
+    } else {
+      fprintf(w->f, "  0,\n");
+    }
+  }
+  fprintf(w->f, "};\n\n");
+  fprintf(w->f,
+          "const PNNativeModule pn_native_module = {\n"
+          "  %u, 0x%08xu, %u, pn_functions,\n"
+          "};\n",
+          PN_NATIVE_ABI_VERSION, checksum, w->num_functions);
+
+  if (fclose(w->f) != 0) {
+    PN_FATAL("unable to write %s\n", w->filename);
+  }
+
+  for (n = 0; n < w->num_functions; ++n) {
+    pn_free(w->infos[n].body);
+    pn_free(w->infos[n].callee_ids);
+  }
+  pn_free(w->infos);
+
+  if (g_pn_verbose) {
+    PN_PRINT("Emitted %u of %u functions to %s.\n", num_emitted,
+             w->num_functions, w->filename);
+  }
+}
+
+static void pn_native_memory_error(PNNativeContext* context,
+                                   uint32_t offset,
+                                   uint32_t size) {
+  pn_memory_check(context->user_data, offset, size);
+  /* pn_memory_check only returns for valid accesses. */
+  PN_UNREACHABLE();
+}
+
+static void pn_native_unreachable(PNNativeContext* context) {
+  PN_FATAL("Reached unreachable instruction!\n");
+}
+
+static void pn_module_load_native(PNModule* module,
+                                  const char* filename,
+                                  uint32_t checksum) {
+  /* dlopen searches the library path for names without a slash. */
+  char path[PATH_MAX];
+  if (strchr(filename, '/')) {
+    snprintf(path, sizeof(path), "%s", filename);
+  } else {
+    snprintf(path, sizeof(path), "./%s", filename);
+  }
+
+  void* handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (!handle) {
+    PN_FATAL("unable to load %s: %s\n", filename, dlerror());
+  }
+
+  const PNNativeModule* native = dlsym(handle, "pn_native_module");
+  if (!native) {
+    PN_FATAL("%s has no pn_native_module\n", filename);
+  }
+
+  if (native->abi_version != PN_NATIVE_ABI_VERSION) {
+    PN_FATAL("%s has ABI version %u, expected %u\n", filename,
+             native->abi_version, PN_NATIVE_ABI_VERSION);
+  }
+
+  if (native->checksum != checksum ||
+      native->num_functions != module->num_functions) {
+    PN_FATAL("%s was not built from this module\n", filename);
+  }
+
+  uint32_t num_loaded = 0;
+  uint32_t n;
+  for (n = 0; n < module->num_functions; ++n) {
+    if (native->functions[n]) {
+      module->functions[n].callee.native = native->functions[n];
+      num_loaded++;
+    }
+  }
+
+  if (g_pn_verbose) {
+    PN_PRINT("Loaded %u of %u functions from %s.\n", num_loaded,
+             module->num_functions, filename);
+  }
+}
+
+static PNRuntimeValue pn_thread_call_native(PNThread* thread,
+                                            PNCallee* callee,
+                                            const PNRuntimeValue* args) {
+  PNMemory* memory = thread->executor->memory;
+  PNNativeContext context;
+  context.memory = memory->data;
+  context.memory_size = memory->size;
+  context.memory_error = pn_native_memory_error;
+  context.unreachable = pn_native_unreachable;
+  context.user_data = memory;
+
+  PNRuntimeValue result;
+  result.u64 = 0;
+  callee->native(&context, args, &result);
+  return result;
+}
+
+#endif /* PN_NATIVE */
+
+#endif /* PN_NATIVE_H_ */
@@ -51,7 +51,7 @@ PN_FOREACH_PPP_INTERFACES(PN_PPP_INTERFACE)
 static PNRuntimeValue pn_builtin_PPB_GET_INTERFACE(PNThread* thread,
                                                    PNFunction* function,
                                                    uint32_t num_args,
-                                                   PNValueId* arg_ids) {
+                                                   PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 1);
   PN_BUILTIN_ARG(iface_name_p, 0, u32);
@@ -83,7 +83,7 @@ static PNRuntimeValue pn_builtin_PPB_GET_INTERFACE(PNThread* thread,
 static PNRuntimeValue pn_builtin_PPB_CORE_ADD_REF_RESOURCE(PNThread* thread,
                                                            PNFunction* function,
                                                            uint32_t num_args,
-                                                           PNValueId* arg_ids) {
+                                                           PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 1);
   PN_BUILTIN_ARG(resource, 0, i32);
@@ -95,7 +95,7 @@ static PNRuntimeValue pn_builtin_PPB_CORE_ADD_REF_RESOURCE(PNThread* thread,
 static PNRuntimeValue pn_builtin_PPB_CORE_RELEASE_RESOURCE(PNThread* thread,
                                                            PNFunction* function,
                                                            uint32_t num_args,
-                                                           PNValueId* arg_ids) {
+                                                           PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 1);
   PN_BUILTIN_ARG(resource, 0, i32);
@@ -107,7 +107,7 @@ static PNRuntimeValue pn_builtin_PPB_CORE_RELEASE_RESOURCE(PNThread* thread,
 static PNRuntimeValue pn_builtin_PPB_CORE_GET_TIME(PNThread* thread,
                                                    PNFunction* function,
                                                    uint32_t num_args,
-                                                   PNValueId* arg_ids) {
+                                                   PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 0);
   (void)executor;
@@ -118,7 +118,7 @@ static PNRuntimeValue pn_builtin_PPB_CORE_GET_TIME(PNThread* thread,
 static PNRuntimeValue pn_builtin_PPB_CORE_GET_TIME_TICKS(PNThread* thread,
                                                          PNFunction* function,
                                                          uint32_t num_args,
-                                                         PNValueId* arg_ids) {
+                                                         PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 0);
   (void)executor;
@@ -130,7 +130,7 @@ static PNRuntimeValue pn_builtin_PPB_CORE_CALL_ON_MAIN_THREAD(
     PNThread* thread,
     PNFunction* function,
     uint32_t num_args,
-    PNValueId* arg_ids) {
+    PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 3);
   PN_BUILTIN_ARG(delay_in_ms, 0, i32);
@@ -145,7 +145,7 @@ static PNRuntimeValue pn_builtin_PPB_CORE_CALL_ON_MAIN_THREAD(
 static PNRuntimeValue pn_builtin_PPB_CORE_IS_MAIN_THREAD(PNThread* thread,
                                                          PNFunction* function,
                                                          uint32_t num_args,
-                                                         PNValueId* arg_ids) {
+                                                         PNSlotId* arg_ids) {
   PNExecutor* executor = thread->executor;
   PN_CHECK(num_args == 0);
   (void)executor;
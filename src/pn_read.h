@@ -562,7 +562,7 @@ static void pn_value_symtab_block_read(PNReadContext* read_context,
               PNFunction* function = &module->functions[function_id];
               function->name = name;
 
-#define PN_INTRINSIC_CHECK(i_enum, i_name)                                 \
+#define PN_INTRINSIC_CHECK(i_enum, i_name, num_args, result)               \
   if (strcmp(name, i_name) == 0) {                                         \
     module->known_functions[PN_INTRINSIC_##i_enum] = function_id;          \
     function->intrinsic_id = PN_INTRINSIC_##i_enum;                        \
@@ -879,6 +879,7 @@ static void pn_function_block_read(PNReadContext* read_context,
       case PN_ENTRY_END_BLOCK:
         PN_CHECK(num_bbs == function->num_bbs);
         pn_function_calculate_result_value_types(module, function);
+        pn_function_calculate_address_modes(module, function);
         pn_function_calculate_uses(module, function);
         pn_function_calculate_phi_assigns(module, function);
 #if PN_CALCULATE_PRED_BBS
@@ -891,6 +892,7 @@ static void pn_function_block_read(PNReadContext* read_context,
         pn_function_calculate_liveness(module, function);
 #endif /* PN_CALCULATE_LIVENESS */
         pn_function_calculate_opcodes(module, function);
+        pn_function_verify(module, function);
 
         PN_CALLBACK(read_context, after_function_block,
                     (module, function_id, function, read_context->user_data));
@@ -1255,6 +1257,7 @@ static void pn_function_block_read(PNReadContext* read_context,
                 (1 << pn_record_read_int32(&reader, "alignment")) >> 1;
             inst->type_id = pn_record_read_int32(&reader, "type_id");
             PN_CHECK(pn_is_power_of_two(inst->alignment));
+            inst->index_id = PN_INVALID_VALUE_ID;
 
             value->type_id = inst->type_id;
 
@@ -1275,6 +1278,7 @@ static void pn_function_block_read(PNReadContext* read_context,
             inst->alignment =
                 (1 << pn_record_read_int32(&reader, "alignment")) >> 1;
             PN_CHECK(pn_is_power_of_two(inst->alignment));
+            inst->index_id = PN_INVALID_VALUE_ID;
 
             if (context->use_relative_ids) {
               inst->dest_id = rel_id - inst->dest_id;
@@ -1443,6 +1447,25 @@ static void pn_function_block_read(PNReadContext* read_context,
   PN_FATAL("Unexpected end of stream.\n");
 }
 
+/* Records where the function block starts, then skips it; see
+ * pn_module_read_lazy_function and pn_module_read_functions_parallel. */
+static void pn_function_block_skip(PNModule* module,
+                                   PNBitStream* bs,
+                                   PNFunctionId function_id) {
+  PNFunction* function = &module->functions[function_id];
+  function->lazy_bit_offset = bs->bit_offset;
+
+  /* Direct calls are resolved to the callee before it is read. */
+  function->callee.function = function;
+  function->callee.function_id = function_id;
+  function->callee.num_args = function->num_args;
+
+  pn_bitstream_read_vbr(bs, 4); /* codelen */
+  pn_bitstream_align_32(bs);
+  uint32_t num_words = pn_bitstream_read(bs, 32);
+  pn_bitstream_skip_bytes(bs, num_words * 4);
+}
+
 static void pn_module_block_read(PNReadContext* read_context,
                                  PNModule* module,
                                  PNBlockInfoContext* context,
@@ -1493,8 +1516,12 @@ static void pn_module_block_read(PNReadContext* read_context,
             }
 
             pn_function_id_check(module, function_id);
-            pn_function_block_read(read_context, module, context, bs,
-                                   function_id);
+            if (module->lazy_lowering || module->load_threads > 1) {
+              pn_function_block_skip(module, bs, function_id);
+            } else {
+              pn_function_block_read(read_context, module, context, bs,
+                                     function_id);
+            }
             function_id++;
             break;
           }
@@ -1552,9 +1579,19 @@ static void pn_module_block_read(PNReadContext* read_context,
             function->num_values = 0;
             function->values = NULL;
             function->num_instructions = 0;
+            function->instructions = NULL;
+            function->constant_pool = NULL;
+            function->num_module_value_slots = 0;
+            function->module_value_ids = NULL;
+            function->num_frame_slots = 0;
+            function->num_scratch_slots = 0;
+            function->lazy_bit_offset = 0;
 #if PN_CALCULATE_LIVENESS
             function->value_liveness_range = NULL;
 #endif /* PN_CALCULATE_LIVENESS */
+#if PN_JIT
+            function->jit_entries = NULL;
+#endif /* PN_JIT */
 
             /* Cache number of arguments to function */
             PNType* function_type = &module->types[function->type_id];
@@ -1620,6 +1657,123 @@ static void pn_header_read(PNBitStream* bs) {
   }
 }
 
+#if PN_LOAD_THREADS
+
+static void* pn_load_worker_main(void* arg) {
+  PNLoadWorker* worker = arg;
+  PNLoadThreads* load = worker->load;
+  PNModule* module = &worker->module;
+  /* No callbacks; they aren't thread-safe */
+  PNReadContext read_context = {};
+
+  while (PN_TRUE) {
+    uint32_t index = __sync_fetch_and_add(&load->next_index, 1);
+    if (index >= load->num_function_ids) {
+      break;
+    }
+
+    PNFunctionId function_id = load->function_ids[index];
+    PNFunction* function = &module->functions[function_id];
+    PNBitStream bs = load->bs;
+    pn_bitstream_seek_bit(&bs, function->lazy_bit_offset);
+    function->lazy_bit_offset = 0;
+
+    PNAllocatorMark mark = pn_allocator_mark(&module->temp_allocator);
+    pn_function_block_read(&read_context, module, load->context, &bs,
+                           function_id);
+    pn_allocator_reset_to_mark(&module->temp_allocator, mark);
+  }
+
+#if PN_TIMERS
+  memcpy(worker->timer_times, g_pn_timer_times, sizeof(g_pn_timer_times));
+#endif /* PN_TIMERS */
+  return NULL;
+}
+
+/* Reads the function blocks skipped because of PNModule.load_threads. Each
+ * worker reads into its own allocators; the allocators are merged into the
+ * module's when all are done. Worker timers are summed, so they measure
+ * thread time; PARALLEL_FUNCTION_BLOCK_READ measures the elapsed time. */
+static void pn_module_read_functions_parallel(PNModule* module,
+                                              PNBlockInfoContext* context,
+                                              PNBitStream* bs) {
+  PN_BEGIN_TIME(PARALLEL_FUNCTION_BLOCK_READ);
+#if PN_DIRECT_THREADED
+  /* Otherwise initialized lazily by the first function lowered */
+  if (!g_pn_opcode_handlers) {
+    pn_executor_init_opcode_handlers();
+  }
+#endif /* PN_DIRECT_THREADED */
+
+  PNAllocatorMark mark = pn_allocator_mark(&module->temp_allocator);
+  PNLoadThreads load = {};
+  load.context = context;
+  load.bs = *bs;
+  load.function_ids = pn_allocator_alloc(
+      &module->temp_allocator, sizeof(PNFunctionId) * module->num_functions,
+      sizeof(PNFunctionId));
+  uint32_t n;
+  for (n = 0; n < module->num_functions; ++n) {
+    if (module->functions[n].lazy_bit_offset != 0) {
+      load.function_ids[load.num_function_ids++] = n;
+    }
+  }
+
+  uint32_t num_workers = module->load_threads;
+  if (num_workers > load.num_function_ids) {
+    num_workers = load.num_function_ids;
+  }
+
+  PNLoadWorker* workers = pn_allocator_allocz(
+      &module->temp_allocator, sizeof(PNLoadWorker) * num_workers,
+      PN_DEFAULT_ALIGN);
+  for (n = 0; n < num_workers; ++n) {
+    PNLoadWorker* worker = &workers[n];
+    worker->load = &load;
+    worker->module = *module;
+    pn_allocator_init(&worker->module.allocator, PN_MIN_CHUNKSIZE, "module");
+    pn_allocator_init(&worker->module.value_allocator, PN_MIN_CHUNKSIZE,
+                      "value");
+    pn_allocator_init(&worker->module.instruction_allocator, PN_MIN_CHUNKSIZE,
+                      "instruction");
+    pn_allocator_init(&worker->module.temp_allocator, PN_MIN_CHUNKSIZE,
+                      "temp");
+    worker->module.module_value_slots = NULL;
+
+    int result =
+        pthread_create(&worker->thread, NULL, pn_load_worker_main, worker);
+    if (result != 0) {
+      PN_FATAL("Unable to create load thread: %s\n", strerror(result));
+    }
+  }
+
+  for (n = 0; n < num_workers; ++n) {
+    PNLoadWorker* worker = &workers[n];
+    pthread_join(worker->thread, NULL);
+
+    pn_allocator_merge(&module->allocator, &worker->module.allocator);
+    pn_allocator_merge(&module->value_allocator,
+                       &worker->module.value_allocator);
+    pn_allocator_merge(&module->instruction_allocator,
+                       &worker->module.instruction_allocator);
+    pn_allocator_reset(&worker->module.temp_allocator);
+
+#if PN_TIMERS
+    uint32_t i;
+    for (i = 0; i < PN_NUM_TIMERS; ++i) {
+      struct timespec sum;
+      pn_timespec_add(&sum, &g_pn_timer_times[i], &worker->timer_times[i]);
+      g_pn_timer_times[i] = sum;
+    }
+#endif /* PN_TIMERS */
+  }
+
+  pn_allocator_reset_to_mark(&module->temp_allocator, mark);
+  PN_END_TIME(PARALLEL_FUNCTION_BLOCK_READ);
+}
+
+#endif /* PN_LOAD_THREADS */
+
 void pn_module_read(PNReadContext* read_context,
                     PNModule* module,
                     PNBitStream* bs) {
@@ -1634,6 +1788,36 @@ void pn_module_read(PNReadContext* read_context,
 
   PNBlockInfoContext context = {};
   pn_module_block_read(read_context, module, &context, bs);
+
+  if (module->lazy_lowering) {
+    module->lazy_read_context = read_context;
+    module->lazy_bs = *bs;
+    module->lazy_block_info_context = context;
+  } else if (module->load_threads > 1) {
+#if PN_LOAD_THREADS
+    pn_module_read_functions_parallel(module, &context, bs);
+#else
+    PN_FATAL("Not built with PN_LOAD_THREADS.\n");
+#endif /* PN_LOAD_THREADS */
+  }
+}
+
+/* Reads and lowers a function block that was skipped because of
+ * PNModule.lazy_lowering. */
+static void pn_module_read_lazy_function(PNModule* module,
+                                         PNFunction* function) {
+  PN_BEGIN_TIME(LAZY_FUNCTION_BLOCK_READ);
+  PN_CHECK(function->lazy_bit_offset != 0);
+  PNBitStream bs = module->lazy_bs;
+  pn_bitstream_seek_bit(&bs, function->lazy_bit_offset);
+  function->lazy_bit_offset = 0;
+
+  PNAllocatorMark mark = pn_allocator_mark(&module->temp_allocator);
+  pn_function_block_read(module->lazy_read_context, module,
+                         &module->lazy_block_info_context, &bs,
+                         function - module->functions);
+  pn_allocator_reset_to_mark(&module->temp_allocator, mark);
+  PN_END_TIME(LAZY_FUNCTION_BLOCK_READ);
 }
 
 #endif /* PN_READ_H_ */
@@ -0,0 +1,502 @@
+/* Copyright 2015 The Native Client Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. */
+
+#ifndef PN_SNAPSHOT_H_
+#define PN_SNAPSHOT_H_
+
+#if PN_SNAPSHOT
+
+/* --snapshot-at writes the executor state to a file when a function is first
+ * entered: memory, mapped pages, open files, and every thread with its call
+ * frames and setjmp targets. --snapshot-in starts a later run of the same pexe
+ * and build from that state instead of from _start, skipping whatever startup
+ * came before. The program arguments are already in the snapshot's memory, so
+ * the later run must be given the same ones.
+ *
+ * Snapshots are checked for consistency with the module, but like cache files
+ * they are trusted not to be malicious. */
+
+/**** WRITING *****************************************************************/
+
+/* Returns the start of the lowest page that holds a live stack above the
+ * heap. Only the main thread's stack is there; other threads' stacks were
+ * allocated by the program, below heap_end. */
+static uint32_t pn_snapshot_get_stack_start(PNExecutor* executor,
+                                            PNThread* thread) {
+  uint32_t stack_start = executor->memory->size;
+  PNThread* t = thread;
+  do {
+    uint32_t top = t->current_frame->memory_stack_top;
+    if (top >= executor->heap_end && top < stack_start) {
+      stack_start = top;
+    }
+    t = t->next;
+  } while (t != thread);
+  return pn_align_down(stack_start, PN_PAGESIZE);
+}
+
+static uint32_t pn_snapshot_write_fds(PNCacheWriter* w, PNExecutor* executor) {
+  uint32_t num_fds = 0;
+  uint32_t fd;
+  for (fd = 0; fd < PN_MAX_FDS; ++fd) {
+    int host_fd = executor->fd_map[fd];
+    if (host_fd == -1) {
+      continue;
+    }
+
+    PNSnapshotFd s = {};
+    char path[PATH_MAX];
+    s.fd = fd;
+    s.host_fd = host_fd;
+    if (host_fd > 2) {
+      /* Other files are reopened by name when the snapshot is loaded */
+      char link[32];
+      snprintf(link, sizeof(link), "/proc/self/fd/%d", host_fd);
+      ssize_t size = readlink(link, path, sizeof(path) - 1);
+      s.flags = fcntl(host_fd, F_GETFL);
+      s.offset = lseek(host_fd, 0, SEEK_CUR);
+      if (size <= 0 || s.flags == -1) {
+        PN_ERROR("unable to find the file for fd %u, it won't be in the "
+                 "snapshot\n",
+                 fd);
+        continue;
+      }
+
+      path[size] = 0;
+      s.path_size = size + 1;
+      if (s.offset == -1) {
+        s.offset = 0;
+      }
+    }
+
+    pn_cache_write_data(w, &s, sizeof(s), PN_DEFAULT_ALIGN);
+    pn_cache_write_data(w, path, s.path_size, 1);
+    num_fds++;
+  }
+  return num_fds;
+}
+
+static void pn_snapshot_write_thread(PNCacheWriter* w,
+                                     PNExecutor* executor,
+                                     PNThread* thread) {
+  PNModule* module = executor->module;
+  uint32_t values_start = pn_align_up(sizeof(PNCallFrame), PN_DEFAULT_ALIGN);
+  uint32_t num_frames = 0;
+  PNCallFrame* frame;
+  for (frame = thread->current_frame; frame != &executor->sentinel_frame;
+       frame = frame->parent) {
+    num_frames++;
+  }
+
+  PN_CHECK(num_frames > 0);
+  PN_CHECK(thread->function ==
+           &module->functions[thread->current_frame->location.function_id]);
+
+  /* Oldest first, so they can be pushed in order when loading */
+  PNCallFrame** frames = pn_malloc(sizeof(PNCallFrame*) * num_frames);
+  uint32_t n = num_frames;
+  for (frame = thread->current_frame; frame != &executor->sentinel_frame;
+       frame = frame->parent) {
+    frames[--n] = frame;
+  }
+
+  PNSnapshotThread s = {};
+  s.id = thread->id;
+  s.is_main = thread == executor->main_thread;
+  s.state = thread->state;
+  s.futex_state = thread->futex_state;
+  s.tls = thread->tls;
+  s.wait_addr = thread->wait_addr;
+  s.has_timeout = thread->has_timeout;
+  s.timeout_sec = thread->timeout_sec;
+  s.timeout_usec = thread->timeout_usec;
+  s.num_frames = num_frames;
+  s.num_jmpbufs = thread->num_jmpbufs;
+  s.inst_offset = thread->inst - thread->function->instructions;
+  pn_cache_write_data(w, &s, sizeof(s), PN_DEFAULT_ALIGN);
+
+  for (n = 0; n < num_frames; ++n) {
+    PNFunction* function = &module->functions[frames[n]->location.function_id];
+    PNSnapshotFrame f = {};
+    f.function_id = frames[n]->location.function_id;
+    f.inst_offset = frames[n]->location.inst - function->instructions;
+    f.memory_stack_top = frames[n]->memory_stack_top;
+    f.jmpbuf_base = frames[n]->jmpbuf_base;
+    f.values_size = function->callee.frame_size - values_start;
+    pn_cache_write_data(w, &f, sizeof(f), PN_DEFAULT_ALIGN);
+    pn_cache_write_data(w, frames[n]->function_values, f.values_size,
+                        PN_DEFAULT_ALIGN);
+  }
+
+  for (n = 0; n < thread->num_jmpbufs; ++n) {
+    PNJmpBuf* buf = &thread->jmpbufs[n];
+    uint32_t index = 0;
+    while (index < num_frames && frames[index] != buf->frame) {
+      index++;
+    }
+    PN_CHECK(index < num_frames);
+
+    PNFunction* function = &module->functions[buf->frame->location.function_id];
+    PNSnapshotJmpBuf j = {};
+    j.id = buf->id;
+    j.memory_stack_top = buf->memory_stack_top;
+    j.frame_index = index;
+    j.inst_offset = buf->inst - function->instructions;
+    j.frame_stack_offset = buf->frame_stack_top - (void*)buf->frame;
+    pn_cache_write_data(w, &j, sizeof(j), PN_DEFAULT_ALIGN);
+  }
+
+  pn_free(frames);
+}
+
+/* Writes the state of |executor|, where |thread| is the next thread to run.
+ * It must be stopped at a safepoint; see pn_executor_run_until_entered.
+ * |argv| is the pexe filename followed by the program arguments. */
+static void pn_snapshot_write(PNExecutor* executor,
+                              PNThread* thread,
+                              const char* filename,
+                              uint64_t pexe_hash,
+                              uint64_t build_id,
+                              char** argv) {
+  PN_BEGIN_TIME(SNAPSHOT_WRITE);
+  PNMemory* memory = executor->memory;
+  PNCacheWriter w = {};
+  PNSnapshotHeader header = {};
+  pn_cache_write_data(&w, NULL, sizeof(header), PN_DEFAULT_ALIGN);
+
+  header.magic = PN_SNAPSHOT_MAGIC;
+  header.version = PN_SNAPSHOT_VERSION;
+  header.pexe_hash = pexe_hash;
+  header.build_id = build_id;
+  header.memory_size = memory->size;
+  header.heap_end = executor->heap_end;
+  header.stack_start = pn_snapshot_get_stack_start(executor, thread);
+  header.memory = *memory;
+  header.memory.data = NULL;
+  header.memory.size = 0;
+  header.next_thread_id = executor->next_thread_id;
+  header.next_jmpbuf_id = executor->next_jmpbuf_id;
+
+  /* The pexe may be loaded from another path, so its filename isn't kept */
+  char** arg;
+  for (arg = argv + 1; *arg; ++arg) {
+    uint32_t size = strlen(*arg) + 1;
+    pn_cache_write_data(&w, *arg, size, 1);
+    header.args_size += size;
+  }
+
+  pn_cache_write_data(&w, memory->data, header.heap_end, PN_DEFAULT_ALIGN);
+  pn_cache_write_data(&w, memory->data + header.stack_start,
+                      memory->size - header.stack_start, PN_DEFAULT_ALIGN);
+  pn_cache_write_data(&w, executor->mapped_pages.words,
+                      sizeof(uint32_t) * executor->mapped_pages.num_words,
+                      PN_DEFAULT_ALIGN);
+  header.num_fds = pn_snapshot_write_fds(&w, executor);
+
+  PNThread* t = thread;
+  do {
+    pn_snapshot_write_thread(&w, executor, t);
+    header.num_threads++;
+    t = t->next;
+  } while (t != thread);
+
+  header.file_size = w.size;
+  memcpy(w.data, &header, sizeof(header));
+
+  if (pn_cache_write_file(&w, filename)) {
+    if (g_pn_verbose) {
+      PN_PRINT("Wrote snapshot %s.\n", filename);
+    }
+  } else {
+    PN_ERROR("unable to write snapshot %s: %s\n", filename, strerror(errno));
+  }
+
+  pn_free(w.data);
+  PN_END_TIME(SNAPSHOT_WRITE);
+}
+
+/**** LOADING *****************************************************************/
+
+typedef struct PNSnapshotReader {
+  const char* filename;
+  void* data;
+  uint32_t size;
+  uint32_t offset;
+} PNSnapshotReader;
+
+#define PN_SNAPSHOT_CHECK(r, x)                                          \
+  do {                                                                   \
+    if (!(x)) {                                                          \
+      PN_FATAL("Invalid snapshot %s: %s\n", (r)->filename, #x);          \
+    }                                                                    \
+  } while (0) /* no semicolon */
+
+/* Returns the next |size| bytes of the file. Everything but the paths of open
+ * files was written with PN_DEFAULT_ALIGN. */
+static void* pn_snapshot_read(PNSnapshotReader* r, uint64_t size) {
+  uint64_t offset = pn_align_up(r->offset, PN_DEFAULT_ALIGN);
+  PN_SNAPSHOT_CHECK(r, offset + size <= r->size);
+  r->offset = offset + size;
+  return r->data + offset;
+}
+
+/* Fails unless |argv|, without the pexe filename, matches the program
+ * arguments the snapshot was written with. */
+static void pn_snapshot_check_args(PNSnapshotReader* r,
+                                   uint32_t args_size,
+                                   char** argv) {
+  const char* args = r->data + r->offset;
+  const char* end = args + args_size;
+  PN_SNAPSHOT_CHECK(r, args_size <= r->size - r->offset);
+  PN_SNAPSHOT_CHECK(r, args_size == 0 || end[-1] == 0);
+  r->offset += args_size;
+
+  const char* arg = args;
+  char** p;
+  for (p = argv + 1; *p && arg != end; ++p) {
+    if (strcmp(*p, arg) != 0) {
+      break;
+    }
+    arg += strlen(arg) + 1;
+  }
+
+  if (!*p && arg == end) {
+    return;
+  }
+
+  if (args_size == 0) {
+    PN_FATAL("Snapshot %s was written with no arguments.\n", r->filename);
+  }
+
+  PN_ERROR("Snapshot %s was written with the arguments:", r->filename);
+  for (arg = args; arg != end; arg += strlen(arg) + 1) {
+    PN_ERROR(" %s", arg);
+  }
+  PN_FATAL("\n");
+}
+
+static void pn_snapshot_load_fds(PNSnapshotReader* r,
+                                 PNExecutor* executor,
+                                 uint32_t num_fds) {
+  memset(executor->fd_map, 0xff, sizeof(executor->fd_map));
+  uint32_t n;
+  for (n = 0; n < num_fds; ++n) {
+    PNSnapshotFd* s = pn_snapshot_read(r, sizeof(PNSnapshotFd));
+    char* path = r->data + r->offset;
+    PN_SNAPSHOT_CHECK(r, s->fd < PN_MAX_FDS);
+    PN_SNAPSHOT_CHECK(r, s->path_size <= r->size - r->offset);
+    r->offset += s->path_size;
+
+    if (s->path_size == 0) {
+      PN_SNAPSHOT_CHECK(r, s->host_fd >= 0 && s->host_fd <= 2);
+      executor->fd_map[s->fd] = s->host_fd;
+      continue;
+    }
+
+    PN_SNAPSHOT_CHECK(r, path[s->path_size - 1] == 0);
+    int host_fd = open(path, s->flags);
+    if (host_fd == -1 || lseek(host_fd, s->offset, SEEK_SET) == -1) {
+      PN_ERROR("unable to reopen %s as fd %u: %s\n", path, s->fd,
+               strerror(errno));
+    }
+    executor->fd_map[s->fd] = host_fd;
+  }
+}
+
+static void pn_snapshot_load_thread(PNSnapshotReader* r,
+                                    PNThread* thread,
+                                    PNSnapshotThread* s) {
+  PNModule* module = thread->module;
+  uint32_t values_start = pn_align_up(sizeof(PNCallFrame), PN_DEFAULT_ALIGN);
+  PN_SNAPSHOT_CHECK(r, s->num_frames > 0 && s->num_frames <= r->size);
+  PN_SNAPSHOT_CHECK(r, s->num_jmpbufs <= r->size);
+  PN_SNAPSHOT_CHECK(
+      r, s->state == PN_THREAD_RUNNING || s->state == PN_THREAD_BLOCKED);
+  PN_SNAPSHOT_CHECK(r, s->futex_state <= PN_FUTEX_TIMEDOUT);
+  thread->id = s->id;
+  thread->state = s->state;
+  thread->futex_state = s->futex_state;
+  thread->tls = s->tls;
+  thread->wait_addr = s->wait_addr;
+  thread->has_timeout = s->has_timeout;
+  thread->timeout_sec = s->timeout_sec;
+  thread->timeout_usec = s->timeout_usec;
+
+  PNCallFrame** frames = pn_malloc(sizeof(PNCallFrame*) * s->num_frames);
+  uint32_t n;
+  for (n = 0; n < s->num_frames; ++n) {
+    PNSnapshotFrame* f = pn_snapshot_read(r, sizeof(PNSnapshotFrame));
+    PN_SNAPSHOT_CHECK(r, f->function_id < module->num_functions);
+    PNFunction* function = &module->functions[f->function_id];
+    PN_SNAPSHOT_CHECK(r, function->instructions || function->lazy_bit_offset);
+
+    /* Reads the function first if it was skipped by lazy lowering */
+    pn_thread_push_function(thread, function);
+    PNCallFrame* frame = thread->current_frame;
+    PN_SNAPSHOT_CHECK(r, f->values_size == function->callee.frame_size -
+                                               values_start);
+    PN_SNAPSHOT_CHECK(r, f->inst_offset < function->instructions_size);
+    PN_SNAPSHOT_CHECK(r, f->jmpbuf_base <= s->num_jmpbufs);
+    memcpy(frame->function_values, pn_snapshot_read(r, f->values_size),
+           f->values_size);
+    frame->location.inst = function->instructions + f->inst_offset;
+    frame->memory_stack_top = f->memory_stack_top;
+    frame->jmpbuf_base = f->jmpbuf_base;
+    frames[n] = frame;
+  }
+
+  PN_SNAPSHOT_CHECK(r, s->inst_offset < thread->function->instructions_size);
+  thread->inst = thread->function->instructions + s->inst_offset;
+
+  if (s->num_jmpbufs > thread->max_jmpbufs) {
+    thread->max_jmpbufs = s->num_jmpbufs;
+    thread->jmpbufs =
+        pn_realloc(thread->jmpbufs, thread->max_jmpbufs * sizeof(PNJmpBuf));
+  }
+
+  for (n = 0; n < s->num_jmpbufs; ++n) {
+    PNSnapshotJmpBuf* j = pn_snapshot_read(r, sizeof(PNSnapshotJmpBuf));
+    PN_SNAPSHOT_CHECK(r, j->frame_index < s->num_frames);
+    PNCallFrame* frame = frames[j->frame_index];
+    PNFunction* function = &module->functions[frame->location.function_id];
+    PN_SNAPSHOT_CHECK(r, j->inst_offset < function->instructions_size);
+    PN_SNAPSHOT_CHECK(r, j->frame_stack_offset <=
+                             pn_align_up(function->callee.frame_size,
+                                         PN_DEFAULT_ALIGN));
+    PNJmpBuf* buf = &thread->jmpbufs[n];
+    buf->id = j->id;
+    buf->memory_stack_top = j->memory_stack_top;
+    buf->frame = frame;
+    buf->inst = function->instructions + j->inst_offset;
+    buf->frame_stack_top = (void*)frame + j->frame_stack_offset;
+  }
+  thread->num_jmpbufs = s->num_jmpbufs;
+
+  pn_free(frames);
+}
+
+/* Replaces the state of |executor|, which was just initialized, with the
+ * snapshot in |filename|. The snapshot must have been written with the same
+ * pexe, build and program arguments; |argv| is as for pn_snapshot_write.
+ * Returns the thread to run first. */
+static PNThread* pn_snapshot_load(PNExecutor* executor,
+                                  const char* filename,
+                                  uint64_t pexe_hash,
+                                  uint64_t build_id,
+                                  char** argv) {
+  PN_BEGIN_TIME(SNAPSHOT_LOAD);
+  PNSnapshotReader r = {};
+  r.filename = filename;
+
+  int fd = open(filename, O_RDONLY);
+  struct stat st;
+  if (fd == -1 || fstat(fd, &st) != 0) {
+    PN_FATAL("unable to read %s\n", filename);
+  }
+  PN_SNAPSHOT_CHECK(&r, st.st_size >= (off_t)sizeof(PNSnapshotHeader) &&
+                            st.st_size < 0x80000000);
+  r.size = st.st_size;
+  r.data = mmap(NULL, r.size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (r.data == MAP_FAILED) {
+    PN_FATAL("unable to read %s\n", filename);
+  }
+  close(fd);
+
+  PNSnapshotHeader* header = pn_snapshot_read(&r, sizeof(PNSnapshotHeader));
+  PN_SNAPSHOT_CHECK(&r, header->magic == PN_SNAPSHOT_MAGIC &&
+                            header->version == PN_SNAPSHOT_VERSION);
+  if (header->pexe_hash != pexe_hash || header->build_id != build_id) {
+    PN_FATAL("Snapshot %s was written for a different pexe or build.\n",
+             filename);
+  }
+  PN_SNAPSHOT_CHECK(&r, header->file_size == r.size);
+  pn_snapshot_check_args(&r, header->args_size, argv);
+  PN_SNAPSHOT_CHECK(&r, pn_is_aligned(header->memory_size, PN_PAGESIZE));
+  PN_SNAPSHOT_CHECK(&r, header->memory.heap_start <= header->heap_end &&
+                            header->heap_end <= header->stack_start &&
+                            header->stack_start <= header->memory_size);
+  PN_SNAPSHOT_CHECK(&r, header->memory.stack_end <= header->memory_size);
+
+  /* The memory size is that of the run that wrote the snapshot */
+  PNMemory* memory = executor->memory;
+  if (memory->size != header->memory_size) {
+    memory->data = pn_realloc(memory->data, header->memory_size);
+    memory->size = header->memory_size;
+    pn_bitset_init(&executor->allocator, &executor->mapped_pages,
+                   memory->size >> PN_PAGESHIFT);
+  }
+
+  void* data = memory->data;
+  *memory = header->memory;
+  memory->data = data;
+  memory->size = header->memory_size;
+  memcpy(memory->data, pn_snapshot_read(&r, header->heap_end),
+         header->heap_end);
+  memcpy(memory->data + header->stack_start,
+         pn_snapshot_read(&r, memory->size - header->stack_start),
+         memory->size - header->stack_start);
+  memcpy(executor->mapped_pages.words,
+         pn_snapshot_read(&r, sizeof(uint32_t) *
+                                  executor->mapped_pages.num_words),
+         sizeof(uint32_t) * executor->mapped_pages.num_words);
+  executor->heap_end = header->heap_end;
+  executor->sentinel_frame.memory_stack_top = memory->stack_end;
+  executor->next_thread_id = header->next_thread_id;
+  executor->next_jmpbuf_id = header->next_jmpbuf_id;
+
+  pn_snapshot_load_fds(&r, executor, header->num_fds);
+
+  /* Drop the start thread's call to _start, pushed by pn_executor_init */
+  PNThread* start_thread = &executor->start_thread;
+  pn_frame_stack_reset(&start_thread->frame_stack);
+  start_thread->current_frame = &executor->sentinel_frame;
+  start_thread->num_jmpbufs = 0;
+
+  PNThread* first = NULL;
+  PNBool has_main = PN_FALSE;
+  uint32_t n;
+  PN_SNAPSHOT_CHECK(&r, header->num_threads > 0);
+  for (n = 0; n < header->num_threads; ++n) {
+    PNSnapshotThread* s = pn_snapshot_read(&r, sizeof(PNSnapshotThread));
+    PNThread* thread;
+    if (s->is_main) {
+      PN_SNAPSHOT_CHECK(&r, !has_main);
+      has_main = PN_TRUE;
+      thread = start_thread;
+    } else {
+      thread = pn_allocator_allocz(&executor->allocator, sizeof(PNThread),
+                                   PN_DEFAULT_ALIGN);
+      thread->executor = executor;
+      thread->current_frame = &executor->sentinel_frame;
+      thread->module = executor->module;
+    }
+    pn_snapshot_load_thread(&r, thread, s);
+
+    /* Link in the order the threads were written */
+    if (first) {
+      thread->next = first;
+      thread->prev = first->prev;
+      first->prev->next = thread;
+      first->prev = thread;
+    } else {
+      first = thread;
+      thread->next = thread;
+      thread->prev = thread;
+    }
+  }
+  PN_SNAPSHOT_CHECK(&r, has_main);
+
+  munmap(r.data, r.size);
+  if (g_pn_verbose) {
+    PN_PRINT("Loaded snapshot %s.\n", filename);
+  }
+  PN_END_TIME(SNAPSHOT_LOAD);
+  return first;
+}
+
+#undef PN_SNAPSHOT_CHECK
+
+#endif /* PN_SNAPSHOT */
+
+#endif /* PN_SNAPSHOT_H_ */
@@ -211,6 +211,26 @@ static const char* pn_value_describe_type(PNModule* module,
   return pn_type_describe(module, value->type_id);
 }
 
+static const char* pn_slot_describe(PNModule* module,
+                                    PNFunction* function,
+                                    PNWideSlotId slot) {
+  PNValueId value_id = pn_function_slot_to_value_id(module, function, slot);
+  if (value_id == PN_INVALID_VALUE_ID) {
+    return "%scratch";
+  }
+  return pn_value_describe(module, function, value_id);
+}
+
+static const char* pn_slot_describe_type(PNModule* module,
+                                         PNFunction* function,
+                                         PNWideSlotId slot) {
+  PNValueId value_id = pn_function_slot_to_value_id(module, function, slot);
+  if (value_id == PN_INVALID_VALUE_ID) {
+    return "?";
+  }
+  return pn_value_describe_type(module, function, value_id);
+}
+
 static const char* pn_binop_get_name(uint32_t op) {
   const char* names[] = {"add", "sub",  "mul",  "udiv", "sdiv", "urem", "srem",
                          "shl", "lshr", "ashr", "and",  "or",   "xor"};
@@ -273,21 +293,22 @@ static const char* pn_liveness_range_describe(PNModule* module,
                                               PNFunction* function,
                                               PNValueId value_id) {
   if (PN_IS_TRACE(BASIC_BLOCK_EXTRAS)) {
-    const uint32_t BUFFER_SIZE = 30;
-    static char buffer[BUFFER_SIZE];
+#define PN_BUFFER_SIZE 48
+    static char buffer[PN_BUFFER_SIZE];
     PNValueId rel_id = value_id - module->num_values;
     PNLivenessRange* range = &function->value_liveness_range[rel_id];
     if (range->first_bb_id != PN_INVALID_BB_ID &&
         range->last_bb_id != PN_INVALID_BB_ID) {
       if (range->first_bb_id == range->last_bb_id) {
-        snprintf(buffer, BUFFER_SIZE, "  live: [%%b%d], %%v%d",
+        snprintf(buffer, PN_BUFFER_SIZE, "  live: [%%b%d], %%v%d",
                  range->first_bb_id, range->slot_id);
       } else {
-        snprintf(buffer, BUFFER_SIZE, "  live: [%%b%d..%%b%d], %%v%d",
+        snprintf(buffer, PN_BUFFER_SIZE, "  live: [%%b%d..%%b%d], %%v%d",
                  range->first_bb_id, range->last_bb_id, range->slot_id);
       }
       return buffer;
     }
+#undef PN_BUFFER_SIZE
   }
   return "";
 }
@@ -299,6 +320,27 @@ static const char* pn_liveness_range_describe(PNModule* module,
 }
 #endif /* PN_CALCULATE_LIVENESS */
 
+/* Describes the address of a load or store; see PNInstructionLoad. */
+static const char* pn_address_describe(PNModule* module,
+                                       PNFunction* function,
+                                       PNValueId base_id,
+                                       PNValueId index_id,
+                                       uint32_t scale,
+                                       uint32_t offset) {
+  static char buffer[64];
+  if (index_id != PN_INVALID_VALUE_ID) {
+    snprintf(buffer, sizeof(buffer), "%s + %s * %u",
+             pn_value_describe(module, function, base_id),
+             pn_value_describe(module, function, index_id), scale);
+  } else if (offset != 0) {
+    snprintf(buffer, sizeof(buffer), "%s + %u",
+             pn_value_describe(module, function, base_id), offset);
+  } else {
+    return pn_value_describe(module, function, base_id);
+  }
+  return buffer;
+}
+
 static void pn_instruction_trace(PNModule* module,
                                  PNFunction* function,
                                  PNInstruction* inst,
@@ -437,7 +479,9 @@ static void pn_instruction_trace(PNModule* module,
           "%s = load %s* %s, align %d;%s\n",
           pn_value_describe(module, function, i->result_value_id),
           pn_value_describe_type(module, function, i->result_value_id),
-          pn_value_describe(module, function, i->src_id), i->alignment,
+          pn_address_describe(module, function, i->src_id, i->index_id,
+                              i->scale, i->offset),
+          i->alignment,
           pn_liveness_range_describe(module, function, i->result_value_id));
       break;
     }
@@ -448,7 +492,9 @@ static void pn_instruction_trace(PNModule* module,
                pn_value_describe_type(module, function, i->value_id),
                pn_value_describe(module, function, i->value_id),
                pn_value_describe_type(module, function, i->value_id),
-               pn_value_describe(module, function, i->dest_id), i->alignment);
+               pn_address_describe(module, function, i->dest_id, i->index_id,
+                                   i->scale, i->offset),
+               i->alignment);
       break;
     }
 
@@ -673,9 +719,9 @@ static void pn_runtime_instruction_trace(PNModule* module,
     case PN_OPCODE_ALLOCA_INT32: {
       PNRuntimeInstructionAlloca* i = (PNRuntimeInstructionAlloca*)inst;
       PN_PRINT("%s = alloca i8, %s %s, align %d;\n",
-               pn_value_describe(module, function, i->result_value_id),
-               pn_value_describe_type(module, function, i->size_id),
-               pn_value_describe(module, function, i->size_id), i->alignment);
+               pn_slot_describe(module, function, i->result_value_id),
+               pn_slot_describe_type(module, function, i->size_id),
+               pn_slot_describe(module, function, i->size_id), i->alignment);
       break;
     }
 
@@ -743,10 +789,33 @@ static void pn_runtime_instruction_trace(PNModule* module,
       // clang-format on
       PNRuntimeInstructionBinop* i = (PNRuntimeInstructionBinop*)inst;
       PN_PRINT("%s = %s %s %s, %s;\n",
-               pn_value_describe(module, function, i->result_value_id), opname,
-               pn_value_describe_type(module, function, i->result_value_id),
-               pn_value_describe(module, function, i->value0_id),
-               pn_value_describe(module, function, i->value1_id));
+               pn_slot_describe(module, function, i->result_value_id), opname,
+               pn_slot_describe_type(module, function, i->result_value_id),
+               pn_slot_describe(module, function, i->value0_id),
+               pn_slot_describe(module, function, i->value1_id));
+      break;
+    }
+
+    // clang-format off
+    case PN_OPCODE_BINOP_ADD_INT32_IMM:  opname = "add"; goto binop_imm;
+    case PN_OPCODE_BINOP_AND_INT32_IMM:  opname = "and"; goto binop_imm;
+    case PN_OPCODE_BINOP_ASHR_INT32_IMM: opname = "ashr"; goto binop_imm;
+    case PN_OPCODE_BINOP_LSHR_INT32_IMM: opname = "lshr"; goto binop_imm;
+    case PN_OPCODE_BINOP_MUL_INT32_IMM:  opname = "mul"; goto binop_imm;
+    case PN_OPCODE_BINOP_OR_INT32_IMM:   opname = "or"; goto binop_imm;
+    case PN_OPCODE_BINOP_SDIV_INT32_IMM: opname = "sdiv"; goto binop_imm;
+    case PN_OPCODE_BINOP_SHL_INT32_IMM:  opname = "shl"; goto binop_imm;
+    case PN_OPCODE_BINOP_SREM_INT32_IMM: opname = "srem"; goto binop_imm;
+    case PN_OPCODE_BINOP_SUB_INT32_IMM:  opname = "sub"; goto binop_imm;
+    case PN_OPCODE_BINOP_UDIV_INT32_IMM: opname = "udiv"; goto binop_imm;
+    case PN_OPCODE_BINOP_UREM_INT32_IMM: opname = "urem"; goto binop_imm;
+    case PN_OPCODE_BINOP_XOR_INT32_IMM:  opname = "xor"; goto binop_imm;
+    binop_imm: {
+      // clang-format on
+      PNRuntimeInstructionBinop* i = (PNRuntimeInstructionBinop*)inst;
+      PN_PRINT("%s = %s i32 %s, %u;\n",
+               pn_slot_describe(module, function, i->result_value_id), opname,
+               pn_slot_describe(module, function, i->value0_id), i->value1);
       break;
     }
 
@@ -759,15 +828,16 @@ static void pn_runtime_instruction_trace(PNModule* module,
     case PN_OPCODE_BR_INT1: {
       PNRuntimeInstructionBrInt1* i = (PNRuntimeInstructionBrInt1*)inst;
       PN_PRINT("br %s %s, label %%%zd, label %%%zd;\n",
-               pn_value_describe_type(module, function, i->value_id),
-               pn_value_describe(module, function, i->value_id),
+               pn_slot_describe_type(module, function, i->value_id),
+               pn_slot_describe(module, function, i->value_id),
                i->true_inst - function->instructions,
                i->false_inst - function->instructions);
       break;
     }
 
     // Display all intrinsics as function calls.
-#define PN_INTRINSIC_OPCODE(e, name) case PN_OPCODE_INTRINSIC_##e:
+#define PN_INTRINSIC_OPCODE(e, name, num_args, result) \
+  case PN_OPCODE_INTRINSIC_##e:
   PN_FOREACH_INTRINSIC(PN_INTRINSIC_OPCODE)
 #undef PN_INTRINSIC_OPCODE
 
@@ -777,26 +847,30 @@ static void pn_runtime_instruction_trace(PNModule* module,
 
     case PN_OPCODE_CALL: {
       PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
 
       if (i->flags & PN_CALL_FLAGS_RETURN_TYPE_VOID) {
         PN_PRINT("%scall void ",
                  (i->flags & PN_CALL_FLAGS_TAIL_CALL) ? "tail " : "");
       } else {
         PN_PRINT("%s = %scall %s ",
-                 pn_value_describe(module, function, i->result_value_id),
+                 pn_slot_describe(module, function, i->result_value_id),
                  (i->flags & PN_CALL_FLAGS_TAIL_CALL) ? "tail " : "",
-                 pn_value_describe_type(module, function, i->result_value_id));
+                 pn_slot_describe_type(module, function, i->result_value_id));
+      }
+      if (i->flags & PN_CALL_FLAGS_INDIRECT) {
+        PN_PRINT("%s(", pn_slot_describe(module, function, i->callee_id));
+      } else {
+        PN_PRINT("%s(", pn_value_describe(module, function, i->callee_id));
       }
-      PN_PRINT("%s(", pn_value_describe(module, function, i->callee_id));
 
       int32_t n;
       for (n = 0; n < i->num_args; ++n) {
         if (n != 0) {
           PN_PRINT(", ");
         }
-        PN_PRINT("%s %s", pn_value_describe_type(module, function, arg_ids[n]),
-                 pn_value_describe(module, function, arg_ids[n]));
+        PN_PRINT("%s %s", pn_slot_describe_type(module, function, arg_ids[n]),
+                 pn_slot_describe(module, function, arg_ids[n]));
       }
       PN_PRINT(");\n");
       break;
@@ -874,10 +948,10 @@ static void pn_runtime_instruction_trace(PNModule* module,
       // clang-format on
       PNRuntimeInstructionCast* i = (PNRuntimeInstructionCast*)inst;
       PN_PRINT("%s = %s %s %s to %s;\n",
-               pn_value_describe(module, function, i->result_value_id), opname,
-               pn_value_describe_type(module, function, i->value_id),
-               pn_value_describe(module, function, i->value_id),
-               pn_value_describe_type(module, function, i->result_value_id));
+               pn_slot_describe(module, function, i->result_value_id), opname,
+               pn_slot_describe_type(module, function, i->value_id),
+               pn_slot_describe(module, function, i->value_id),
+               pn_slot_describe_type(module, function, i->result_value_id));
       break;
     }
 
@@ -954,10 +1028,30 @@ static void pn_runtime_instruction_trace(PNModule* module,
       // clang-format on
       PNRuntimeInstructionCmp2* i = (PNRuntimeInstructionCmp2*)inst;
       PN_PRINT("%s = %s %s %s, %s;\n",
-               pn_value_describe(module, function, i->result_value_id), opname,
-               pn_value_describe_type(module, function, i->value0_id),
-               pn_value_describe(module, function, i->value0_id),
-               pn_value_describe(module, function, i->value1_id));
+               pn_slot_describe(module, function, i->result_value_id), opname,
+               pn_slot_describe_type(module, function, i->value0_id),
+               pn_slot_describe(module, function, i->value0_id),
+               pn_slot_describe(module, function, i->value1_id));
+      break;
+    }
+
+    // clang-format off
+    case PN_OPCODE_ICMP_EQ_INT32_IMM:  opname = "icmp eq"; goto cmp2_imm;
+    case PN_OPCODE_ICMP_NE_INT32_IMM:  opname = "icmp ne"; goto cmp2_imm;
+    case PN_OPCODE_ICMP_SGE_INT32_IMM: opname = "icmp sge"; goto cmp2_imm;
+    case PN_OPCODE_ICMP_SGT_INT32_IMM: opname = "icmp sgt"; goto cmp2_imm;
+    case PN_OPCODE_ICMP_SLE_INT32_IMM: opname = "icmp sle"; goto cmp2_imm;
+    case PN_OPCODE_ICMP_SLT_INT32_IMM: opname = "icmp slt"; goto cmp2_imm;
+    case PN_OPCODE_ICMP_UGE_INT32_IMM: opname = "icmp uge"; goto cmp2_imm;
+    case PN_OPCODE_ICMP_UGT_INT32_IMM: opname = "icmp ugt"; goto cmp2_imm;
+    case PN_OPCODE_ICMP_ULE_INT32_IMM: opname = "icmp ule"; goto cmp2_imm;
+    case PN_OPCODE_ICMP_ULT_INT32_IMM: opname = "icmp ult"; goto cmp2_imm;
+    cmp2_imm: {
+      // clang-format on
+      PNRuntimeInstructionCmp2* i = (PNRuntimeInstructionCmp2*)inst;
+      PN_PRINT("%s = %s i32 %s, %u;\n",
+               pn_slot_describe(module, function, i->result_value_id), opname,
+               pn_slot_describe(module, function, i->value0_id), i->value1);
       break;
     }
 
@@ -969,9 +1063,61 @@ static void pn_runtime_instruction_trace(PNModule* module,
     case PN_OPCODE_LOAD_INT64: {
       PNRuntimeInstructionLoad* i = (PNRuntimeInstructionLoad*)inst;
       PN_PRINT("%s = load %s* %s, align %d;\n",
-               pn_value_describe(module, function, i->result_value_id),
-               pn_value_describe_type(module, function, i->result_value_id),
-               pn_value_describe(module, function, i->src_id), i->alignment);
+               pn_slot_describe(module, function, i->result_value_id),
+               pn_slot_describe_type(module, function, i->result_value_id),
+               pn_slot_describe(module, function, i->src_id), i->alignment);
+      break;
+    }
+
+    case PN_OPCODE_LOAD_DOUBLE_OFFSET:
+    case PN_OPCODE_LOAD_FLOAT_OFFSET:
+    case PN_OPCODE_LOAD_INT8_OFFSET:
+    case PN_OPCODE_LOAD_INT16_OFFSET:
+    case PN_OPCODE_LOAD_INT32_OFFSET:
+    case PN_OPCODE_LOAD_INT64_OFFSET: {
+      PNRuntimeInstructionLoadOffset* i = (PNRuntimeInstructionLoadOffset*)inst;
+      PN_PRINT("%s = load %s* %s + %u;\n",
+               pn_slot_describe(module, function, i->result_value_id),
+               pn_slot_describe_type(module, function, i->result_value_id),
+               pn_slot_describe(module, function, i->src_id), i->offset);
+      break;
+    }
+
+    case PN_OPCODE_LOAD_DOUBLE_INDEXED:
+    case PN_OPCODE_LOAD_FLOAT_INDEXED:
+    case PN_OPCODE_LOAD_INT8_INDEXED:
+    case PN_OPCODE_LOAD_INT16_INDEXED:
+    case PN_OPCODE_LOAD_INT32_INDEXED:
+    case PN_OPCODE_LOAD_INT64_INDEXED: {
+      PNRuntimeInstructionLoadIndexed* i =
+          (PNRuntimeInstructionLoadIndexed*)inst;
+      PN_PRINT("%s = load %s* %s + %s * %u;\n",
+               pn_slot_describe(module, function, i->result_value_id),
+               pn_slot_describe_type(module, function, i->result_value_id),
+               pn_slot_describe(module, function, i->src_id),
+               pn_slot_describe(module, function, i->index_id), i->scale);
+      break;
+    }
+
+    case PN_OPCODE_MOVE_WIDE: {
+      PNRuntimeInstructionMoveWide* i = (PNRuntimeInstructionMoveWide*)inst;
+      PN_PRINT("move wide %s = %s;\n",
+               pn_slot_describe(module, function, i->result_value_id),
+               pn_slot_describe(module, function, i->value_id));
+      break;
+    }
+
+    case PN_OPCODE_PHI_MOVES: {
+      PNRuntimeInstructionPhiMoves* i = (PNRuntimeInstructionPhiMoves*)inst;
+      PNRuntimePhiMove* moves = (void*)inst + sizeof(*i);
+      PN_PRINT("phi moves");
+      uint32_t n;
+      for (n = 0; n < i->num_moves; ++n) {
+        PN_PRINT("%s%s = %s", n == 0 ? " " : ", ",
+                 pn_slot_describe(module, function, moves[n].dest_value_id),
+                 pn_slot_describe(module, function, moves[n].source_value_id));
+      }
+      PN_PRINT("; br label %%%zd;\n", i->inst - function->instructions);
       break;
     }
 
@@ -983,8 +1129,8 @@ static void pn_runtime_instruction_trace(PNModule* module,
     case PN_OPCODE_RET_VALUE: {
       PNRuntimeInstructionRetValue* i = (PNRuntimeInstructionRetValue*)inst;
       PN_PRINT("ret %s %s;\n",
-               pn_value_describe_type(module, function, i->value_id),
-               pn_value_describe(module, function, i->value_id));
+               pn_slot_describe_type(module, function, i->value_id),
+               pn_slot_describe(module, function, i->value_id));
       break;
     }
 
@@ -996,13 +1142,62 @@ static void pn_runtime_instruction_trace(PNModule* module,
     case PN_OPCODE_STORE_INT64: {
       PNRuntimeInstructionStore* i = (PNRuntimeInstructionStore*)inst;
       PN_PRINT("store %s %s, %s* %s, align %d;\n",
-               pn_value_describe_type(module, function, i->value_id),
-               pn_value_describe(module, function, i->value_id),
-               pn_value_describe_type(module, function, i->value_id),
-               pn_value_describe(module, function, i->dest_id), i->alignment);
+               pn_slot_describe_type(module, function, i->value_id),
+               pn_slot_describe(module, function, i->value_id),
+               pn_slot_describe_type(module, function, i->value_id),
+               pn_slot_describe(module, function, i->dest_id), i->alignment);
+      break;
+    }
+
+    case PN_OPCODE_STORE_DOUBLE_OFFSET:
+    case PN_OPCODE_STORE_FLOAT_OFFSET:
+    case PN_OPCODE_STORE_INT8_OFFSET:
+    case PN_OPCODE_STORE_INT16_OFFSET:
+    case PN_OPCODE_STORE_INT32_OFFSET:
+    case PN_OPCODE_STORE_INT64_OFFSET: {
+      PNRuntimeInstructionStoreOffset* i =
+          (PNRuntimeInstructionStoreOffset*)inst;
+      PN_PRINT("store %s %s, %s* %s + %u;\n",
+               pn_slot_describe_type(module, function, i->value_id),
+               pn_slot_describe(module, function, i->value_id),
+               pn_slot_describe_type(module, function, i->value_id),
+               pn_slot_describe(module, function, i->dest_id), i->offset);
+      break;
+    }
+
+    case PN_OPCODE_STORE_DOUBLE_INDEXED:
+    case PN_OPCODE_STORE_FLOAT_INDEXED:
+    case PN_OPCODE_STORE_INT8_INDEXED:
+    case PN_OPCODE_STORE_INT16_INDEXED:
+    case PN_OPCODE_STORE_INT32_INDEXED:
+    case PN_OPCODE_STORE_INT64_INDEXED: {
+      PNRuntimeInstructionStoreIndexed* i =
+          (PNRuntimeInstructionStoreIndexed*)inst;
+      PN_PRINT("store %s %s, %s* %s + %s * %u;\n",
+               pn_slot_describe_type(module, function, i->value_id),
+               pn_slot_describe(module, function, i->value_id),
+               pn_slot_describe_type(module, function, i->value_id),
+               pn_slot_describe(module, function, i->dest_id),
+               pn_slot_describe(module, function, i->index_id), i->scale);
+      break;
+    }
+
+    // clang-format off
+    case PN_OPCODE_STORE_INT8_IMM:  opname = "i8"; goto store_imm;
+    case PN_OPCODE_STORE_INT16_IMM: opname = "i16"; goto store_imm;
+    case PN_OPCODE_STORE_INT32_IMM: opname = "i32"; goto store_imm;
+    store_imm: {
+      // clang-format on
+      PNRuntimeInstructionStore* i = (PNRuntimeInstructionStore*)inst;
+      PN_PRINT("store %s %u, %s* %s, align %d;\n", opname, i->value, opname,
+               pn_slot_describe(module, function, i->dest_id), i->alignment);
       break;
     }
 
+    case PN_OPCODE_SWITCH_BSEARCH_INT8:
+    case PN_OPCODE_SWITCH_BSEARCH_INT16:
+    case PN_OPCODE_SWITCH_BSEARCH_INT32:
+    case PN_OPCODE_SWITCH_BSEARCH_INT64:
     case PN_OPCODE_SWITCH_INT1:
     case PN_OPCODE_SWITCH_INT8:
     case PN_OPCODE_SWITCH_INT16:
@@ -1012,9 +1207,9 @@ static void pn_runtime_instruction_trace(PNModule* module,
       PNRuntimeSwitchCase* cases =
           (void*)inst + sizeof(PNRuntimeInstructionSwitch);
       const char* type_str =
-          pn_value_describe_type(module, function, i->value_id);
+          pn_slot_describe_type(module, function, i->value_id);
       PN_PRINT("switch %s %s {\n", type_str,
-               pn_value_describe(module, function, i->value_id));
+               pn_slot_describe(module, function, i->value_id));
       PN_TRACE_PRINT_INDENTX(2);
       PN_PRINT("default: br label %%%zd;\n",
                i->default_inst - function->instructions);
@@ -1032,6 +1227,36 @@ static void pn_runtime_instruction_trace(PNModule* module,
       break;
     }
 
+    case PN_OPCODE_SWITCH_TABLE_INT8:
+    case PN_OPCODE_SWITCH_TABLE_INT16:
+    case PN_OPCODE_SWITCH_TABLE_INT32:
+    case PN_OPCODE_SWITCH_TABLE_INT64: {
+      PNRuntimeInstructionSwitchTable* i =
+          (PNRuntimeInstructionSwitchTable*)inst;
+      void** table = (void*)inst + sizeof(PNRuntimeInstructionSwitchTable);
+      const char* type_str =
+          pn_slot_describe_type(module, function, i->value_id);
+      PN_PRINT("switch %s %s {\n", type_str,
+               pn_slot_describe(module, function, i->value_id));
+      PN_TRACE_PRINT_INDENTX(2);
+      PN_PRINT("default: br label %%%zd;\n",
+               i->default_inst - function->instructions);
+
+      uint32_t n;
+      for (n = 0; n < i->num_entries; ++n) {
+        if (table[n] == i->default_inst) {
+          continue;
+        }
+        PN_TRACE_PRINT_INDENTX(2);
+        PN_PRINT("%s %" PRId64 ": br label %%%zd;\n", type_str,
+                 (int64_t)((uint64_t)i->min_value + n),
+                 table[n] - (void*)function->instructions);
+      }
+      PN_TRACE_PRINT_INDENT();
+      PN_PRINT("}\n");
+      break;
+    }
+
     case PN_OPCODE_UNREACHABLE:
       PN_PRINT("unreachable;\n");
       break;
@@ -1039,13 +1264,13 @@ static void pn_runtime_instruction_trace(PNModule* module,
     case PN_OPCODE_VSELECT: {
       PNRuntimeInstructionVselect* i = (PNRuntimeInstructionVselect*)inst;
       PN_PRINT("%s = select %s %s, %s %s, %s %s;\n",
-               pn_value_describe(module, function, i->result_value_id),
-               pn_value_describe_type(module, function, i->cond_id),
-               pn_value_describe(module, function, i->cond_id),
-               pn_value_describe_type(module, function, i->true_value_id),
-               pn_value_describe(module, function, i->true_value_id),
-               pn_value_describe_type(module, function, i->false_value_id),
-               pn_value_describe(module, function, i->false_value_id));
+               pn_slot_describe(module, function, i->result_value_id),
+               pn_slot_describe_type(module, function, i->cond_id),
+               pn_slot_describe(module, function, i->cond_id),
+               pn_slot_describe_type(module, function, i->true_value_id),
+               pn_slot_describe(module, function, i->true_value_id),
+               pn_slot_describe_type(module, function, i->false_value_id),
+               pn_slot_describe(module, function, i->false_value_id));
       break;
     }
 
@@ -1057,12 +1282,16 @@ static void pn_runtime_instruction_trace(PNModule* module,
 
 static void pn_executor_value_trace(PNExecutor* executor,
                                     PNFunction* function,
-                                    PNValueId value_id,
+                                    PNWideSlotId slot,
                                     PNRuntimeValue value,
                                     const char* prefix,
                                     const char* postfix) {
   if (PN_IS_TRACE(EXECUTE)) {
     PNModule* module = executor->module;
+    PNValueId value_id = pn_function_slot_to_value_id(module, function, slot);
+    if (value_id == PN_INVALID_VALUE_ID) {
+      return;
+    }
     PNValue* val = pn_function_get_value(module, function, value_id);
     PNTypeId type_id = val->type_id;
 
@@ -1110,43 +1339,18 @@ static void pn_executor_value_trace(PNExecutor* executor,
   }
 }
 
-static PNRuntimeValue pn_thread_get_value(PNThread* thread, PNValueId value_id);
-static PNRuntimeValue pn_executor_get_value_from_frame(PNExecutor* executor,
-                                                       PNCallFrame* frame,
-                                                       PNValueId value_id);
-
-static void pn_basic_block_trace_phi_assigns(PNThread* thread,
-                                             PNFunction* old_function,
-                                             PNRuntimeInstruction* inst) {
-  PNModule* module = thread->module;
-  PNRuntimeInstruction* dest_inst = thread->inst;
-  void* istream = inst;
-  uint16_t num_phi_assigns = *(uint16_t*)istream;
-  istream += sizeof(uint16_t) + sizeof(uint16_t);
-  PNRuntimePhiAssign* phi_assigns = (PNRuntimePhiAssign*)istream;
-  istream += num_phi_assigns * sizeof(PNRuntimePhiAssign);
-
-  uint32_t i;
-  for (i = 0; i < num_phi_assigns; ++i) {
-    PNRuntimePhiAssign* assign = &phi_assigns[i];
-    if (assign->inst == dest_inst) {
-      PN_TRACE(
-          EXECUTE, "    %s <= %s\n",
-          pn_value_describe(module, old_function, assign->dest_value_id),
-          pn_value_describe(module, old_function, assign->source_value_id));
-    }
-  }
-}
+static PNRuntimeValue pn_thread_get_value(PNThread* thread, PNSlotId slot);
+static PNRuntimeValue pn_frame_get_value(PNCallFrame* frame, PNSlotId slot);
 
 static void pn_runtime_instruction_trace_values(PNThread* thread,
                                                 PNFunction* old_function,
                                                 PNCallFrame* old_frame,
                                                 PNRuntimeInstruction* inst) {
 #define PN_VALUE(id, ty) \
-  pn_value_describe(module, function, id), pn_thread_get_value(thread, id).ty
+  pn_slot_describe(module, function, id), pn_thread_get_value(thread, id).ty
 #define PN_VALUE_OLD(id, ty)               \
-  pn_value_describe(module, old_function, id), \
-      pn_executor_get_value_from_frame(thread->executor, old_frame, id).ty
+  pn_slot_describe(module, old_function, id), \
+      pn_frame_get_value(old_frame, id).ty
 
   PNModule* module = thread->module;
   PNFunction* function = thread->function;
@@ -1247,17 +1451,31 @@ static void pn_runtime_instruction_trace_values(PNThread* thread,
 
 #undef PN_OPCODE_BINOP
 
+    case PN_OPCODE_BINOP_ADD_INT32_IMM:
+    case PN_OPCODE_BINOP_AND_INT32_IMM:
+    case PN_OPCODE_BINOP_ASHR_INT32_IMM:
+    case PN_OPCODE_BINOP_LSHR_INT32_IMM:
+    case PN_OPCODE_BINOP_MUL_INT32_IMM:
+    case PN_OPCODE_BINOP_OR_INT32_IMM:
+    case PN_OPCODE_BINOP_SDIV_INT32_IMM:
+    case PN_OPCODE_BINOP_SHL_INT32_IMM:
+    case PN_OPCODE_BINOP_SREM_INT32_IMM:
+    case PN_OPCODE_BINOP_SUB_INT32_IMM:
+    case PN_OPCODE_BINOP_UDIV_INT32_IMM:
+    case PN_OPCODE_BINOP_UREM_INT32_IMM:
+    case PN_OPCODE_BINOP_XOR_INT32_IMM: {
+      PNRuntimeInstructionBinop* i = (PNRuntimeInstructionBinop*)inst;
+      PN_TRACE(EXECUTE, "    %s = %u  %s = %u\n",
+               PN_VALUE(i->result_value_id, u32), PN_VALUE(i->value0_id, u32));
+      break;
+    }
+
     case PN_OPCODE_BR:
-      pn_basic_block_trace_phi_assigns(
-          thread, old_function, (void*)inst + sizeof(PNRuntimeInstructionBr));
       PN_TRACE(EXECUTE, "pc = %%%zd\n", thread->inst - function->instructions);
       break;
 
     case PN_OPCODE_BR_INT1: {
       PNRuntimeInstructionBrInt1* i = (PNRuntimeInstructionBrInt1*)inst;
-      pn_basic_block_trace_phi_assigns(
-          thread, old_function,
-          (void*)inst + sizeof(PNRuntimeInstructionBrInt1));
       PN_TRACE(EXECUTE, "    %s = %u\n", PN_VALUE(i->value_id, u8));
       PN_TRACE(EXECUTE, "pc = %%%zd\n", thread->inst - function->instructions);
       break;
@@ -1265,7 +1483,7 @@ static void pn_runtime_instruction_trace_values(PNThread* thread,
 
     case PN_OPCODE_CALL: {
       PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
 
       if (i->flags & PN_CALL_FLAGS_INDIRECT) {
         PN_TRACE(EXECUTE, "    %s = %u ", PN_VALUE_OLD(i->callee_id, u32));
@@ -1275,9 +1493,7 @@ static void pn_runtime_instruction_trace_values(PNThread* thread,
 
       uint32_t n;
       for (n = 0; n < i->num_args; ++n) {
-        PNRuntimeValue arg = pn_executor_get_value_from_frame(
-            thread->executor, old_frame, arg_ids[n]);
-
+        PNRuntimeValue arg = pn_frame_get_value(old_frame, arg_ids[n]);
         pn_executor_value_trace(thread->executor, old_function, arg_ids[n], arg,
                                 "", "  ");
       }
@@ -1468,9 +1684,25 @@ static void pn_runtime_instruction_trace_values(PNThread* thread,
 
 #undef PN_OPCODE_CMP2
 
+    case PN_OPCODE_ICMP_EQ_INT32_IMM:
+    case PN_OPCODE_ICMP_NE_INT32_IMM:
+    case PN_OPCODE_ICMP_SGE_INT32_IMM:
+    case PN_OPCODE_ICMP_SGT_INT32_IMM:
+    case PN_OPCODE_ICMP_SLE_INT32_IMM:
+    case PN_OPCODE_ICMP_SLT_INT32_IMM:
+    case PN_OPCODE_ICMP_UGE_INT32_IMM:
+    case PN_OPCODE_ICMP_UGT_INT32_IMM:
+    case PN_OPCODE_ICMP_ULE_INT32_IMM:
+    case PN_OPCODE_ICMP_ULT_INT32_IMM: {
+      PNRuntimeInstructionCmp2* i = (PNRuntimeInstructionCmp2*)inst;
+      PN_TRACE(EXECUTE, "    %s = %u  %s = %d\n",
+               PN_VALUE(i->result_value_id, u8), PN_VALUE(i->value0_id, i32));
+      break;
+    }
+
     case PN_OPCODE_INTRINSIC_LLVM_CTLZ_I32:
     case PN_OPCODE_INTRINSIC_LLVM_CTTZ_I32: {
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
       PN_TRACE(EXECUTE, "    %s = %u  %s = %u\n", PN_VALUE(arg_ids[0], u32),
                PN_VALUE(arg_ids[1], u8));
       break;
@@ -1478,7 +1710,7 @@ static void pn_runtime_instruction_trace_values(PNThread* thread,
 
     case PN_OPCODE_INTRINSIC_LLVM_CTLZ_I64:
     case PN_OPCODE_INTRINSIC_LLVM_CTTZ_I64: {
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
       PN_TRACE(EXECUTE, "    %s = " PN_FORMAT_u64 "  %s = %u\n",
                PN_VALUE(arg_ids[0], u64), PN_VALUE(arg_ids[1], u8));
       break;
@@ -1486,7 +1718,7 @@ static void pn_runtime_instruction_trace_values(PNThread* thread,
 
     case PN_OPCODE_INTRINSIC_LLVM_MEMCPY:
     case PN_OPCODE_INTRINSIC_LLVM_MEMMOVE: {
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
       PN_TRACE(EXECUTE, "    %s = %u  %s = %u  %s = %u  %s = %u  %s = %u\n",
                PN_VALUE(arg_ids[0], u32), PN_VALUE(arg_ids[1], u32),
                PN_VALUE(arg_ids[2], u32), PN_VALUE(arg_ids[3], u32),
@@ -1495,7 +1727,7 @@ static void pn_runtime_instruction_trace_values(PNThread* thread,
     }
 
     case PN_OPCODE_INTRINSIC_LLVM_MEMSET: {
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
       PN_TRACE(EXECUTE, "    %s = %u  %s = %u  %s = %u  %s = %u  %s = %u\n",
                PN_VALUE(arg_ids[0], u32), PN_VALUE(arg_ids[1], u8),
                PN_VALUE(arg_ids[2], u32), PN_VALUE(arg_ids[3], u32),
@@ -1506,7 +1738,7 @@ static void pn_runtime_instruction_trace_values(PNThread* thread,
 #define PN_OPCODE_INTRINSIC_CMPXCHG(ty)                                   \
   do {                                                                    \
     PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;        \
-    PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);  \
+    PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);  \
     PN_TRACE(EXECUTE,                                                     \
              "    %s = " PN_FORMAT_##ty "  %s = %u  %s = " PN_FORMAT_##ty \
              "  %s = " PN_FORMAT_##ty " %s = %u  %s = %u\n",              \
@@ -1536,7 +1768,7 @@ static void pn_runtime_instruction_trace_values(PNThread* thread,
 #define PN_OPCODE_INTRINSIC_LOAD(ty)                                        \
   do {                                                                      \
     PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;          \
-    PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);    \
+    PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);    \
     PN_TRACE(EXECUTE, "    %s = " PN_FORMAT_##ty "  %s = %u  %s = %u\n",    \
              PN_VALUE(i->result_value_id, ty), PN_VALUE(arg_ids[0], u32),   \
              PN_VALUE(arg_ids[1], u32));                                    \
@@ -1560,7 +1792,7 @@ static void pn_runtime_instruction_trace_values(PNThread* thread,
 #define PN_OPCODE_INTRINSIC_RMW(ty)                                       \
   do {                                                                    \
     PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;        \
-    PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);  \
+    PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);  \
     PN_TRACE(EXECUTE, "    %s = " PN_FORMAT_##ty                          \
              "  %s = %u  %s = %u  %s = " PN_FORMAT_##ty "  %s = %u\n",    \
              PN_VALUE(i->result_value_id, ty), PN_VALUE(arg_ids[0], u32), \
@@ -1607,7 +1839,7 @@ static void pn_runtime_instruction_trace_values(PNThread* thread,
 #undef PN_OPCODE_INTRINSIC_RMW
 
     case PN_OPCODE_INTRINSIC_LLVM_NACL_LONGJMP: {
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
       PN_TRACE(EXECUTE, "    %s = %u  %s = %u\n", PN_VALUE(arg_ids[0], u32),
                PN_VALUE(arg_ids[1], u32));
       PN_TRACE(EXECUTE, "function = %%f%d  pc = %%%zd\n",
@@ -1618,7 +1850,7 @@ static void pn_runtime_instruction_trace_values(PNThread* thread,
 
     case PN_OPCODE_INTRINSIC_LLVM_NACL_SETJMP: {
       PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
       PN_TRACE(EXECUTE, "    %s = %u  %s = %u\n",
                PN_VALUE(i->result_value_id, u32), PN_VALUE(arg_ids[0], u32));
       break;
@@ -1626,7 +1858,7 @@ static void pn_runtime_instruction_trace_values(PNThread* thread,
 
 #define PN_OPCODE_INTRINSIC_STORE(ty)                                    \
   do {                                                                   \
-    PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall); \
+    PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall); \
     PN_TRACE(EXECUTE, "    %s = " PN_FORMAT_##ty "  %s = %u  %s = %u\n", \
              PN_VALUE(arg_ids[0], ty), PN_VALUE(arg_ids[1], u32),        \
              PN_VALUE(arg_ids[2], u32));                                 \
@@ -1655,7 +1887,7 @@ static void pn_runtime_instruction_trace_values(PNThread* thread,
 
     case PN_OPCODE_INTRINSIC_LLVM_SQRT_F32: {
       PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
       PN_TRACE(EXECUTE, "    %s = %f  %s = %f\n",
                PN_VALUE(i->result_value_id, f32), PN_VALUE(arg_ids[0], f32));
       break;
@@ -1663,14 +1895,14 @@ static void pn_runtime_instruction_trace_values(PNThread* thread,
 
     case PN_OPCODE_INTRINSIC_LLVM_SQRT_F64: {
       PNRuntimeInstructionCall* i = (PNRuntimeInstructionCall*)inst;
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
       PN_TRACE(EXECUTE, "    %s = %f  %s = %f\n",
                PN_VALUE(i->result_value_id, f64), PN_VALUE(arg_ids[0], f64));
       break;
     }
 
     case PN_OPCODE_INTRINSIC_LLVM_STACKRESTORE: {
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
       PN_TRACE(EXECUTE, "    %s = %u\n", PN_VALUE(arg_ids[0], u32));
       break;
     }
@@ -1714,6 +1946,27 @@ static void pn_runtime_instruction_trace_values(PNThread* thread,
 
 #undef PN_OPCODE_LOAD
 
+    case PN_OPCODE_MOVE_WIDE: {
+      PNRuntimeInstructionMoveWide* i = (PNRuntimeInstructionMoveWide*)inst;
+      PN_TRACE(EXECUTE, "    %s <= %s\n",
+               pn_slot_describe(module, function, i->result_value_id),
+               pn_slot_describe(module, function, i->value_id));
+      break;
+    }
+
+    case PN_OPCODE_PHI_MOVES: {
+      PNRuntimeInstructionPhiMoves* i = (PNRuntimeInstructionPhiMoves*)inst;
+      PNRuntimePhiMove* moves = (void*)inst + sizeof(*i);
+      uint32_t n;
+      for (n = 0; n < i->num_moves; ++n) {
+        PN_TRACE(EXECUTE, "    %s <= %s\n",
+                 pn_slot_describe(module, function, moves[n].dest_value_id),
+                 pn_slot_describe(module, function, moves[n].source_value_id));
+      }
+      PN_TRACE(EXECUTE, "pc = %%%zd\n", thread->inst - function->instructions);
+      break;
+    }
+
     case PN_OPCODE_RET: {
       if (thread->executor->exiting) {
         PN_TRACE(EXECUTE, "exiting\n");
@@ -1729,7 +1982,7 @@ static void pn_runtime_instruction_trace_values(PNThread* thread,
       if (thread->executor->exiting) {
         PN_TRACE(EXECUTE, "exiting\n");
       } else {
-        PNRuntimeInstructionCall* c = (PNRuntimeInstructionCall*)thread->inst;
+        PNRuntimeInstructionCall* c = thread->current_frame->location.inst;
         PNRuntimeValue value = pn_thread_get_value(thread, c->result_value_id);
         pn_executor_value_trace(thread->executor, function, c->result_value_id,
                                 value, "    ", "\n");
@@ -1758,12 +2011,17 @@ static void pn_runtime_instruction_trace_values(PNThread* thread,
 
 #undef PN_OPCODE_STORE
 
+    case PN_OPCODE_STORE_INT8_IMM:
+    case PN_OPCODE_STORE_INT16_IMM:
+    case PN_OPCODE_STORE_INT32_IMM: {
+      PNRuntimeInstructionStore* i = (PNRuntimeInstructionStore*)inst;
+      PN_TRACE(EXECUTE, "    %s = %u\n", PN_VALUE(i->dest_id, u32));
+      break;
+    }
+
 #define PN_OPCODE_SWITCH(ty)                                                  \
   do {                                                                        \
     PNRuntimeInstructionSwitch* i = (PNRuntimeInstructionSwitch*)inst;        \
-    pn_basic_block_trace_phi_assigns(                                         \
-        thread, old_function,                                                 \
-        (void*)inst + sizeof(PNRuntimeInstructionSwitch));                    \
     PN_TRACE(EXECUTE, "    %s = " PN_FORMAT_##ty "\n",                        \
              PN_VALUE(i->value_id, ty));                                      \
     PN_TRACE(EXECUTE, "pc = %%%zd\n", thread->inst - function->instructions); \
@@ -1771,12 +2029,34 @@ static void pn_runtime_instruction_trace_values(PNThread* thread,
 
     // clang-format off
     case PN_OPCODE_SWITCH_INT1:
-    case PN_OPCODE_SWITCH_INT8:  PN_OPCODE_SWITCH(i8); break;
-    case PN_OPCODE_SWITCH_INT16: PN_OPCODE_SWITCH(i16); break;
-    case PN_OPCODE_SWITCH_INT32: PN_OPCODE_SWITCH(i32); break;
-    case PN_OPCODE_SWITCH_INT64: PN_OPCODE_SWITCH(i64); break;
+    case PN_OPCODE_SWITCH_INT8:
+    case PN_OPCODE_SWITCH_BSEARCH_INT8:  PN_OPCODE_SWITCH(i8); break;
+    case PN_OPCODE_SWITCH_INT16:
+    case PN_OPCODE_SWITCH_BSEARCH_INT16: PN_OPCODE_SWITCH(i16); break;
+    case PN_OPCODE_SWITCH_INT32:
+    case PN_OPCODE_SWITCH_BSEARCH_INT32: PN_OPCODE_SWITCH(i32); break;
+    case PN_OPCODE_SWITCH_INT64:
+    case PN_OPCODE_SWITCH_BSEARCH_INT64: PN_OPCODE_SWITCH(i64); break;
+// clang-format on
+
+#define PN_OPCODE_SWITCH_TABLE(ty)                                            \
+  do {                                                                        \
+    PNRuntimeInstructionSwitchTable* i =                                      \
+        (PNRuntimeInstructionSwitchTable*)inst;                               \
+    PN_TRACE(EXECUTE, "    %s = " PN_FORMAT_##ty "\n",                        \
+             PN_VALUE(i->value_id, ty));                                      \
+    PN_TRACE(EXECUTE, "pc = %%%zd\n", thread->inst - function->instructions); \
+  } while (0) /* no semicolon */
+
+    // clang-format off
+    case PN_OPCODE_SWITCH_TABLE_INT8:  PN_OPCODE_SWITCH_TABLE(i8); break;
+    case PN_OPCODE_SWITCH_TABLE_INT16: PN_OPCODE_SWITCH_TABLE(i16); break;
+    case PN_OPCODE_SWITCH_TABLE_INT32: PN_OPCODE_SWITCH_TABLE(i32); break;
+    case PN_OPCODE_SWITCH_TABLE_INT64: PN_OPCODE_SWITCH_TABLE(i64); break;
 // clang-format on
 
+#undef PN_OPCODE_SWITCH_TABLE
+
     case PN_OPCODE_UNREACHABLE:
       break;
 
@@ -1786,12 +2066,12 @@ static void pn_runtime_instruction_trace_values(PNThread* thread,
       PNRuntimeInstructionVselect* i = (PNRuntimeInstructionVselect*)inst;
       PNRuntimeValue result = pn_thread_get_value(thread, i->result_value_id);
       PNRuntimeValue cond = pn_thread_get_value(thread, i->cond_id);
-      PNValueId value_id = (cond.u8 & 1) ? i->true_value_id : i->false_value_id;
+      PNSlotId slot = (cond.u8 & 1) ? i->true_value_id : i->false_value_id;
       pn_executor_value_trace(thread->executor, function, i->result_value_id,
                               result, "    ", "  ");
       pn_executor_value_trace(thread->executor, function, i->cond_id, cond, "",
                               "  ");
-      pn_executor_value_trace(thread->executor, function, value_id, result, "",
+      pn_executor_value_trace(thread->executor, function, slot, result, "",
                               "\n");
       break;
     }
@@ -1815,7 +2095,7 @@ static void pn_runtime_instruction_trace_intrinsics(
 
   switch (inst->opcode) {
     case PN_OPCODE_INTRINSIC_LLVM_MEMCPY: {
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
       PN_TRACE(INTRINSICS,
                "    llvm.memcpy(dst_p:%u, src_p:%u, len:%u, align:%u, "
                "is_volatile:%u)\n",
@@ -1825,7 +2105,7 @@ static void pn_runtime_instruction_trace_intrinsics(
     }
 
     case PN_OPCODE_INTRINSIC_LLVM_MEMSET: {
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
       PN_TRACE(INTRINSICS,
                "    llvm.memset(dst_p:%u, value:%u, len:%u, align:%u, "
                "is_volatile:%u)\n",
@@ -1835,7 +2115,7 @@ static void pn_runtime_instruction_trace_intrinsics(
     }
 
     case PN_OPCODE_INTRINSIC_LLVM_MEMMOVE: {
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
       PN_TRACE(INTRINSICS,
                "    llvm.memmove(dst_p:%u, src_p:%u, len:%u, align:%u, "
                "is_volatile:%u)\n",
@@ -1846,7 +2126,7 @@ static void pn_runtime_instruction_trace_intrinsics(
 
 #define PN_OPCODE_INTRINSIC_CMPXCHG(ty)                                  \
   do {                                                                   \
-    PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall); \
+    PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall); \
     PN_TRACE(INTRINSICS, "    llvm.nacl.atomic.cmpxchg." #ty             \
                          "(addr_p:%u, expected:" PN_FORMAT_##ty          \
              ", desired:" PN_FORMAT_##ty ", ...)\n",                     \
@@ -1870,7 +2150,7 @@ static void pn_runtime_instruction_trace_intrinsics(
 
 #define PN_OPCODE_INTRINSIC_LOAD(ty)                                     \
   do {                                                                   \
-    PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall); \
+    PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall); \
     PN_TRACE(INTRINSICS,                                                 \
              "    llvm.nacl.atomic.load." #ty "(addr_p:%u, flags:%u)\n", \
              PN_ARG(0, u32), PN_ARG(1, u32));                            \
@@ -1893,7 +2173,7 @@ static void pn_runtime_instruction_trace_intrinsics(
 
 #define PN_OPCODE_INTRINSIC_RMW(op, ty)                                      \
   do {                                                                       \
-    PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);     \
+    PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);     \
     PN_TRACE(INTRINSICS, "    llvm.nacl.atomic.rmw." #ty                     \
                          "(op: %s, addr_p:%u, value: " PN_FORMAT_##ty ")\n", \
              #op, PN_ARG(0, u32), PN_ARG(1, ty));                            \
@@ -1967,7 +2247,7 @@ static void pn_runtime_instruction_trace_intrinsics(
 
 #define PN_OPCODE_INTRINSIC_EXCHANGE(ty)                                 \
   do {                                                                   \
-    PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall); \
+    PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall); \
     PN_TRACE(INTRINSICS, "    llvm.nacl.atomic.exchange." #ty            \
                          "(addr_p:%u, value: " PN_FORMAT_##ty ")\n",     \
              PN_ARG(1, u32), PN_ARG(2, ty));                             \
@@ -1989,14 +2269,14 @@ static void pn_runtime_instruction_trace_intrinsics(
 #undef PN_OPCODE_INTRINSIC_EXCHANGE
 
     case PN_OPCODE_INTRINSIC_LLVM_NACL_LONGJMP: {
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
       PN_TRACE(INTRINSICS, "    llvm.nacl.longjmp(jmpbuf: %u, value: %u)\n",
                PN_ARG(0, u32), PN_ARG(1, u32));
       break;
     }
 
     case PN_OPCODE_INTRINSIC_LLVM_NACL_SETJMP: {
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
       PN_TRACE(INTRINSICS, "    llvm.nacl.setjmp(jmpbuf: %u)\n",
                PN_ARG(0, u32));
       break;
@@ -2004,7 +2284,7 @@ static void pn_runtime_instruction_trace_intrinsics(
 
 #define PN_OPCODE_INTRINSIC_STORE(ty)                                    \
   do {                                                                   \
-    PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall); \
+    PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall); \
     PN_TRACE(INTRINSICS,                                                 \
              "    llvm.nacl.atomic.store.u32(value: " PN_FORMAT_##ty     \
              " addr_p:%u, flags: %u)\n",                                 \
@@ -2031,19 +2311,19 @@ static void pn_runtime_instruction_trace_intrinsics(
       break;
 
     case PN_OPCODE_INTRINSIC_LLVM_SQRT_F32: {
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
       PN_TRACE(INTRINSICS, "    llvm.sqrt.f32(%f)\n", PN_ARG(0, f32));
       break;
     }
 
     case PN_OPCODE_INTRINSIC_LLVM_SQRT_F64: {
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
       PN_TRACE(INTRINSICS, "    llvm.sqrt.f64(%f)\n", PN_ARG(0, f64));
       break;
     }
 
     case PN_OPCODE_INTRINSIC_LLVM_STACKRESTORE: {
-      PNValueId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
+      PNSlotId* arg_ids = (void*)inst + sizeof(PNRuntimeInstructionCall);
       PN_TRACE(INTRINSICS, "    llvm.stackrestore(%u)\n", PN_ARG(0, u32));
       break;
     }
@@ -0,0 +1,69 @@
+/* Copyright 2015 The Native Client Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. */
+
+#ifndef PN_VERIFY_H_
+#define PN_VERIFY_H_
+
+#define PN_INTRINSIC_RESULT_VALUE PN_TRUE
+#define PN_INTRINSIC_RESULT_VOID PN_FALSE
+
+/* Indexed by PNIntrinsicId. PN_INTRINSIC_NULL has no signature. */
+static const PNIntrinsicSignature
+    g_pn_intrinsic_signatures[PN_MAX_INTRINSICS] = {
+#define PN_INTRINSIC(e, name, num_args, result) \
+  [PN_INTRINSIC_##e] = {name, num_args, PN_INTRINSIC_RESULT_##result},
+        PN_FOREACH_INTRINSIC(PN_INTRINSIC)
+#undef PN_INTRINSIC
+};
+
+/* Checks the facts about |function|'s instructions that the executor relies on
+ * without checking them itself. This is run once per function after it is
+ * lowered, so a malformed module fails at load time instead of when the bad
+ * instruction is reached.
+ *
+ * Currently this checks that every call to an intrinsic passes the number of
+ * arguments the intrinsic's handler reads, and has a result value exactly
+ * when the handler writes one. */
+static void pn_function_verify(PNModule* module, PNFunction* function) {
+  PN_BEGIN_TIME(VERIFY);
+  PNFunctionId function_id = function - module->functions;
+  uint32_t n;
+  for (n = 0; n < function->num_bbs; ++n) {
+    PNBasicBlock* bb = &function->bbs[n];
+    PNInstruction* inst;
+    for (inst = bb->instructions; inst; inst = inst->next) {
+      if (inst->code != PN_FUNCTION_CODE_INST_CALL) {
+        continue;
+      }
+
+      PNInstructionCall* i = (PNInstructionCall*)inst;
+      if (i->is_indirect) {
+        continue;
+      }
+
+      PNValue* callee = pn_function_get_value(module, function, i->callee_id);
+      PNFunction* callee_function = &module->functions[callee->index];
+      if (callee_function->intrinsic_id == PN_INTRINSIC_NULL) {
+        continue;
+      }
+
+      const PNIntrinsicSignature* signature =
+          &g_pn_intrinsic_signatures[callee_function->intrinsic_id];
+      PNBool has_result = i->result_value_id != PN_INVALID_VALUE_ID;
+      if (i->num_args != signature->num_args ||
+          has_result != signature->has_result) {
+        PN_FATAL(
+            "Invalid call to %s in function %s (f%d): expected %u args %s a "
+            "result, got %u args %s a result\n",
+            signature->name, function->name ? function->name : "<unnamed>",
+            function_id, signature->num_args,
+            signature->has_result ? "with" : "without", i->num_args,
+            has_result ? "with" : "without");
+      }
+    }
+  }
+  PN_END_TIME(VERIFY);
+}
+
+#endif /* PN_VERIFY_H_ */
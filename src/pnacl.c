@@ -19,6 +19,14 @@
 #include <time.h>
 #include <unistd.h>
 
+#if PN_JIT || PN_CACHE
+#include <sys/mman.h>
+#endif /* PN_JIT || PN_CACHE */
+
+#if PN_NATIVE
+#include <dlfcn.h>
+#endif /* PN_NATIVE */
+
 /* Some crazy system where this isn't true? */
 PN_STATIC_ASSERT(sizeof(float) == sizeof(uint32_t));
 PN_STATIC_ASSERT(sizeof(double) == sizeof(uint64_t));
@@ -61,23 +69,52 @@ static char* g_pn_print_block_graph_function;
 static PNBool g_pn_print_stats;
 static PNBool g_pn_print_opcode_counts;
 static PNBool g_pn_run = PN_TRUE;
+static PNBool g_pn_lazy_lowering;
+#if PN_LOAD_THREADS
+static uint32_t g_pn_load_threads = 1;
+#endif /* PN_LOAD_THREADS */
+#if PN_CACHE
+static const char* g_pn_cache_dirname;
+#endif /* PN_CACHE */
+#if PN_SNAPSHOT
+static const char* g_pn_snapshot_at_function;
+static const char* g_pn_snapshot_out_filename;
+static const char* g_pn_snapshot_in_filename;
+#endif /* PN_SNAPSHOT */
+#if PN_JIT
+/* 0 with --no-jit */
+static uint32_t g_pn_jit_threshold = PN_JIT_THRESHOLD;
+#endif /* PN_JIT */
 static uint32_t g_pn_opcode_count[PN_MAX_OPCODE];
+static uint64_t g_pn_call_cache_hits;
+static uint64_t g_pn_call_cache_misses;
+#if PN_DIRECT_THREADED
+static const int32_t* g_pn_opcode_handlers;
+#endif /* PN_DIRECT_THREADED */
 static PNBool g_pn_repeat_load_times = 1;
 #if PN_PPAPI
 static PNBool g_pn_ppapi = PN_FALSE;
 #endif /* PN_PPAPI */
 static PNBool g_pn_filesystem_access = PN_FALSE;
+#if PN_NATIVE
+static const char* g_pn_emit_c_filename;
+static const char* g_pn_load_native_filename;
+#endif /* PN_NATIVE */
 
 #if PN_TRACING
 static const char* g_pn_trace_function_filter;
 static int g_pn_trace_indent;
+/* Indexed by [first * PN_MAX_OPCODE + second]. Only allocated when
+ * --print-opcode-pairs is set. */
+static uint32_t* g_pn_opcode_pair_count;
 #define PN_TRACE_DEFINE(name, flag) static PNBool g_pn_trace_##name;
 PN_FOREACH_TRACE(PN_TRACE_DEFINE)
 #undef PN_TRACE_DEFINE
 #endif /* PN_TRACING */
 
 #if PN_TIMERS
-static struct timespec g_pn_timer_times[PN_NUM_TIMERS];
+/* Per thread, so the --load-threads workers can be timed too */
+static __thread struct timespec g_pn_timer_times[PN_NUM_TIMERS];
 static PNBool g_pn_print_time;
 static PNBool g_pn_print_time_as_zero;
 #endif /* PN_TIMERS */
@@ -87,13 +124,18 @@ static const char* g_pn_opcode_names[] = {
   PN_FOREACH_OPCODE(PN_OPCODE)
 #undef PN_OPCODE
 
-#define PN_INTRINSIC_OPCODE(e, name) "INTRINSIC_" #e,
+#define PN_INTRINSIC_OPCODE(e, name, num_args, result) "INTRINSIC_" #e,
   PN_FOREACH_INTRINSIC(PN_INTRINSIC_OPCODE)
 #undef PN_INTRINSIC_OPCODE
 
 #define PN_ATOMIC_RMW_INTRINSIC_OPCODE(e) "INTRINSIC_" #e,
   PN_FOREACH_ATOMIC_RMW_INTRINSIC_OPCODE(PN_ATOMIC_RMW_INTRINSIC_OPCODE)
 #undef PN_ATOMIC_RMW_INTRINSIC_OPCODE
+
+#define PN_SUPERINSTRUCTION_OPCODE(first, second, family, ...) \
+  #first "_THEN_" #second,
+  PN_FOREACH_SUPERINSTRUCTION(PN_SUPERINSTRUCTION_OPCODE)
+#undef PN_SUPERINSTRUCTION_OPCODE
 };
 
 /**** SOURCES *****************************************************************/
@@ -102,6 +144,7 @@ static const char* g_pn_opcode_names[] = {
 #include "pn_malloc.h"
 #include "pn_timespec.h"
 #include "pn_allocator.h"
+#include "pn_frame_stack.h"
 #include "pn_bitset.h"
 #include "pn_bitstream.h"
 #include "pn_record.h"
@@ -112,16 +155,22 @@ static const char* g_pn_opcode_names[] = {
 #include "pn_trace.h"
 #include "pn_calculate_result_value_types.h"
 #include "pn_calculate_opcodes.h"
+#include "pn_calculate_address_modes.h"
 #include "pn_calculate_uses.h"
 #include "pn_calculate_pred_bbs.h"
 #include "pn_calculate_phi_assigns.h"
 #include "pn_calculate_loops.h"
 #include "pn_calculate_liveness.h"
+#include "pn_verify.h"
 #include "pn_read.h"
+#include "pn_jit.h"
+#include "pn_native.h"
+#include "pn_cache.h"
 #include "pn_executor.h"
 #include "pn_filesystem.h"
 #include "pn_builtins.h"
 #include "pn_ppapi.h"
+#include "pn_snapshot.h"
 
 /* Option parsing, environment variables */
 
@@ -137,6 +186,22 @@ enum {
   PN_FLAG_ENV,
   PN_FLAG_USE_HOST_ENV,
   PN_FLAG_NO_DEDUPE_PHI_NODES,
+  PN_FLAG_LAZY_LOWERING,
+#if PN_LOAD_THREADS
+  PN_FLAG_LOAD_THREADS,
+#endif /* PN_LOAD_THREADS */
+#if PN_CACHE
+  PN_FLAG_CACHE_DIR,
+#endif /* PN_CACHE */
+#if PN_SNAPSHOT
+  PN_FLAG_SNAPSHOT_AT,
+  PN_FLAG_SNAPSHOT_OUT,
+  PN_FLAG_SNAPSHOT_IN,
+#endif /* PN_SNAPSHOT */
+#if PN_JIT
+  PN_FLAG_NO_JIT,
+  PN_FLAG_JIT_THRESHOLD,
+#endif /* PN_JIT */
 #if PN_TRACING
   PN_FLAG_TRACE_ALL,
   PN_FLAG_TRACE_BLOCK,
@@ -156,8 +221,15 @@ enum {
   PN_FLAG_PRINT_TIME_AS_ZERO,
 #endif /* PN_TIMERS */
   PN_FLAG_PRINT_OPCODE_COUNTS,
+#if PN_TRACING
+  PN_FLAG_PRINT_OPCODE_PAIRS,
+#endif /* PN_TRACING */
   PN_FLAG_PRINT_STATS,
   PN_FLAG_REPEAT_LOAD,
+#if PN_NATIVE
+  PN_FLAG_EMIT_C,
+  PN_FLAG_LOAD_NATIVE,
+#endif /* PN_NATIVE */
   PN_NUM_FLAGS
 };
 
@@ -173,6 +245,22 @@ static struct option g_pn_long_options[] = {
     {"env", required_argument, NULL, 'e'},
     {"use-host-env", no_argument, NULL, 'E'},
     {"no-dedupe-phi-nodes", no_argument, NULL, 0},
+    {"lazy-lowering", no_argument, NULL, 0},
+#if PN_LOAD_THREADS
+    {"load-threads", required_argument, NULL, 0},
+#endif /* PN_LOAD_THREADS */
+#if PN_CACHE
+    {"cache-dir", required_argument, NULL, 0},
+#endif /* PN_CACHE */
+#if PN_SNAPSHOT
+    {"snapshot-at", required_argument, NULL, 0},
+    {"snapshot-out", required_argument, NULL, 0},
+    {"snapshot-in", required_argument, NULL, 0},
+#endif /* PN_SNAPSHOT */
+#if PN_JIT
+    {"no-jit", no_argument, NULL, 0},
+    {"jit-threshold", required_argument, NULL, 0},
+#endif /* PN_JIT */
 #if PN_TRACING
     {"trace-all", no_argument, NULL, 't'},
     {"trace-block", no_argument, NULL, 0},
@@ -193,8 +281,15 @@ static struct option g_pn_long_options[] = {
     {"print-time-as-zero", no_argument, NULL, 0},
 #endif /* PN_TIMERS */
     {"print-opcode-counts", no_argument, NULL, 0},
+#if PN_TRACING
+    {"print-opcode-pairs", no_argument, NULL, 0},
+#endif /* PN_TRACING */
     {"print-stats", no_argument, NULL, 0},
     {"repeat-load", required_argument, NULL, 0},
+#if PN_NATIVE
+    {"emit-c", required_argument, NULL, 0},
+    {"load-native", required_argument, NULL, 0},
+#endif /* PN_NATIVE */
     {NULL, 0, NULL, 0},
 };
 
@@ -211,6 +306,32 @@ static PNOptionHelp g_pn_option_help[] = {
      "size of runtime memory. suffixes k=1024, m=1024*1024"},
     {PN_FLAG_ENV, "KEY=VALUE", "set runtime environment variable KEY to VALUE"},
     {PN_FLAG_FILESYSTEM_ACCESS, NULL, "allow access to host filesystem"},
+    {PN_FLAG_LAZY_LOWERING, NULL,
+     "read each function when it is first called. Ignored with --no-run"},
+#if PN_LOAD_THREADS
+    {PN_FLAG_LOAD_THREADS, "N",
+     "read functions on N threads. Ignored with --lazy-lowering and tracing"},
+#endif /* PN_LOAD_THREADS */
+#if PN_CACHE
+    {PN_FLAG_CACHE_DIR, "DIR",
+     "load the lowered module from DIR, or write it there. Ignored when "
+     "tracing"},
+#endif /* PN_CACHE */
+#if PN_SNAPSHOT
+    {PN_FLAG_SNAPSHOT_AT, "NAME",
+     "write a snapshot when the function with given name or id is first "
+     "called. Requires --snapshot-out"},
+    {PN_FLAG_SNAPSHOT_OUT, "FILE", "file written by --snapshot-at"},
+    {PN_FLAG_SNAPSHOT_IN, "FILE",
+     "resume from a snapshot of the same pexe and arguments, instead of "
+     "starting"},
+#endif /* PN_SNAPSHOT */
+#if PN_JIT
+    {PN_FLAG_NO_JIT, NULL, "only interpret, never compile to machine code"},
+    {PN_FLAG_JIT_THRESHOLD, "N",
+     "compile a function once it has passed N safepoints (backward jumps, "
+     "calls and returns)"},
+#endif /* PN_JIT */
 #if PN_TRACING
     {PN_FLAG_TRACE_FUNCTION_FILTER, "NAME",
      "only trace function with given name or id"},
@@ -219,8 +340,18 @@ static PNOptionHelp g_pn_option_help[] = {
     {PN_FLAG_PRINT_BLOCK_GRAPH, "NAME",
      "print the basic-block graph of a function with given name or id"},
 #endif /* PN_CALCULATE_PRED_BBS */
+#if PN_TRACING
+    {PN_FLAG_PRINT_OPCODE_PAIRS, NULL,
+     "print counts of adjacent opcodes. See test/gen-superinstructions.py"},
+#endif /* PN_TRACING */
     {PN_FLAG_REPEAT_LOAD, "TIMES",
      "number of times to repeat loading. Useful for profiling"},
+#if PN_NATIVE
+    {PN_FLAG_EMIT_C, "FILE",
+     "write the module as C, to be built as a shared object"},
+    {PN_FLAG_LOAD_NATIVE, "FILE",
+     "run functions from a shared object built from --emit-c output"},
+#endif /* PN_NATIVE */
     {PN_NUM_FLAGS, NULL},
 };
 
@@ -380,6 +511,68 @@ static void pn_options_parse(int argc, char** argv, char** env) {
             g_pn_dedupe_phi_nodes = PN_FALSE;
             break;
 
+          case PN_FLAG_LAZY_LOWERING:
+            g_pn_lazy_lowering = PN_TRUE;
+            break;
+
+#if PN_LOAD_THREADS
+          case PN_FLAG_LOAD_THREADS: {
+            char* endptr;
+            errno = 0;
+            long int threads = strtol(optarg, &endptr, 10);
+            size_t optarg_len = strlen(optarg);
+
+            if (errno != 0 || optarg_len != (endptr - optarg) ||
+                threads < 1) {
+              PN_FATAL("Unable to parse load-threads flag \"%s\".\n", optarg);
+            }
+
+            g_pn_load_threads = threads;
+            break;
+          }
+#endif /* PN_LOAD_THREADS */
+
+#if PN_CACHE
+          case PN_FLAG_CACHE_DIR:
+            g_pn_cache_dirname = optarg;
+            break;
+#endif /* PN_CACHE */
+
+#if PN_SNAPSHOT
+          case PN_FLAG_SNAPSHOT_AT:
+            g_pn_snapshot_at_function = optarg;
+            break;
+
+          case PN_FLAG_SNAPSHOT_OUT:
+            g_pn_snapshot_out_filename = optarg;
+            break;
+
+          case PN_FLAG_SNAPSHOT_IN:
+            g_pn_snapshot_in_filename = optarg;
+            break;
+#endif /* PN_SNAPSHOT */
+
+#if PN_JIT
+          case PN_FLAG_NO_JIT:
+            g_pn_jit_threshold = 0;
+            break;
+
+          case PN_FLAG_JIT_THRESHOLD: {
+            char* endptr;
+            errno = 0;
+            long int threshold = strtol(optarg, &endptr, 10);
+            size_t optarg_len = strlen(optarg);
+
+            if (errno != 0 || optarg_len != (endptr - optarg) ||
+                threshold < 1 || threshold >= UINT32_MAX) {
+              PN_FATAL("Unable to parse jit-threshold flag \"%s\".\n", optarg);
+            }
+
+            g_pn_jit_threshold = threshold;
+            break;
+          }
+#endif /* PN_JIT */
+
 #if PN_TRACING
           case PN_FLAG_TRACE_BCDIS:
 #define PN_TRACE_UNSET(name, flag) g_pn_trace_##name = PN_FALSE;
@@ -447,6 +640,13 @@ static void pn_options_parse(int argc, char** argv, char** env) {
             g_pn_print_opcode_counts = PN_TRUE;
             break;
 
+#if PN_TRACING
+          case PN_FLAG_PRINT_OPCODE_PAIRS:
+            g_pn_opcode_pair_count =
+                pn_calloc(PN_MAX_OPCODE * PN_MAX_OPCODE, sizeof(uint32_t));
+            break;
+#endif /* PN_TRACING */
+
           case PN_FLAG_REPEAT_LOAD: {
             char* endptr;
             errno = 0;
@@ -460,6 +660,16 @@ static void pn_options_parse(int argc, char** argv, char** env) {
             g_pn_repeat_load_times = times;
             break;
           }
+
+#if PN_NATIVE
+          case PN_FLAG_EMIT_C:
+            g_pn_emit_c_filename = optarg;
+            break;
+
+          case PN_FLAG_LOAD_NATIVE:
+            g_pn_load_native_filename = optarg;
+            break;
+#endif /* PN_NATIVE */
         }
         break;
 
@@ -557,6 +767,18 @@ static void pn_options_parse(int argc, char** argv, char** env) {
 
   g_pn_argv = argv + optind;
 
+#if PN_SNAPSHOT
+  if (!g_pn_snapshot_at_function != !g_pn_snapshot_out_filename) {
+    PN_FATAL("--snapshot-at and --snapshot-out must be used together.\n");
+  }
+#if PN_PPAPI
+  if (g_pn_ppapi &&
+      (g_pn_snapshot_at_function || g_pn_snapshot_in_filename)) {
+    PN_FATAL("Snapshots can't be used with --ppapi.\n");
+  }
+#endif /* PN_PPAPI */
+#endif /* PN_SNAPSHOT */
+
 #if PN_TRACING
   /* Handle flag dependencies */
   if (g_pn_trace_INSTRUCTIONS) {
@@ -629,6 +851,18 @@ PN_TOTAL_NUM(instructions)
 #undef PN_MAX_NUM
 #undef PN_TOTAL_NUM
 
+/* Functions skipped by lazy lowering that were never called */
+static uint32_t pn_num_unread_functions(PNModule* module) {
+  uint32_t result = 0;
+  uint32_t n;
+  for (n = 0; n < module->num_functions; ++n) {
+    if (module->functions[n].lazy_bit_offset != 0) {
+      result++;
+    }
+  }
+  return result;
+}
+
 static const char* pn_human_readable_size_leaky(size_t size) {
   const size_t gig = 1024 * 1024 * 1024;
   const size_t meg = 1024 * 1024;
@@ -661,6 +895,27 @@ static int pn_opcode_count_pair_compare(const void* a, const void* b) {
   return ((PNOpcodeCountPair*)b)->count - ((PNOpcodeCountPair*)a)->count;
 }
 
+#if PN_TRACING
+typedef struct PNOpcodePairCount {
+  PNOpcode first;
+  PNOpcode second;
+  uint32_t count;
+} PNOpcodePairCount;
+
+static int pn_opcode_pair_count_compare(const void* a, const void* b) {
+  const PNOpcodePairCount* pair_a = a;
+  const PNOpcodePairCount* pair_b = b;
+  if (pair_a->count != pair_b->count) {
+    return pair_a->count < pair_b->count ? 1 : -1;
+  }
+  /* Ties are sorted by opcode, so the output is deterministic */
+  if (pair_a->first != pair_b->first) {
+    return pair_a->first < pair_b->first ? -1 : 1;
+  }
+  return pair_a->second < pair_b->second ? -1 : pair_a->second > pair_b->second;
+}
+#endif /* PN_TRACING */
+
 typedef struct PNFileData {
   void* data;
   size_t size;
@@ -698,33 +953,10 @@ static void pn_print_basic_block_graph(PNModule* module) {
     return;
   }
 
-  PNFunctionId index = PN_INVALID_FUNCTION_ID;
+  PNFunctionId index =
+      pn_module_find_function(module, g_pn_print_block_graph_function);
 
   int i;
-  char first = g_pn_print_block_graph_function[0];
-  if (first >= '0' && first <= '9') {
-    /* Filter based on function id */
-    index = atoi(g_pn_print_block_graph_function);
-    if (index >= module->num_functions) {
-      PN_FATAL("Invalid function id: %d\n", index);
-    }
-  } else {
-    for (i = 0; i < module->num_functions; ++i) {
-      PNFunction* function = &module->functions[i];
-      if (function->name) {
-        if (strcmp(function->name, g_pn_print_block_graph_function) == 0) {
-          index = i;
-          break;
-        }
-      }
-    }
-
-    if (index == -1) {
-      PN_FATAL("Invalid function name: \"%s\"\n",
-               g_pn_print_block_graph_function);
-    }
-  }
-
   PNFunction* function = &module->functions[index];
 
   /* Print graph in dot format */
@@ -790,6 +1022,10 @@ static void pn_print_stats(PNModule* module) {
     PN_PRINT("-----------------\n");
     PN_PRINT("num_types: %u\n", module->num_types);
     PN_PRINT("num_functions: %u\n", module->num_functions);
+    if (module->lazy_lowering) {
+      PN_PRINT("num_functions never read: %u\n",
+               pn_num_unread_functions(module));
+    }
     PN_PRINT("num_global_vars: %u\n", module->num_global_vars);
     PN_PRINT("max num_constants: %u\n", pn_max_num_constants(module));
     PN_PRINT("max num_values: %u\n", pn_max_num_values(module));
@@ -808,6 +1044,9 @@ static void pn_print_stats(PNModule* module) {
     pn_allocator_print_stats_leaky(&module->allocator);
     pn_allocator_print_stats_leaky(&module->value_allocator);
     pn_allocator_print_stats_leaky(&module->instruction_allocator);
+    PN_PRINT("indirect call cache hits: %" PRIu64 "\n", g_pn_call_cache_hits);
+    PN_PRINT("indirect call cache misses: %" PRIu64 "\n",
+             g_pn_call_cache_misses);
   }
 
   if (g_pn_print_opcode_counts) {
@@ -828,6 +1067,49 @@ static void pn_print_stats(PNModule* module) {
       }
     }
   }
+
+#if PN_TRACING
+  if (g_pn_opcode_pair_count) {
+    uint32_t num_pairs = 0;
+    uint32_t n;
+    for (n = 0; n < PN_MAX_OPCODE * PN_MAX_OPCODE; ++n) {
+      num_pairs += g_pn_opcode_pair_count[n] > 0;
+    }
+
+    PNOpcodePairCount* pairs =
+        pn_calloc(num_pairs, sizeof(PNOpcodePairCount));
+    uint32_t m = 0;
+    for (n = 0; n < PN_MAX_OPCODE * PN_MAX_OPCODE; ++n) {
+      if (g_pn_opcode_pair_count[n] > 0) {
+        pairs[m].first = n / PN_MAX_OPCODE;
+        pairs[m].second = n % PN_MAX_OPCODE;
+        pairs[m].count = g_pn_opcode_pair_count[n];
+        m++;
+      }
+    }
+    qsort(pairs, num_pairs, sizeof(PNOpcodePairCount),
+          pn_opcode_pair_count_compare);
+
+    PN_PRINT("-----------------\n");
+    for (n = 0; n < num_pairs; ++n) {
+      PN_PRINT("%40s %-40s %u\n", g_pn_opcode_names[pairs[n].first],
+               g_pn_opcode_names[pairs[n].second], pairs[n].count);
+    }
+    pn_free(pairs);
+  }
+#endif /* PN_TRACING */
+}
+
+/* Nothing is traced with --load-threads or --cache-dir. Tracing opcode pairs
+ * also disables superinstructions, so it changes the lowered module. */
+static PNBool pn_is_tracing(void) {
+#if PN_TRACING
+#define PN_TRACE_ANY(name, flag) g_pn_trace_##name ||
+  return PN_FOREACH_TRACE(PN_TRACE_ANY) g_pn_opcode_pair_count != NULL;
+#undef PN_TRACE_ANY
+#else
+  return PN_FALSE;
+#endif /* PN_TRACING */
 }
 
 void pn_read_context_init(PNReadContext* read_context) {
@@ -885,10 +1167,61 @@ int main(int argc, char** argv, char** envp) {
   pn_read_context_init(&read_context);
   pn_memory_init(&memory, g_pn_memory_size);
   pn_module_init(&module, &memory);
+  /* Without running, read everything so the whole module is validated. */
+  module.lazy_lowering = g_pn_lazy_lowering && g_pn_run;
+#if PN_LOAD_THREADS
+  /* The trace callbacks would print from every thread at once. */
+  module.load_threads = pn_is_tracing() ? 1 : g_pn_load_threads;
+#endif /* PN_LOAD_THREADS */
   pn_bitstream_init(&bs, file_data.data, file_data.size);
 
+#if PN_NATIVE
+  PNNativeWriter native_writer;
+  if (g_pn_emit_c_filename) {
+    pn_native_writer_init(&native_writer, &read_context, g_pn_emit_c_filename);
+    /* Functions are written as they are read, so read them all now, in
+     * order. */
+    module.lazy_lowering = PN_FALSE;
+    module.load_threads = 1;
+  }
+#endif /* PN_NATIVE */
+
+  PNBool read_module = PN_TRUE;
+#if PN_CACHE
+  uint64_t pexe_hash = 0;
+  uint64_t build_id = 0;
+  /* The cache only has what is needed to run. */
+  PNBool use_cache = g_pn_cache_dirname && g_pn_run && !pn_is_tracing() &&
+                     g_pn_repeat_load_times == 1;
+#if PN_NATIVE
+  use_cache = use_cache && !g_pn_emit_c_filename;
+#endif /* PN_NATIVE */
+#if PN_CALCULATE_PRED_BBS
+  use_cache = use_cache && !g_pn_print_block_graph_function;
+#endif /* PN_CALCULATE_PRED_BBS */
+  /* Snapshots are matched to the pexe and build with the same hashes. */
+  PNBool need_hashes = use_cache;
+#if PN_SNAPSHOT
+  need_hashes = need_hashes || (g_pn_run && (g_pn_snapshot_at_function ||
+                                             g_pn_snapshot_in_filename));
+#endif /* PN_SNAPSHOT */
+  if (need_hashes) {
+    pexe_hash =
+        pn_cache_hash(PN_CACHE_HASH_INIT, file_data.data, file_data.size);
+    build_id = pn_cache_build_id();
+  }
+  if (use_cache) {
+    read_module =
+        !pn_cache_load(&module, g_pn_cache_dirname, pexe_hash, build_id);
+    /* Every function is written, so read them all now. */
+    module.lazy_lowering = PN_FALSE;
+    module.record_relocs = PN_TRUE;
+  }
+#endif /* PN_CACHE */
+
   uint32_t load_count;
-  for (load_count = 0; load_count < g_pn_repeat_load_times; ++load_count) {
+  for (load_count = 0; read_module && load_count < g_pn_repeat_load_times;
+       ++load_count) {
     pn_module_read(&read_context, &module, &bs);
 
     /* Reset the state so everything can be reloaded */
@@ -900,6 +1233,24 @@ int main(int argc, char** argv, char** envp) {
     }
   }
 
+#if PN_CACHE
+  if (use_cache && read_module) {
+    pn_cache_write(&module, g_pn_cache_dirname, pexe_hash, build_id);
+  }
+#endif /* PN_CACHE */
+
+#if PN_NATIVE
+  if (g_pn_emit_c_filename || g_pn_load_native_filename) {
+    uint32_t checksum = pn_native_checksum(file_data.data, file_data.size);
+    if (g_pn_emit_c_filename) {
+      pn_native_writer_finish(&native_writer, &module, checksum);
+    }
+    if (g_pn_load_native_filename) {
+      pn_module_load_native(&module, g_pn_load_native_filename, checksum);
+    }
+  }
+#endif /* PN_NATIVE */
+
   if (g_pn_run) {
     PN_BEGIN_TIME(EXECUTE);
     PNExecutor executor = {};
@@ -912,7 +1263,33 @@ int main(int argc, char** argv, char** envp) {
 #endif /* PN_PPAPI */
 
     pn_executor_init(&executor, &module);
+#if PN_SNAPSHOT
+    PNThread* thread = executor.main_thread;
+    if (g_pn_snapshot_in_filename) {
+      thread = pn_snapshot_load(&executor, g_pn_snapshot_in_filename,
+                                pexe_hash, build_id, g_pn_argv);
+    }
+
+    if (g_pn_snapshot_at_function) {
+      PNFunctionId function_id =
+          pn_module_find_function(&module, g_pn_snapshot_at_function);
+      thread = pn_executor_run_until_entered(
+          &executor, thread, &module.functions[function_id]);
+      if (thread) {
+        pn_snapshot_write(&executor, thread, g_pn_snapshot_out_filename,
+                          pexe_hash, build_id, g_pn_argv);
+      } else {
+        PN_ERROR("%s was not called, so no snapshot was written.\n",
+                 g_pn_snapshot_at_function);
+      }
+    }
+
+    if (thread) {
+      pn_executor_run_from(&executor, thread);
+    }
+#else
     pn_executor_run(&executor);
+#endif /* PN_SNAPSHOT */
     PN_END_TIME(EXECUTE);
 
     if (g_pn_verbose) {
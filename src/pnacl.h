@@ -26,8 +26,10 @@
 #define PN_CALCULATE_LOOPS 0
 #endif
 
+/* Liveness is used to share frame slots between values; see
+ * pn_function_make_slot_map. */
 #ifndef PN_CALCULATE_LIVENESS
-#define PN_CALCULATE_LIVENESS 0
+#define PN_CALCULATE_LIVENESS 1
 #endif
 
 /* Liveness and loop analysis require calculating predecessor basic blocks. */
@@ -40,22 +42,99 @@
 #define PN_PPAPI 0
 #endif
 
+/* Dispatch instructions with computed gotos (a GNU extension) instead of a
+ * switch statement. Clang defines __GNUC__ as well. */
+#ifndef PN_DIRECT_THREADED
+#if defined(__GNUC__)
+#define PN_DIRECT_THREADED 1
+#else
+#define PN_DIRECT_THREADED 0
+#endif
+#endif
+
+/* Compile hot functions to x86-64 machine code; see pn_jit.h. Only the fast
+ * executor variant runs compiled code, so tracing and profiling still see
+ * every instruction. */
+#ifndef PN_JIT
+#if defined(__x86_64__)
+#define PN_JIT 1
+#else
+#define PN_JIT 0
+#endif
+#endif
+
+/* Support --emit-c and --load-native; see pn_native.h. */
+#ifndef PN_NATIVE
+#define PN_NATIVE 1
+#endif
+
+/* Support --load-threads, which reads function blocks on a pool of
+ * pthreads. */
+#ifndef PN_LOAD_THREADS
+#define PN_LOAD_THREADS 1
+#endif
+
+#if PN_LOAD_THREADS
+#include <pthread.h>
+#endif /* PN_LOAD_THREADS */
+
+/* Support --cache-dir; see pn_cache.h. */
+#ifndef PN_CACHE
+#define PN_CACHE 1
+#endif
+
+/* Support --snapshot-at, --snapshot-out and --snapshot-in; see
+ * pn_snapshot.h. Snapshots are matched to the pexe and the build with the
+ * hashes from pn_cache.h. */
+#ifndef PN_SNAPSHOT
+#define PN_SNAPSHOT PN_CACHE
+#endif
+
+#if PN_SNAPSHOT && !PN_CACHE
+#error "PN_SNAPSHOT requires PN_CACHE"
+#endif
+
 #define PN_DEFAULT_ALIGN 8
 
 #define PN_MAX_FDS 1000
 #define PN_MIN_CHUNKSIZE (64 * 1024)
+/* Minimum size of each chunk of a thread's call frame stack */
+#define PN_FRAME_STACK_CHUNKSIZE (1024 * 1024)
 #define PN_DEFAULT_MEMORY_SIZE (1024 * 1024)
 #define PN_MEMORY_GUARD_SIZE 1024
 #define PN_PAGESHIFT 12
 #define PN_PAGESIZE (1 << PN_PAGESHIFT)
-#define PN_INSTRUCTIONS_QUANTUM 100
+/* Number of safepoints (backward jumps, calls and returns) a thread runs
+ * before yielding to the next thread. A program with only one thread never
+ * yields. */
+#define PN_SAFEPOINT_QUANTUM 16
+/* Switches with at most this many cases are scanned linearly. */
+#define PN_SWITCH_MAX_LINEAR_CASES 4
+/* A jump table is used when its size is at most this many times the number
+ * of cases; otherwise the cases are sorted and binary searched. */
+#define PN_SWITCH_MAX_TABLE_SPREAD 3
+/* Tail calls with more args than this push a new frame */
+#define PN_MAX_TAIL_CALL_ARGS 16
+/* Number of safepoints a function passes in the interpreter before it is
+ * compiled. */
+#ifndef PN_JIT_THRESHOLD
+#define PN_JIT_THRESHOLD 1000
+#endif
+/* Size of the buffer compiled code is written to. When it is full, no more
+ * functions are compiled. */
+#define PN_JIT_CODE_SIZE (64 * 1024 * 1024)
 #define PN_FAKE_GETCWD "/home"
+/* Bumped whenever PNNativeContext, PNNativeModule or the code written by
+ * --emit-c changes in a way that makes older shared objects incompatible. */
+#define PN_NATIVE_ABI_VERSION 1
 
 /**** TYPEDEFS  ***************************************************************/
 
 typedef uint8_t PNBool;
 typedef uint16_t PNTypeId;
 typedef uint32_t PNValueId;
+typedef uint16_t PNSlotId;
+typedef uint32_t PNWideSlotId;
 typedef uint32_t PNFunctionId;
 typedef uint16_t PNConstantId;
 typedef uint32_t PNGlobalVarId;
@@ -85,6 +164,25 @@ typedef double pn_f64;
 #define PN_INSTANCE_ID 0xc0de5
 
 #define PN_INVALID_VALUE_ID ((PNValueId)~0)
+#define PN_INVALID_SLOT_ID ((PNSlotId)~0)
+#define PN_INVALID_WIDE_SLOT_ID ((PNWideSlotId)~0)
+
+/* A slot is either an index into the frame's values (args and locals), or an
+ * index into the function's constant pool, selected by the low bit.
+ * Instruction operands are PNSlotIds; a PNWideSlotId can address every value
+ * of the function, and is only used by PHI_MOVES, MOVE_WIDE and indirect
+ * calls. */
+#define PN_FRAME_SLOT(index) ((PNWideSlotId)(index) << 1)
+#define PN_CONSTANT_SLOT(index) (((PNWideSlotId)(index) << 1) | 1)
+#define PN_SLOT_IS_CONSTANT(slot) ((slot)&1)
+#define PN_SLOT_INDEX(slot) ((slot) >> 1)
+#define PN_WIDE_SLOT_FITS(slot) (PN_SLOT_INDEX(slot) < PN_MAX_SLOTS)
+/* The number of frame values, or constants, a PNSlotId can address. Lower it
+ * to exercise the MOVE_WIDE fallback with small functions; see
+ * out/pnacl-maxslots. */
+#ifndef PN_MAX_SLOTS
+#define PN_MAX_SLOTS (PN_INVALID_SLOT_ID >> 1)
+#endif
 #define PN_INVALID_BB_ID ((PNBasicBlockId)~0)
 #define PN_INVALID_FUNCTION_ID ((PNFunctionId)~0)
 #define PN_INVALID_TYPE_ID ((PNTypeId)~0)
@@ -96,6 +194,14 @@ typedef double pn_f64;
 
 #define PN_ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 
+#if defined(__clang__)
+#define PN_NOINLINE __attribute__((noinline))
+#elif defined(__GNUC__)
+#define PN_NOINLINE __attribute__((noinline, noclone))
+#else
+#define PN_NOINLINE
+#endif
+
 #define PN_WARN(...)       \
   if (g_pn_verbose > 0)    \
     PN_PRINT(__VA_ARGS__); \
@@ -214,17 +320,26 @@ enum { PN_FOREACH_TRACE(PN_TRACE_ENUM) PN_NUM_TRACE };
   V(MODULE_BLOCK_READ)            \
   V(CONSTANTS_BLOCK_READ)         \
   V(FUNCTION_BLOCK_READ)          \
+  V(LAZY_FUNCTION_BLOCK_READ)     \
+  V(PARALLEL_FUNCTION_BLOCK_READ) \
+  V(CACHE_LOAD)                   \
+  V(CACHE_WRITE)                  \
   V(VALUE_SYMTAB_BLOCK_READ)      \
   V(TYPE_BLOCK_READ)              \
   V(GLOBALVAR_BLOCK_READ)         \
   V(CALCULATE_RESULT_VALUE_TYPES) \
+  V(CALCULATE_ADDRESS_MODES)      \
   V(CALCULATE_OPCODES)            \
   V(CALCULATE_USES)               \
   V(CALCULATE_PRED_BBS)           \
   V(CALCULATE_PHI_ASSIGNS)        \
   V(CALCULATE_LIVENESS)           \
   V(CALCULATE_LOOPS)              \
+  V(VERIFY)                       \
   V(FUNCTION_TRACE)               \
+  V(JIT_COMPILE)                  \
+  V(SNAPSHOT_LOAD)                \
+  V(SNAPSHOT_WRITE)               \
   V(EXECUTE)
 
 #define PN_TIMERS_ENUM(name) PN_TIMER_##name,
@@ -396,49 +511,51 @@ typedef enum PNBasicType {
   PN_BASIC_TYPE_DOUBLE,
 } PNBasicType;
 
-#define PN_FOREACH_INTRINSIC(V)                                   \
-  V(LLVM_BSWAP_I16, "llvm.bswap.i16")                             \
-  V(LLVM_BSWAP_I32, "llvm.bswap.i32")                             \
-  V(LLVM_BSWAP_I64, "llvm.bswap.i64")                             \
-  V(LLVM_CTLZ_I32, "llvm.ctlz.i32")                               \
-  V(LLVM_CTLZ_I64, "llvm.ctlz.i64")                               \
-  V(LLVM_CTTZ_I32, "llvm.cttz.i32")                               \
-  V(LLVM_CTTZ_I64, "llvm.cttz.i64")                               \
-  V(LLVM_FABS_F32, "llvm.fabs.f32")                               \
-  V(LLVM_FABS_F64, "llvm.fabs.f64")                               \
-  V(LLVM_MEMCPY, "llvm.memcpy.p0i8.p0i8.i32")                     \
-  V(LLVM_MEMMOVE, "llvm.memmove.p0i8.p0i8.i32")                   \
-  V(LLVM_MEMSET, "llvm.memset.p0i8.i32")                          \
-  V(LLVM_NACL_ATOMIC_CMPXCHG_I8, "llvm.nacl.atomic.cmpxchg.i8")   \
-  V(LLVM_NACL_ATOMIC_CMPXCHG_I16, "llvm.nacl.atomic.cmpxchg.i16") \
-  V(LLVM_NACL_ATOMIC_CMPXCHG_I32, "llvm.nacl.atomic.cmpxchg.i32") \
-  V(LLVM_NACL_ATOMIC_CMPXCHG_I64, "llvm.nacl.atomic.cmpxchg.i64") \
-  V(LLVM_NACL_ATOMIC_FENCE_ALL, "llvm.nacl.atomic.fence.all")     \
-  V(LLVM_NACL_ATOMIC_LOAD_I8, "llvm.nacl.atomic.load.i8")         \
-  V(LLVM_NACL_ATOMIC_LOAD_I16, "llvm.nacl.atomic.load.i16")       \
-  V(LLVM_NACL_ATOMIC_LOAD_I32, "llvm.nacl.atomic.load.i32")       \
-  V(LLVM_NACL_ATOMIC_LOAD_I64, "llvm.nacl.atomic.load.i64")       \
-  V(LLVM_NACL_ATOMIC_RMW_I8, "llvm.nacl.atomic.rmw.i8")           \
-  V(LLVM_NACL_ATOMIC_RMW_I16, "llvm.nacl.atomic.rmw.i16")         \
-  V(LLVM_NACL_ATOMIC_RMW_I32, "llvm.nacl.atomic.rmw.i32")         \
-  V(LLVM_NACL_ATOMIC_RMW_I64, "llvm.nacl.atomic.rmw.i64")         \
-  V(LLVM_NACL_ATOMIC_STORE_I8, "llvm.nacl.atomic.store.i8")       \
-  V(LLVM_NACL_ATOMIC_STORE_I16, "llvm.nacl.atomic.store.i16")     \
-  V(LLVM_NACL_ATOMIC_STORE_I32, "llvm.nacl.atomic.store.i32")     \
-  V(LLVM_NACL_ATOMIC_STORE_I64, "llvm.nacl.atomic.store.i64")     \
-  V(LLVM_NACL_LONGJMP, "llvm.nacl.longjmp")                       \
-  V(LLVM_NACL_READ_TP, "llvm.nacl.read.tp")                       \
-  V(LLVM_NACL_SETJMP, "llvm.nacl.setjmp")                         \
-  V(LLVM_SQRT_F32, "llvm.sqrt.f32")                               \
-  V(LLVM_SQRT_F64, "llvm.sqrt.f64")                               \
-  V(LLVM_STACKRESTORE, "llvm.stackrestore")                       \
-  V(LLVM_STACKSAVE, "llvm.stacksave")                             \
-  V(LLVM_TRAP, "llvm.trap")                                       \
-  V(START, "_start")
+/* V(enum, name, num_args, result), where result is VALUE or VOID. Every call
+ * to an intrinsic is checked against these by pn_function_verify. */
+#define PN_FOREACH_INTRINSIC(V)                                             \
+  V(LLVM_BSWAP_I16, "llvm.bswap.i16", 1, VALUE)                             \
+  V(LLVM_BSWAP_I32, "llvm.bswap.i32", 1, VALUE)                             \
+  V(LLVM_BSWAP_I64, "llvm.bswap.i64", 1, VALUE)                             \
+  V(LLVM_CTLZ_I32, "llvm.ctlz.i32", 2, VALUE)                               \
+  V(LLVM_CTLZ_I64, "llvm.ctlz.i64", 2, VALUE)                               \
+  V(LLVM_CTTZ_I32, "llvm.cttz.i32", 2, VALUE)                               \
+  V(LLVM_CTTZ_I64, "llvm.cttz.i64", 2, VALUE)                               \
+  V(LLVM_FABS_F32, "llvm.fabs.f32", 1, VALUE)                               \
+  V(LLVM_FABS_F64, "llvm.fabs.f64", 1, VALUE)                               \
+  V(LLVM_MEMCPY, "llvm.memcpy.p0i8.p0i8.i32", 5, VOID)                      \
+  V(LLVM_MEMMOVE, "llvm.memmove.p0i8.p0i8.i32", 5, VOID)                    \
+  V(LLVM_MEMSET, "llvm.memset.p0i8.i32", 5, VOID)                           \
+  V(LLVM_NACL_ATOMIC_CMPXCHG_I8, "llvm.nacl.atomic.cmpxchg.i8", 5, VALUE)   \
+  V(LLVM_NACL_ATOMIC_CMPXCHG_I16, "llvm.nacl.atomic.cmpxchg.i16", 5, VALUE) \
+  V(LLVM_NACL_ATOMIC_CMPXCHG_I32, "llvm.nacl.atomic.cmpxchg.i32", 5, VALUE) \
+  V(LLVM_NACL_ATOMIC_CMPXCHG_I64, "llvm.nacl.atomic.cmpxchg.i64", 5, VALUE) \
+  V(LLVM_NACL_ATOMIC_FENCE_ALL, "llvm.nacl.atomic.fence.all", 0, VOID)      \
+  V(LLVM_NACL_ATOMIC_LOAD_I8, "llvm.nacl.atomic.load.i8", 2, VALUE)         \
+  V(LLVM_NACL_ATOMIC_LOAD_I16, "llvm.nacl.atomic.load.i16", 2, VALUE)       \
+  V(LLVM_NACL_ATOMIC_LOAD_I32, "llvm.nacl.atomic.load.i32", 2, VALUE)       \
+  V(LLVM_NACL_ATOMIC_LOAD_I64, "llvm.nacl.atomic.load.i64", 2, VALUE)       \
+  V(LLVM_NACL_ATOMIC_RMW_I8, "llvm.nacl.atomic.rmw.i8", 4, VALUE)           \
+  V(LLVM_NACL_ATOMIC_RMW_I16, "llvm.nacl.atomic.rmw.i16", 4, VALUE)         \
+  V(LLVM_NACL_ATOMIC_RMW_I32, "llvm.nacl.atomic.rmw.i32", 4, VALUE)         \
+  V(LLVM_NACL_ATOMIC_RMW_I64, "llvm.nacl.atomic.rmw.i64", 4, VALUE)         \
+  V(LLVM_NACL_ATOMIC_STORE_I8, "llvm.nacl.atomic.store.i8", 3, VOID)        \
+  V(LLVM_NACL_ATOMIC_STORE_I16, "llvm.nacl.atomic.store.i16", 3, VOID)      \
+  V(LLVM_NACL_ATOMIC_STORE_I32, "llvm.nacl.atomic.store.i32", 3, VOID)      \
+  V(LLVM_NACL_ATOMIC_STORE_I64, "llvm.nacl.atomic.store.i64", 3, VOID)      \
+  V(LLVM_NACL_LONGJMP, "llvm.nacl.longjmp", 2, VOID)                        \
+  V(LLVM_NACL_READ_TP, "llvm.nacl.read.tp", 0, VALUE)                       \
+  V(LLVM_NACL_SETJMP, "llvm.nacl.setjmp", 1, VALUE)                         \
+  V(LLVM_SQRT_F32, "llvm.sqrt.f32", 1, VALUE)                               \
+  V(LLVM_SQRT_F64, "llvm.sqrt.f64", 1, VALUE)                               \
+  V(LLVM_STACKRESTORE, "llvm.stackrestore", 1, VOID)                        \
+  V(LLVM_STACKSAVE, "llvm.stacksave", 0, VALUE)                             \
+  V(LLVM_TRAP, "llvm.trap", 0, VOID)                                        \
+  V(START, "_start", 1, VOID)
 
 typedef enum PNIntrinsicId {
   PN_INTRINSIC_NULL,
-#define PN_INTRINSIC_DEFINE(e, name) PN_INTRINSIC_##e,
+#define PN_INTRINSIC_DEFINE(e, name, num_args, result) PN_INTRINSIC_##e,
   PN_FOREACH_INTRINSIC(PN_INTRINSIC_DEFINE)
 #undef PN_INTRINSIC_DEFINE
   PN_MAX_INTRINSICS,
@@ -451,59 +568,72 @@ typedef enum PNIntrinsicId {
   V(BINOP_ADD_INT8)                          \
   V(BINOP_ADD_INT16)                         \
   V(BINOP_ADD_INT32)                         \
+  V(BINOP_ADD_INT32_IMM)                     \
   V(BINOP_ADD_INT64)                         \
   V(BINOP_AND_INT1)                          \
   V(BINOP_AND_INT8)                          \
   V(BINOP_AND_INT16)                         \
   V(BINOP_AND_INT32)                         \
+  V(BINOP_AND_INT32_IMM)                     \
   V(BINOP_AND_INT64)                         \
   V(BINOP_ASHR_INT8)                         \
   V(BINOP_ASHR_INT16)                        \
   V(BINOP_ASHR_INT32)                        \
+  V(BINOP_ASHR_INT32_IMM)                    \
   V(BINOP_ASHR_INT64)                        \
   V(BINOP_LSHR_INT8)                         \
   V(BINOP_LSHR_INT16)                        \
   V(BINOP_LSHR_INT32)                        \
+  V(BINOP_LSHR_INT32_IMM)                    \
   V(BINOP_LSHR_INT64)                        \
   V(BINOP_MUL_DOUBLE)                        \
   V(BINOP_MUL_FLOAT)                         \
   V(BINOP_MUL_INT8)                          \
   V(BINOP_MUL_INT16)                         \
   V(BINOP_MUL_INT32)                         \
+  V(BINOP_MUL_INT32_IMM)                     \
   V(BINOP_MUL_INT64)                         \
   V(BINOP_OR_INT1)                           \
   V(BINOP_OR_INT8)                           \
   V(BINOP_OR_INT16)                          \
   V(BINOP_OR_INT32)                          \
+  V(BINOP_OR_INT32_IMM)                      \
   V(BINOP_OR_INT64)                          \
   V(BINOP_SDIV_DOUBLE)                       \
   V(BINOP_SDIV_FLOAT)                        \
   V(BINOP_SDIV_INT32)                        \
+  V(BINOP_SDIV_INT32_IMM)                    \
   V(BINOP_SDIV_INT64)                        \
   V(BINOP_SHL_INT8)                          \
   V(BINOP_SHL_INT16)                         \
   V(BINOP_SHL_INT32)                         \
+  V(BINOP_SHL_INT32_IMM)                     \
   V(BINOP_SHL_INT64)                         \
   V(BINOP_SREM_INT32)                        \
+  V(BINOP_SREM_INT32_IMM)                    \
   V(BINOP_SREM_INT64)                        \
   V(BINOP_SUB_DOUBLE)                        \
   V(BINOP_SUB_FLOAT)                         \
   V(BINOP_SUB_INT8)                          \
   V(BINOP_SUB_INT16)                         \
   V(BINOP_SUB_INT32)                         \
+  V(BINOP_SUB_INT32_IMM)                     \
   V(BINOP_SUB_INT64)                         \
   V(BINOP_UDIV_INT8)                         \
   V(BINOP_UDIV_INT16)                        \
   V(BINOP_UDIV_INT32)                        \
+  V(BINOP_UDIV_INT32_IMM)                    \
   V(BINOP_UDIV_INT64)                        \
   V(BINOP_UREM_INT8)                         \
   V(BINOP_UREM_INT16)                        \
   V(BINOP_UREM_INT32)                        \
+  V(BINOP_UREM_INT32_IMM)                    \
   V(BINOP_UREM_INT64)                        \
   V(BINOP_XOR_INT1)                          \
   V(BINOP_XOR_INT8)                          \
   V(BINOP_XOR_INT16)                         \
   V(BINOP_XOR_INT32)                         \
+  V(BINOP_XOR_INT32_IMM)                     \
   V(BINOP_XOR_INT64)                         \
   V(BR)                                      \
   V(BR_INT1)                                 \
@@ -606,65 +736,159 @@ typedef enum PNIntrinsicId {
   V(ICMP_EQ_INT8)                            \
   V(ICMP_EQ_INT16)                           \
   V(ICMP_EQ_INT32)                           \
+  V(ICMP_EQ_INT32_IMM)                       \
   V(ICMP_EQ_INT64)                           \
   V(ICMP_NE_INT8)                            \
   V(ICMP_NE_INT16)                           \
   V(ICMP_NE_INT32)                           \
+  V(ICMP_NE_INT32_IMM)                       \
   V(ICMP_NE_INT64)                           \
   V(ICMP_SGE_INT8)                           \
   V(ICMP_SGE_INT16)                          \
   V(ICMP_SGE_INT32)                          \
+  V(ICMP_SGE_INT32_IMM)                      \
   V(ICMP_SGE_INT64)                          \
   V(ICMP_SGT_INT8)                           \
   V(ICMP_SGT_INT16)                          \
   V(ICMP_SGT_INT32)                          \
+  V(ICMP_SGT_INT32_IMM)                      \
   V(ICMP_SGT_INT64)                          \
   V(ICMP_SLE_INT8)                           \
   V(ICMP_SLE_INT16)                          \
   V(ICMP_SLE_INT32)                          \
+  V(ICMP_SLE_INT32_IMM)                      \
   V(ICMP_SLE_INT64)                          \
   V(ICMP_SLT_INT8)                           \
   V(ICMP_SLT_INT16)                          \
   V(ICMP_SLT_INT32)                          \
+  V(ICMP_SLT_INT32_IMM)                      \
   V(ICMP_SLT_INT64)                          \
   V(ICMP_UGE_INT8)                           \
   V(ICMP_UGE_INT16)                          \
   V(ICMP_UGE_INT32)                          \
+  V(ICMP_UGE_INT32_IMM)                      \
   V(ICMP_UGE_INT64)                          \
   V(ICMP_UGT_INT8)                           \
   V(ICMP_UGT_INT16)                          \
   V(ICMP_UGT_INT32)                          \
+  V(ICMP_UGT_INT32_IMM)                      \
   V(ICMP_UGT_INT64)                          \
   V(ICMP_ULE_INT8)                           \
   V(ICMP_ULE_INT16)                          \
   V(ICMP_ULE_INT32)                          \
+  V(ICMP_ULE_INT32_IMM)                      \
   V(ICMP_ULE_INT64)                          \
   V(ICMP_ULT_INT8)                           \
   V(ICMP_ULT_INT16)                          \
   V(ICMP_ULT_INT32)                          \
+  V(ICMP_ULT_INT32_IMM)                      \
   V(ICMP_ULT_INT64)                          \
   V(LOAD_DOUBLE)                             \
+  V(LOAD_DOUBLE_INDEXED)                     \
+  V(LOAD_DOUBLE_OFFSET)                      \
   V(LOAD_FLOAT)                              \
+  V(LOAD_FLOAT_INDEXED)                      \
+  V(LOAD_FLOAT_OFFSET)                       \
   V(LOAD_INT8)                               \
+  V(LOAD_INT8_INDEXED)                       \
+  V(LOAD_INT8_OFFSET)                        \
   V(LOAD_INT16)                              \
+  V(LOAD_INT16_INDEXED)                      \
+  V(LOAD_INT16_OFFSET)                       \
   V(LOAD_INT32)                              \
+  V(LOAD_INT32_INDEXED)                      \
+  V(LOAD_INT32_OFFSET)                       \
   V(LOAD_INT64)                              \
+  V(LOAD_INT64_INDEXED)                      \
+  V(LOAD_INT64_OFFSET)                       \
+  V(MOVE_WIDE)                               \
+  V(PHI_MOVES)                               \
   V(RET)                                     \
   V(RET_VALUE)                               \
   V(STORE_DOUBLE)                            \
+  V(STORE_DOUBLE_INDEXED)                    \
+  V(STORE_DOUBLE_OFFSET)                     \
   V(STORE_FLOAT)                             \
+  V(STORE_FLOAT_INDEXED)                     \
+  V(STORE_FLOAT_OFFSET)                      \
   V(STORE_INT8)                              \
+  V(STORE_INT8_INDEXED)                      \
+  V(STORE_INT8_IMM)                          \
+  V(STORE_INT8_OFFSET)                       \
   V(STORE_INT16)                             \
+  V(STORE_INT16_INDEXED)                     \
+  V(STORE_INT16_IMM)                         \
+  V(STORE_INT16_OFFSET)                      \
   V(STORE_INT32)                             \
+  V(STORE_INT32_INDEXED)                     \
+  V(STORE_INT32_IMM)                         \
+  V(STORE_INT32_OFFSET)                      \
   V(STORE_INT64)                             \
+  V(STORE_INT64_INDEXED)                     \
+  V(STORE_INT64_OFFSET)                      \
+  V(SWITCH_BSEARCH_INT8)                     \
+  V(SWITCH_BSEARCH_INT16)                    \
+  V(SWITCH_BSEARCH_INT32)                    \
+  V(SWITCH_BSEARCH_INT64)                    \
   V(SWITCH_INT1)                             \
   V(SWITCH_INT8)                             \
   V(SWITCH_INT16)                            \
   V(SWITCH_INT32)                            \
   V(SWITCH_INT64)                            \
+  V(SWITCH_TABLE_INT8)                       \
+  V(SWITCH_TABLE_INT16)                      \
+  V(SWITCH_TABLE_INT32)                      \
+  V(SWITCH_TABLE_INT64)                      \
   V(UNREACHABLE)                             \
   V(VSELECT)
 
+/* Opcodes that have an _IMM variant, where the last operand is a literal
+ * stored in the instruction instead of a slot. */
+#define PN_FOREACH_IMMEDIATE_OPCODE(V) \
+  V(BINOP_ADD_INT32)                   \
+  V(BINOP_AND_INT32)                   \
+  V(BINOP_ASHR_INT32)                  \
+  V(BINOP_LSHR_INT32)                  \
+  V(BINOP_MUL_INT32)                   \
+  V(BINOP_OR_INT32)                    \
+  V(BINOP_SDIV_INT32)                  \
+  V(BINOP_SHL_INT32)                   \
+  V(BINOP_SREM_INT32)                  \
+  V(BINOP_SUB_INT32)                   \
+  V(BINOP_UDIV_INT32)                  \
+  V(BINOP_UREM_INT32)                  \
+  V(BINOP_XOR_INT32)                   \
+  V(ICMP_EQ_INT32)                     \
+  V(ICMP_NE_INT32)                     \
+  V(ICMP_SGE_INT32)                    \
+  V(ICMP_SGT_INT32)                    \
+  V(ICMP_SLE_INT32)                    \
+  V(ICMP_SLT_INT32)                    \
+  V(ICMP_UGE_INT32)                    \
+  V(ICMP_UGT_INT32)                    \
+  V(ICMP_ULE_INT32)                    \
+  V(ICMP_ULT_INT32)                    \
+  V(STORE_INT8)                        \
+  V(STORE_INT16)                       \
+  V(STORE_INT32)
+
+/* Load and store opcodes that have _OFFSET and _INDEXED variants, which
+ * compute the address as base + offset or base + index * scale; see
+ * pn_function_calculate_address_modes. */
+#define PN_FOREACH_ADDRESS_MODE_OPCODE(V) \
+  V(LOAD_DOUBLE)                          \
+  V(LOAD_FLOAT)                           \
+  V(LOAD_INT8)                            \
+  V(LOAD_INT16)                           \
+  V(LOAD_INT32)                           \
+  V(LOAD_INT64)                           \
+  V(STORE_DOUBLE)                         \
+  V(STORE_FLOAT)                          \
+  V(STORE_INT8)                           \
+  V(STORE_INT16)                          \
+  V(STORE_INT32)                          \
+  V(STORE_INT64)
+
 #define PN_FOREACH_ATOMIC_RMW_INTRINSIC_OPCODE(V) \
   V(LLVM_NACL_ATOMIC_ADD_I8)                      \
   V(LLVM_NACL_ATOMIC_ADD_I16)                     \
@@ -691,12 +915,36 @@ typedef enum PNIntrinsicId {
   V(LLVM_NACL_ATOMIC_XOR_I32)                     \
   V(LLVM_NACL_ATOMIC_XOR_I64)
 
+/* Pairs of adjacent instructions that are fused into one opcode, saving a
+ * dispatch. V(first, second, family, ...) runs |first| with the executor's
+ * PN_OPCODE_<family>(...) handler macro, then jumps straight to |second|'s
+ * handler. Regenerate from a --print-opcode-pairs profile with
+ * test/gen-superinstructions.py. */
+#define PN_FOREACH_SUPERINSTRUCTION(V)                        \
+  V(ICMP_EQ_INT32_IMM, BR_INT1, CMP2_IMM, ==, u32)            \
+  V(ICMP_EQ_INT32, BR_INT1, CMP2, ==, u32)                    \
+  V(BINOP_MUL_INT32_IMM, BINOP_ADD_INT32, BINOP_IMM, *, u32)  \
+  V(BINOP_MUL_DOUBLE, BINOP_MUL_DOUBLE, BINOP, *, f64)        \
+  V(BINOP_ADD_INT32, BINOP_ADD_INT32_IMM, BINOP, +, u32)      \
+  V(BINOP_ADD_INT32_IMM, ICMP_EQ_INT32, BINOP_IMM, +, u32)    \
+  V(BINOP_MUL_DOUBLE, BINOP_ADD_DOUBLE, BINOP, *, f64)        \
+  V(CAST_ZEXT_INT1_INT32, BINOP_ADD_INT32, CAST_ZEXT1, 32)    \
+  V(FCMP_OLE_FLOAT, CAST_ZEXT_INT1_INT32, CMP2, <=, f32)      \
+  V(LOAD_FLOAT_INDEXED, FCMP_OLE_FLOAT, LOAD_INDEXED, f32)    \
+  V(BINOP_OR_INT1, BR_INT1, BINOP, |, u8)                     \
+  V(BINOP_ADD_DOUBLE, BINOP_MUL_DOUBLE, BINOP, +, f64)        \
+  V(BINOP_ADD_INT32_IMM, STORE_INT32, BINOP_IMM, +, u32)      \
+  V(BINOP_ADD_INT32, LOAD_DOUBLE_OFFSET, BINOP, +, u32)       \
+  V(LOAD_DOUBLE_INDEXED, BINOP_MUL_DOUBLE, LOAD_INDEXED, f64) \
+  V(BINOP_ADD_INT32, CAST_SITOFP_INT32_DOUBLE, BINOP, +, u32)
+
 typedef enum PNOpcode {
 #define PN_OPCODE(e) PN_OPCODE_##e,
   PN_FOREACH_OPCODE(PN_OPCODE)
 #undef PN_OPCODE
 
-#define PN_INTRINSIC_OPCODE(e, name) PN_OPCODE_INTRINSIC_##e,
+#define PN_INTRINSIC_OPCODE(e, name, num_args, result) \
+  PN_OPCODE_INTRINSIC_##e,
   PN_FOREACH_INTRINSIC(PN_INTRINSIC_OPCODE)
 #undef PN_INTRINSIC_OPCODE
 
@@ -704,69 +952,74 @@ typedef enum PNOpcode {
   PN_FOREACH_ATOMIC_RMW_INTRINSIC_OPCODE(PN_ATOMIC_RMW_INTRINSIC_OPCODE)
 #undef PN_ATOMIC_RMW_INTRINSIC_OPCODE
 
+#define PN_SUPERINSTRUCTION_OPCODE(first, second, family, ...) \
+  PN_OPCODE_##first##_THEN_##second,
+  PN_FOREACH_SUPERINSTRUCTION(PN_SUPERINSTRUCTION_OPCODE)
+#undef PN_SUPERINSTRUCTION_OPCODE
+
   PN_MAX_OPCODE,
 } PNOpcode;
 
-#define PN_FOREACH_BUILTIN_BASE(V)                    \
-  V(NACL_IRT_QUERY)                                   \
-  V(NACL_IRT_BASIC_EXIT)                              \
-  V(NACL_IRT_BASIC_GETTOD)                            \
-  V(NACL_IRT_BASIC_CLOCK)                             \
-  V(NACL_IRT_BASIC_NANOSLEEP)                         \
-  V(NACL_IRT_BASIC_SCHED_YIELD)                       \
-  V(NACL_IRT_BASIC_SYSCONF)                           \
-  V(NACL_IRT_FDIO_CLOSE)                              \
-  V(NACL_IRT_FDIO_DUP)                                \
-  V(NACL_IRT_FDIO_DUP2)                               \
-  V(NACL_IRT_FDIO_READ)                               \
-  V(NACL_IRT_FDIO_WRITE)                              \
-  V(NACL_IRT_FDIO_SEEK)                               \
-  V(NACL_IRT_FDIO_FSTAT)                              \
-  V(NACL_IRT_FDIO_GETDENTS)                           \
-  V(NACL_IRT_FDIO_FCHDIR)                             \
-  V(NACL_IRT_FDIO_FCHMOD)                             \
-  V(NACL_IRT_FDIO_FSYNC)                              \
-  V(NACL_IRT_FDIO_FDATASYNC)                          \
-  V(NACL_IRT_FDIO_FTRUNCATE)                          \
-  V(NACL_IRT_FDIO_ISATTY)                             \
-  V(NACL_IRT_FILENAME_OPEN)                           \
-  V(NACL_IRT_FILENAME_STAT)                           \
-  V(NACL_IRT_FILENAME_MKDIR)                          \
-  V(NACL_IRT_FILENAME_RMDIR)                          \
-  V(NACL_IRT_FILENAME_CHDIR)                          \
-  V(NACL_IRT_FILENAME_GETCWD)                         \
-  V(NACL_IRT_FILENAME_UNLINK)                         \
-  V(NACL_IRT_FILENAME_TRUNCATE)                       \
-  V(NACL_IRT_FILENAME_LSTAT)                          \
-  V(NACL_IRT_FILENAME_LINK)                           \
-  V(NACL_IRT_FILENAME_RENAME)                         \
-  V(NACL_IRT_FILENAME_SYMLINK)                        \
-  V(NACL_IRT_FILENAME_CHMOD)                          \
-  V(NACL_IRT_FILENAME_ACCESS)                         \
-  V(NACL_IRT_FILENAME_READLINK)                       \
-  V(NACL_IRT_FILENAME_UTIMES)                         \
-  V(NACL_IRT_MEMORY_MMAP)                             \
-  V(NACL_IRT_MEMORY_MUNMAP)                           \
-  V(NACL_IRT_MEMORY_MPROTECT)                         \
-  V(NACL_IRT_TLS_INIT)                                \
-  V(NACL_IRT_TLS_GET)                                 \
-  V(NACL_IRT_THREAD_CREATE)                           \
-  V(NACL_IRT_THREAD_EXIT)                             \
-  V(NACL_IRT_THREAD_NICE)                             \
-  V(NACL_IRT_FUTEX_WAIT_ABS)                          \
-  V(NACL_IRT_FUTEX_WAKE)                              \
+#define PN_FOREACH_BUILTIN_BASE(V)                           \
+  V(NACL_IRT_QUERY, NONE)                                    \
+  V(NACL_IRT_BASIC_EXIT, MAY_BLOCK)                          \
+  V(NACL_IRT_BASIC_GETTOD, NONE)                             \
+  V(NACL_IRT_BASIC_CLOCK, NONE)                              \
+  V(NACL_IRT_BASIC_NANOSLEEP, NONE)                          \
+  V(NACL_IRT_BASIC_SCHED_YIELD, NONE)                        \
+  V(NACL_IRT_BASIC_SYSCONF, NONE)                            \
+  V(NACL_IRT_FDIO_CLOSE, NONE)                               \
+  V(NACL_IRT_FDIO_DUP, NONE)                                 \
+  V(NACL_IRT_FDIO_DUP2, NONE)                                \
+  V(NACL_IRT_FDIO_READ, NONE)                                \
+  V(NACL_IRT_FDIO_WRITE, NONE)                               \
+  V(NACL_IRT_FDIO_SEEK, NONE)                                \
+  V(NACL_IRT_FDIO_FSTAT, NONE)                               \
+  V(NACL_IRT_FDIO_GETDENTS, NONE)                            \
+  V(NACL_IRT_FDIO_FCHDIR, NONE)                              \
+  V(NACL_IRT_FDIO_FCHMOD, NONE)                              \
+  V(NACL_IRT_FDIO_FSYNC, NONE)                               \
+  V(NACL_IRT_FDIO_FDATASYNC, NONE)                           \
+  V(NACL_IRT_FDIO_FTRUNCATE, NONE)                           \
+  V(NACL_IRT_FDIO_ISATTY, NONE)                              \
+  V(NACL_IRT_FILENAME_OPEN, NONE)                            \
+  V(NACL_IRT_FILENAME_STAT, NONE)                            \
+  V(NACL_IRT_FILENAME_MKDIR, NONE)                           \
+  V(NACL_IRT_FILENAME_RMDIR, NONE)                           \
+  V(NACL_IRT_FILENAME_CHDIR, NONE)                           \
+  V(NACL_IRT_FILENAME_GETCWD, NONE)                          \
+  V(NACL_IRT_FILENAME_UNLINK, NONE)                          \
+  V(NACL_IRT_FILENAME_TRUNCATE, NONE)                        \
+  V(NACL_IRT_FILENAME_LSTAT, NONE)                           \
+  V(NACL_IRT_FILENAME_LINK, NONE)                            \
+  V(NACL_IRT_FILENAME_RENAME, NONE)                          \
+  V(NACL_IRT_FILENAME_SYMLINK, NONE)                         \
+  V(NACL_IRT_FILENAME_CHMOD, NONE)                           \
+  V(NACL_IRT_FILENAME_ACCESS, NONE)                          \
+  V(NACL_IRT_FILENAME_READLINK, NONE)                        \
+  V(NACL_IRT_FILENAME_UTIMES, NONE)                          \
+  V(NACL_IRT_MEMORY_MMAP, NONE)                              \
+  V(NACL_IRT_MEMORY_MUNMAP, NONE)                            \
+  V(NACL_IRT_MEMORY_MPROTECT, NONE)                          \
+  V(NACL_IRT_TLS_INIT, NONE)                                 \
+  V(NACL_IRT_TLS_GET, NONE)                                  \
+  V(NACL_IRT_THREAD_CREATE, CREATES_THREAD)                  \
+  V(NACL_IRT_THREAD_EXIT, MAY_BLOCK)                         \
+  V(NACL_IRT_THREAD_NICE, NONE)                              \
+  V(NACL_IRT_FUTEX_WAIT_ABS, MAY_BLOCK)                      \
+  V(NACL_IRT_FUTEX_WAKE, NONE)                               \
 
 #if PN_PPAPI
-#define PN_FOREACH_BUILTIN_EXTRA(V)                   \
-  V(NACL_IRT_PPAPIHOOK_PPAPI_START)                   \
-  V(NACL_IRT_PPAPIHOOK_PPAPI_REGISTER_THREAD_CREATOR) \
-  V(PPB_GET_INTERFACE)                                \
-  V(PPB_CORE_ADD_REF_RESOURCE)                        \
-  V(PPB_CORE_RELEASE_RESOURCE)                        \
-  V(PPB_CORE_GET_TIME)                                \
-  V(PPB_CORE_GET_TIME_TICKS)                          \
-  V(PPB_CORE_CALL_ON_MAIN_THREAD)                     \
-  V(PPB_CORE_IS_MAIN_THREAD)
+#define PN_FOREACH_BUILTIN_EXTRA(V)                          \
+  V(NACL_IRT_PPAPIHOOK_PPAPI_START, REPLACES_FRAME)          \
+  V(NACL_IRT_PPAPIHOOK_PPAPI_REGISTER_THREAD_CREATOR, NONE)  \
+  V(PPB_GET_INTERFACE, NONE)                                 \
+  V(PPB_CORE_ADD_REF_RESOURCE, NONE)                         \
+  V(PPB_CORE_RELEASE_RESOURCE, NONE)                         \
+  V(PPB_CORE_GET_TIME, NONE)                                 \
+  V(PPB_CORE_GET_TIME_TICKS, NONE)                           \
+  V(PPB_CORE_CALL_ON_MAIN_THREAD, NONE)                      \
+  V(PPB_CORE_IS_MAIN_THREAD, NONE)
 #else
 #define PN_FOREACH_BUILTIN_EXTRA(V)
 #endif /* PN_PPAPI */
@@ -777,12 +1030,22 @@ typedef enum PNOpcode {
 
 typedef enum PNBuiltinId {
   PN_BUILTIN_NULL,
-#define PN_BUILTIN(e) PN_BUILTIN_##e,
+#define PN_BUILTIN(e, flags) PN_BUILTIN_##e,
   PN_FOREACH_BUILTIN(PN_BUILTIN)
 #undef PN_BUILTIN
   PN_MAX_BUILTINS
 } PNBuiltinId;
 
+/* Builtins without flags can't change the state of the calling thread, so the
+ * executor continues with the next instruction without checking it. */
+#define PN_BUILTIN_FLAGS_NONE 0
+/* May block, exit or kill the calling thread */
+#define PN_BUILTIN_FLAGS_MAY_BLOCK 1
+/* Leaves the calling thread in a new frame; the call is never stepped over */
+#define PN_BUILTIN_FLAGS_REPLACES_FRAME 2
+/* Starts another thread, so the calling thread must start yielding */
+#define PN_BUILTIN_FLAGS_CREATES_THREAD 4
+
 #if PN_PPAPI
 #define PN_FOREACH_PPB_INTERFACES(V) \
   V(CORE_1_0, "PPB_Core;1.0")
@@ -904,6 +1167,20 @@ typedef struct PNAllocator {
   PNAllocatorMark reset_mark;
 } PNAllocator;
 
+typedef struct PNFrameStackChunk {
+  struct PNFrameStackChunk* prev;
+  struct PNFrameStackChunk* next;
+  void* end;
+} PNFrameStackChunk;
+
+/* Call frames and their values, pushed and popped with a bump pointer. A
+ * zero-initialized PNFrameStack is empty. */
+typedef struct PNFrameStack {
+  PNFrameStackChunk* chunk;
+  void* top;
+  void* end;
+} PNFrameStack;
+
 typedef struct PNBitSet {
   uint32_t num_words;
   uint32_t* words;
@@ -1015,6 +1292,12 @@ typedef struct PNInstructionLoad {
   PNValueId src_id;
   PNAlignment alignment;
   PNTypeId type_id;
+  /* The address is src_id + offset, or src_id + index_id * scale when
+   * index_id is not PN_INVALID_VALUE_ID; see
+   * pn_function_calculate_address_modes. */
+  PNValueId index_id;
+  uint32_t scale;
+  uint32_t offset;
 } PNInstructionLoad;
 
 typedef struct PNPhiIncoming {
@@ -1040,6 +1323,10 @@ typedef struct PNInstructionStore {
   PNValueId dest_id;
   PNValueId value_id;
   PNAlignment alignment;
+  /* Same as PNInstructionLoad, relative to dest_id. */
+  PNValueId index_id;
+  uint32_t scale;
+  uint32_t offset;
 } PNInstructionStore;
 
 typedef struct PNSwitchCase {
@@ -1073,6 +1360,8 @@ typedef struct PNPhiUse {
   PNPhiIncoming incoming;
 } PNPhiUse;
 
+/* Phi assigns are grouped by the destination basic block, and each group is
+ * ordered so it can be executed as a sequence of moves. */
 typedef struct PNPhiAssign {
   PNBasicBlockId bb_id;
   PNValueId source_value_id;
@@ -1087,7 +1376,6 @@ typedef struct PNBasicBlock {
   PNPhiUse* phi_uses;
   uint32_t num_phi_assigns;
   PNPhiAssign* phi_assigns;
-  PNBool fast_phi_assign;
 #if PN_CALCULATE_PRED_BBS
   uint32_t num_succ_bbs;
   PNBasicBlockId* succ_bb_ids;
@@ -1158,6 +1446,50 @@ typedef struct PNLivenessRange {
 } PNLivenessRange;
 #endif /* PN_CALCULATE_LIVENESS */
 
+/* What a call needs to push a frame for a function. Direct calls point at
+ * their callee's descriptor, which is filled in when the callee is lowered. */
+#if PN_NATIVE
+/* The host ABI of a shared object built from --emit-c output. The emitted C
+ * file repeats these definitions, so they must only change along with
+ * PN_NATIVE_ABI_VERSION. */
+typedef struct PNNativeContext {
+  uint8_t* memory;
+  uint32_t memory_size;
+  /* Called when an access of |size| bytes at |offset| is out of bounds, and
+   * when an unreachable instruction is reached. Neither returns. */
+  void (*memory_error)(struct PNNativeContext* context,
+                       uint32_t offset,
+                       uint32_t size);
+  void (*unreachable)(struct PNNativeContext* context);
+  void* user_data;
+} PNNativeContext;
+
+typedef void (*PNNativeFunction)(PNNativeContext* context,
+                                 const PNRuntimeValue* args,
+                                 PNRuntimeValue* result);
+
+typedef struct PNNativeModule {
+  uint32_t abi_version;
+  uint32_t checksum; /* Of the pexe the C file was emitted from */
+  uint32_t num_functions;
+  /* Indexed by function id; NULL for functions that stay interpreted. */
+  const PNNativeFunction* functions;
+} PNNativeModule;
+#endif /* PN_NATIVE */
+
+typedef struct PNCallee {
+  struct PNFunction* function;
+  void* instructions;
+  PNRuntimeValue* constant_pool;
+  PNFunctionId function_id;
+  uint32_t num_args;
+  uint32_t frame_size; /* Size of the PNCallFrame and its values, in bytes */
+#if PN_NATIVE
+  /* Set by --load-native; called instead of running |instructions|. */
+  PNNativeFunction native;
+#endif /* PN_NATIVE */
+} PNCallee;
+
 typedef struct PNFunction {
   char* name;
   PNTypeId type_id;
@@ -1174,9 +1506,40 @@ typedef struct PNFunction {
   PNValue* values;
   uint32_t num_instructions;
   void* instructions;
+  /* The constant pool holds the function's constants followed by the module
+   * values it uses; module_value_ids maps those back to value ids. */
+  PNRuntimeValue* constant_pool;
+  uint32_t num_module_value_slots;
+  PNValueId* module_value_ids;
+  /* Frame slots used by args and locals, not counting scratch slots. */
+  uint32_t num_frame_slots;
+  /* Frame slots after the args, used to stage operands that don't fit in a
+   * PNSlotId through MOVE_WIDE. Zero unless the function has more than 32K
+   * frame values or constants. */
+  uint32_t num_scratch_slots;
+  /* Bit offset of the function block if it was skipped by lazy lowering or
+   * --load-threads and hasn't been read yet, otherwise 0. */
+  uint32_t lazy_bit_offset;
+  PNCallee callee;
+  /* Size of |instructions| in bytes, including the trap at the end. */
+  uint32_t instructions_size;
+#if PN_CACHE
+  /* Each pointer written to |instructions|, as its offset << 1 | its
+   * PNRelocKind. Only recorded if PNModule.record_relocs is set. */
+  uint32_t num_relocs;
+  uint32_t* relocs;
+#endif /* PN_CACHE */
 #if PN_CALCULATE_LIVENESS
   PNLivenessRange* value_liveness_range;
 #endif /* PN_CALCULATE_LIVENESS */
+#if PN_JIT
+  /* Decremented at each safepoint; the function is compiled at zero. */
+  uint32_t jit_countdown;
+  /* Offset in PNJit.code of each instruction's machine code, indexed by the
+   * instruction's offset in |instructions| / 2, or 0 if it has none. NULL
+   * until the function is compiled. */
+  uint32_t* jit_entries;
+#endif /* PN_JIT */
 } PNFunction;
 
 typedef struct PNType {
@@ -1222,6 +1585,12 @@ typedef struct PNMemory {
 #endif /* PN_PPAPI */
 } PNMemory;
 
+typedef struct PNBlockInfoContext {
+  uint32_t num_abbrevs;
+  PNAbbrevs block_abbrev_map[PN_MAX_BLOCK_IDS];
+  PNBool use_relative_ids;
+} PNBlockInfoContext;
+
 typedef struct PNModule {
   uint32_t version;
   uint32_t num_functions;
@@ -1239,25 +1608,168 @@ typedef struct PNModule {
   PNAllocator instruction_allocator;
   PNAllocator temp_allocator;
 
+  /* Maps a module value id to its slot in the function being lowered. */
+  PNWideSlotId* module_value_slots;
+
   /* Stored here so global variable data can be written directly. */
   PNMemory* memory;
+
+  /* If set before the module is read, function blocks are skipped and read
+   * by pn_module_read_lazy_function when the function is first called. The
+   * rest is what is needed to read them then. */
+  PNBool lazy_lowering;
+  struct PNReadContext* lazy_read_context;
+  PNBitStream lazy_bs;
+  PNBlockInfoContext lazy_block_info_context;
+
+  /* If greater than 1, function blocks are skipped while the module block is
+   * read, then read on this many threads; see
+   * pn_module_read_functions_parallel. Ignored with lazy_lowering. */
+  uint32_t load_threads;
+
+#if PN_CACHE
+  /* Set when the module will be written with pn_cache_write. */
+  PNBool record_relocs;
+#endif /* PN_CACHE */
 } PNModule;
 
+#if PN_LOAD_THREADS
+typedef struct PNLoadThreads {
+  PNBlockInfoContext* context;
+  PNBitStream bs;
+  PNFunctionId* function_ids;
+  uint32_t num_function_ids;
+  /* Index of the next function id to read, claimed atomically */
+  uint32_t next_index;
+} PNLoadThreads;
+
+typedef struct PNLoadWorker {
+  pthread_t thread;
+  PNLoadThreads* load;
+  /* Shares everything with the real module but the allocators and
+   * module_value_slots. Allocations are merged back after joining. */
+  PNModule module;
+#if PN_TIMERS
+  struct timespec timer_times[PN_NUM_TIMERS];
+#endif /* PN_TIMERS */
+} PNLoadWorker;
+#endif /* PN_LOAD_THREADS */
+
+#if PN_CACHE
+typedef enum PNRelocKind {
+  /* Points into the same instruction stream */
+  PN_RELOC_INSTRUCTION,
+  /* Points to a PNFunction.callee */
+  PN_RELOC_CALLEE,
+} PNRelocKind;
+
+#define PN_CACHE_MAGIC 0x43414e50 /* "PNAC" */
+#define PN_CACHE_VERSION 1
+
+/* The rest of the file is found through these offsets. Pointers in the
+ * arrays are stored as offsets from the start of the file, too. */
+typedef struct PNCacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t pexe_hash;
+  uint64_t build_id;
+  uint32_t file_size;
+  uint32_t module_version;
+  uint32_t num_functions;
+  uint32_t functions_offset;
+  uint32_t num_types;
+  uint32_t types_offset;
+  uint32_t num_values;
+  uint32_t values_offset;
+  uint32_t num_global_vars;
+  uint32_t global_vars_offset;
+  PNFunctionId known_functions[PN_MAX_INTRINSICS];
+  uint32_t globalvar_start;
+  uint32_t globalvar_end;
+  uint32_t globalvar_data_offset;
+} PNCacheHeader;
+#endif /* PN_CACHE */
+
+#if PN_SNAPSHOT
+#define PN_SNAPSHOT_MAGIC 0x534e5050 /* "PPNS" */
+#define PN_SNAPSHOT_VERSION 2
+
+/* A snapshot file is this header, followed by:
+ *
+ *   the program arguments, without the pexe filename, each ending with a 0;
+ *   the memory below heap_end, and from stack_start to memory_size;
+ *   the words of PNExecutor.mapped_pages;
+ *   num_fds PNSnapshotFds, each followed by its path;
+ *   num_threads PNSnapshotThreads, each followed by its PNSnapshotFrames
+ *     (oldest first, each followed by its values) and its PNSnapshotJmpBufs.
+ *
+ * Instructions are stored as offsets from the start of their function's
+ * instruction stream, so the module can be loaded any way, even lazily. */
+typedef struct PNSnapshotHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t pexe_hash;
+  uint64_t build_id;
+  uint32_t file_size;
+  uint32_t args_size;
+  uint32_t memory_size;
+  uint32_t heap_end;
+  uint32_t stack_start;
+  PNMemory memory; /* Everything but data and size */
+  uint32_t next_thread_id;
+  PNJmpBufId next_jmpbuf_id;
+  uint32_t num_fds;
+  uint32_t num_threads;
+} PNSnapshotHeader;
+
+typedef struct PNSnapshotFd {
+  uint32_t fd;
+  int32_t host_fd; /* Only std{in,out,err} are kept; others are reopened */
+  int32_t flags;
+  uint32_t path_size;
+  int64_t offset;
+} PNSnapshotFd;
+
+typedef struct PNSnapshotThread {
+  uint32_t id;
+  PNBool is_main;
+  PNThreadState state;
+  PNFutexState futex_state;
+  uint32_t tls;
+  uint32_t wait_addr;
+  PNBool has_timeout;
+  uint64_t timeout_sec;
+  uint32_t timeout_usec;
+  uint32_t num_frames;
+  uint32_t num_jmpbufs;
+  uint32_t inst_offset; /* In the newest frame */
+} PNSnapshotThread;
+
+typedef struct PNSnapshotFrame {
+  PNFunctionId function_id;
+  uint32_t inst_offset;
+  uint32_t memory_stack_top;
+  uint32_t jmpbuf_base;
+  uint32_t values_size;
+} PNSnapshotFrame;
+
+typedef struct PNSnapshotJmpBuf {
+  PNJmpBufId id;
+  uint32_t memory_stack_top;
+  uint32_t frame_index;
+  uint32_t inst_offset;
+  uint32_t frame_stack_offset; /* From the start of the frame */
+} PNSnapshotJmpBuf;
+#endif /* PN_SNAPSHOT */
+
 #if PN_CALCULATE_LIVENESS
 typedef struct PNLivenessState {
-  PNBitSet seen_values;
   PNBitSet livein;
   PNBitSet seen_bbs;
   PNBasicBlockId* bb_id_stack;
 } PNLivenessState;
 #endif /* PN_CALCULATE_LIVENESS */
 
-typedef struct PNBlockInfoContext {
-  uint32_t num_abbrevs;
-  PNAbbrevs block_abbrev_map[PN_MAX_BLOCK_IDS];
-  PNBool use_relative_ids;
-} PNBlockInfoContext;
-
 typedef struct PNLocation {
   PNFunctionId function_id;
   void* inst;
@@ -1265,23 +1777,33 @@ typedef struct PNLocation {
 
 typedef struct PNCallFrame {
   PNLocation location;
-  PNAllocatorMark mark;
-  PNRuntimeValue* function_values;
+  PNRuntimeValue* function_values; /* Args and locals */
+  PNRuntimeValue* constants;
   struct PNCallFrame* parent;
-  struct PNJmpBuf* jmpbuf_head;
+  uint32_t jmpbuf_base; /* PNThread.num_jmpbufs when the frame was pushed */
   uint32_t memory_stack_top; /* Grows down */
 } PNCallFrame;
 
+/* A setjmp target. Only the parts of the frame that can change after setjmp
+ * returns are saved. */
 typedef struct PNJmpBuf {
   PNJmpBufId id;
-  PNCallFrame frame;
-  struct PNJmpBuf* next;
+  uint32_t memory_stack_top;
+  PNCallFrame* frame;
+  void* inst; /* The setjmp call */
+  void* frame_stack_top;
 } PNJmpBuf;
 
 typedef struct PNThread {
-  PNAllocator allocator;
+  PNFrameStack frame_stack;
   struct PNExecutor* executor;
   PNCallFrame* current_frame;
+  /* Live setjmp targets, oldest first. A guest jmp_buf holds the id of its
+   * entry and the entry's index. Popping a frame drops the entries created
+   * since it was pushed. */
+  PNJmpBuf* jmpbufs;
+  uint32_t num_jmpbufs;
+  uint32_t max_jmpbufs;
   struct PNThread* next;
   struct PNThread* prev;
   PNThreadState state;
@@ -1307,6 +1829,22 @@ typedef struct PNThread {
   void* inst;
 } PNThread;
 
+typedef PNRuntimeValue (*PNBuiltinFunc)(PNThread* thread,
+                                        PNFunction* function,
+                                        uint32_t num_args,
+                                        PNSlotId* arg_ids);
+
+typedef struct PNBuiltin {
+  PNBuiltinFunc func;
+  uint32_t flags; /* PN_BUILTIN_FLAGS_* */
+} PNBuiltin;
+
+typedef struct PNIntrinsicSignature {
+  const char* name;
+  uint32_t num_args;
+  PNBool has_result;
+} PNIntrinsicSignature;
+
 #if PN_PPAPI
 typedef struct PNEvent {
   struct PNEvent* next;
@@ -1332,10 +1870,29 @@ typedef struct PNPpapi {
 } PNPpapi;
 #endif /* PN_PPAPI */
 
+/* Each variant is a copy of the executor loop with only the instrumentation
+ * it needs; see pn_executor_loop.h. */
+typedef enum PNExecutorVariant {
+  PN_EXECUTOR_VARIANT_FAST,
+  PN_EXECUTOR_VARIANT_COUNTING,  /* Opcode counts and call cache statistics */
+#if PN_TRACING
+  PN_EXECUTOR_VARIANT_PROFILING, /* Also steps one instruction at a time */
+  PN_EXECUTOR_VARIANT_TRACING,   /* Also traces memory accesses */
+#endif /* PN_TRACING */
+} PNExecutorVariant;
+
+#if PN_JIT
+typedef struct PNJit {
+  uint8_t* code; /* PN_JIT_CODE_SIZE bytes, mapped on first use */
+  uint32_t code_size;
+  uint32_t exit_offset; /* Where compiled code returns to the interpreter */
+  PNBool failed;        /* Couldn't map |code| */
+} PNJit;
+#endif /* PN_JIT */
+
 typedef struct PNExecutor {
   PNModule* module;
   PNMemory* memory;
-  PNRuntimeValue* module_values;
   PNThread start_thread;
   PNThread* main_thread;
   PNThread* dead_threads;
@@ -1351,24 +1908,35 @@ typedef struct PNExecutor {
   uint32_t heap_end; /* Grows up */
   int32_t exit_code;
   PNBool exiting;
+  PNExecutorVariant variant;
+#if PN_JIT
+  PNJit jit;
+#endif /* PN_JIT */
 } PNExecutor;
 
 typedef struct PNRuntimeInstruction {
-  PNOpcode opcode;
+  uint16_t opcode; /* PNOpcode */
+#if PN_DIRECT_THREADED
+  /* Offset of this opcode's handler label in pn_thread_run_quantum_fast. */
+  int32_t handler;
+#endif
 } PNRuntimeInstruction;
 
 typedef struct PNRuntimeInstructionAlloca {
   PNRuntimeInstruction base;
-  PNValueId result_value_id;
-  PNValueId size_id;
+  PNSlotId result_value_id;
+  PNSlotId size_id;
   PNAlignment alignment;
 } PNRuntimeInstructionAlloca;
 
 typedef struct PNRuntimeInstructionBinop {
   PNRuntimeInstruction base;
-  PNValueId result_value_id;
-  PNValueId value0_id;
-  PNValueId value1_id;
+  PNSlotId result_value_id;
+  PNSlotId value0_id;
+  union {
+    PNSlotId value1_id;
+    uint32_t value1; /* _IMM opcodes */
+  };
 } PNRuntimeInstructionBinop;
 
 typedef struct PNRuntimeInstructionBr {
@@ -1378,7 +1946,7 @@ typedef struct PNRuntimeInstructionBr {
 
 typedef struct PNRuntimeInstructionBrInt1 {
   PNRuntimeInstruction base;
-  PNValueId value_id;
+  PNSlotId value_id;
   void* true_inst;
   void* false_inst;
 } PNRuntimeInstructionBrInt1;
@@ -1386,80 +1954,170 @@ typedef struct PNRuntimeInstructionBrInt1 {
 #define PN_CALL_FLAGS_INDIRECT 1
 #define PN_CALL_FLAGS_TAIL_CALL 2
 #define PN_CALL_FLAGS_RETURN_TYPE_VOID 4
+/* A tail call that is immediately followed by a return of its result, so the
+ * callee can run in the caller's frame. */
+#define PN_CALL_FLAGS_REUSE_FRAME 8
+/* The inline cache of a PN_CALL_FLAGS_INDIRECT call holds a builtin. */
+#define PN_CALL_FLAGS_CACHE_BUILTIN 16
 
 typedef struct PNRuntimeInstructionCall {
   PNRuntimeInstruction base;
-  PNValueId result_value_id;
-  PNValueId callee_id;
+  PNSlotId result_value_id;
+  PNValueId callee_id; /* Slot if PN_CALL_FLAGS_INDIRECT, else value id */
   uint8_t num_args;
   uint8_t flags;
+  union {
+    /* Inline cache for PN_CALL_FLAGS_INDIRECT: the last function pointer
+     * called through this instruction, and what it resolved to, so a hit
+     * calls it without looking anything up. That is a builtin if
+     * PN_CALL_FLAGS_CACHE_BUILTIN is set, otherwise a function's callee.
+     * Before the first call, the cache holds pointer 0 and a NULL builtin. */
+    struct {
+      uint32_t cache_pointer;
+      union {
+        const PNBuiltin* cache_builtin;
+        PNCallee* cache_callee;
+      };
+    };
+    /* Direct calls, resolved when lowered */
+    PNCallee* callee;
+  };
 } PNRuntimeInstructionCall;
 
 typedef struct PNRuntimeInstructionCast {
   PNRuntimeInstruction base;
-  PNValueId result_value_id;
-  PNValueId value_id;
+  PNSlotId result_value_id;
+  PNSlotId value_id;
 } PNRuntimeInstructionCast;
 
 typedef struct PNRuntimeInstructionCmp2 {
   PNRuntimeInstruction base;
-  PNValueId result_value_id;
-  PNValueId value0_id;
-  PNValueId value1_id;
+  PNSlotId result_value_id;
+  PNSlotId value0_id;
+  union {
+    PNSlotId value1_id;
+    uint32_t value1; /* _IMM opcodes */
+  };
 } PNRuntimeInstructionCmp2;
 
 typedef struct PNRuntimeInstructionLoad {
   PNRuntimeInstruction base;
-  PNValueId result_value_id;
-  PNValueId src_id;
+  PNSlotId result_value_id;
+  PNSlotId src_id;
   PNAlignment alignment;
 } PNRuntimeInstructionLoad;
 
+typedef struct PNRuntimeInstructionLoadOffset {
+  PNRuntimeInstruction base;
+  PNSlotId result_value_id;
+  PNSlotId src_id;
+  uint32_t offset;
+} PNRuntimeInstructionLoadOffset;
+
+typedef struct PNRuntimeInstructionLoadIndexed {
+  PNRuntimeInstruction base;
+  PNSlotId result_value_id;
+  PNSlotId src_id;
+  PNSlotId index_id;
+  uint32_t scale;
+} PNRuntimeInstructionLoadIndexed;
+
+/* Copies a value between slots when either doesn't fit in a PNSlotId; see
+ * PNFunction.num_scratch_slots. */
+typedef struct PNRuntimeInstructionMoveWide {
+  PNRuntimeInstruction base;
+  PNWideSlotId result_value_id;
+  PNWideSlotId value_id;
+} PNRuntimeInstructionMoveWide;
+
 typedef struct PNRuntimeInstructionRet {
   PNRuntimeInstruction base;
 } PNRuntimeInstructionRet;
 
 typedef struct PNRuntimeInstructionRetValue {
   PNRuntimeInstruction base;
-  PNValueId value_id;
+  PNSlotId value_id;
 } PNRuntimeInstructionRetValue;
 
 typedef struct PNRuntimeInstructionStore {
   PNRuntimeInstruction base;
-  PNValueId dest_id;
-  PNValueId value_id;
+  PNSlotId dest_id;
+  union {
+    PNSlotId value_id;
+    uint32_t value; /* _IMM opcodes */
+  };
   PNAlignment alignment;
 } PNRuntimeInstructionStore;
 
+typedef struct PNRuntimeInstructionStoreOffset {
+  PNRuntimeInstruction base;
+  PNSlotId dest_id;
+  PNSlotId value_id;
+  uint32_t offset;
+} PNRuntimeInstructionStoreOffset;
+
+typedef struct PNRuntimeInstructionStoreIndexed {
+  PNRuntimeInstruction base;
+  PNSlotId dest_id;
+  PNSlotId value_id;
+  PNSlotId index_id;
+  uint32_t scale;
+} PNRuntimeInstructionStoreIndexed;
+
+typedef enum PNSwitchLayout {
+  PN_SWITCH_LAYOUT_LINEAR,
+  PN_SWITCH_LAYOUT_BSEARCH,
+  PN_SWITCH_LAYOUT_TABLE,
+} PNSwitchLayout;
+
 typedef struct PNRuntimeSwitchCase {
   int64_t value;
   void* inst;
 } PNRuntimeSwitchCase;
 
+/* Used by SWITCH_* and SWITCH_BSEARCH_*. Followed by |num_cases|
+ * PNRuntimeSwitchCases, which are sorted by value for SWITCH_BSEARCH_*. */
 typedef struct PNRuntimeInstructionSwitch {
   PNRuntimeInstruction base;
-  PNValueId value_id;
+  PNSlotId value_id;
   void* default_inst;
   uint32_t num_cases;
 } PNRuntimeInstructionSwitch;
 
+/* Followed by |num_entries| instruction pointers, indexed by
+ * value - |min_value|. Entries without a case point to |default_inst|. */
+typedef struct PNRuntimeInstructionSwitchTable {
+  PNRuntimeInstruction base;
+  PNSlotId value_id;
+  void* default_inst;
+  int64_t min_value;
+  uint32_t num_entries;
+} PNRuntimeInstructionSwitchTable;
+
 typedef struct PNRuntimeInstructionUnreachable {
   PNRuntimeInstruction base;
 } PNRuntimeInstructionUnreachable;
 
 typedef struct PNRuntimeInstructionVselect {
   PNRuntimeInstruction base;
-  PNValueId result_value_id;
-  PNValueId cond_id;
-  PNValueId true_value_id;
-  PNValueId false_value_id;
+  PNSlotId result_value_id;
+  PNSlotId cond_id;
+  PNSlotId true_value_id;
+  PNSlotId false_value_id;
 } PNRuntimeInstructionVselect;
 
-typedef struct PNRuntimePhiAssign {
+typedef struct PNRuntimePhiMove {
+  PNWideSlotId source_value_id;
+  PNWideSlotId dest_value_id;
+} PNRuntimePhiMove;
+
+/* The phi assigns of a single CFG edge. Followed by |num_moves|
+ * PNRuntimePhiMoves, then continues at |inst|. */
+typedef struct PNRuntimeInstructionPhiMoves {
+  PNRuntimeInstruction base;
+  uint32_t num_moves;
   void* inst;
-  PNValueId source_value_id;
-  PNValueId dest_value_id;
-} PNRuntimePhiAssign;
+} PNRuntimeInstructionPhiMoves;
 
 typedef struct PNReadContext {
   void* user_data;
@@ -1584,9 +2242,9 @@ typedef struct PNReadContext {
 
 /**** FORWARD DECLARATIONS ****************************************************/
 
-#define PN_BUILTIN(e)                                                          \
+#define PN_BUILTIN(e, flags)                                                   \
   static PNRuntimeValue pn_builtin_##e(PNThread* thread, PNFunction* function, \
-                                       uint32_t num_args, PNValueId* arg_ids);
+                                       uint32_t num_args, PNSlotId* arg_ids);
 PN_FOREACH_BUILTIN(PN_BUILTIN)
 #undef PN_BUILTIN
 
@@ -0,0 +1,168 @@
+#!/usr/bin/env python
+# Copyright 2015 The Native Client Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Generates PN_FOREACH_SUPERINSTRUCTION from opcode pair profiles.
+
+Each profile is the output of `pnacl --print-opcode-pairs`. The most frequent
+pairs over all profiles whose first opcode has a handler macro that can be
+reused for a superinstruction are chosen.
+"""
+
+import argparse
+import os
+import re
+import sys
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+REPO_ROOT_DIR = os.path.dirname(SCRIPT_DIR)
+PNACL_H = os.path.join(REPO_ROOT_DIR, 'src', 'pnacl.h')
+PN_EXECUTOR_H = os.path.join(REPO_ROOT_DIR, 'src', 'pn_executor.h')
+
+DEFAULT_COUNT = 16
+
+CASE_RE = re.compile(r'^\s*PN_OPCODE_CASE\((\w+)\):\s*(.*)$')
+BODY_RE = re.compile(r'^PN_OPCODE_(\w+)\((.*)\);$')
+UNDEF_RE = re.compile(r'^#undef PN_OPCODE_(\w+)$')
+PAIR_RE = re.compile(r'^\s*([A-Z0-9_]+)\s+([A-Z0-9_]+)\s+(\d+)\s*$')
+TABLE_RE = re.compile(r'^#define PN_FOREACH_SUPERINSTRUCTION\(V\).*?[^\\]\n',
+                      re.DOTALL | re.MULTILINE)
+
+
+class Error(Exception):
+  pass
+
+
+def ReadFile(path):
+  with open(path) as f:
+    return f.read()
+
+
+def GetFamilies(executor):
+  """Returns the handler macros that are still defined where the
+  superinstruction handlers are expanded."""
+  families = set()
+  lines = executor.splitlines()
+  try:
+    start = lines.index(
+        '    PN_FOREACH_SUPERINSTRUCTION(PN_SUPERINSTRUCTION)')
+  except ValueError:
+    raise Error('Unable to find superinstruction handlers in %s' %
+                PN_EXECUTOR_H)
+  for line in lines[start + 1:]:
+    if line.startswith('#if'):
+      break
+    match = UNDEF_RE.match(line)
+    if match:
+      families.add(match.group(1))
+  return families
+
+
+def GetHandlers(executor, families):
+  """Returns a dict mapping opcode name to (family, args) for each opcode
+  whose handler is one of |families|."""
+  handlers = {}
+  pending = []
+  for line in executor.splitlines():
+    match = CASE_RE.match(line)
+    if not match:
+      pending = []
+      continue
+    opcode, body = match.groups()
+    pending.append(opcode)
+    if not body:
+      # Falls through to the next case.
+      continue
+    match = BODY_RE.match(body.strip())
+    if match and match.group(1) in families:
+      for opcode in pending:
+        handlers[opcode] = match.groups()
+    pending = []
+  return handlers
+
+
+def ReadProfiles(paths):
+  """Returns a dict mapping (first, second) to its weight. Each profile is
+  weighted equally, regardless of how long it ran."""
+  weights = {}
+  for path in paths:
+    counts = {}
+    # The program's own output is mixed in, and may not be text.
+    if path == '-':
+      data = sys.stdin.read()
+    else:
+      with open(path, 'rb') as f:
+        data = f.read().decode('latin-1')
+    for line in data.splitlines():
+      match = PAIR_RE.match(line)
+      if match:
+        first, second, count = match.groups()
+        key = (first, second)
+        counts[key] = counts.get(key, 0) + int(count)
+    total = float(sum(counts.values()))
+    for key, count in counts.items():
+      weights[key] = weights.get(key, 0) + count / total
+  return weights
+
+
+def FormatTable(rows):
+  lines = ['#define PN_FOREACH_SUPERINSTRUCTION(V)']
+  for first, second, family, args in rows:
+    lines.append('  V(%s, %s, %s, %s)' % (first, second, family, args))
+  width = max(len(line) for line in lines) + 1
+  result = ''
+  for line in lines[:-1]:
+    result += '%s\\\n' % line.ljust(width)
+  result += '%s\n' % lines[-1]
+  return result
+
+
+def main(args):
+  parser = argparse.ArgumentParser(description=__doc__)
+  parser.add_argument('profiles', metavar='PROFILE', nargs='+',
+                      help='output of pnacl --print-opcode-pairs, or - for '
+                      'stdin')
+  parser.add_argument('-n', '--count', type=int, default=DEFAULT_COUNT,
+                      help='number of superinstructions to generate')
+  parser.add_argument('-w', '--write', action='store_true',
+                      help='update %s in place' % PNACL_H)
+  options = parser.parse_args(args)
+
+  executor = ReadFile(PN_EXECUTOR_H)
+  handlers = GetHandlers(executor, GetFamilies(executor))
+  counts = ReadProfiles(options.profiles)
+
+  pairs = sorted(counts.items(), key=lambda item: (-item[1], item[0]))
+  rows = []
+  for (first, second), _ in pairs:
+    if len(rows) == options.count:
+      break
+    if first not in handlers:
+      continue
+    family, handler_args = handlers[first]
+    rows.append((first, second, family, handler_args))
+
+  if not rows:
+    raise Error('No pairs in the profiles can be fused')
+
+  table = FormatTable(rows)
+  if not options.write:
+    sys.stdout.write(table)
+    return 0
+
+  pnacl_h = ReadFile(PNACL_H)
+  new_pnacl_h, num_subs = TABLE_RE.subn(lambda m: table, pnacl_h, count=1)
+  if num_subs != 1:
+    raise Error('Unable to find PN_FOREACH_SUPERINSTRUCTION in %s' % PNACL_H)
+  with open(PNACL_H, 'w') as f:
+    f.write(new_pnacl_h)
+  return 0
+
+
+if __name__ == '__main__':
+  try:
+    sys.exit(main(sys.argv[1:]))
+  except Error as e:
+    sys.stderr.write(str(e) + '\n')
+    sys.exit(1)
@@ -0,0 +1,597 @@
+#!/usr/bin/env python
+# Copyright 2015 The Native Client Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Assembles a .pnasm file into a pexe.
+
+Test pexes are usually built from C with the NaCl SDK; see Makefile. This is
+for the ones that need exact control over the instructions, or instructions
+that C compilers don't produce. The syntax is that of pnacl's
+--trace-function-block output, but values have names and constants are written
+inline:
+
+  ; comment
+  declare i32 @llvm.nacl.setjmp(i32);
+  var @buf, align 8, zerofill 1024;
+  const @msg, align 1, {104, 105, 0};
+  define i32 @_start(i32 %info) {
+  %entry:
+    %x = add i32 %info, 1;
+    %c = icmp slt i32 %x, 10;
+    br i1 %c, label %then, label %else;
+    ...
+  }
+
+Every function is named in the value symbol table, so intrinsics and _start
+are found and --trace-function-filter works. Functions named _start have
+external linkage; other defined functions are internal. Records are written
+unabbreviated, with relative value ids.
+"""
+
+from __future__ import print_function
+
+import argparse
+import re
+import struct
+import sys
+
+MODULE_VERSION = 1
+
+BLOCKID_MODULE = 8
+BLOCKID_CONSTANTS = 11
+BLOCKID_FUNCTION = 12
+BLOCKID_VALUE_SYMTAB = 14
+BLOCKID_TYPE = 17
+BLOCKID_GLOBALVAR = 19
+
+MODULE_CODE_VERSION = 1
+MODULE_CODE_FUNCTION = 8
+TYPE_CODE_NUMENTRY = 1
+TYPE_CODE_VOID = 2
+TYPE_CODE_FLOAT = 3
+TYPE_CODE_DOUBLE = 4
+TYPE_CODE_INTEGER = 7
+TYPE_CODE_FUNCTION = 21
+GLOBALVAR_CODE_VAR = 0
+GLOBALVAR_CODE_ZEROFILL = 2
+GLOBALVAR_CODE_DATA = 3
+GLOBALVAR_CODE_COUNT = 5
+VALUESYMTAB_CODE_ENTRY = 1
+CONSTANTS_CODE_SETTYPE = 1
+CONSTANTS_CODE_INTEGER = 4
+FUNCTION_CODE_DECLAREBLOCKS = 1
+FUNCTION_CODE_INST_BINOP = 2
+FUNCTION_CODE_INST_CAST = 3
+FUNCTION_CODE_INST_RET = 10
+FUNCTION_CODE_INST_BR = 11
+FUNCTION_CODE_INST_SWITCH = 12
+FUNCTION_CODE_INST_UNREACHABLE = 15
+FUNCTION_CODE_INST_PHI = 16
+FUNCTION_CODE_INST_ALLOCA = 19
+FUNCTION_CODE_INST_LOAD = 20
+FUNCTION_CODE_INST_STORE = 24
+FUNCTION_CODE_INST_CMP2 = 28
+FUNCTION_CODE_INST_VSELECT = 29
+FUNCTION_CODE_INST_CALL = 34
+FUNCTION_CODE_INST_CALL_INDIRECT = 44
+
+LINKAGE_EXTERNAL = 0
+LINKAGE_INTERNAL = 3
+
+ENTRY_END_BLOCK = 0
+ENTRY_SUBBLOCK = 1
+ENTRY_UNABBREV_RECORD = 3
+ABBREV_WIDTH = 2
+
+BINOPS = {
+    'add': 0, 'sub': 1, 'mul': 2, 'udiv': 3, 'sdiv': 4, 'urem': 5, 'srem': 6,
+    'shl': 7, 'lshr': 8, 'ashr': 9, 'and': 10, 'or': 11, 'xor': 12,
+}
+CASTS = {
+    'trunc': 0, 'zext': 1, 'sext': 2, 'fptoui': 3, 'fptosi': 4, 'uitofp': 5,
+    'sitofp': 6, 'fptrunc': 7, 'fpext': 8, 'bitcast': 11,
+}
+ICMPS = {
+    'eq': 32, 'ne': 33, 'ugt': 34, 'uge': 35, 'ult': 36, 'ule': 37, 'sgt': 38,
+    'sge': 39, 'slt': 40, 'sle': 41,
+}
+TYPES = ['void', 'i1', 'i8', 'i16', 'i32', 'i64', 'float', 'double']
+
+TYPE_RE = r'(void|i1|i8|i16|i32|i64|float|double)'
+VALUE_RE = r'([%@][\w.]+|-?\d+)'
+LABEL_RE = r'label %([\w.]+)'
+ALIGN_RE = r'align (\d+)'
+
+
+class Error(Exception):
+  pass
+
+
+def SignRotate(value):
+  if value >= 0:
+    return value << 1
+  return ((-value) << 1) | 1
+
+
+def Log2Align(align):
+  if align == 0 or align & (align - 1):
+    raise Error('bad alignment %d' % align)
+  return align.bit_length()
+
+
+class BitWriter(object):
+  def __init__(self):
+    self.data = bytearray()
+    self.bits = 0
+    self.num_bits = 0
+
+  def Write(self, value, width):
+    self.bits |= value << self.num_bits
+    self.num_bits += width
+    while self.num_bits >= 8:
+      self.data.append(self.bits & 0xff)
+      self.bits >>= 8
+      self.num_bits -= 8
+
+  def WriteVbr(self, value, width):
+    hibit = 1 << (width - 1)
+    while value >= hibit:
+      self.Write((value & (hibit - 1)) | hibit, width)
+      value >>= width - 1
+    self.Write(value, width)
+
+  def Align32(self):
+    if self.num_bits:
+      self.Write(0, 8 - self.num_bits)
+    while len(self.data) % 4:
+      self.data.append(0)
+
+  def EnterBlock(self, block_id):
+    self.Write(ENTRY_SUBBLOCK, ABBREV_WIDTH)
+    self.WriteVbr(block_id, 8)
+    self.WriteVbr(ABBREV_WIDTH, 4)
+    self.Align32()
+    offset = len(self.data)
+    self.data += b'\0\0\0\0'
+    return offset
+
+  def EndBlock(self, offset):
+    self.Write(ENTRY_END_BLOCK, ABBREV_WIDTH)
+    self.Align32()
+    num_words = (len(self.data) - offset - 4) // 4
+    self.data[offset:offset + 4] = struct.pack('<I', num_words)
+
+  def Record(self, code, ops):
+    self.Write(ENTRY_UNABBREV_RECORD, ABBREV_WIDTH)
+    self.WriteVbr(code, 6)
+    self.WriteVbr(len(ops), 6)
+    for op in ops:
+      self.WriteVbr(op, 6)
+
+
+class Function(object):
+  def __init__(self, name, ret_type, arg_types, arg_names, is_proto):
+    self.name = name
+    self.ret_type = ret_type
+    self.arg_types = arg_types
+    self.arg_names = arg_names
+    self.is_proto = is_proto
+    self.insts = []  # (line number, text)
+    self.labels = []
+
+
+class GlobalVar(object):
+  def __init__(self, name, align, is_constant, init):
+    self.name = name
+    self.align = align
+    self.is_constant = is_constant
+    self.init = init  # number of zero bytes, or list of bytes
+
+
+class Assembler(object):
+  def __init__(self):
+    self.functions = []
+    self.global_vars = []
+    self.types = []  # type names; function types are (ret, args) tuples
+    self.line = 0
+
+  def Fail(self, msg):
+    raise Error('%d: %s' % (self.line, msg))
+
+  def TypeId(self, t):
+    if t not in self.types:
+      self.types.append(t)
+    return self.types.index(t)
+
+  def Parse(self, text):
+    function = None
+    for self.line, line in enumerate(text.splitlines(), 1):
+      # Comments start with a ; after whitespace; a ; right after an
+      # instruction ends it, as in pnacl's output.
+      line = re.sub(r'(^|\s);.*$', '', line).strip().rstrip(';')
+      if not line:
+        continue
+      if function:
+        if line == '}':
+          function = None
+        elif re.match(r'^%[\w.]+:$', line):
+          function.labels.append(line[1:-1])
+          function.insts.append((self.line, line))
+        else:
+          function.insts.append((self.line, line))
+        continue
+
+      m = re.match(r'^(declare|define) %s @([\w.]+)\((.*)\)\s*(\{?)$' %
+                   TYPE_RE, line)
+      if m:
+        kind, ret_type, name, args, brace = m.groups()
+        arg_types, arg_names = [], []
+        for arg in filter(None, [a.strip() for a in args.split(',')]):
+          am = re.match(r'^%s(?: %%([\w.]+))?$' % TYPE_RE, arg)
+          if not am:
+            self.Fail('bad argument %r' % arg)
+          arg_types.append(am.group(1))
+          arg_names.append(am.group(2))
+        is_proto = kind == 'declare'
+        if is_proto == bool(brace):
+          self.Fail('expected { only after define')
+        f = Function(name, ret_type, arg_types, arg_names, is_proto)
+        self.functions.append(f)
+        if not is_proto:
+          function = f
+        continue
+
+      m = re.match(r'^(var|const) @([\w.]+), %s, (.*)$' % ALIGN_RE, line)
+      if m:
+        kind, name, align, init = m.groups()
+        zm = re.match(r'^zerofill (\d+)$', init)
+        dm = re.match(r'^\{(.*)\}$', init)
+        if zm:
+          init = int(zm.group(1))
+        elif dm:
+          init = [int(b) & 0xff for b in dm.group(1).split(',')]
+        else:
+          self.Fail('bad initializer %r' % init)
+        self.global_vars.append(
+            GlobalVar(name, int(align), kind == 'const', init))
+        continue
+
+      self.Fail('unexpected %r' % line)
+    if function:
+      raise Error('missing } at end of file')
+
+  def Write(self):
+    for t in ['i1', 'i32']:
+      self.TypeId(t)
+    for f in self.functions:
+      for t in [f.ret_type] + f.arg_types:
+        self.TypeId(t)
+      f.type_id = self.TypeId((f.ret_type, tuple(f.arg_types)))
+    self.module_values = {}
+    for n, f in enumerate(self.functions):
+      self.module_values['@' + f.name] = n
+    for n, g in enumerate(self.global_vars):
+      self.module_values['@' + g.name] = len(self.functions) + n
+
+    # Instructions add their types, so write the function blocks first.
+    function_blocks = []
+    for f in self.functions:
+      if not f.is_proto:
+        w = BitWriter()
+        self.WriteFunctionBlock(w, f)
+        function_blocks.append(w)
+
+    w = BitWriter()
+    module = w.EnterBlock(BLOCKID_MODULE)
+    w.Record(MODULE_CODE_VERSION, [MODULE_VERSION])
+
+    block = w.EnterBlock(BLOCKID_TYPE)
+    w.Record(TYPE_CODE_NUMENTRY, [len(self.types)])
+    for t in self.types:
+      if isinstance(t, tuple):
+        ret_type, arg_types = t
+        w.Record(TYPE_CODE_FUNCTION, [0, self.TypeId(ret_type)] +
+                 [self.TypeId(a) for a in arg_types])
+      elif t == 'void':
+        w.Record(TYPE_CODE_VOID, [])
+      elif t == 'float':
+        w.Record(TYPE_CODE_FLOAT, [])
+      elif t == 'double':
+        w.Record(TYPE_CODE_DOUBLE, [])
+      else:
+        w.Record(TYPE_CODE_INTEGER, [int(t[1:])])
+    w.EndBlock(block)
+
+    for f in self.functions:
+      linkage = LINKAGE_EXTERNAL
+      if not f.is_proto and f.name != '_start':
+        linkage = LINKAGE_INTERNAL
+      w.Record(MODULE_CODE_FUNCTION, [f.type_id, 0, int(f.is_proto), linkage])
+
+    block = w.EnterBlock(BLOCKID_GLOBALVAR)
+    w.Record(GLOBALVAR_CODE_COUNT, [len(self.global_vars)])
+    for g in self.global_vars:
+      w.Record(GLOBALVAR_CODE_VAR, [Log2Align(g.align), int(g.is_constant)])
+      if isinstance(g.init, list):
+        w.Record(GLOBALVAR_CODE_DATA, g.init)
+      else:
+        w.Record(GLOBALVAR_CODE_ZEROFILL, [g.init])
+    w.EndBlock(block)
+
+    block = w.EnterBlock(BLOCKID_VALUE_SYMTAB)
+    for n, f in enumerate(self.functions):
+      w.Record(VALUESYMTAB_CODE_ENTRY, [n] + [ord(c) for c in f.name])
+    w.EndBlock(block)
+
+    # Function blocks are written with the same alignment, so they can be
+    # copied in whole.
+    for fw in function_blocks:
+      w.data += fw.data
+    w.EndBlock(module)
+
+    header = b'PEXE' + struct.pack('<HHBBHI', 1, 8, 0x11, 0, 4, 2)
+    return header + bytes(w.data)
+
+  def WriteFunctionBlock(self, w, f):
+    # First pass: number the values and find the constants.
+    values = dict(self.module_values)
+    value_types = {}
+    num_values = len(self.functions) + len(self.global_vars)
+    for name, t in zip(f.arg_names, f.arg_types):
+      if name:
+        values['%' + name] = num_values
+        value_types['%' + name] = t
+      num_values += 1
+
+    constants = []
+    insts = []
+    for self.line, text in f.insts:
+      if text.endswith(':'):
+        continue
+      inst = self.ParseInstruction(f, text)
+      insts.append((self.line, inst))
+      for t, v in inst['operands']:
+        if re.match(r'^-?\d+$', v) and (t, int(v)) not in constants:
+          constants.append((t, int(v)))
+    constants.sort(key=lambda c: (self.TypeId(c[0]), c[1]))
+    for t, v in constants:
+      values[(t, v)] = num_values
+      num_values += 1
+
+    block = w.EnterBlock(BLOCKID_FUNCTION)
+    w.Record(FUNCTION_CODE_DECLAREBLOCKS, [len(f.labels)])
+    if constants:
+      cblock = w.EnterBlock(BLOCKID_CONSTANTS)
+      cur_type = None
+      for t, v in constants:
+        if t != cur_type:
+          w.Record(CONSTANTS_CODE_SETTYPE, [self.TypeId(t)])
+          cur_type = t
+        w.Record(CONSTANTS_CODE_INTEGER, [SignRotate(v)])
+      w.EndBlock(cblock)
+
+    # Results are numbered before writing, so phis can refer forward.
+    result_id = num_values
+    for self.line, inst in insts:
+      if inst['result']:
+        if inst['result'] in values:
+          self.Fail('%s redefined' % inst['result'])
+        values[inst['result']] = result_id
+        result_id += 1
+
+    bbs = dict((label, n) for n, label in enumerate(f.labels))
+
+    def Value(operand):
+      t, v = operand
+      if re.match(r'^-?\d+$', v):
+        return values[(t, int(v))]
+      if v not in values:
+        self.Fail('unknown value %s' % v)
+      return values[v]
+
+    def Rel(operand):
+      value_id = Value(operand)
+      if value_id >= num_values:
+        self.Fail('%s used before it is defined' % operand[1])
+      return num_values - value_id
+
+    def Bb(label):
+      if label not in bbs:
+        self.Fail('unknown label %%%s' % label)
+      return bbs[label]
+
+    for self.line, inst in insts:
+      code = inst['code']
+      ops = inst['operands']
+      if code == FUNCTION_CODE_INST_PHI:
+        record = [self.TypeId(inst['type'])]
+        for op, label in zip(ops, inst['labels']):
+          record += [SignRotate(num_values - Value(op)), Bb(label)]
+      elif code == FUNCTION_CODE_INST_SWITCH:
+        record = [self.TypeId(inst['type']), Rel(ops[0]),
+                  Bb(inst['labels'][0]), len(inst['cases'])]
+        for value, label in inst['cases']:
+          record += [1, 1, SignRotate(value), Bb(label)]
+      elif code == FUNCTION_CODE_INST_BR:
+        record = [Bb(l) for l in inst['labels']] + [Rel(op) for op in ops]
+      elif code in (FUNCTION_CODE_INST_CALL, FUNCTION_CODE_INST_CALL_INDIRECT):
+        record = [inst['tail'], Rel(ops[0])]
+        if code == FUNCTION_CODE_INST_CALL_INDIRECT:
+          record.append(self.TypeId(inst['type']))
+        record += [Rel(op) for op in ops[1:]]
+      else:
+        record = [Rel(op) for op in ops] + inst['extra']
+      w.Record(code, record)
+      if inst['result']:
+        num_values += 1
+    w.EndBlock(block)
+
+  def ParseInstruction(self, f, text):
+    inst = {'result': None, 'operands': [], 'labels': [], 'extra': []}
+    m = re.match(r'^(%[\w.]+) = (.*)$', text)
+    if m:
+      inst['result'], text = m.groups()
+
+    def Match(pattern):
+      return re.match('^' + pattern.replace(' ', r'\s+') + '$', text)
+
+    def Done(code, has_result):
+      if bool(inst['result']) != has_result:
+        self.Fail('%s a result' % ('expected' if has_result else 'unexpected'))
+      inst['code'] = code
+      return inst
+
+    m = Match(r'(\w+) %s %s, %s' % (TYPE_RE, VALUE_RE, VALUE_RE))
+    if m and m.group(1) in BINOPS:
+      op, t, a, b = m.groups()
+      inst['operands'] = [(t, a), (t, b)]
+      inst['extra'] = [BINOPS[op]]
+      return Done(FUNCTION_CODE_INST_BINOP, True)
+
+    m = Match(r'icmp (\w+) %s %s, %s' % (TYPE_RE, VALUE_RE, VALUE_RE))
+    if m and m.group(1) in ICMPS:
+      pred, t, a, b = m.groups()
+      inst['operands'] = [(t, a), (t, b)]
+      inst['extra'] = [ICMPS[pred]]
+      return Done(FUNCTION_CODE_INST_CMP2, True)
+
+    m = Match(r'(\w+) %s %s to %s' % (TYPE_RE, VALUE_RE, TYPE_RE))
+    if m and m.group(1) in CASTS:
+      op, t, a, to = m.groups()
+      inst['operands'] = [(t, a)]
+      inst['extra'] = [self.TypeId(to), CASTS[op]]
+      return Done(FUNCTION_CODE_INST_CAST, True)
+
+    m = Match(r'select i1 %s, %s %s, %s %s' % (VALUE_RE, TYPE_RE, VALUE_RE,
+                                               TYPE_RE, VALUE_RE))
+    if m:
+      c, t, a, _, b = m.groups()
+      inst['operands'] = [(t, a), (t, b), ('i1', c)]
+      return Done(FUNCTION_CODE_INST_VSELECT, True)
+
+    m = Match(r'alloca i8, i32 %s, %s' % (VALUE_RE, ALIGN_RE))
+    if m:
+      size, align = m.groups()
+      inst['operands'] = [('i32', size)]
+      inst['extra'] = [Log2Align(int(align))]
+      return Done(FUNCTION_CODE_INST_ALLOCA, True)
+
+    m = Match(r'load %s\* %s, %s' % (TYPE_RE, VALUE_RE, ALIGN_RE))
+    if m:
+      t, ptr, align = m.groups()
+      inst['operands'] = [('i32', ptr)]
+      inst['extra'] = [Log2Align(int(align)), self.TypeId(t)]
+      return Done(FUNCTION_CODE_INST_LOAD, True)
+
+    m = Match(r'store %s %s, %s\* %s, %s' % (TYPE_RE, VALUE_RE, TYPE_RE,
+                                             VALUE_RE, ALIGN_RE))
+    if m:
+      t, v, _, ptr, align = m.groups()
+      inst['operands'] = [('i32', ptr), (t, v)]
+      inst['extra'] = [Log2Align(int(align))]
+      return Done(FUNCTION_CODE_INST_STORE, False)
+
+    m = Match(r'br %s' % LABEL_RE)
+    if m:
+      inst['labels'] = [m.group(1)]
+      return Done(FUNCTION_CODE_INST_BR, False)
+
+    m = Match(r'br i1 %s, %s, %s' % (VALUE_RE, LABEL_RE, LABEL_RE))
+    if m:
+      c, t, f = m.groups()
+      inst['operands'] = [('i1', c)]
+      inst['labels'] = [t, f]
+      return Done(FUNCTION_CODE_INST_BR, False)
+
+    m = Match(r'switch %s %s \{ default: br %s;?(.*)\}' % (TYPE_RE, VALUE_RE,
+                                                          LABEL_RE))
+    if m:
+      t, v, default, cases = m.groups()
+      inst['type'] = t
+      inst['operands'] = [(t, v)]
+      inst['labels'] = [default]
+      inst['cases'] = []
+      for case in filter(None, [c.strip() for c in cases.split(';')]):
+        cm = re.match(r'^%s (-?\d+): br %s$' % (t, LABEL_RE), case)
+        if not cm:
+          self.Fail('bad switch case %r' % case)
+        inst['cases'].append((int(cm.group(1)), cm.group(2)))
+      return Done(FUNCTION_CODE_INST_SWITCH, False)
+
+    m = Match(r'ret void')
+    if m:
+      return Done(FUNCTION_CODE_INST_RET, False)
+
+    m = Match(r'ret %s %s' % (TYPE_RE, VALUE_RE))
+    if m:
+      inst['operands'] = [m.groups()]
+      return Done(FUNCTION_CODE_INST_RET, False)
+
+    m = Match(r'unreachable')
+    if m:
+      return Done(FUNCTION_CODE_INST_UNREACHABLE, False)
+
+    m = Match(r'phi %s (.*)' % TYPE_RE)
+    if m:
+      t, incoming = m.groups()
+      inst['type'] = t
+      for v, label in re.findall(r'\[\s*%s,\s*%%([\w.]+)\s*\]' % VALUE_RE,
+                                 incoming):
+        inst['operands'].append((t, v))
+        inst['labels'].append(label)
+      if not inst['labels']:
+        self.Fail('phi without incoming values')
+      return Done(FUNCTION_CODE_INST_PHI, True)
+
+    m = Match(r'(tail )?call %s %s\((.*)\)' % (TYPE_RE, VALUE_RE))
+    if m:
+      tail, t, callee, args = m.groups()
+      inst['tail'] = int(bool(tail))
+      inst['type'] = t
+      inst['operands'] = [('i32', callee)]
+      for arg in filter(None, [a.strip() for a in args.split(',')]):
+        am = re.match(r'^%s %s$' % (TYPE_RE, VALUE_RE), arg)
+        if not am:
+          self.Fail('bad argument %r' % arg)
+        inst['operands'].append(am.groups())
+      code = FUNCTION_CODE_INST_CALL
+      if callee.startswith('%'):
+        code = FUNCTION_CODE_INST_CALL_INDIRECT
+      return Done(code, t != 'void')
+
+    self.Fail('unknown instruction %r' % text)
+
+
+def JoinSwitches(text):
+  # A switch is written over several lines, like pnacl prints it.
+  return re.sub(r'(\bswitch\s[^{\n]*\{)([^}]*)\}',
+                lambda m: '%s %s }' % (m.group(1),
+                                       ' '.join(m.group(2).split())),
+                text)
+
+
+def main(args):
+  parser = argparse.ArgumentParser()
+  parser.add_argument('-o', '--output', help='output pexe', required=True)
+  parser.add_argument('input', help='input .pnasm file')
+  options = parser.parse_args(args)
+
+  with open(options.input) as f:
+    text = f.read()
+
+  assembler = Assembler()
+  try:
+    assembler.Parse(JoinSwitches(text))
+    data = assembler.Write()
+  except Error as e:
+    sys.stderr.write('%s:%s\n' % (options.input, e))
+    return 1
+
+  with open(options.output, 'wb') as f:
+    f.write(data)
+  return 0
+
+
+if __name__ == '__main__':
+  sys.exit(main(sys.argv[1:]))
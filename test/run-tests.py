@@ -11,8 +11,10 @@ import os
 import Queue
 import re
 import shlex
+import shutil
 import subprocess
 import sys
+import tempfile
 import time
 
 
@@ -69,6 +71,7 @@ class TestInfo(object):
     self.args = []
     self.expected_error = 0
     self.slow = False
+    self.prepare = None
 
   def Parse(self, filename):
     self.name = filename
@@ -97,7 +100,7 @@ class TestInfo(object):
           if state != 'header':
             raise Error('unexpected directive: %s' % line)
 
-          key, value = directive.split(':')
+          key, value = directive.split(':', 1)
           key = key.strip().lower()
           value = value.strip()
           if key in seen_keys:
@@ -119,6 +122,8 @@ class TestInfo(object):
               self.expected_stdout = s.read()
           elif key == 'slow':
             self.slow = True
+          elif key == 'prepare':
+            self.prepare = value
           else:
             raise Error('Unknown directive: %s' % key)
         elif state == 'header':
@@ -148,25 +153,48 @@ class TestInfo(object):
 
     return os.path.relpath(exe, SCRIPT_DIR)
 
-  def GetCommand(self, override_exe=None):
+  def GetCommand(self, override_exe=None, tmpdir=None):
     cmd = [self.GetExecutable(override_exe)]
     cmd += self.flags
     cmd += AsList(self.pexe)
     cmd += ['--'] + AsList(self.args)
+    if tmpdir:
+      cmd = [arg.replace('{tmpdir}', tmpdir) for arg in cmd]
     return cmd
 
+  def RunPrepare(self, override_exe, tmpdir):
+    # The PREPARE command is run by the shell before the test. {pnacl} is the
+    # executable being tested, {cc} is $CC, and {tmpdir} is a directory that
+    # is removed after the test. FLAGS and ARGS can refer to {tmpdir} too, and
+    # it is written as {tmpdir} in the output, so the output doesn't change.
+    cmd = self.prepare.replace('{pnacl}', self.GetExecutable(override_exe))
+    cmd = cmd.replace('{cc}', os.environ.get('CC', 'cc'))
+    cmd = cmd.replace('{tmpdir}', tmpdir)
+    process = subprocess.Popen(cmd, shell=True, stdout=subprocess.PIPE,
+                               stderr=subprocess.STDOUT)
+    output = process.communicate()[0]
+    if process.returncode != 0:
+      raise Error('PREPARE failed with %d:\n%s' % (process.returncode, output))
+
   def Run(self, override_exe=None):
-    # Pass 'pnacl' as the executable name so the output is consistent
-    cmd = ['pnacl'] + self.GetCommand(override_exe)[1:]
-    exe = self.GetExecutable(override_exe)
+    tmpdir = tempfile.mkdtemp(prefix='pnacl-test-')
     try:
+      if self.prepare:
+        self.RunPrepare(override_exe, tmpdir)
+      # Pass 'pnacl' as the executable name so the output is consistent
+      cmd = ['pnacl'] + self.GetCommand(override_exe, tmpdir)[1:]
+      exe = self.GetExecutable(override_exe)
       start_time = time.time()
       process = subprocess.Popen(cmd, executable=exe, stdout=subprocess.PIPE,
                                                       stderr=subprocess.PIPE)
       stdout, stderr = process.communicate()
       duration = time.time() - start_time
+      stdout = stdout.replace(tmpdir, '{tmpdir}')
+      stderr = stderr.replace(tmpdir, '{tmpdir}')
     except OSError as e:
       raise Error(str(e))
+    finally:
+      shutil.rmtree(tmpdir)
 
     return stdout, stderr, process.returncode, duration
 